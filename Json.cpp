@@ -1,461 +1,4731 @@
 #include "Json.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
 #include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 using namespace my_json;
 
-Json::Json() : data_type(json_null) {}
+#ifdef MY_JSON_INSTRUMENTATION
+struct JsonInstrumentation::State {
+    State() : threshold(UINT64_MAX) {
+        for (auto &i : counters)
+            i.store(0);
+    }
+
+    std::atomic<std::uint64_t> counters[sizeof(JsonStats) / sizeof(std::uint64_t)];
+    std::atomic<std::uint64_t> threshold;
+    std::mutex mutex;
+    Callback callback;
+};
+
+JsonInstrumentation::State &JsonInstrumentation::state() {
+    static State state;
+    return state;
+}
+
+static thread_local JsonStats last_stats = JsonStats();
+#endif
+
+bool JsonInstrumentation::enabled() {
+    MY_JSON_STATS(return true;)
+    return false;
+}
+
+// JsonStats 的所有字段都是 std::uint64_t，累计值按下标逐个保存
+JsonStats JsonInstrumentation::total() {
+    JsonStats stats = JsonStats();
+#ifdef MY_JSON_INSTRUMENTATION
+    std::uint64_t *fields = reinterpret_cast<std::uint64_t *>(&stats);
+    for (std::size_t i = 0; i < sizeof(JsonStats) / sizeof(std::uint64_t); i++)
+        fields[i] = state().counters[i].load(std::memory_order_relaxed);
+#endif
+    return stats;
+}
+
+JsonStats JsonInstrumentation::last() {
+    MY_JSON_STATS(return last_stats;)
+    return JsonStats();
+}
+
+void JsonInstrumentation::reset() {
+#ifdef MY_JSON_INSTRUMENTATION
+    for (auto &i : state().counters)
+        i.store(0, std::memory_order_relaxed);
+#endif
+}
+
+void JsonInstrumentation::set_callback(Callback callback, std::uint64_t threshold_ns) {
+#ifdef MY_JSON_INSTRUMENTATION
+    std::lock_guard<std::mutex> lock(state().mutex);
+    state().threshold.store(callback ? threshold_ns : UINT64_MAX);
+    state().callback = std::move(callback);
+#else
+    (void)callback;
+    (void)threshold_ns;
+#endif
+}
 
-Json::Json(Type type) : data_type(type) {
-    switch (data_type) {
+void JsonInstrumentation::record(const JsonStats &stats, const std::string &input) {
+    JsonInstrumentation::record(stats, input.data(), input.size());
+}
+
+void JsonInstrumentation::record(const JsonStats &stats, const char *input, std::size_t size) {
+#ifdef MY_JSON_INSTRUMENTATION
+    last_stats = stats;
+    State &state = JsonInstrumentation::state();
+    const std::uint64_t *fields = reinterpret_cast<const std::uint64_t *>(&stats);
+    const std::size_t max_depth = offsetof(JsonStats, max_depth) / sizeof(std::uint64_t);
+    for (std::size_t i = 0; i < sizeof(JsonStats) / sizeof(std::uint64_t); i++) {
+        if (i != max_depth) {
+            if (fields[i] != 0)
+                state.counters[i].fetch_add(fields[i], std::memory_order_relaxed);
+            continue;
+        }
+        std::uint64_t depth = state.counters[i].load(std::memory_order_relaxed);
+        while (depth < fields[i] && !state.counters[i].compare_exchange_weak(depth, fields[i], std::memory_order_relaxed))
+            ;
+    }
+    if (stats.read_ns + stats.parse_ns + stats.serialize_ns >= state.threshold.load(std::memory_order_relaxed)) {
+        Callback callback;
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            callback = state.callback;
+        }
+        if (callback)
+            callback(stats, std::string(input, size));
+    }
+#else
+    (void)stats;
+    (void)input;
+    (void)size;
+#endif
+}
+
+void JsonInstrumentation::record_read(std::uint64_t ns) {
+#ifdef MY_JSON_INSTRUMENTATION
+    state().counters[offsetof(JsonStats, read_ns) / sizeof(std::uint64_t)].fetch_add(ns, std::memory_order_relaxed);
+#else
+    (void)ns;
+#endif
+}
+
+template <typename Traits>
+basic_json<Traits>::basic_json() {
+    this->store(json_null, 0, Value());
+}
+
+template <typename Traits>
+basic_json<Traits>::basic_json(Type type) {
+    switch (type) {
     case json_string:
-        value.data_string = new std::string();
+        this->store(type, 0, create<string_type>());
         break;
     case json_array:
-        value.data_array = new std::vector<Json>();
+        this->store(type, 0, create<array_type>());
         break;
     case json_object:
-        value.data_object = new std::map<std::string, Json>();
+        this->store(type, 0, create<object_type>());
         break;
     default:
+        this->store(type, 0, Value());
         break;
     }
 }
 
-Json::Json(bool value) : data_type(json_bool) {
-    this->value.data_bool = value;
+template <typename Traits>
+basic_json<Traits>::basic_json(bool value) {
+    this->store(json_bool, 0, value);
 }
 
-Json::Json(int value) : data_type(json_int) {
-    this->value.data_int = value;
+template <typename Traits>
+basic_json<Traits>::basic_json(int value) {
+    this->store(json_int, 0, value);
 }
 
-Json::Json(double value) : data_type(json_double) {
-    this->value.data_double = value;
+template <typename Traits>
+basic_json<Traits>::basic_json(unsigned value) : basic_json(from_uint64(value)) {}
+
+template <typename Traits>
+basic_json<Traits>::basic_json(long value) : basic_json(from_int64(value)) {}
+
+template <typename Traits>
+basic_json<Traits>::basic_json(unsigned long value) : basic_json(from_uint64(value)) {}
+
+template <typename Traits>
+basic_json<Traits>::basic_json(long long value) : basic_json(from_int64(value)) {}
+
+template <typename Traits>
+basic_json<Traits>::basic_json(unsigned long long value) : basic_json(from_uint64(value)) {}
+
+template <typename Traits>
+basic_json<Traits>::basic_json(double value) {
+    this->store(json_double, 0, value);
 }
 
-Json::Json(const char *value) : data_type(json_string) {
-    this->value.data_string = new std::string(value);
+template <typename Traits>
+basic_json<Traits>::basic_json(const char *value) {
+    this->store(json_string, 0, create<string_type>(value));
 }
 
-Json::Json(std::string value) : data_type(json_string) {
-    this->value.data_string = new std::string(value);
+template <typename Traits>
+basic_json<Traits>::basic_json(string_type value) {
+    this->store(json_string, 0, create<string_type>(std::move(value)));
 }
 
-Json::Json(std::vector<Json> value) : data_type(json_array) {
-    this->value.data_array = new std::vector<Json>(value);
+// 调用者可能仍持有 value 中元素的引用（移动不改变元素的地址），因此视为已经借出
+template <typename Traits>
+basic_json<Traits>::basic_json(array_type value) {
+    this->store(json_array, flag_lent, create<array_type>(std::move(value)));
 }
 
-Json::Json(std::map<std::string, Json> value) : data_type(json_object) {
-    this->value.data_object = new std::map<std::string, Json>(value);
+template <typename Traits>
+basic_json<Traits>::basic_json(object_type value) {
+    this->store(json_object, flag_lent, create<object_type>(std::move(value)));
 }
 
-Json::Json(const Json &other) {
+template <typename Traits>
+basic_json<Traits>::basic_json(const basic_json &other) {
     this->copy(other);
 }
 
-Json::Json(Json &&other) {
-    this->data_type = other.data_type;
-    this->value = other.value;
-    other.data_type = json_null;
+template <typename Traits>
+basic_json<Traits>::basic_json(basic_json &&other) noexcept {
+    this->storage = other.storage;
+    other.store(json_null, 0, Value());
 }
 
-Json::~Json() {
+template <typename Traits>
+basic_json<Traits>::~basic_json() {
     this->clear();
 }
 
-Json::Type Json::type() const {
-    return data_type;
+template <typename Traits>
+typename basic_json<Traits>::Type basic_json<Traits>::type() const {
+    return storage.type();
+}
+
+template <typename Traits>
+std::uint8_t basic_json<Traits>::flags() const {
+    return storage.flags();
+}
+
+template <typename Traits>
+typename basic_json<Traits>::Value basic_json<Traits>::payload() const {
+    return storage.load();
+}
+
+template <typename Traits>
+void basic_json<Traits>::store(Type type, std::uint8_t flags, Value value) {
+    storage.store(type, flags, value);
+}
+
+template <typename Traits>
+void basic_json<Traits>::set_flags(std::uint8_t flags) {
+    storage.set_flags(flags);
 }
 
-bool Json::is_null() const {
-    return data_type == json_null;
+template <typename Traits>
+bool basic_json<Traits>::is_null() const {
+    return this->type() == json_null;
 }
 
-bool Json::is_bool() const {
-    return data_type == json_bool;
+template <typename Traits>
+bool basic_json<Traits>::is_bool() const {
+    return this->type() == json_bool;
 }
 
-bool Json::is_int() const {
-    return data_type == json_int;
+template <typename Traits>
+bool basic_json<Traits>::is_int() const {
+    return this->type() == json_int;
 }
 
-bool Json::is_double() const {
-    return data_type == json_double;
+template <typename Traits>
+bool basic_json<Traits>::is_double() const {
+    return this->type() == json_double;
 }
 
-bool Json::is_string() const {
-    return data_type == json_string;
+template <typename Traits>
+bool basic_json<Traits>::is_string() const {
+    return this->type() == json_string;
 }
 
-bool Json::is_array() const {
-    return data_type == json_array;
+template <typename Traits>
+bool basic_json<Traits>::is_array() const {
+    return this->type() == json_array;
 }
 
-bool Json::is_object() const {
-    return data_type == json_object;
+template <typename Traits>
+bool basic_json<Traits>::is_object() const {
+    return this->type() == json_object;
 }
 
-bool Json::get_bool() const {
+template <typename Traits>
+bool basic_json<Traits>::get_bool() const {
     if (this->is_bool())
-        return value.data_bool;
-    throw std::logic_error("function Json::get_bool: type error");
+        return payload().data_bool;
+    MY_JSON_THROW(std::logic_error("function Json::get_bool: type error"));
 }
 
-int Json::get_int() const {
-    if (this->is_int())
-        return value.data_int;
-    throw std::logic_error("function Json::get_int: type error");
+template <typename Traits>
+int basic_json<Traits>::get_int() const {
+    if (this->is_int()) {
+        std::int64_t number = this->get_int64();
+        if (number < INT_MIN || number > INT_MAX)
+            MY_JSON_THROW(std::out_of_range("function Json::get_int: number out of range"));
+        return static_cast<int>(number);
+    }
+    MY_JSON_THROW(std::logic_error("function Json::get_int: type error"));
 }
 
-double Json::get_double() const {
-    if (this->is_double())
-        return value.data_double;
-    throw std::logic_error("function Json::get_double: type error");
+template <typename Traits>
+double basic_json<Traits>::get_double() const {
+    if (this->is_double()) {
+        if (!(this->flags() & flag_raw_number))
+            return payload().data_double;
+        std::size_t size = 0;
+        const char *text = this->raw_text(size);
+        double number;
+        parse_double(text, size, number);
+        return number;
+    }
+    MY_JSON_THROW(std::logic_error("function Json::get_double: type error"));
 }
 
-std::string Json::get_string() const {
-    if (this->is_string())
-        return *value.data_string;
-    throw std::logic_error("function Json::get_string: type error");
+template <typename Traits>
+std::int64_t basic_json<Traits>::get_int64() const {
+    if (this->is_int()) {
+        if (!(this->flags() & flag_raw_number))
+            return payload().data_int;
+        std::size_t size = 0;
+        const char *text = this->raw_text(size);
+        std::int64_t number;
+        if (parse_int64(text, size, number))
+            return number;
+        MY_JSON_THROW(std::out_of_range("function Json::get_int64: number out of range"));
+    }
+    MY_JSON_THROW(std::logic_error("function Json::get_int64: type error"));
+}
+
+template <typename Traits>
+std::uint64_t basic_json<Traits>::get_uint64() const {
+    if (this->is_int()) {
+        std::size_t size = 0;
+        const char *text = this->raw_text(size);
+        std::uint64_t number;
+        if (text == nullptr) {
+            if (payload().data_int >= 0)
+                return static_cast<std::uint64_t>(payload().data_int);
+        } else if (text[0] != '-') {
+            if (parse_uint64(text, size, number))
+                return number;
+        } else if (this->get_int64() == 0)
+            return 0;
+        MY_JSON_THROW(std::out_of_range("function Json::get_uint64: number out of range"));
+    }
+    MY_JSON_THROW(std::logic_error("function Json::get_uint64: type error"));
+}
+
+// 未保存原文时与 to_string() 的输出相同
+template <typename Traits>
+std::string basic_json<Traits>::get_number_text() const {
+    if (this->is_int() || this->is_double()) {
+        std::size_t size = 0;
+        const char *text = this->raw_text(size);
+        if (text != nullptr)
+            return std::string(text, size);
+        return this->is_int() ? std::to_string(payload().data_int) : std::to_string(payload().data_double);
+    }
+    MY_JSON_THROW(std::logic_error("function Json::get_number_text: type error"));
+}
+
+template <typename Traits>
+typename basic_json<Traits>::string_type basic_json<Traits>::get_string() const {
+    if (this->is_string()) {
+        if (!(this->flags() & flag_escaped))
+            return *payload().data_string;
+        string_type str;
+        unescape(payload().data_string->data(), payload().data_string->size(), str);
+        return str;
+    }
+    MY_JSON_THROW(std::logic_error("function Json::get_string: type error"));
 }
 
-std::vector<Json> Json::get_array() const {
+template <typename Traits>
+typename basic_json<Traits>::array_type basic_json<Traits>::get_array() const {
+    if (this->flags() & flag_packed) {
+        basic_json copy(*this);
+        copy.unpack();
+        return std::move(*copy.payload().data_array);
+    }
     if (this->is_array())
-        return *value.data_array;
-    throw std::logic_error("function Json::get_array: type error");
+        return *payload().data_array;
+    MY_JSON_THROW(std::logic_error("function Json::get_array: type error"));
 }
 
-std::map<std::string, Json> Json::get_object() const {
+template <typename Traits>
+typename basic_json<Traits>::object_type basic_json<Traits>::get_object() const {
     if (this->is_object())
-        return *value.data_object;
-    throw std::logic_error("function Json::get_object: type error");
+        return *payload().data_object;
+    MY_JSON_THROW(std::logic_error("function Json::get_object: type error"));
 }
 
-int Json::size() const {
-    switch (data_type) {
+template <typename Traits>
+int basic_json<Traits>::size() const {
+    switch (this->type()) {
     case json_array:
-        return this->value.data_array->size();
+        if (this->flags() & flag_packed)
+            return this->packed_size();
+        return this->payload().data_array->size();
     case json_object:
-        return this->value.data_object->size();
+        return this->payload().data_object->size();
     default:
         break;
     }
-    throw std::logic_error("function Json::size: this json object is not array or map,cam't get size");
+    MY_JSON_THROW(std::logic_error("function Json::size: this json object is not array or map,cam't get size"));
 }
 
-bool Json::empty() const {
-    switch (data_type) {
+template <typename Traits>
+bool basic_json<Traits>::empty() const {
+    switch (this->type()) {
     case json_null:
         return true;
     case json_array:
-        return value.data_array->empty();
+        if (this->flags() & flag_packed)
+            return this->packed_size() == 0;
+        return payload().data_array->empty();
     case json_object:
-        return value.data_object->empty();
+        return payload().data_object->empty();
     default:
         break;
     }
-    throw std::logic_error("function Json::empty: type error");
+    MY_JSON_THROW(std::logic_error("function Json::empty: type error"));
 }
 
-void Json::clear() {
-    switch (data_type) {
-    case json_string:
-        delete value.data_string;
-        break;
-    case json_array:
-        for (auto i : *value.data_array)
-            i.clear();
-        delete value.data_array;
-        break;
-    case json_object:
-        for (auto i : *value.data_object)
-            i.second.clear();
-        delete value.data_object;
-        break;
-    default:
-        break;
-    }
-    data_type = json_null;
+template <typename Traits>
+void basic_json<Traits>::clear() {
+    this->release(0);
 }
 
-std::string Json::to_string() const {
-    std::string str;
-    switch (data_type) {
-    case json_null:
-        str = "null";
-        break;
-    case json_bool:
-        str = value.data_bool ? "true" : "false";
-        break;
+// 共享的值只减少引用计数，最后一个引用释放存储
+// 递归超过 64 层后，把剩余的嵌套容器移到显式的栈中逐个释放，释放任意深度的文档都不会耗尽调用栈
+template <typename Traits>
+void basic_json<Traits>::release(std::size_t depth) {
+    touch();
+    ContainerHeader *block = this->header();
+    if (block != nullptr && block->shares != 0 && block->shares.fetch_sub(1) != 1) {
+        this->store(json_null, 0, Value());
+        return;
+    }
+    if (depth >= 64) {
+        std::vector<basic_json> nested;
+        this->detach_nested(nested);
+        while (!nested.empty()) {
+            basic_json node(std::move(nested.back()));
+            nested.pop_back();
+            node.detach_nested(nested);
+        }
+    }
+    switch (this->type()) {
     case json_int:
-        str = std::to_string(value.data_int);
-        break;
     case json_double:
-        str = std::to_string(value.data_double);
+        if (this->flags() & flag_raw_heap)
+            destroy(payload().data_string, nullptr);
         break;
     case json_string:
-        str = "\"" + *value.data_string + "\"";
+        destroy(payload().data_string, block);
         break;
     case json_array:
-        str = "[";
-        for (auto i : *value.data_array)
-            str += i.to_string() + ",";
-        if (!value.data_array->empty())
-            str.pop_back();
-        str += "]";
+        if (this->flags() & flag_packed_double)
+            destroy(payload().data_doubles, nullptr);
+        else if (this->flags() & flag_packed)
+            destroy(payload().data_ints, nullptr);
+        else {
+            for (auto &i : *payload().data_array)
+                i.release(depth + 1);
+            destroy(payload().data_array, block);
+        }
         break;
     case json_object:
-        str = "{";
-        for (auto i : *value.data_object)
-            str += "\"" + i.first + "\":" + i.second.to_string() + ",";
-        if (!value.data_object->empty())
-            str.pop_back();
-        str += "}";
+        for (auto &i : *payload().data_object)
+            i.second.release(depth + 1);
+        destroy(payload().data_object, block);
         break;
     default:
         break;
     }
+    this->store(json_null, 0, Value());
+}
+
+// 把非空的子容器移入 nested，留下的子节点释放时不再递归；其他引用仍在使用的共享容器保持不变
+template <typename Traits>
+void basic_json<Traits>::detach_nested(std::vector<basic_json> &nested) {
+    ContainerHeader *block = this->header();
+    if (block != nullptr && block->shares > 1)
+        return;
+    auto detach = [&nested](basic_json &child) {
+        if ((child.is_array() && !(child.flags() & flag_packed) && !child.payload().data_array->empty()) ||
+            (child.is_object() && !child.payload().data_object->empty()))
+            nested.push_back(std::move(child));
+    };
+    if (this->is_array() && !(this->flags() & flag_packed)) {
+        for (auto &i : *payload().data_array)
+            detach(i);
+    } else if (this->is_object()) {
+        for (auto &i : *payload().data_object)
+            detach(i.second);
+    }
+}
+
+// 先生成完整的缓冲区再释放原来的数组，中途失败时保持不变；打包不改变序列化结果，因此父节点的缓存仍然有效
+template <typename Traits>
+bool basic_json<Traits>::pack() {
+    if (this->flags() & flag_packed)
+        return true;
+    if (!this->is_array() || payload().data_array->empty())
+        return false;
+    const array_type &array = *payload().data_array;
+    if (array.front().is_double()) {
+        std::vector<double> doubles;
+        doubles.reserve(array.size());
+        for (const auto &i : array) {
+            if (!i.is_double() || (i.flags() & flag_raw_number))
+                return false;
+            doubles.push_back(i.payload().data_double);
+        }
+        PackedBuffer<double> *packed = create<PackedBuffer<double>>(std::move(doubles));
+        this->clear();
+        this->store(json_array, flag_packed | flag_packed_double, packed);
+    } else {
+        std::vector<std::int64_t> ints;
+        ints.reserve(array.size());
+        std::int64_t number;
+        for (const auto &i : array) {
+            if (!packed_int64(i, number))
+                return false;
+            ints.push_back(number);
+        }
+        PackedBuffer<std::int64_t> *packed = create<PackedBuffer<std::int64_t>>(std::move(ints));
+        this->clear();
+        this->store(json_array, flag_packed, packed);
+    }
+    return true;
+}
+
+// 元素按解析时的规则重建：int 范围内的整数直接保存，其余整数保存原文
+template <typename Traits>
+void basic_json<Traits>::unpack() {
+    if (!(this->flags() & flag_packed))
+        return;
+    std::size_t count = this->packed_size();
+    array_type array;
+    array.reserve(count);
+    for (std::size_t i = 0; i < count; i++)
+        array.push_back(this->packed_element(i));
+    array_type *unpacked = create<array_type>(std::move(array));
+    this->clear();
+    this->store(json_array, 0, unpacked);
+}
+
+template <typename Traits>
+bool basic_json<Traits>::is_packed() const {
+    return (this->flags() & flag_packed) != 0;
+}
+
+template <typename Traits>
+JsonSpan<const std::int64_t> basic_json<Traits>::get_int64s() const {
+    if ((this->flags() & (flag_packed | flag_packed_double)) != flag_packed)
+        MY_JSON_THROW(std::logic_error("function Json::get_int64s: not a packed int64 array"));
+    return JsonSpan<const std::int64_t>(payload().data_ints->data(), payload().data_ints->size());
+}
+
+template <typename Traits>
+JsonSpan<const double> basic_json<Traits>::get_doubles() const {
+    if (!(this->flags() & flag_packed_double))
+        MY_JSON_THROW(std::logic_error("function Json::get_doubles: not a packed double array"));
+    return JsonSpan<const double>(payload().data_doubles->data(), payload().data_doubles->size());
+}
+
+template <typename Traits>
+JsonSpan<std::int64_t> basic_json<Traits>::get_int64s() {
+    this->invalidate();
+    JsonSpan<const std::int64_t> span = static_cast<const basic_json *>(this)->get_int64s();
+    this->lend();
+    return JsonSpan<std::int64_t>(const_cast<std::int64_t *>(span.data()), span.size());
+}
+
+template <typename Traits>
+JsonSpan<double> basic_json<Traits>::get_doubles() {
+    this->invalidate();
+    JsonSpan<const double> span = static_cast<const basic_json *>(this)->get_doubles();
+    this->lend();
+    return JsonSpan<double>(const_cast<double *>(span.data()), span.size());
+}
+
+template <typename Traits>
+std::string basic_json<Traits>::to_string() const {
+    std::string str;
+#ifdef MY_JSON_INSTRUMENTATION
+    JsonStats stats = JsonStats();
+    auto start = std::chrono::steady_clock::now();
+    this->dump(str, &stats, 0);
+    stats.serialize_calls = 1;
+    stats.serialize_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    stats.bytes_out = str.size();
+    JsonInstrumentation::record(stats, str);
+#else
+    this->dump(str, nullptr, 0);
+#endif
     return str;
 }
 
-bool Json::find(const char *key) const {
+template <typename Traits>
+bool basic_json<Traits>::find(const char *key) const {
     return this->has_key(key);
 }
 
-bool Json::find(const std::string &key) const {
+template <typename Traits>
+bool basic_json<Traits>::find(const string_type &key) const {
     return this->has_key(key);
 }
 
-bool Json::has_key(const char *key) const {
-    std::string str(key);
+template <typename Traits>
+bool basic_json<Traits>::has_key(const char *key) const {
     if (this->is_object())
-        return value.data_object->find(str) != value.data_object->end();
-    throw std::logic_error("function Json::has_key: type error");
+        return this->find_member(key, std::strlen(key)) != nullptr;
+    MY_JSON_THROW(std::logic_error("function Json::has_key: type error"));
 }
 
-bool Json::has_key(const std::string &key) const {
+template <typename Traits>
+bool basic_json<Traits>::has_key(const string_type &key) const {
     if (this->is_object())
-        return value.data_object->find(key) != value.data_object->end();
-    throw std::logic_error("function Json::has_key: type error");
+        return payload().data_object->find(key) != payload().data_object->end();
+    MY_JSON_THROW(std::logic_error("function Json::has_key: type error"));
 }
 
-void Json::push_back(const Json &value) {
-    if (this->is_array())
-        this->value.data_array->push_back(value);
-    else if (this->is_null()) {
-        this->data_type = json_array;
-        this->value.data_array = new std::vector<Json>();
-        this->value.data_array->push_back(value);
+template <typename Traits>
+void basic_json<Traits>::push_back(const basic_json &value) {
+    this->invalidate(this->is_array() ? this->size() : 0);
+    if (this->is_array()) {
+        if ((this->flags() & flag_packed) && this->packed_append(value, false))
+            return;
+        this->unpack();
+        this->payload().data_array->push_back(value);
+    } else if (this->is_null()) {
+        this->store(json_array, 0, create<array_type>());
+        this->payload().data_array->push_back(value);
     } else
-        throw std::logic_error("function Json::push_back: This object has been defined as another type, if you want to force changes to the properties of this object, call the clear() function first");
+        MY_JSON_THROW(std::logic_error("function Json::push_back: This object has been defined as another type, if you want to force changes to the properties of this object, call the clear() function first"));
 }
 
-void Json::push_front(const Json &value) {
-    if (this->is_array())
-        this->value.data_array->insert(this->value.data_array->begin(), value);
-    else if (this->is_null()) {
-        this->data_type = json_array;
-        this->value.data_array = new std::vector<Json>();
-        this->value.data_array->push_back(value);
+template <typename Traits>
+void basic_json<Traits>::push_back(basic_json &&value) {
+    if ((this->flags() & flag_packed) && this->packed_append(value, false))
+        return;
+    this->append_target("push_back").push_back(std::move(value));
+}
+
+template <typename Traits>
+void basic_json<Traits>::push_front(const basic_json &value) {
+    this->invalidate();
+    if (this->is_array()) {
+        if ((this->flags() & flag_packed) && this->packed_append(value, true))
+            return;
+        this->unpack();
+        this->payload().data_array->insert(this->payload().data_array->begin(), value);
+    } else if (this->is_null()) {
+        this->store(json_array, 0, create<array_type>());
+        this->payload().data_array->push_back(value);
     } else
-        throw std::logic_error("function Json::push_front: This object has been defined as another type, if you want to force changes to the properties of this object, call the clear() function first");
+        MY_JSON_THROW(std::logic_error("function Json::push_front: This object has been defined as another type, if you want to force changes to the properties of this object, call the clear() function first"));
 }
 
-void Json::erase(int index) {
+template <typename Traits>
+void basic_json<Traits>::push_front(basic_json &&value) {
+    this->invalidate();
     if (this->is_array()) {
-        int size = this->value.data_array->size();
-        if (index >= 0 || index < size) {
-            auto iter = this->value.data_array->begin() + index;
+        if ((this->flags() & flag_packed) && this->packed_append(value, true))
+            return;
+        this->unpack();
+        this->payload().data_array->insert(this->payload().data_array->begin(), std::move(value));
+    } else if (this->is_null()) {
+        this->store(json_array, 0, create<array_type>());
+        this->payload().data_array->push_back(std::move(value));
+    } else
+        MY_JSON_THROW(std::logic_error("function Json::push_front: This object has been defined as another type, if you want to force changes to the properties of this object, call the clear() function first"));
+}
+
+// packed 数组保持 packed，预留的是数字缓冲区的容量
+template <typename Traits>
+void basic_json<Traits>::reserve(std::size_t size) {
+    if (this->flags() & flag_packed_double)
+        this->payload().data_doubles->reserve(size);
+    else if (this->flags() & flag_packed)
+        this->payload().data_ints->reserve(size);
+    else
+        this->append_target("reserve").reserve(size);
+}
+
+// 数组为空时直接接管 values 的缓冲区（调用者可能仍持有其中元素的引用，视为已经借出），否则逐个移动元素
+template <typename Traits>
+void basic_json<Traits>::append(array_type &&values) {
+    array_type &array = this->append_target("append");
+    if (array.empty()) {
+        array = std::move(values);
+        this->lend();
+    } else {
+        array.reserve(array.size() + values.size());
+        std::move(values.begin(), values.end(), std::back_inserter(array));
+    }
+    values.clear();
+}
+
+template <typename Traits>
+void basic_json<Traits>::erase(int index) {
+    this->invalidate();
+    if (this->flags() & flag_packed) {
+        if (index < 0 || index >= this->size())
+            MY_JSON_THROW(std::out_of_range("function Json::erase: index out of range"));
+        this->drop_packed_elements();
+        if (this->flags() & flag_packed_double)
+            payload().data_doubles->erase(payload().data_doubles->begin() + index);
+        else
+            payload().data_ints->erase(payload().data_ints->begin() + index);
+    } else if (this->is_array()) {
+        int size = this->payload().data_array->size();
+        if (index >= 0 && index < size) {
+            auto iter = this->payload().data_array->begin() + index;
             iter->clear();
-            this->value.data_array->erase(iter);
+            this->payload().data_array->erase(iter);
         } else
-            throw std::out_of_range("function Json::erase: index out of range");
+            MY_JSON_THROW(std::out_of_range("function Json::erase: index out of range"));
     } else
-        throw std::logic_error("function Json::erase: type error");
+        MY_JSON_THROW(std::logic_error("function Json::erase: type error"));
 }
 
-void Json::erase(const char *key) {
-    std::string str(key);
+template <typename Traits>
+void basic_json<Traits>::erase(const char *key) {
+    string_type str(key);
     erase(str);
 }
 
-void Json::erase(const std::string &key) {
+template <typename Traits>
+void basic_json<Traits>::erase(const string_type &key) {
+    this->invalidate();
     if (this->is_object()) {
-        auto iter = this->value.data_object->find(key);
-        if (iter != this->value.data_object->end()) {
+        auto iter = this->payload().data_object->find(key);
+        if (iter != this->payload().data_object->end()) {
             iter->second.clear();
-            this->value.data_object->erase(iter);
+            this->payload().data_object->erase(iter);
         }
     } else
-        throw std::logic_error("function Json::erase: type error");
+        MY_JSON_THROW(std::logic_error("function Json::erase: type error"));
 }
 
-Json &Json::operator=(const Json &other) {
+template <typename Traits>
+basic_json<Traits> &basic_json<Traits>::operator=(const basic_json &other) {
     this->clear();
     this->copy(other);
     return *this;
 }
 
-Json &Json::operator=(Json &&other) {
+template <typename Traits>
+basic_json<Traits> &basic_json<Traits>::operator=(basic_json &&other) noexcept {
     this->clear();
-    this->data_type = other.data_type;
-    this->value = other.value;
-    other.data_type = json_null;
+    this->storage = other.storage;
+    other.store(json_null, 0, Value());
     return *this;
 }
 
-bool Json::operator==(const Json &other) const {
-    if (this->data_type != other.data_type)
+template <typename Traits>
+bool basic_json<Traits>::operator==(const basic_json &other) const {
+    if (this->type() != other.type())
         return false;
-    switch (this->data_type) {
+    ContainerHeader *lhs = this->header(), *rhs = other.header();
+    if (lhs != nullptr && rhs != nullptr) {
+        if (lhs == rhs)
+            return true;
+        const std::uint64_t *lhs_hash = this->hash_cache(), *rhs_hash = other.hash_cache();
+        if (lhs_hash != nullptr && rhs_hash != nullptr && *lhs_hash != *rhs_hash)
+            return false;
+    }
+    switch (this->type()) {
     case json_null:
         return true;
     case json_bool:
-        return this->value.data_bool == other.value.data_bool;
+        return this->payload().data_bool == other.payload().data_bool;
     case json_int:
-        return this->value.data_int == other.value.data_int;
     case json_double:
-        return this->value.data_double == other.value.data_double;
+        if ((this->flags() | other.flags()) & flag_raw_number)
+            return this->number_equal(other);
+        if (this->type() == json_int)
+            return this->payload().data_int == other.payload().data_int;
+        return this->payload().data_double == other.payload().data_double;
     case json_string:
-        return *this->value.data_string == *other.value.data_string;
+        if ((this->flags() | other.flags()) & flag_escaped)
+            return this->get_string() == other.get_string();
+        return *this->payload().data_string == *other.payload().data_string;
     case json_array:
-        return *this->value.data_array == *other.value.data_array;
+        if ((this->flags() | other.flags()) & flag_packed)
+            return packed_equal(*this, other);
+        return *this->payload().data_array == *other.payload().data_array;
     case json_object:
-        return *this->value.data_object == *other.value.data_object;
+        return *this->payload().data_object == *other.payload().data_object;
     default:
         break;
     }
     return false;
 }
 
-bool Json::operator!=(const Json &other) const {
+template <typename Traits>
+bool basic_json<Traits>::operator!=(const basic_json &other) const {
     return !((*this) == other);
 }
 
-Json &Json::operator[](int index) {
+template <typename Traits>
+basic_json<Traits> &basic_json<Traits>::operator[](int index) {
+    this->invalidate(index);
+    this->unpack();
     if (this->is_array()) {
-        int size = this->value.data_array->size();
+        int size = this->payload().data_array->size();
         if (index >= 0 && index < size) {
-            return this->value.data_array->at(index);
+            this->lend(static_cast<std::size_t>(index));
+            return this->payload().data_array->at(index);
         }
-        throw std::out_of_range("function Json::operator[]: index out of range");
+        MY_JSON_THROW(std::out_of_range("function Json::operator[]: index out of range"));
     } else
-        throw std::logic_error("function Json::operator[]: type error");
+        MY_JSON_THROW(std::logic_error("function Json::operator[]: type error"));
 }
 
-Json &Json::operator[](const char *key) {
-    std::string str(key);
-    return (*this)[str];
+template <typename Traits>
+basic_json<Traits> &basic_json<Traits>::operator[](const char *key) {
+    basic_json *member = this->get_ptr(key);
+    if (member != nullptr)
+        return *member;
+    return (*this)[string_type(key)];
 }
 
-Json &Json::operator[](const std::string &key) {
+template <typename Traits>
+basic_json<Traits> &basic_json<Traits>::operator[](const string_type &key) {
+    this->invalidate();
     if (this->is_object()) {
-        auto iter = this->value.data_object->find(key);
-        if (iter != this->value.data_object->end())
+        this->lend();
+        auto iter = this->payload().data_object->find(key);
+        if (iter != this->payload().data_object->end())
             return iter->second;
-        else {
-            this->value.data_object->insert(std::make_pair(key, Json()));
-            return (*this)[key];
-        }
+        else
+            return this->payload().data_object->emplace(key, basic_json()).first->second;
     } else if (this->is_null()) {
-        this->data_type = json_object;
-        this->value.data_object = new std::map<std::string, Json>();
+        this->store(json_object, 0, create<object_type>());
         return (*this)[key];
     } else
-        throw std::logic_error("function Json::operator[]: type error");
+        MY_JSON_THROW(std::logic_error("function Json::operator[]: type error"));
+}
+
+template <typename Traits>
+const basic_json<Traits> *basic_json<Traits>::get_ptr(int index) const {
+    if (!this->is_array() || index < 0 || index >= this->size())
+        return nullptr;
+    if (this->flags() & flag_packed)
+        return &this->packed_ref(index);
+    return &(*payload().data_array)[index];
+}
+
+template <typename Traits>
+const basic_json<Traits> *basic_json<Traits>::get_ptr(const char *key) const {
+    return this->find_member(key, std::strlen(key));
+}
+
+template <typename Traits>
+const basic_json<Traits> *basic_json<Traits>::get_ptr(const string_type &key) const {
+    return this->find_member(key.data(), key.size());
+}
+
+// 返回的指针可能被用来修改，因此与 operator[] 一样使哈希缓存失效
+template <typename Traits>
+basic_json<Traits> *basic_json<Traits>::get_ptr(int index) {
+    this->invalidate(index);
+    this->unpack();
+    this->lend(static_cast<std::size_t>(index));
+    return const_cast<basic_json *>(static_cast<const basic_json *>(this)->get_ptr(index));
+}
+
+template <typename Traits>
+basic_json<Traits> *basic_json<Traits>::get_ptr(const char *key) {
+    this->invalidate();
+    this->lend();
+    return const_cast<basic_json *>(this->find_member(key, std::strlen(key)));
+}
+
+template <typename Traits>
+basic_json<Traits> *basic_json<Traits>::get_ptr(const string_type &key) {
+    this->invalidate();
+    this->lend();
+    return const_cast<basic_json *>(this->find_member(key.data(), key.size()));
 }
 
-Json::operator bool() const {
+template <typename Traits>
+const basic_json<Traits> &basic_json<Traits>::at(int index) const {
+    if (!this->is_array())
+        MY_JSON_THROW(std::logic_error("function Json::at: type error"));
+    const basic_json *element = this->get_ptr(index);
+    if (element == nullptr)
+        MY_JSON_THROW(std::out_of_range("function Json::at: index out of range"));
+    return *element;
+}
+
+template <typename Traits>
+const basic_json<Traits> &basic_json<Traits>::at(const char *key) const {
+    return this->at_member(key, std::strlen(key));
+}
+
+template <typename Traits>
+const basic_json<Traits> &basic_json<Traits>::at(const string_type &key) const {
+    return this->at_member(key.data(), key.size());
+}
+
+template <typename Traits>
+basic_json<Traits> &basic_json<Traits>::at(int index) {
+    this->invalidate(index);
+    this->unpack();
+    this->lend(static_cast<std::size_t>(index));
+    return const_cast<basic_json &>(static_cast<const basic_json *>(this)->at(index));
+}
+
+template <typename Traits>
+basic_json<Traits> &basic_json<Traits>::at(const char *key) {
+    this->invalidate();
+    this->lend();
+    return const_cast<basic_json &>(static_cast<const basic_json *>(this)->at(key));
+}
+
+template <typename Traits>
+basic_json<Traits> &basic_json<Traits>::at(const string_type &key) {
+    this->invalidate();
+    this->lend();
+    return const_cast<basic_json &>(static_cast<const basic_json *>(this)->at(key));
+}
+
+template <typename Traits>
+basic_json<Traits>::operator bool() const {
     if (this->is_bool())
-        return this->value.data_bool;
+        return this->payload().data_bool;
     else
-        throw std::logic_error("function Json::operator bool(): type error");
+        MY_JSON_THROW(std::logic_error("function Json::operator bool(): type error"));
 }
 
-Json::operator int() const {
+template <typename Traits>
+basic_json<Traits>::operator int() const {
     if (this->is_int())
-        return this->value.data_int;
+        return this->get_int();
     else
-        throw std::logic_error("function Json::operator int(): type error");
+        MY_JSON_THROW(std::logic_error("function Json::operator int(): type error"));
 }
 
-Json::operator double() const {
+template <typename Traits>
+basic_json<Traits>::operator double() const {
     if (this->is_double())
-        return this->value.data_double;
+        return this->get_double();
     else
-        throw std::logic_error("function Json::operator double(): type error");
+        MY_JSON_THROW(std::logic_error("function Json::operator double(): type error"));
 }
 
-Json::operator std::string() const {
+template <typename Traits>
+basic_json<Traits>::operator string_type() const {
     if (this->is_string())
-        return *this->value.data_string;
+        return this->get_string();
     else
-        throw std::logic_error("function Json::operator std::string(): type error");
+        MY_JSON_THROW(std::logic_error("function Json::operator std::string(): type error"));
 }
 
-Json::operator std::vector<Json>() const {
+template <typename Traits>
+basic_json<Traits>::operator array_type() const {
+    if (this->flags() & flag_packed)
+        return this->get_array();
     if (this->is_array())
-        return *this->value.data_array;
+        return *this->payload().data_array;
     else
-        throw std::logic_error("function Json::operator std::vector<Json>(): type error");
+        MY_JSON_THROW(std::logic_error("function Json::operator std::vector<Json>(): type error"));
 }
 
-Json::operator std::map<std::string, Json>() const {
+template <typename Traits>
+basic_json<Traits>::operator object_type() const {
     if (this->is_object())
-        return *this->value.data_object;
+        return *this->payload().data_object;
     else
-        throw std::logic_error("function Json::operator std::map<std::string, Json>(): type error");
+        MY_JSON_THROW(std::logic_error("function Json::operator std::map<std::string, Json>(): type error"));
 }
 
 // operator<<
-// std::ostream &operator<<(std::ostream &os, const Json &json) {
+// std::ostream &operator<<(std::ostream &os, const basic_json &json) {
 //     os << json.to_string();
 //     return os;
 // }
 
-void Json::parse(const char *json) {
-    std::string str(json);
-    this->parse(str);
+template <typename Traits>
+void basic_json<Traits>::parse(const char *json, const JsonParseOptions &options) {
+    JsonError error;
+    if (!this->parse(json, std::strlen(json), error, options))
+        throw_error(error);
 }
 
-void Json::parse(const std::string &json) {
-    this->clear();
-    Parser parser(json);
-    *this = parser.parse();
+template <typename Traits>
+void basic_json<Traits>::parse(const std::string &json, const JsonParseOptions &options) {
+    JsonError error;
+    if (!this->parse(json.data(), json.size(), error, options))
+        throw_error(error);
 }
 
-void Json::parse(std::ifstream &file) {
+template <typename Traits>
+void basic_json<Traits>::parse(std::ifstream &file, const JsonParseOptions &options) {
     this->clear();
     std::string json;
     std::string line;
     if (!file.is_open())
-        throw std::runtime_error("function Json::parse: file is not open");
+        MY_JSON_THROW(std::runtime_error("function Json::parse: file is not open"));
+    MY_JSON_STATS(auto start = std::chrono::steady_clock::now();)
     while (std::getline(file, line))
         json += line;
-    this->parse(json);
+    MY_JSON_STATS(JsonInstrumentation::record_read(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());)
+    this->parse(json, options);
+}
+
+template <typename Traits>
+bool basic_json<Traits>::parse(const char *json, JsonError &error, const JsonParseOptions &options) {
+    return this->parse(json, std::strlen(json), error, options);
+}
+
+template <typename Traits>
+bool basic_json<Traits>::parse(const char *json, std::size_t size, JsonError &error, const JsonParseOptions &options) {
+    this->clear();
+    Parser parser(options);
+    if (parser.parse_into(json, size, *this, error))
+        return true;
+    this->clear();
+    return false;
+}
+
+template <typename Traits>
+bool basic_json<Traits>::parse(const std::string &json, JsonError &error, const JsonParseOptions &options) {
+    return this->parse(json.data(), json.size(), error, options);
+}
+
+// 用显式的栈代替递归，栈中记录每一层是数组 '[' 还是对象 '{'
+template <typename Traits>
+JsonError basic_json<Traits>::validate(const char *data, std::size_t size) {
+    const char *p = data, *end = data + size;
+    std::string stack;
+    auto skip_space = [&]() {
+        while (p != end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+            p++;
+    };
+    auto digits = [&]() {
+        const char *start = p;
+        while (p != end && *p >= '0' && *p <= '9')
+            p++;
+        return p != start;
+    };
+    auto error = [&](JsonError::Code code) {
+        return JsonError(p == end && code == JsonError::unexpected_character ? JsonError::unexpected_end : code, p - data);
+    };
+    // 检查从 p 开始的字符串，成功时 p 指向结尾引号之后
+    auto check_string = [&](JsonError::Code &code) {
+        bool escaped;
+        const char *quote = find_string_end(p + 1, end, escaped, code);
+        p = quote;
+        if (code == JsonError::ok)
+            p++;
+        return code == JsonError::ok;
+    };
+    JsonError::Code code = JsonError::ok;
+    skip_space();
+    while (true) {
+        // 读取一个值
+        if (p == end)
+            return error(JsonError::unexpected_end);
+        switch (*p) {
+        case '{':
+        case '[':
+            stack += *p++;
+            skip_space();
+            if (p != end && *p == (stack.back() == '[' ? ']' : '}')) {
+                stack.pop_back();
+                p++;
+                break;
+            }
+            if (stack.back() == '{') {
+                if (p == end || *p != '"')
+                    return error(JsonError::unexpected_character);
+                if (!check_string(code))
+                    return error(code);
+                skip_space();
+                if (p == end || *p != ':')
+                    return error(JsonError::unexpected_character);
+                p++;
+                skip_space();
+            }
+            continue;
+        case '"':
+            if (!check_string(code))
+                return error(code);
+            break;
+        case 'n':
+        case 't':
+        case 'f': {
+            const char *literal = *p == 'n' ? "null" : *p == 't' ? "true" : "false";
+            std::size_t length = std::strlen(literal);
+            if (static_cast<std::size_t>(end - p) < length || std::memcmp(p, literal, length) != 0)
+                return error(JsonError::unexpected_character);
+            p += length;
+            break;
+        }
+        default:
+            if (*p == '-')
+                p++;
+            if (p != end && *p == '0')
+                p++;
+            else if (p == end || *p < '1' || *p > '9' || !digits())
+                return error(JsonError::unexpected_character);
+            if (p != end && *p == '.') {
+                p++;
+                if (!digits())
+                    return error(JsonError::unexpected_character);
+            }
+            if (p != end && (*p == 'e' || *p == 'E')) {
+                p++;
+                if (p != end && (*p == '+' || *p == '-'))
+                    p++;
+                if (!digits())
+                    return error(JsonError::unexpected_character);
+            }
+            break;
+        }
+        // 一个值结束后关闭已完成的数组和对象，直到遇到 ',' 需要读取下一个值
+        while (true) {
+            skip_space();
+            if (stack.empty())
+                return p == end ? JsonError() : error(JsonError::trailing_characters);
+            if (p == end)
+                return error(JsonError::unexpected_end);
+            if (*p == (stack.back() == '[' ? ']' : '}')) {
+                stack.pop_back();
+                p++;
+                continue;
+            }
+            if (*p != ',')
+                return error(JsonError::unexpected_character);
+            p++;
+            skip_space();
+            if (stack.back() == '{') {
+                if (p == end || *p != '"')
+                    return error(JsonError::unexpected_character);
+                if (!check_string(code))
+                    return error(code);
+                skip_space();
+                if (p == end || *p != ':')
+                    return error(JsonError::unexpected_character);
+                p++;
+                skip_space();
+            }
+            break;
+        }
+    }
+}
+
+template <typename Traits>
+JsonError basic_json<Traits>::validate(const std::string &json) {
+    return validate(json.data(), json.size());
+}
+
+template <typename Traits>
+void basic_json<Traits>::save_snapshot(const char *path) const {
+    std::string str(path);
+    this->save_snapshot(str);
+}
+
+template <typename Traits>
+void basic_json<Traits>::save_snapshot(const std::string &path) const {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    this->save_snapshot(file);
+}
+
+template <typename Traits>
+void basic_json<Traits>::save_snapshot(std::ofstream &file) const {
+    if (!file.is_open())
+        MY_JSON_THROW(std::runtime_error("function Json::save_snapshot: file is not open"));
+    char header[JsonSnapshot::header_size] = {0};
+    file.write(header, sizeof(header));
+    std::uint64_t pos = sizeof(header);
+    std::uint64_t root = this->write_snapshot(file, pos);
+
+    std::uint32_t version = JsonSnapshot::version;
+    std::uint32_t endian = 0x01020304;
+    std::memcpy(header, "MYJSNAP", 8);
+    std::memcpy(header + 8, &version, 4);
+    std::memcpy(header + 12, &endian, 4);
+    std::memcpy(header + 16, &root, 8);
+    std::memcpy(header + 24, &pos, 8);
+    file.seekp(0);
+    file.write(header, sizeof(header));
+    file.flush();
+    if (!file)
+        MY_JSON_THROW(std::runtime_error("function Json::save_snapshot: write error"));
 }
 
-void Json::copy(const Json &other) {
-    data_type = other.data_type;
-    switch (data_type) {
+template <typename Traits>
+std::uint64_t basic_json<Traits>::write_snapshot(std::ofstream &file, std::uint64_t &pos) const {
+    switch (this->type()) {
     case json_bool:
-        value.data_bool = other.value.data_bool;
-        break;
-    case json_int:
-        value.data_int = other.value.data_int;
-        break;
-    case json_double:
-        value.data_double = other.value.data_double;
-        break;
-    case json_string:
-        value.data_string = new std::string(*other.value.data_string);
-        break;
-    case json_array:
-        value.data_array = new std::vector<Json>(*other.value.data_array);
-        break;
-    case json_object:
-        value.data_object = new std::map<std::string, Json>(*other.value.data_object);
-        break;
+        return write_snapshot_node(file, pos, this->type(), payload().data_bool, nullptr, 0);
+    case json_int: {
+        // 能放进 int64 或 uint64 的整数按 8 字节保存，更大的整数保存原文
+        std::size_t size = 0;
+        const char *text = this->raw_text(size);
+        std::int64_t number = 0;
+        std::uint64_t unsigned_number = 0;
+        if (text == nullptr) {
+            number = payload().data_int;
+            return write_snapshot_node(file, pos, this->type(), JsonView::int_signed, &number, sizeof(number));
+        }
+        if (parse_int64(text, size, number))
+            return write_snapshot_node(file, pos, this->type(), JsonView::int_signed, &number, sizeof(number));
+        if (parse_uint64(text, size, unsigned_number))
+            return write_snapshot_node(file, pos, this->type(), JsonView::int_unsigned, &unsigned_number, sizeof(unsigned_number));
+        std::string str(text, size);
+        return write_snapshot_node(file, pos, this->type(), JsonView::int_text, str.c_str(), str.size() + 1);
+    }
+    case json_double: {
+        double number = this->get_double();
+        return write_snapshot_node(file, pos, this->type(), 0, &number, sizeof(double));
+    }
+    case json_string: {
+        string_type str = this->get_string();
+        if (str.size() > UINT32_MAX)
+            MY_JSON_THROW(std::length_error("function Json::save_snapshot: string too long"));
+        return write_snapshot_node(file, pos, this->type(), str.size(), str.c_str(), str.size() + 1);
+    }
+    case json_array: {
+        std::size_t count = this->flags() & flag_packed ? this->packed_size() : payload().data_array->size();
+        if (count > UINT32_MAX)
+            MY_JSON_THROW(std::length_error("function Json::save_snapshot: array too large"));
+        std::vector<std::uint64_t> children;
+        children.reserve(count);
+        if (this->flags() & flag_packed) {
+            for (std::size_t i = 0; i < this->packed_size(); i++)
+                children.push_back(this->packed_element(i).write_snapshot(file, pos));
+        } else {
+            for (const auto &i : *payload().data_array)
+                children.push_back(i.write_snapshot(file, pos));
+        }
+        return write_snapshot_node(file, pos, this->type(), children.size(), children.data(), children.size() * sizeof(std::uint64_t));
+    }
+    case json_object: {
+        // JsonView 按 key 二分查找，object_type 无序时先排序
+        typedef const typename object_type::value_type *Member;
+        if (payload().data_object->size() > UINT32_MAX)
+            MY_JSON_THROW(std::length_error("function Json::save_snapshot: object too large"));
+        std::vector<Member> sorted;
+        sorted.reserve(payload().data_object->size());
+        for (const auto &i : *payload().data_object)
+            sorted.push_back(&i);
+        auto less = [](Member lhs, Member rhs) { return lhs->first < rhs->first; };
+        if (!std::is_sorted(sorted.begin(), sorted.end(), less))
+            std::sort(sorted.begin(), sorted.end(), less);
+        std::vector<std::uint64_t> members;
+        members.reserve(sorted.size() * 2);
+        for (Member i : sorted) {
+            if (i->first.size() > UINT32_MAX)
+                MY_JSON_THROW(std::length_error("function Json::save_snapshot: key too long"));
+            members.push_back(write_snapshot_node(file, pos, json_string, i->first.size(), i->first.c_str(), i->first.size() + 1));
+            members.push_back(i->second.write_snapshot(file, pos));
+        }
+        return write_snapshot_node(file, pos, this->type(), members.size() / 2, members.data(), members.size() * sizeof(std::uint64_t));
+    }
     default:
         break;
     }
+    return write_snapshot_node(file, pos, json_null, 0, nullptr, 0);
+}
+
+template <typename Traits>
+std::uint64_t basic_json<Traits>::write_snapshot_node(std::ofstream &file, std::uint64_t &pos, Type type, std::uint32_t aux, const void *data, std::size_t size) {
+    static const char padding[8] = {0};
+    std::uint64_t offset = pos;
+    std::uint32_t tag = type;
+    file.write(reinterpret_cast<const char *>(&tag), 4);
+    file.write(reinterpret_cast<const char *>(&aux), 4);
+    if (size != 0)
+        file.write(static_cast<const char *>(data), size);
+    std::size_t pad = (8 - size % 8) % 8;
+    file.write(padding, pad);
+    pos += 8 + size + pad;
+    return offset;
+}
+
+// 撤销日志中的一步，回滚时逆序执行
+// undo_restore 把上一步撤销时移除的值放回 path，用于撤销 move 操作
+template <typename Traits>
+struct basic_json<Traits>::PatchStep {
+    enum Action {
+        undo_add,
+        undo_remove,
+        undo_replace,
+        undo_restore
+    };
+
+    Action action;
+    std::vector<string_type> path;
+    basic_json value;
+};
+
+template <typename Traits>
+void basic_json<Traits>::apply_patch(const basic_json &patch) {
+    basic_json copy(patch);
+    this->apply_patch(std::move(copy));
+}
+
+template <typename Traits>
+void basic_json<Traits>::apply_patch(basic_json &&patch) {
+    if (!patch.is_array())
+        MY_JSON_THROW(std::logic_error("function Json::apply_patch: patch must be an array"));
+    patch.unpack();
+    std::vector<PatchStep> undo;
+    MY_JSON_TRY {
+        for (auto &operation : *patch.payload().data_array)
+            this->patch_operation(operation, undo);
+    } MY_JSON_CATCH_ALL {
+        this->patch_rollback(undo);
+        MY_JSON_RETHROW;
+    }
+}
+
+template <typename Traits>
+void basic_json<Traits>::apply_merge_patch(const basic_json &patch) {
+    basic_json copy(patch);
+    this->apply_merge_patch(std::move(copy));
+}
+
+template <typename Traits>
+void basic_json<Traits>::apply_merge_patch(basic_json &&patch) {
+    std::vector<PatchStep> undo;
+    std::vector<string_type> path;
+    MY_JSON_TRY {
+        merge_patch(*this, std::move(patch), path, &undo);
+    } MY_JSON_CATCH_ALL {
+        this->patch_rollback(undo);
+        MY_JSON_RETHROW;
+    }
+}
+
+template <typename Traits>
+std::vector<typename basic_json<Traits>::string_type> basic_json<Traits>::parse_pointer(const string_type &pointer) {
+    std::vector<string_type> path;
+    if (pointer.empty())
+        return path;
+    if (pointer[0] != '/')
+        MY_JSON_THROW(std::logic_error("function Json::apply_patch: invalid json pointer " + string_cast<std::string>(pointer)));
+    string_type token;
+    for (std::size_t i = 1; i <= pointer.size(); i++) {
+        if (i == pointer.size() || pointer[i] == '/') {
+            path.push_back(std::move(token));
+            token.clear();
+        } else if (pointer[i] == '~') {
+            if (i + 1 < pointer.size() && pointer[i + 1] == '0')
+                token += '~';
+            else if (i + 1 < pointer.size() && pointer[i + 1] == '1')
+                token += '/';
+            else
+                MY_JSON_THROW(std::logic_error("function Json::apply_patch: invalid json pointer " + string_cast<std::string>(pointer)));
+            i++;
+        } else
+            token += pointer[i];
+    }
+    return path;
+}
+
+template <typename Traits>
+bool basic_json<Traits>::parse_index(const string_type &token, std::size_t &index) {
+    if (token.empty() || (token[0] == '0' && token.size() > 1))
+        return false;
+    index = 0;
+    for (char ch : token) {
+        if (ch < '0' || ch > '9')
+            return false;
+        index = index * 10 + (ch - '0');
+    }
+    return true;
 }
+
+template <typename Traits>
+template <typename To, typename From>
+To basic_json<Traits>::string_cast(const From &str) {
+    return To(str.data(), str.size());
+}
+
+template <typename Traits>
+typename basic_json<Traits>::string_type basic_json<Traits>::index_token(std::size_t index) {
+    return string_cast<string_type>(std::to_string(index));
+}
+
+// 修改之前先预留日志空间，保证修改完成后写日志不会再抛出异常
+template <typename Traits>
+void basic_json<Traits>::reserve_patch_steps(std::vector<PatchStep> *undo, std::size_t count) {
+    if (undo != nullptr && undo->capacity() - undo->size() < count)
+        undo->reserve(undo->size() * 2 + count);
+}
+
+template <typename Traits>
+basic_json<Traits> *basic_json<Traits>::resolve_pointer(const std::vector<string_type> &path, std::size_t depth) {
+    basic_json *node = this;
+    // 经过的 packed 数组转换为普通数组，以便返回元素的指针
+    for (std::size_t i = 0; i < depth; i++) {
+        node->invalidate();
+        node->unpack();
+        if (node->is_object()) {
+            auto iter = node->payload().data_object->find(path[i]);
+            if (iter == node->payload().data_object->end())
+                return nullptr;
+            node = &iter->second;
+        } else if (node->is_array()) {
+            std::size_t index;
+            if (!parse_index(path[i], index) || index >= node->payload().data_array->size())
+                return nullptr;
+            node = &(*node->payload().data_array)[index];
+        } else
+            return nullptr;
+    }
+    node->invalidate();
+    node->unpack();
+    return node;
+}
+
+// 只读的 test 与 copy 的源路径使用，不转换 packed 数组，也不使缓存失效
+template <typename Traits>
+const basic_json<Traits> *basic_json<Traits>::find_pointer(const std::vector<string_type> &path) const {
+    const basic_json *node = this;
+    for (const string_type &token : path) {
+        std::size_t index;
+        if (node->is_object())
+            node = node->find_member(token.data(), token.size());
+        else if (node->is_array() && parse_index(token, index) && index < static_cast<std::size_t>(node->size()))
+            node = node->get_ptr(static_cast<int>(index));
+        else
+            return nullptr;
+        if (node == nullptr)
+            return nullptr;
+    }
+    return node;
+}
+
+// RFC 6902 4.6 的相等：数字按数值比较（1 与 1.0 相等），数组与对象逐个元素、成员比较，其余与 operator== 相同
+template <typename Traits>
+bool basic_json<Traits>::patch_equal(const basic_json &lhs, const basic_json &rhs) {
+    if (lhs.is_int() && rhs.is_double())
+        return patch_number_equal(lhs, rhs.get_double());
+    if (lhs.is_double() && rhs.is_int())
+        return patch_number_equal(rhs, lhs.get_double());
+    if (lhs.type() != rhs.type())
+        return false;
+    if (lhs == rhs)
+        return true;
+    if (lhs.is_array()) {
+        int size = lhs.size();
+        if (size != rhs.size())
+            return false;
+        for (int i = 0; i < size; i++) {
+            basic_json lhs_element, rhs_element;
+            const basic_json &left = lhs.flags() & flag_packed ? (lhs_element = lhs.packed_element(i)) : (*lhs.payload().data_array)[i];
+            const basic_json &right = rhs.flags() & flag_packed ? (rhs_element = rhs.packed_element(i)) : (*rhs.payload().data_array)[i];
+            if (!patch_equal(left, right))
+                return false;
+        }
+        return true;
+    }
+    if (lhs.is_object()) {
+        if (lhs.size() != rhs.size())
+            return false;
+        for (const auto &i : *lhs.payload().data_object) {
+            const basic_json *other = rhs.find_member(i.first.data(), i.first.size());
+            if (other == nullptr || !patch_equal(i.second, *other))
+                return false;
+        }
+        return true;
+    }
+    return false;
+}
+
+// 浮点数必须是整数值；int64 与 uint64 范围内精确比较，超出时按 double 比较原文
+template <typename Traits>
+bool basic_json<Traits>::patch_number_equal(const basic_json &integer, double real) {
+    if (std::floor(real) != real)
+        return false;
+    std::size_t size = 0;
+    const char *text = integer.raw_text(size);
+    std::int64_t number = integer.payload().data_int;
+    std::uint64_t unsigned_number;
+    if (text == nullptr || parse_int64(text, size, number))
+        return real >= -9223372036854775808.0 && real < 9223372036854775808.0 && static_cast<std::int64_t>(real) == number;
+    if (parse_uint64(text, size, unsigned_number))
+        return real >= 0 && real < 18446744073709551616.0 && static_cast<std::uint64_t>(real) == unsigned_number;
+    double other;
+    return parse_double(text, size, other) && other == real;
+}
+
+template <typename Traits>
+void basic_json<Traits>::patch_operation(basic_json &operation, std::vector<PatchStep> &undo) {
+    if (!operation.is_object())
+        MY_JSON_THROW(std::logic_error("function Json::apply_patch: operation must be an object"));
+    auto &members = *operation.payload().data_object;
+    auto op = members.find("op");
+    auto path = members.find("path");
+    if (op == members.end() || !op->second.is_string() || path == members.end() || !path->second.is_string())
+        MY_JSON_THROW(std::logic_error("function Json::apply_patch: operation requires \"op\" and \"path\""));
+    string_type name = op->second.get_string();
+    std::vector<string_type> target = parse_pointer(path->second.get_string());
+
+    if (name == "remove") {
+        this->patch_remove(target, &undo);
+        return;
+    }
+    if (name == "move" || name == "copy") {
+        auto from = members.find("from");
+        if (from == members.end() || !from->second.is_string())
+            MY_JSON_THROW(std::logic_error("function Json::apply_patch: operation requires \"from\""));
+        std::vector<string_type> source = parse_pointer(from->second.get_string());
+        if (name == "copy") {
+            const basic_json *node = this->find_pointer(source);
+            if (node == nullptr)
+                MY_JSON_THROW(std::logic_error("function Json::apply_patch: path not found " + string_cast<std::string>(from->second.get_string())));
+            this->patch_add(target, basic_json(*node), &undo);
+            return;
+        }
+        if (source.size() < target.size() && std::equal(source.begin(), source.end(), target.begin()))
+            MY_JSON_THROW(std::logic_error("function Json::apply_patch: cannot move a value into one of its children"));
+        reserve_patch_steps(&undo, 2);
+        basic_json moved = this->patch_remove(source, nullptr);
+        MY_JSON_TRY {
+            this->patch_add(target, std::move(moved), &undo);
+        } MY_JSON_CATCH_ALL {
+            this->patch_add(source, std::move(moved), nullptr);
+            MY_JSON_RETHROW;
+        }
+        undo.insert(undo.end() - 1, PatchStep{PatchStep::undo_restore, std::move(source), basic_json()});
+        return;
+    }
+
+    if (name != "add" && name != "replace" && name != "test")
+        MY_JSON_THROW(std::logic_error("function Json::apply_patch: unknown operation " + string_cast<std::string>(name)));
+    auto value = members.find("value");
+    if (value == members.end())
+        MY_JSON_THROW(std::logic_error("function Json::apply_patch: operation requires \"value\""));
+    if (name == "add")
+        this->patch_add(target, std::move(value->second), &undo);
+    else if (name == "replace")
+        this->patch_replace(target, std::move(value->second), &undo);
+    else {
+        const basic_json *node = this->find_pointer(target);
+        if (node == nullptr || !patch_equal(*node, value->second))
+            MY_JSON_THROW(std::logic_error("function Json::apply_patch: test failed " + string_cast<std::string>(path->second.get_string())));
+    }
+}
+
+// value 只在成功时才会被移走，失败时调用者仍持有它
+template <typename Traits>
+void basic_json<Traits>::patch_add(const std::vector<string_type> &path, basic_json &&value, std::vector<PatchStep> *undo) {
+    if (path.empty()) {
+        this->patch_replace(path, std::move(value), undo);
+        return;
+    }
+    basic_json *parent = this->resolve_pointer(path, path.size() - 1);
+    if (parent != nullptr && parent->is_object()) {
+        auto iter = parent->payload().data_object->find(path.back());
+        if (iter != parent->payload().data_object->end()) {
+            this->patch_replace(path, std::move(value), undo);
+            return;
+        }
+        reserve_patch_steps(undo, 1);
+        std::vector<string_type> undo_path;
+        if (undo != nullptr)
+            undo_path = path;
+        parent->payload().data_object->insert(iter, std::make_pair(path.back(), std::move(value)));
+        if (undo != nullptr)
+            undo->push_back(PatchStep{PatchStep::undo_remove, std::move(undo_path), basic_json()});
+        return;
+    }
+    if (parent != nullptr && parent->is_array()) {
+        auto &array = *parent->payload().data_array;
+        std::size_t index = array.size();
+        if (path.back() != "-" && (!parse_index(path.back(), index) || index > array.size()))
+            MY_JSON_THROW(std::out_of_range("function Json::apply_patch: index out of range"));
+        reserve_patch_steps(undo, 1);
+        std::vector<string_type> undo_path;
+        if (undo != nullptr) {
+            undo_path = path;
+            undo_path.back() = index_token(index);
+        }
+        array.insert(array.begin() + index, std::move(value));
+        if (undo != nullptr)
+            undo->push_back(PatchStep{PatchStep::undo_remove, std::move(undo_path), basic_json()});
+        return;
+    }
+    MY_JSON_THROW(std::logic_error("function Json::apply_patch: path not found"));
+}
+
+// 记录日志时被移除的值保存在日志中，返回 null
+template <typename Traits>
+basic_json<Traits> basic_json<Traits>::patch_remove(const std::vector<string_type> &path, std::vector<PatchStep> *undo) {
+    basic_json *parent = path.empty() ? nullptr : this->resolve_pointer(path, path.size() - 1);
+    if (parent == nullptr || !(parent->is_object() || parent->is_array()))
+        MY_JSON_THROW(std::logic_error("function Json::apply_patch: path not found"));
+    reserve_patch_steps(undo, 1);
+    std::vector<string_type> undo_path;
+    if (undo != nullptr)
+        undo_path = path;
+    basic_json removed;
+    if (parent->is_object()) {
+        auto iter = parent->payload().data_object->find(path.back());
+        if (iter == parent->payload().data_object->end())
+            MY_JSON_THROW(std::logic_error("function Json::apply_patch: path not found"));
+        removed = std::move(iter->second);
+        parent->payload().data_object->erase(iter);
+    } else {
+        auto &array = *parent->payload().data_array;
+        std::size_t index;
+        if (!parse_index(path.back(), index) || index >= array.size())
+            MY_JSON_THROW(std::out_of_range("function Json::apply_patch: index out of range"));
+        removed = std::move(array[index]);
+        array.erase(array.begin() + index);
+    }
+    if (undo != nullptr) {
+        undo->push_back(PatchStep{PatchStep::undo_add, std::move(undo_path), std::move(removed)});
+        return basic_json();
+    }
+    return removed;
+}
+
+template <typename Traits>
+void basic_json<Traits>::patch_replace(const std::vector<string_type> &path, basic_json &&value, std::vector<PatchStep> *undo) {
+    basic_json *node = this->resolve_pointer(path, path.size());
+    if (node == nullptr)
+        MY_JSON_THROW(std::logic_error("function Json::apply_patch: path not found"));
+    reserve_patch_steps(undo, 1);
+    if (undo != nullptr)
+        undo->push_back(PatchStep{PatchStep::undo_replace, path, std::move(*node)});
+    *node = std::move(value);
+}
+
+template <typename Traits>
+void basic_json<Traits>::patch_rollback(std::vector<PatchStep> &undo) {
+    basic_json dropped;
+    while (!undo.empty()) {
+        PatchStep &step = undo.back();
+        switch (step.action) {
+        case PatchStep::undo_add:
+            this->patch_add(step.path, std::move(step.value), nullptr);
+            break;
+        case PatchStep::undo_remove:
+            dropped = this->patch_remove(step.path, nullptr);
+            break;
+        case PatchStep::undo_replace: {
+            basic_json *node = this->resolve_pointer(step.path, step.path.size());
+            dropped = std::move(*node);
+            *node = std::move(step.value);
+            break;
+        }
+        case PatchStep::undo_restore:
+            this->patch_add(step.path, std::move(dropped), nullptr);
+            break;
+        }
+        undo.pop_back();
+    }
+}
+
+// path 为 target 在根对象中的位置，用于记录日志
+// 新插入的成员整体由一条 undo_remove 撤销，其内部的修改不再记录
+template <typename Traits>
+void basic_json<Traits>::merge_patch(basic_json &target, basic_json &&patch, std::vector<string_type> &path, std::vector<PatchStep> *undo) {
+    target.invalidate();
+    if (!patch.is_object()) {
+        reserve_patch_steps(undo, 1);
+        if (undo != nullptr)
+            undo->push_back(PatchStep{PatchStep::undo_replace, path, std::move(target)});
+        target = std::move(patch);
+        return;
+    }
+    if (!target.is_object()) {
+        reserve_patch_steps(undo, 1);
+        if (undo != nullptr)
+            undo->push_back(PatchStep{PatchStep::undo_replace, path, std::move(target)});
+        target = basic_json(json_object);
+    }
+    // 下面会移走 patch 的成员，共享时先复制
+    patch.invalidate();
+    auto &members = *target.payload().data_object;
+    for (auto &i : *patch.payload().data_object) {
+        auto iter = members.find(i.first);
+        path.push_back(i.first);
+        if (i.second.is_null()) {
+            if (iter != members.end()) {
+                reserve_patch_steps(undo, 1);
+                if (undo != nullptr)
+                    undo->push_back(PatchStep{PatchStep::undo_add, path, std::move(iter->second)});
+                members.erase(iter);
+            }
+        } else if (iter == members.end()) {
+            reserve_patch_steps(undo, 1);
+            std::vector<string_type> undo_path;
+            if (undo != nullptr)
+                undo_path = path;
+            iter = members.insert(iter, std::make_pair(i.first, basic_json()));
+            if (undo != nullptr)
+                undo->push_back(PatchStep{PatchStep::undo_remove, std::move(undo_path), basic_json()});
+            merge_patch(iter->second, std::move(i.second), path, nullptr);
+        } else
+            merge_patch(iter->second, std::move(i.second), path, undo);
+        path.pop_back();
+    }
+}
+
+// 容器的哈希只计算一次（已缓存的直接使用）；64 位哈希相同时再用 operator== 确认子树相同
+template <typename Traits>
+struct basic_json<Traits>::DiffContext {
+    std::unordered_map<const basic_json *, std::uint64_t> hashes;
+    string_type array_key;
+    basic_json patch;
+};
+
+template <typename Traits>
+basic_json<Traits> basic_json<Traits>::diff(const basic_json &source, const basic_json &target) {
+    return diff(source, target, string_type());
+}
+
+template <typename Traits>
+basic_json<Traits> basic_json<Traits>::diff(const basic_json &source, const basic_json &target, const string_type &array_key) {
+    DiffContext context;
+    context.array_key = array_key;
+    context.patch = basic_json(json_array);
+    diff_node(source, target, string_type(), context);
+    return std::move(context.patch);
+}
+
+template <typename Traits>
+std::uint64_t basic_json<Traits>::diff_hash(const basic_json &json, DiffContext &context) {
+    return hash_node(json, 0, &context.hashes);
+}
+
+template <typename Traits>
+typename basic_json<Traits>::string_type basic_json<Traits>::escape_pointer(const string_type &key) {
+    string_type token;
+    token.reserve(key.size());
+    for (char ch : key) {
+        if (ch == '~')
+            token += "~0";
+        else if (ch == '/')
+            token += "~1";
+        else
+            token += ch;
+    }
+    return token;
+}
+
+template <typename Traits>
+void basic_json<Traits>::diff_emit(DiffContext &context, const char *op, const string_type &path, const basic_json *value) {
+    basic_json operation(json_object);
+    operation["op"] = op;
+    operation["path"] = path;
+    if (value != nullptr)
+        operation["value"] = *value;
+    context.patch.payload().data_array->push_back(std::move(operation));
+}
+
+template <typename Traits>
+void basic_json<Traits>::diff_node(const basic_json &source, const basic_json &target, const string_type &path, DiffContext &context) {
+    if (diff_hash(source, context) == diff_hash(target, context) && source == target)
+        return;
+    // packed 数组没有元素节点，整体替换
+    if (source.type() != target.type() || !(source.is_array() || source.is_object()) || ((source.flags() | target.flags()) & flag_packed))
+        diff_emit(context, "replace", path, &target);
+    else if (source.is_object())
+        diff_object(source, target, path, context);
+    else if (context.array_key.empty() || !diff_keyed_array(source, target, path, context))
+        diff_array(source, target, path, context);
+}
+
+// object_type 不一定有序，按 key 在另一边查找而不是归并
+template <typename Traits>
+void basic_json<Traits>::diff_object(const basic_json &source, const basic_json &target, const string_type &path, DiffContext &context) {
+    const auto &from = *source.payload().data_object;
+    const auto &to = *target.payload().data_object;
+    for (const auto &i : from) {
+        auto iter = to.find(i.first);
+        if (iter == to.end())
+            diff_emit(context, "remove", path + "/" + escape_pointer(i.first), nullptr);
+        else
+            diff_node(i.second, iter->second, path + "/" + escape_pointer(i.first), context);
+    }
+    for (const auto &i : to) {
+        if (from.find(i.first) == from.end())
+            diff_emit(context, "add", path + "/" + escape_pointer(i.first), &i.second);
+    }
+}
+
+// 去掉相同的头尾后对中间部分求 LCS，规模过大时退化为按下标逐个比较
+// 相邻的删除与插入配对成对元素的递归 diff，而不是整体删除再添加
+template <typename Traits>
+void basic_json<Traits>::diff_array(const basic_json &source, const basic_json &target, const string_type &path, DiffContext &context) {
+    const auto &from = *source.payload().data_array;
+    const auto &to = *target.payload().data_array;
+    std::size_t begin = 0, from_end = from.size(), to_end = to.size();
+    while (begin < from_end && begin < to_end && diff_hash(from[begin], context) == diff_hash(to[begin], context) && from[begin] == to[begin])
+        begin++;
+    while (from_end > begin && to_end > begin && diff_hash(from[from_end - 1], context) == diff_hash(to[to_end - 1], context) && from[from_end - 1] == to[to_end - 1]) {
+        from_end--;
+        to_end--;
+    }
+    std::size_t n = from_end - begin, m = to_end - begin;
+
+    // script: 0 保留，1 删除 from 中的元素，2 插入 to 中的元素
+    std::vector<char> script;
+    if (n != 0 && m != 0 && n * m <= (1u << 22)) {
+        std::vector<std::uint64_t> from_hash(n), to_hash(m);
+        for (std::size_t i = 0; i < n; i++)
+            from_hash[i] = diff_hash(from[begin + i], context);
+        for (std::size_t j = 0; j < m; j++)
+            to_hash[j] = diff_hash(to[begin + j], context);
+        std::vector<std::uint32_t> lcs((n + 1) * (m + 1), 0);
+        for (std::size_t i = n; i-- > 0;)
+            for (std::size_t j = m; j-- > 0;)
+                lcs[i * (m + 1) + j] = from_hash[i] == to_hash[j] ? lcs[(i + 1) * (m + 1) + j + 1] + 1 : std::max(lcs[(i + 1) * (m + 1) + j], lcs[i * (m + 1) + j + 1]);
+        std::size_t i = 0, j = 0;
+        while (i < n || j < m) {
+            if (i < n && j < m && from_hash[i] == to_hash[j]) {
+                script.push_back(0);
+                i++;
+                j++;
+            } else if (j == m || (i < n && lcs[(i + 1) * (m + 1) + j] >= lcs[i * (m + 1) + j + 1])) {
+                script.push_back(1);
+                i++;
+            } else {
+                script.push_back(2);
+                j++;
+            }
+        }
+    } else {
+        script.assign(std::min(n, m), 0);
+        script.insert(script.end(), n > m ? n - m : 0, 1);
+        script.insert(script.end(), m > n ? m - n : 0, 2);
+    }
+
+    std::size_t pos = begin, i = begin, j = begin;
+    for (std::size_t k = 0; k < script.size();) {
+        if (script[k] == 0) {
+            diff_node(from[i++], to[j++], path + "/" + index_token(pos++), context);
+            k++;
+            continue;
+        }
+        std::size_t removed = 0, inserted = 0;
+        for (; k < script.size() && script[k] != 0; k++)
+            script[k] == 1 ? removed++ : inserted++;
+        for (; removed != 0 && inserted != 0; removed--, inserted--)
+            diff_node(from[i++], to[j++], path + "/" + index_token(pos++), context);
+        for (; removed != 0; removed--, i++)
+            diff_emit(context, "remove", path + "/" + index_token(pos), nullptr);
+        for (; inserted != 0; inserted--)
+            diff_emit(context, "add", path + "/" + index_token(pos++), &to[j++]);
+    }
+}
+
+// 元素按 array_key 的值匹配，哈希相同时再用 operator== 确认：先删除没有匹配的元素，
+// 再保留按 target 顺序递增的最长子序列，其余元素依次移动到 target 中前一个元素之后，最后对匹配的元素递归 diff
+// 当前位置用树状数组统计，n 个元素为 O(n log n)；有元素不是对象或缺少该 key 时返回 false，由调用者改用 LCS
+template <typename Traits>
+bool basic_json<Traits>::diff_keyed_array(const basic_json &source, const basic_json &target, const string_type &path, DiffContext &context) {
+    const auto &from = *source.payload().data_array;
+    const auto &to = *target.payload().data_array;
+    auto collect = [&context](const array_type &array, std::vector<const basic_json *> &keys) {
+        keys.reserve(array.size());
+        for (const auto &i : array) {
+            if (!i.is_object())
+                return false;
+            auto key = i.payload().data_object->find(context.array_key);
+            if (key == i.payload().data_object->end())
+                return false;
+            keys.push_back(&key->second);
+        }
+        return true;
+    };
+    std::vector<const basic_json *> from_keys, to_keys;
+    if (!collect(from, from_keys) || !collect(to, to_keys))
+        return false;
+
+    // 同一哈希的候选按 source 中的顺序排列，next 之前的都已匹配
+    struct Candidates {
+        std::vector<std::size_t> from;
+        std::size_t next;
+    };
+    const std::size_t none = SIZE_MAX;
+    std::unordered_map<std::uint64_t, Candidates> candidates;
+    for (std::size_t i = 0; i < from.size(); i++)
+        candidates[diff_hash(*from_keys[i], context)].from.push_back(i);
+    std::vector<std::size_t> match(to.size(), none);
+    std::vector<char> used(from.size(), 0);
+    for (std::size_t j = 0; j < to.size(); j++) {
+        auto iter = candidates.find(diff_hash(*to_keys[j], context));
+        if (iter == candidates.end())
+            continue;
+        Candidates &candidate = iter->second;
+        while (candidate.next < candidate.from.size() && used[candidate.from[candidate.next]])
+            candidate.next++;
+        for (std::size_t k = candidate.next; k < candidate.from.size(); k++) {
+            std::size_t i = candidate.from[k];
+            if (!used[i] && *from_keys[i] == *to_keys[j]) {
+                match[j] = i;
+                used[i] = 1;
+                break;
+            }
+        }
+    }
+    for (std::size_t i = from.size(); i-- > 0;) {
+        if (!used[i])
+            diff_emit(context, "remove", path + "/" + index_token(i), nullptr);
+    }
+
+    // 删除后剩下的元素按原来的顺序编号，order[p] 为第 p 个元素在 target 中的位置
+    std::vector<std::size_t> position(from.size(), none), order;
+    for (std::size_t i = 0; i < from.size(); i++) {
+        if (used[i]) {
+            position[i] = order.size();
+            order.push_back(0);
+        }
+    }
+    for (std::size_t j = 0; j < to.size(); j++) {
+        if (match[j] != none)
+            order[position[match[j]]] = j;
+    }
+    std::vector<std::size_t> tails, parent(order.size());
+    std::vector<char> keep(order.size(), 0);
+    for (std::size_t p = 0; p < order.size(); p++) {
+        auto iter = std::lower_bound(tails.begin(), tails.end(), order[p], [&order](std::size_t q, std::size_t value) { return order[q] < value; });
+        parent[p] = iter == tails.begin() ? none : *(iter - 1);
+        if (iter == tails.end())
+            tails.push_back(p);
+        else
+            *iter = p;
+    }
+    for (std::size_t p = tails.empty() ? none : tails.back(); p != none; p = parent[p])
+        keep[p] = 1;
+
+    // 槽位：每个剩下的元素一个，其后依次是 target 中紧跟它的移动或插入的元素，开头的一组属于数组的起点
+    // run 为 0 表示起点，p + 1 表示第 p 个元素之后
+    std::vector<std::size_t> run_size(order.size() + 1, 0), run_start(order.size() + 1), slot(order.size());
+    std::size_t run = 0;
+    for (std::size_t j = 0; j < to.size(); j++) {
+        if (match[j] != none && keep[position[match[j]]])
+            run = position[match[j]] + 1;
+        else
+            run_size[run]++;
+    }
+    std::size_t slots = run_size[0];
+    run_start[0] = 0;
+    for (std::size_t p = 0; p < order.size(); p++) {
+        slot[p] = slots++;
+        run_start[p + 1] = slots;
+        slots += run_size[p + 1];
+    }
+    std::vector<std::size_t> tree(slots + 1, 0);
+    auto update = [&tree](std::size_t index, int delta) {
+        for (index++; index < tree.size(); index += index & (0 - index))
+            tree[index] += delta;
+    };
+    auto rank = [&tree](std::size_t index) {
+        std::size_t count = 0;
+        for (; index != 0; index -= index & (0 - index))
+            count += tree[index];
+        return count;
+    };
+    for (std::size_t p = 0; p < order.size(); p++)
+        update(slot[p], 1);
+
+    std::size_t next = run_start[0];
+    for (std::size_t j = 0; j < to.size(); j++) {
+        if (match[j] != none && keep[position[match[j]]]) {
+            next = run_start[position[match[j]] + 1];
+            continue;
+        }
+        std::size_t target_slot = next++;
+        if (match[j] == none) {
+            diff_emit(context, "add", path + "/" + index_token(rank(target_slot)), &to[j]);
+            update(target_slot, 1);
+            continue;
+        }
+        std::size_t p = position[match[j]];
+        std::size_t from_index = rank(slot[p]);
+        update(slot[p], -1);
+        std::size_t to_index = rank(target_slot);
+        update(target_slot, 1);
+        if (from_index != to_index) {
+            basic_json operation(json_object);
+            operation["op"] = "move";
+            operation["from"] = path + "/" + index_token(from_index);
+            operation["path"] = path + "/" + index_token(to_index);
+            context.patch.payload().data_array->push_back(std::move(operation));
+        }
+    }
+    for (std::size_t j = 0; j < to.size(); j++) {
+        if (match[j] != none)
+            diff_node(from[match[j]], to[j], path + "/" + index_token(j), context);
+    }
+    return true;
+}
+
+template <typename Traits>
+std::uint64_t basic_json<Traits>::hash(std::uint64_t seed) const {
+    return hash_node(*this, seed, nullptr);
+}
+
+template <typename Traits>
+std::pair<std::uint64_t, std::uint64_t> basic_json<Traits>::hash128(std::uint64_t seed) const {
+    return std::make_pair(hash_node(*this, seed, nullptr), hash_node(*this, hash_mix(seed ^ 0x6a09e667f3bcc909ULL) + 1, nullptr));
+}
+
+template <typename Traits>
+void basic_json<Traits>::enable_hash_cache() {
+    cache_hash(*this);
+}
+
+// 先处理子节点，再由它们的状态决定本节点：只有 cache_plain 的容器保存哈希，cache_plain 的缓存只在失效时重新计算
+// cache_guarded 的容器之后的 hash() 都要经过它们重新计算，其中 cache_plain 的子树直接使用缓存
+template <typename Traits>
+typename basic_json<Traits>::CacheState basic_json<Traits>::cache_hash(basic_json &json) {
+    if (json.flags() & flag_packed)
+        return json.flags() & flag_lent ? cache_guarded : cache_plain;
+    if (!(json.is_array() || json.is_object()) || json.is_shared())
+        return cache_plain;
+    if (json.hash_cache() != nullptr)
+        return cache_plain;
+    CacheState state = json.flags() & flag_lent ? cache_guarded : cache_plain;
+    if (json.is_array()) {
+        for (auto &i : *json.payload().data_array)
+            state = std::max(state, cache_hash(i));
+    } else {
+        for (auto &i : *json.payload().data_object)
+            state = std::max(state, cache_hash(i.second));
+    }
+    if (state == cache_guarded)
+        return state;
+    if (!(json.flags() & flag_header))
+        json.attach_header();
+    ContainerHeader *block = json.header();
+    block->hash = hash_node(json, 0, nullptr);
+    block->hash_valid = true;
+    return state;
+}
+
+template <typename Traits>
+JsonColumns basic_json<Traits>::to_columns(unsigned threads) const {
+    if (!this->is_array())
+        MY_JSON_THROW(std::logic_error("function Json::to_columns: type error"));
+    if (this->flags() & flag_packed)
+        return basic_json(this->get_array()).to_columns(threads);
+    const array_type &rows = *payload().data_array;
+    std::size_t chunk = column_chunk(rows.size(), threads);
+    std::size_t chunks = (rows.size() + chunk - 1) / chunk;
+    // 各段分别推断，之后按段的顺序合并；type 为 -1 表示还没有遇到标量，real 表示出现过浮点数
+    struct Guess {
+        std::string name;
+        int type;
+        bool real;
+    };
+    std::vector<std::vector<Guess>> guesses(chunks);
+    run_parallel(chunks, [&](std::size_t part) {
+        std::unordered_map<std::string, std::size_t> names;
+        // 同构的对象中成员的顺序相同，先与上一行同一位置的 key 比较，不同时才查找
+        std::vector<std::pair<const string_type *, std::size_t>> shape;
+        std::vector<Guess> &columns = guesses[part];
+        std::size_t end = std::min(rows.size(), (part + 1) * chunk);
+        for (std::size_t row = part * chunk; row < end; row++) {
+            if (!rows[row].is_object())
+                continue;
+            std::size_t position = 0;
+            for (const auto &member : *rows[row].payload().data_object) {
+                std::size_t index;
+                if (position < shape.size() && *shape[position].first == member.first)
+                    index = shape[position].second;
+                else {
+                    auto iter = names.emplace(std::string(member.first.data(), member.first.size()), columns.size()).first;
+                    index = iter->second;
+                    if (index == columns.size())
+                        columns.push_back(Guess{iter->first, -1, false});
+                    if (position < shape.size())
+                        shape[position] = std::make_pair(&member.first, index);
+                    else
+                        shape.push_back(std::make_pair(&member.first, index));
+                }
+                position++;
+                int type = -1;
+                switch (member.second.type()) {
+                case json_bool:
+                    type = JsonColumn::column_bool;
+                    break;
+                case json_int:
+                    type = JsonColumn::column_int64;
+                    break;
+                case json_double:
+                    type = JsonColumn::column_double;
+                    columns[index].real = true;
+                    break;
+                case json_string:
+                    type = JsonColumn::column_string;
+                    break;
+                default:
+                    break;
+                }
+                if (columns[index].type == -1)
+                    columns[index].type = type;
+            }
+        }
+    });
+    std::vector<Guess> merged;
+    std::unordered_map<std::string, std::size_t> names;
+    for (const auto &part : guesses) {
+        for (const auto &i : part) {
+            auto iter = names.emplace(i.name, merged.size()).first;
+            if (iter->second == merged.size())
+                merged.push_back(i);
+            else {
+                Guess &guess = merged[iter->second];
+                if (guess.type == -1)
+                    guess.type = i.type;
+                guess.real |= i.real;
+            }
+        }
+    }
+    std::vector<JsonColumn> schema;
+    for (const auto &i : merged) {
+        if (i.type == JsonColumn::column_int64 && i.real)
+            schema.push_back(JsonColumn(i.name, JsonColumn::column_double));
+        else if (i.type != -1)
+            schema.push_back(JsonColumn(i.name, static_cast<JsonColumn::Type>(i.type)));
+    }
+    return this->to_columns(schema, threads);
+}
+
+template <typename Traits>
+JsonColumns basic_json<Traits>::to_columns(const std::vector<JsonColumn> &schema, unsigned threads) const {
+    if (!this->is_array())
+        MY_JSON_THROW(std::logic_error("function Json::to_columns: type error"));
+    if (this->flags() & flag_packed)
+        return basic_json(this->get_array()).to_columns(schema, threads);
+    const array_type &rows = *payload().data_array;
+    std::unordered_map<std::string, std::size_t> names;
+    JsonColumns table = column_table(schema, rows.size(), names);
+    std::size_t chunk = column_chunk(rows.size(), threads);
+    std::size_t chunks = (rows.size() + chunk - 1) / chunk;
+    // 字符串先写入各段自己的缓冲区，offsets 中暂存段内的结束位置，之后拼接并改为全局的偏移
+    std::vector<std::vector<std::string>> buffers(chunks, std::vector<std::string>(table.columns.size()));
+    const std::size_t none = static_cast<std::size_t>(-1);
+    std::vector<string_type> keys;
+    for (const auto &i : table.columns)
+        keys.push_back(string_type(i.name.data(), i.name.size()));
+    run_parallel(chunks, [&](std::size_t part) {
+        std::vector<std::pair<const string_type *, std::size_t>> shape;
+        std::size_t end = std::min(rows.size(), (part + 1) * chunk);
+        for (std::size_t row = part * chunk; row < end; row++) {
+            if (!rows[row].is_object())
+                continue;
+            const object_type &object = *rows[row].payload().data_object;
+            // 只取少数的列时逐列查找，避免访问每个成员
+            if (keys.size() * 2 < object.size()) {
+                for (std::size_t index = 0; index < keys.size(); index++) {
+                    auto iter = object.find(keys[index]);
+                    if (iter == object.end())
+                        continue;
+                    JsonColumn &column = table.columns[index];
+                    if (iter->second.column_value(column, row, buffers[part][index]))
+                        column.validity[row / 64] |= std::uint64_t(1) << (row % 64);
+                }
+                continue;
+            }
+            std::size_t position = 0;
+            for (const auto &member : object) {
+                std::size_t index;
+                if (position < shape.size() && *shape[position].first == member.first)
+                    index = shape[position].second;
+                else {
+                    auto iter = names.find(std::string(member.first.data(), member.first.size()));
+                    index = iter != names.end() ? iter->second : none;
+                    if (position < shape.size())
+                        shape[position] = std::make_pair(&member.first, index);
+                    else
+                        shape.push_back(std::make_pair(&member.first, index));
+                }
+                position++;
+                if (index == none)
+                    continue;
+                JsonColumn &column = table.columns[index];
+                if (member.second.column_value(column, row, buffers[part][index]))
+                    column.validity[row / 64] |= std::uint64_t(1) << (row % 64);
+            }
+        }
+    });
+    for (std::size_t index = 0; index < table.columns.size(); index++) {
+        JsonColumn &column = table.columns[index];
+        if (column.type != JsonColumn::column_string)
+            continue;
+        std::vector<std::size_t> bases(chunks + 1, 0);
+        for (std::size_t part = 0; part < chunks; part++)
+            bases[part + 1] = bases[part] + buffers[part][index].size();
+        column.data.resize(bases[chunks]);
+        run_parallel(chunks, [&](std::size_t part) {
+            std::string &buffer = buffers[part][index];
+            if (!buffer.empty())
+                std::memcpy(&column.data[bases[part]], buffer.data(), buffer.size());
+            std::string().swap(buffer);
+            // 无效的行没有数据，结束位置与上一行相同
+            std::uint64_t offset = bases[part];
+            std::size_t end = std::min(rows.size(), (part + 1) * chunk);
+            for (std::size_t row = part * chunk; row < end; row++) {
+                if (column.valid(row))
+                    offset = bases[part] + column.offsets[row + 1];
+                column.offsets[row + 1] = offset;
+            }
+        });
+    }
+    return table;
+}
+
+// 按 schema 创建 rows 行的空列，重复的列名只保留第一个；names 为列名到下标的映射
+template <typename Traits>
+JsonColumns basic_json<Traits>::column_table(const std::vector<JsonColumn> &schema, std::size_t rows, std::unordered_map<std::string, std::size_t> &names) {
+    JsonColumns table;
+    table.rows = rows;
+    for (const auto &i : schema) {
+        if (!names.emplace(i.name, table.columns.size()).second)
+            continue;
+        JsonColumn column(i.name, i.type);
+        column.validity.assign((rows + 63) / 64, 0);
+        if (i.type == JsonColumn::column_int64)
+            column.ints.assign(rows, 0);
+        else if (i.type == JsonColumn::column_double)
+            column.doubles.assign(rows, 0);
+        else if (i.type == JsonColumn::column_bool)
+            column.bools.assign(rows, 0);
+        else
+            column.offsets.assign(rows + 1, 0);
+        table.columns.push_back(std::move(column));
+    }
+    return table;
+}
+
+// 每段的行数为 64 的倍数，使各线程写入 validity 中不同的字；数据较少时不拆分
+template <typename Traits>
+std::size_t basic_json<Traits>::column_chunk(std::size_t rows, unsigned threads) {
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    std::size_t chunk = (rows + threads - 1) / threads;
+    chunk = std::max<std::size_t>(4096, (chunk + 63) / 64 * 64);
+    return chunk;
+}
+
+// 在当前线程与 count - 1 个新线程上分别执行 body(0) 到 body(count - 1)
+template <typename Traits>
+void basic_json<Traits>::run_parallel(std::size_t count, const std::function<void(std::size_t)> &body) {
+    std::vector<std::thread> workers;
+    for (std::size_t i = 1; i < count; i++)
+        workers.emplace_back(body, i);
+    if (count != 0)
+        body(0);
+    for (auto &i : workers)
+        i.join();
+}
+
+// 把标量写入列的第 row 行，类型不符时返回 false
+template <typename Traits>
+bool basic_json<Traits>::column_value(JsonColumn &column, std::size_t row, std::string &buffer) const {
+    std::size_t size = 0;
+    const char *text = this->raw_text(size);
+    switch (column.type) {
+    case JsonColumn::column_int64:
+        if (this->type() != json_int)
+            return false;
+        if (text == nullptr) {
+            column.ints[row] = payload().data_int;
+            return true;
+        }
+        if (parse_int64(text, size, column.ints[row]))
+            return true;
+        column.ints[row] = 0;
+        return false;
+    case JsonColumn::column_double:
+        if (this->type() != json_int && this->type() != json_double)
+            return false;
+        if (text != nullptr) {
+            if (parse_double(text, size, column.doubles[row]))
+                return true;
+            column.doubles[row] = 0;
+            return false;
+        }
+        column.doubles[row] = this->type() == json_int ? payload().data_int : payload().data_double;
+        return true;
+    case JsonColumn::column_bool:
+        if (this->type() != json_bool)
+            return false;
+        column.bools[row] = payload().data_bool;
+        return true;
+    case JsonColumn::column_string:
+        if (this->type() != json_string)
+            return false;
+        if (this->flags() & flag_escaped) {
+            string_type str;
+            unescape(payload().data_string->data(), payload().data_string->size(), str);
+            buffer.append(str.data(), str.size());
+        } else
+            buffer.append(payload().data_string->data(), payload().data_string->size());
+        column.offsets[row + 1] = buffer.size();
+        return true;
+    }
+    return false;
+}
+
+template <typename Traits>
+void basic_json<Traits>::enable_dump_cache(std::size_t depth) {
+    cache_dump(*this, depth);
+}
+
+// 与 cache_hash 相同，先由子树的状态决定能否缓存；只有前 depth 层的容器保存结果，更深的容器只遍历以确定状态
+// 更深处已有的有效缓存（之前以更大的 depth 调用时生成）仍会使用，其状态不需要重新遍历
+template <typename Traits>
+typename basic_json<Traits>::CacheState basic_json<Traits>::cache_dump(basic_json &json, std::size_t depth) {
+    if (json.flags() & flag_packed)
+        return json.flags() & flag_lent ? cache_guarded : cache_plain;
+    if (!(json.is_array() || json.is_object()) || json.is_shared())
+        return cache_plain;
+    ContainerHeader *block = json.header();
+    if (json.dump_cache() != nullptr)
+        return cache_plain;
+    CacheState state = json.flags() & flag_lent ? cache_guarded : cache_plain;
+    std::size_t next = depth == 0 ? 0 : depth - 1;
+    if (json.is_array()) {
+        for (auto &i : *json.payload().data_array)
+            state = std::max(state, cache_dump(i, next));
+    } else {
+        for (auto &i : *json.payload().data_object)
+            state = std::max(state, cache_dump(i.second, next));
+    }
+    // 失效的缓存：不再缓存的容器释放内存，其余的清空后复用容量
+    if (block != nullptr && block->text) {
+        if (depth == 0 || state == cache_guarded)
+            block->text.reset();
+        else
+            block->text->clear();
+    }
+    if (depth == 0 || state == cache_guarded)
+        return state;
+    if (!(json.flags() & flag_header))
+        json.attach_header();
+    block = json.header();
+    if (!block->text)
+        block->text.reset(new std::string());
+    // 子节点的缓存都已有效，dump 只需拼接；缓存为空时 dump 不会读取它，因此可以直接写入并复用原有的容量
+    json.dump(*block->text, nullptr, 0);
+    return state;
+}
+
+// 数组的二级索引，见 create_index
+// entries 与数组的前 count 个元素一一对应，记录元素在 hashed 或 sorted 中的位置，之后的元素尚未加入索引
+// dirty 为修改过、需要重新取 key 的下标；stale 为 true 时下次查找重建整个索引
+// watched 为之后可能通过引用修改的元素：索引存在期间借出的下标，以及 path 经过的容器带有 flag_lent 的元素，
+// 每次查找前重新取这些元素的 key 与索引中的比较，不同时重新加入。借出的下标未知（建立索引之前数组已经借出过引用）
+// 或 watched 过多时 watch_all 为 true，此时只能依赖 generation()：它与上次查找时取得的值不同时重建整个索引
+template <typename Traits>
+struct basic_json<Traits>::ArrayIndex {
+    struct Less {
+        bool operator()(const basic_json &lhs, const basic_json &rhs) const {
+            return index_less(lhs, rhs);
+        }
+    };
+    typedef std::multimap<basic_json, std::size_t, Less> Sorted;
+    struct Entry {
+        bool present;
+        std::uint64_t hash;
+        typename Sorted::iterator position;
+    };
+
+    std::vector<string_type> path;
+    IndexType type;
+    bool stale;
+    bool watch_all;
+    std::size_t count;
+    std::uint64_t generation;
+    std::vector<std::size_t> dirty;
+    std::vector<std::size_t> watched;
+    std::vector<bool> watching;
+    std::vector<Entry> entries;
+    std::unordered_multimap<std::uint64_t, std::size_t> hashed;
+    Sorted sorted;
+
+    // lent 为数组是否借出过元素的引用，重建后无法知道之前借出的是哪些元素
+    void refresh(const array_type &array, bool lent) {
+        if (watch_all && !current(generation))
+            stale = true;
+        for (std::size_t i : watched)
+            if (i < count && this->moved(array, i))
+                dirty.push_back(i);
+        if (stale || array.size() < count) {
+            hashed.clear();
+            sorted.clear();
+            entries.clear();
+            dirty.clear();
+            watched.clear();
+            watching.clear();
+            count = 0;
+            stale = false;
+            watch_all = lent;
+            if (type == index_hashed)
+                hashed.reserve(array.size());
+        }
+        // 先移除全部修改过的元素再重新加入，同一个下标可能出现多次
+        for (std::size_t i : dirty)
+            remove(i);
+        for (std::size_t i : dirty)
+            if (!entries[i].present)
+                add(array, i);
+        dirty.clear();
+        entries.resize(array.size());
+        for (; count < array.size(); count++)
+            add(array, count);
+        // 每次查找都要检查 watched 中的元素，超过 64 个时改为依赖 generation()
+        if (watched.size() > 64) {
+            watch_all = true;
+            watched.clear();
+            watching.clear();
+        }
+        // 之后的修改会使 generation() 变化；只在 watch_all 时取 stamp，其余情况 const 的查找在没有修改时不写入
+        if (watch_all && (generation == 0 || !current(generation)))
+            generation = stamp();
+    }
+
+    // 元素在 path 处的 key 是否与索引中记录的不同
+    bool moved(const array_type &array, std::size_t position) const {
+        bool lent = false;
+        const basic_json *key = index_key(array[position], path, lent);
+        const Entry &entry = entries[position];
+        if (key == nullptr || !entry.present)
+            return (key != nullptr) != entry.present;
+        if (type == index_hashed)
+            return hash_node(*key, 0, nullptr) != entry.hash;
+        return index_less(*key, entry.position->first) || index_less(entry.position->first, *key);
+    }
+
+    void watch(std::size_t position) {
+        if (watch_all)
+            return;
+        if (watching.size() <= position)
+            watching.resize(position + 1);
+        if (!watching[position]) {
+            watching[position] = true;
+            watched.push_back(position);
+        }
+    }
+
+    void add(const array_type &array, std::size_t position) {
+        bool lent = false;
+        const basic_json *key = index_key(array[position], path, lent);
+        if (lent)
+            this->watch(position);
+        if (key == nullptr)
+            return;
+        Entry &entry = entries[position];
+        if (type == index_hashed) {
+            entry.hash = hash_node(*key, 0, nullptr);
+            hashed.emplace(entry.hash, position);
+        } else
+            entry.position = sorted.emplace(*key, position);
+        entry.present = true;
+    }
+
+    // 估算值，不含 sorted 中 key 的字符串
+    std::size_t memory() const {
+        std::size_t size = sizeof(ArrayIndex) + entries.capacity() * sizeof(Entry) + (dirty.capacity() + watched.capacity()) * sizeof(std::size_t) + watching.capacity() / 8;
+        size += hashed.bucket_count() * sizeof(void *) + hashed.size() * (sizeof(typename std::unordered_multimap<std::uint64_t, std::size_t>::value_type) + sizeof(void *));
+        size += sorted.size() * (sizeof(typename Sorted::value_type) + 4 * sizeof(void *));
+        return size;
+    }
+
+    void remove(std::size_t position) {
+        Entry &entry = entries[position];
+        if (!entry.present)
+            return;
+        if (type == index_hashed) {
+            auto range = hashed.equal_range(entry.hash);
+            for (auto iter = range.first; iter != range.second; ++iter) {
+                if (iter->second == position) {
+                    hashed.erase(iter);
+                    break;
+                }
+            }
+        } else
+            sorted.erase(entry.position);
+        entry.present = false;
+    }
+};
+
+template <typename Traits>
+void basic_json<Traits>::create_index(const string_type &path, IndexType type) {
+    if (!this->is_array())
+        MY_JSON_THROW(std::logic_error("function Json::create_index: type error"));
+    std::unique_ptr<ArrayIndex> index(new ArrayIndex());
+    index->path = parse_pointer(path);
+    index->type = type;
+    index->stale = false;
+    index->count = 0;
+    index->generation = 0;
+    this->invalidate();
+    this->unpack();
+    if (!(this->flags() & flag_header))
+        this->attach_header();
+    if (type == index_hashed)
+        index->hashed.reserve(payload().data_array->size());
+    index->watch_all = (this->flags() & flag_lent) != 0;
+    index->refresh(*payload().data_array, index->watch_all);
+    this->header()->index = std::move(index);
+}
+
+template <typename Traits>
+void basic_json<Traits>::drop_index() {
+    ContainerHeader *block = this->header();
+    if (block != nullptr)
+        block->index.reset();
+}
+
+template <typename Traits>
+bool basic_json<Traits>::has_index() const {
+    ContainerHeader *block = this->header();
+    return block != nullptr && block->index;
+}
+
+template <typename Traits>
+const basic_json<Traits> *basic_json<Traits>::find_by(const basic_json &key) const {
+    const ArrayIndex *index = this->array_index("find_by");
+    const array_type &array = *payload().data_array;
+    std::size_t best = array.size();
+    bool lent = false;
+    if (index->type == index_hashed) {
+        auto range = index->hashed.equal_range(hash_node(key, 0, nullptr));
+        for (auto iter = range.first; iter != range.second; ++iter) {
+            if (iter->second < best && *index_key(array[iter->second], index->path, lent) == key)
+                best = iter->second;
+        }
+    } else {
+        auto range = index->sorted.equal_range(key);
+        for (auto iter = range.first; iter != range.second; ++iter)
+            best = std::min(best, iter->second);
+    }
+    return best == array.size() ? nullptr : &array[best];
+}
+
+// 返回的元素可能被修改，与 operator[] 一样只使该元素在索引中失效
+template <typename Traits>
+basic_json<Traits> *basic_json<Traits>::find_by(const basic_json &key) {
+    const basic_json *element = static_cast<const basic_json *>(this)->find_by(key);
+    if (element == nullptr)
+        return nullptr;
+    std::size_t position = element - payload().data_array->data();
+    this->invalidate(position);
+    this->lend(position);
+    return &(*payload().data_array)[position];
+}
+
+template <typename Traits>
+std::vector<const basic_json<Traits> *> basic_json<Traits>::find_all_by(const basic_json &key) const {
+    const ArrayIndex *index = this->array_index("find_all_by");
+    const array_type &array = *payload().data_array;
+    std::vector<std::size_t> positions;
+    bool lent = false;
+    if (index->type == index_hashed) {
+        auto range = index->hashed.equal_range(hash_node(key, 0, nullptr));
+        for (auto iter = range.first; iter != range.second; ++iter) {
+            if (*index_key(array[iter->second], index->path, lent) == key)
+                positions.push_back(iter->second);
+        }
+    } else {
+        auto range = index->sorted.equal_range(key);
+        for (auto iter = range.first; iter != range.second; ++iter)
+            positions.push_back(iter->second);
+    }
+    std::sort(positions.begin(), positions.end());
+    std::vector<const basic_json *> result;
+    result.reserve(positions.size());
+    for (std::size_t i : positions)
+        result.push_back(&array[i]);
+    return result;
+}
+
+template <typename Traits>
+std::vector<const basic_json<Traits> *> basic_json<Traits>::find_range(const basic_json &lower, const basic_json &upper) const {
+    const ArrayIndex *index = this->array_index("find_range");
+    if (index->type != index_sorted)
+        MY_JSON_THROW(std::logic_error("function Json::find_range: index is not sorted"));
+    const array_type &array = *payload().data_array;
+    std::vector<const basic_json *> result;
+    for (auto iter = index->sorted.lower_bound(lower); iter != index->sorted.end() && !index_less(upper, iter->first); ++iter)
+        result.push_back(&array[iter->second]);
+    return result;
+}
+
+// 查找前把尚未处理的修改反映到索引中
+template <typename Traits>
+typename basic_json<Traits>::ArrayIndex *basic_json<Traits>::array_index(const char *function) const {
+    ContainerHeader *block = this->header();
+    if (block == nullptr || !block->index)
+        MY_JSON_THROW(std::logic_error(std::string("function Json::") + function + ": array has no index"));
+    (void)function;
+    block->index->refresh(*payload().data_array, (this->flags() & flag_lent) != 0);
+    return block->index.get();
+}
+
+// 返回元素中 path 处的标量，不存在或为数组、对象时返回 nullptr；经过的容器借出过引用时 lent 为 true
+template <typename Traits>
+const basic_json<Traits> *basic_json<Traits>::index_key(const basic_json &element, const std::vector<string_type> &path, bool &lent) {
+    const basic_json *node = &element;
+    for (const string_type &token : path) {
+        std::size_t index;
+        lent = lent || (node->flags() & flag_lent);
+        if (node->is_object())
+            node = node->find_member(token.data(), token.size());
+        else if (node->is_array() && parse_index(token, index) && index < static_cast<std::size_t>(node->size()))
+            node = node->get_ptr(static_cast<int>(index));
+        else
+            return nullptr;
+        if (node == nullptr)
+            return nullptr;
+    }
+    if (node->is_array() || node->is_object())
+        return nullptr;
+    return node;
+}
+
+// 有序索引的比较：先按类型，再按值；超出 int64 的整数排在其余整数之后，按原文比较
+template <typename Traits>
+bool basic_json<Traits>::index_less(const basic_json &lhs, const basic_json &rhs) {
+    if (lhs.type() != rhs.type())
+        return lhs.type() < rhs.type();
+    switch (lhs.type()) {
+    case json_bool:
+        return lhs.payload().data_bool < rhs.payload().data_bool;
+    case json_int: {
+        if (!((lhs.flags() | rhs.flags()) & flag_raw_number))
+            return lhs.payload().data_int < rhs.payload().data_int;
+        std::size_t size = 0, other_size = 0;
+        const char *text = lhs.raw_text(size), *other_text = rhs.raw_text(other_size);
+        std::int64_t number = lhs.payload().data_int, other_number = rhs.payload().data_int;
+        bool exact = text == nullptr || parse_int64(text, size, number);
+        bool other_exact = other_text == nullptr || parse_int64(other_text, other_size, other_number);
+        if (exact || other_exact)
+            return exact && other_exact ? number < other_number : exact;
+        return string_type(text, size) < string_type(other_text, other_size);
+    }
+    case json_double:
+        return lhs.get_double() < rhs.get_double();
+    case json_string:
+        if ((lhs.flags() | rhs.flags()) & flag_escaped)
+            return lhs.get_string() < rhs.get_string();
+        return *lhs.payload().data_string < *rhs.payload().data_string;
+    default:
+        return false;
+    }
+}
+
+// dedupe 的状态：entries 按结构哈希保存每个值第一次出现的节点，出现重复之前只记录节点的地址，
+// 第一次重复时把该节点转换为共享的值（位于共享的存储中时改为复制一份），之后的重复都引用 value
+// visited 记录已经遍历过的共享存储及其中是否含有不能共享的值，同一份存储只遍历一次
+template <typename Traits>
+struct basic_json<Traits>::DedupeContext {
+    struct Entry {
+        basic_json *node;
+        bool inside_shared;
+        basic_json value;
+    };
+
+    std::unordered_multimap<std::uint64_t, Entry> entries;
+    std::unordered_map<const basic_json *, std::uint64_t> memo;
+    std::unordered_map<const void *, bool> visited;
+    JsonDedupeStats stats;
+};
+
+template <typename Traits>
+void basic_json<Traits>::shrink_to_fit() {
+    if (this->is_shared())
+        return;
+    switch (this->type()) {
+    case json_int:
+    case json_double:
+        if (this->flags() & flag_raw_heap)
+            payload().data_string->shrink_to_fit();
+        break;
+    case json_string:
+        payload().data_string->shrink_to_fit();
+        break;
+    case json_array:
+        if (this->flags() & flag_packed_double)
+            payload().data_doubles->shrink_to_fit();
+        else if (this->flags() & flag_packed)
+            payload().data_ints->shrink_to_fit();
+        else {
+            payload().data_array->shrink_to_fit();
+            for (auto &i : *payload().data_array)
+                i.shrink_to_fit();
+        }
+        break;
+    case json_object:
+        for (auto &i : *payload().data_object)
+            i.second.shrink_to_fit();
+        break;
+    default:
+        break;
+    }
+    ContainerHeader *block = this->header();
+    if (block != nullptr && block->text)
+        block->text->shrink_to_fit();
+}
+
+// 复制时每个容器与字符串都按实际大小重新分配，之后释放原来的树
+template <typename Traits>
+void basic_json<Traits>::compact() {
+    basic_json dense(*this);
+    *this = std::move(dense);
+}
+
+template <typename Traits>
+JsonDedupeStats basic_json<Traits>::dedupe() {
+    DedupeContext context;
+    dedupe_node(*this, false, context);
+    return context.stats;
+}
+
+// 后序遍历：子节点先替换为共享的引用，父节点比较时子节点只需比较地址
+// 返回子树中是否全部可以共享；含有 packed 数组或二级索引的子树不参与比较，以保证 entries 中记录的节点不会随被替换的子树释放
+// inside_shared 表示节点位于共享的存储中，只登记而不修改
+template <typename Traits>
+bool basic_json<Traits>::dedupe_node(basic_json &json, bool inside_shared, DedupeContext &context) {
+    Type type = json.type();
+    if (type != json_string && type != json_array && type != json_object)
+        return true;
+    if (json.flags() & flag_packed)
+        return false;
+    ContainerHeader *block = json.header();
+    bool shared = block != nullptr && block->shares != 0;
+    bool complete = block == nullptr || !block->index;
+    if (type != json_string) {
+        auto visited = context.visited.end();
+        if (shared) {
+            visited = context.visited.find(json.storage_address());
+            if (visited != context.visited.end())
+                complete = visited->second;
+        }
+        if (!shared || visited == context.visited.end()) {
+            if (type == json_array) {
+                for (auto &i : *json.payload().data_array)
+                    complete = dedupe_node(i, inside_shared || shared, context) && complete;
+            } else {
+                for (auto &i : *json.payload().data_object)
+                    complete = dedupe_node(i.second, inside_shared || shared, context) && complete;
+            }
+            if (shared)
+                context.visited.emplace(json.storage_address(), complete);
+        }
+    }
+    if (!complete)
+        return false;
+    std::uint64_t hash = hash_node(json, 0, &context.memo);
+    auto range = context.entries.equal_range(hash);
+    for (auto iter = range.first; iter != range.second; ++iter) {
+        typename DedupeContext::Entry &entry = iter->second;
+        const basic_json &value = entry.node != nullptr ? *entry.node : entry.value;
+        if (!dedupe_equal(value, json))
+            continue;
+        if (inside_shared || value.storage_address() == json.storage_address())
+            return true;
+        if (entry.node != nullptr) {
+            if (entry.inside_shared) {
+                entry.value = *entry.node;
+                context.stats.bytes_added += owned_size(entry.value) + entry.value.share();
+            } else {
+                context.stats.bytes_added += entry.node->share();
+                entry.value = *entry.node;
+            }
+            entry.node = nullptr;
+        }
+        context.stats.bytes_released += owned_size(json);
+        if (type == json_string)
+            context.stats.strings++;
+        else
+            context.stats.containers++;
+        json = entry.value;
+        return true;
+    }
+    typename DedupeContext::Entry entry;
+    if (shared) {
+        entry.node = nullptr;
+        entry.value = json;
+    } else
+        entry.node = &json;
+    entry.inside_shared = inside_shared;
+    context.entries.emplace(hash, std::move(entry));
+    return true;
+}
+
+// 比 operator== 更严格：还要求序列化的结果相同，原文保存的数字与字符串按原文比较，-0.0 与 0.0 不相等
+template <typename Traits>
+bool basic_json<Traits>::dedupe_equal(const basic_json &lhs, const basic_json &rhs) {
+    if (lhs.type() != rhs.type())
+        return false;
+    std::uint8_t mask = flag_raw_number | flag_escaped | flag_packed | flag_packed_double;
+    if ((lhs.flags() & mask) != (rhs.flags() & mask))
+        return false;
+    if (lhs.storage_address() != nullptr && lhs.storage_address() == rhs.storage_address())
+        return true;
+    switch (lhs.type()) {
+    case json_int:
+    case json_double: {
+        if (lhs.flags() & flag_raw_number) {
+            std::size_t size = 0, other_size = 0;
+            const char *text = lhs.raw_text(size), *other_text = rhs.raw_text(other_size);
+            return size == other_size && std::memcmp(text, other_text, size) == 0;
+        }
+        if (lhs.is_int())
+            return lhs.payload().data_int == rhs.payload().data_int;
+        double left = lhs.payload().data_double, right = rhs.payload().data_double;
+        return std::memcmp(&left, &right, sizeof(double)) == 0;
+    }
+    case json_string:
+        return *lhs.payload().data_string == *rhs.payload().data_string;
+    case json_array: {
+        if (lhs.flags() & flag_packed)
+            return lhs == rhs;
+        const array_type &left = *lhs.payload().data_array, &right = *rhs.payload().data_array;
+        if (left.size() != right.size())
+            return false;
+        for (std::size_t i = 0; i < left.size(); i++) {
+            if (!dedupe_equal(left[i], right[i]))
+                return false;
+        }
+        return true;
+    }
+    case json_object: {
+        const object_type &left = *lhs.payload().data_object, &right = *rhs.payload().data_object;
+        if (left.size() != right.size())
+            return false;
+        for (auto i = left.begin(), j = right.begin(); i != left.end(); ++i, ++j) {
+            if (i->first != j->first || !dedupe_equal(i->second, j->second))
+                return false;
+        }
+        return true;
+    }
+    default:
+        return lhs == rhs;
+    }
+}
+
+template <typename Traits>
+JsonMemoryUsage basic_json<Traits>::memory_usage() const {
+    JsonMemoryUsage usage;
+    usage.nodes = sizeof(basic_json);
+    std::unordered_set<const void *> visited;
+    measure_tree(*this, false, usage, visited);
+    return usage;
+}
+
+// 共享的存储只统计一次，同时计入 shared
+template <typename Traits>
+void basic_json<Traits>::measure_tree(const basic_json &json, bool shared, JsonMemoryUsage &usage, std::unordered_set<const void *> &visited) {
+    if (json.is_shared()) {
+        if (!visited.insert(json.storage_address()).second)
+            return;
+        shared = true;
+    }
+    std::size_t total = usage.total();
+    measure(json, usage);
+    if (shared)
+        usage.shared += usage.total() - total;
+    if (json.is_array() && !(json.flags() & flag_packed)) {
+        for (const auto &i : *json.payload().data_array)
+            measure_tree(i, shared, usage, visited);
+    } else if (json.is_object()) {
+        for (const auto &i : *json.payload().data_object)
+            measure_tree(i.second, shared, usage, visited);
+    }
+}
+
+// 字符串对象计入 strings；数据不在对象内部时（没有使用短字符串优化）再计入缓冲区，多余的容量计入 slack
+template <typename Traits>
+template <typename String>
+void basic_json<Traits>::measure_string(const String &str, std::size_t &bytes, std::size_t &slack) {
+    const char *data = reinterpret_cast<const char *>(str.data());
+    const char *self = reinterpret_cast<const char *>(&str);
+    bytes += sizeof(str);
+    if (data < self || data >= self + sizeof(str)) {
+        bytes += (str.size() + 1) * sizeof(typename String::value_type);
+        slack += (str.capacity() - str.size()) * sizeof(typename String::value_type);
+    }
+}
+
+// 节点自身的存储，不含子节点的存储；数组中的元素与对象的成员本身计入 nodes，对象的成员按红黑树的节点（3 个指针与颜色）估算开销
+template <typename Traits>
+void basic_json<Traits>::measure(const basic_json &json, JsonMemoryUsage &usage) {
+    switch (json.type()) {
+    case json_int:
+    case json_double:
+        if (json.flags() & flag_raw_heap)
+            measure_string(*json.payload().data_string, usage.strings, usage.slack);
+        break;
+    case json_string:
+        measure_string(*json.payload().data_string, usage.strings, usage.slack);
+        break;
+    case json_array:
+        if (json.flags() & flag_packed_double) {
+            const PackedBuffer<double> &numbers = *json.payload().data_doubles;
+            usage.containers += sizeof(numbers);
+            usage.nodes += numbers.size() * sizeof(double);
+            usage.slack += (numbers.capacity() - numbers.size()) * sizeof(double);
+            if (const PackedElements *elements = numbers.elements.load(std::memory_order_acquire))
+                usage.caches += elements->memory();
+        } else if (json.flags() & flag_packed) {
+            const PackedBuffer<std::int64_t> &numbers = *json.payload().data_ints;
+            usage.containers += sizeof(numbers);
+            usage.nodes += numbers.size() * sizeof(std::int64_t);
+            usage.slack += (numbers.capacity() - numbers.size()) * sizeof(std::int64_t);
+            if (const PackedElements *elements = numbers.elements.load(std::memory_order_acquire))
+                usage.caches += elements->memory();
+        } else {
+            const array_type &array = *json.payload().data_array;
+            usage.containers += sizeof(array);
+            usage.nodes += array.size() * sizeof(basic_json);
+            usage.slack += (array.capacity() - array.size()) * sizeof(basic_json);
+        }
+        break;
+    case json_object:
+        usage.containers += sizeof(object_type);
+        for (const auto &i : *json.payload().data_object) {
+            usage.nodes += sizeof(basic_json);
+            usage.containers += sizeof(i) - sizeof(i.first) - sizeof(basic_json) + 4 * sizeof(void *);
+            measure_string(i.first, usage.strings, usage.slack);
+        }
+        break;
+    default:
+        break;
+    }
+    ContainerHeader *block = json.header();
+    if (block != nullptr) {
+        usage.containers += json.header_overhead();
+        if (block->text)
+            measure_string(*block->text, usage.caches, usage.caches);
+        if (block->index)
+            usage.caches += block->index->memory();
+    }
+}
+
+template <typename Traits>
+std::size_t basic_json<Traits>::heap_size(const basic_json &json) {
+    JsonMemoryUsage usage;
+    measure(json, usage);
+    return usage.total();
+}
+
+// 释放节点时实际归还的内存：仍被其他节点引用的共享值不计入
+template <typename Traits>
+std::size_t basic_json<Traits>::owned_size(const basic_json &json) {
+    ContainerHeader *block = json.header();
+    if (block != nullptr && block->shares > 1)
+        return 0;
+    std::size_t size = heap_size(json);
+    if (json.is_array() && !(json.flags() & flag_packed)) {
+        for (const auto &i : *json.payload().data_array)
+            size += owned_size(i);
+    } else if (json.is_object()) {
+        for (const auto &i : *json.payload().data_object)
+            size += owned_size(i.second);
+    }
+    return size;
+}
+
+template <typename Traits>
+typename basic_json<Traits>::ContainerHeader *basic_json<Traits>::header() const {
+    if (!(this->flags() & flag_header))
+        return nullptr;
+    const char *data = static_cast<const char *>(this->storage_address());
+    return reinterpret_cast<ContainerHeader *>(const_cast<char *>(data) - sizeof(ContainerHeader));
+}
+
+// enable_hash_cache 缓存的哈希，没有缓存或已经失效时返回 nullptr；借出过引用的容器不使用缓存
+template <typename Traits>
+const std::uint64_t *basic_json<Traits>::hash_cache() const {
+    const ContainerHeader *block = this->header();
+    if (block == nullptr || !block->hash_valid || (this->flags() & flag_lent))
+        return nullptr;
+    return &block->hash;
+}
+
+// enable_dump_cache 缓存的序列化结果，没有缓存或已经失效时返回 nullptr
+template <typename Traits>
+const std::string *basic_json<Traits>::dump_cache() const {
+    const ContainerHeader *block = this->header();
+    if (block == nullptr || !block->text || block->text->empty() || (this->flags() & flag_lent))
+        return nullptr;
+    return block->text.get();
+}
+
+// blocks 的长度在生成时按缓冲区的大小确定，缓冲区的大小改变之前总是先丢弃 elements
+// 被替换的块移到 retired，之前返回的引用仍然指向它们，与 elements 一起释放
+template <typename Traits>
+struct basic_json<Traits>::PackedElements {
+    static const std::size_t block_size = 64;
+
+    struct Block {
+        basic_json values[block_size];
+        Block *next;
+    };
+
+    explicit PackedElements(std::size_t size) : count((size + block_size - 1) / block_size), blocks(new std::atomic<Block *>[count]), retired(nullptr) {
+        for (std::size_t i = 0; i < count; i++)
+            blocks[i].store(nullptr, std::memory_order_relaxed);
+    }
+    PackedElements(const PackedElements &other) = delete;
+    PackedElements &operator=(const PackedElements &other) = delete;
+    ~PackedElements() {
+        for (std::size_t i = 0; i < count; i++)
+            delete blocks[i].load(std::memory_order_relaxed);
+        Block *block = retired.load(std::memory_order_relaxed);
+        while (block != nullptr) {
+            Block *next = block->next;
+            delete block;
+            block = next;
+        }
+    }
+
+    void retire(Block *block) {
+        block->next = retired.load(std::memory_order_relaxed);
+        while (!retired.compare_exchange_weak(block->next, block, std::memory_order_release, std::memory_order_relaxed))
+            ;
+    }
+
+    std::size_t memory() const {
+        std::size_t size = sizeof(PackedElements) + count * sizeof(std::atomic<Block *>);
+        for (std::size_t i = 0; i < count; i++)
+            size += blocks[i].load(std::memory_order_acquire) != nullptr ? sizeof(Block) : 0;
+        for (const Block *block = retired.load(std::memory_order_acquire); block != nullptr; block = block->next)
+            size += sizeof(Block);
+        return size;
+    }
+
+    std::size_t count;
+    std::unique_ptr<std::atomic<Block *>[]> blocks;
+    std::atomic<Block *> retired;
+};
+
+template <typename Traits>
+std::size_t basic_json<Traits>::packed_size() const {
+    return this->flags() & flag_packed_double ? payload().data_doubles->size() : payload().data_ints->size();
+}
+
+template <typename Traits>
+basic_json<Traits> basic_json<Traits>::packed_element(std::size_t index) const {
+    if (this->flags() & flag_packed_double)
+        return basic_json((*payload().data_doubles)[index]);
+    return from_int64((*payload().data_ints)[index]);
+}
+
+// 第一次访问时生成块表，访问到的块再各自生成，都用 compare_exchange 发布，同时访问的线程中只有一个的结果被保留
+// 借出过 span 的数组可能已被原地修改，块中的该元素与缓冲区不一致时生成新的块替换，已经发布的块不再修改
+template <typename Traits>
+const basic_json<Traits> &basic_json<Traits>::packed_ref(std::size_t index) const {
+    bool real = (this->flags() & flag_packed_double) != 0;
+    std::atomic<PackedElements *> &slot = real ? payload().data_doubles->elements : payload().data_ints->elements;
+    PackedElements *elements = slot.load(std::memory_order_acquire);
+    if (elements == nullptr) {
+        std::unique_ptr<PackedElements> built(new PackedElements(this->packed_size()));
+        if (slot.compare_exchange_strong(elements, built.get(), std::memory_order_acq_rel))
+            elements = built.release();
+    }
+    typedef typename PackedElements::Block Block;
+    std::size_t offset = index % PackedElements::block_size, first = index - offset;
+    std::atomic<Block *> &block_slot = elements->blocks[index / PackedElements::block_size];
+    Block *block = block_slot.load(std::memory_order_acquire);
+    if (block != nullptr && (this->flags() & flag_lent)) {
+        const basic_json &element = block->values[offset];
+        double real_number = real ? element.payload().data_double : 0;
+        std::int64_t number;
+        bool same = real ? std::memcmp(&real_number, &(*payload().data_doubles)[index], sizeof(double)) == 0
+                         : packed_int64(element, number) && number == (*payload().data_ints)[index];
+        if (!same)
+            block = nullptr;
+    }
+    if (block == nullptr) {
+        std::unique_ptr<Block> built(new Block());
+        std::size_t last = std::min(first + PackedElements::block_size, this->packed_size());
+        for (std::size_t i = first; i < last; i++)
+            built->values[i - first] = this->packed_element(i);
+        Block *old = block_slot.load(std::memory_order_acquire);
+        if (block_slot.compare_exchange_strong(old, built.get(), std::memory_order_acq_rel)) {
+            if (old != nullptr)
+                elements->retire(old);
+            block = built.release();
+        } else
+            block = old;
+    }
+    return block->values[offset];
+}
+
+template <typename Traits>
+void basic_json<Traits>::drop_packed_elements() {
+    std::atomic<PackedElements *> &slot = this->flags() & flag_packed_double ? payload().data_doubles->elements : payload().data_ints->elements;
+    delete slot.exchange(nullptr, std::memory_order_acq_rel);
+}
+
+// 类型与缓冲区一致时直接写入并返回 true，否则返回 false，由调用者转换为普通数组
+template <typename Traits>
+bool basic_json<Traits>::packed_append(const basic_json &value, bool front) {
+    if (this->flags() & flag_packed_double) {
+        if (!value.is_double() || (value.flags() & flag_raw_number))
+            return false;
+        this->drop_packed_elements();
+        auto &doubles = *this->payload().data_doubles;
+        doubles.insert(front ? doubles.begin() : doubles.end(), value.payload().data_double);
+        return true;
+    }
+    std::int64_t number;
+    if (!packed_int64(value, number))
+        return false;
+    this->drop_packed_elements();
+    auto &ints = *this->payload().data_ints;
+    ints.insert(front ? ints.begin() : ints.end(), number);
+    return true;
+}
+
+// 保存原文的整数只有在 int64 范围内且原文与 std::to_string 的输出相同时才能打包，"-0" 除外的 JSON 整数都满足后者
+template <typename Traits>
+bool basic_json<Traits>::packed_int64(const basic_json &value, std::int64_t &number) {
+    if (!value.is_int())
+        return false;
+    std::size_t size = 0;
+    const char *text = value.raw_text(size);
+    if (text == nullptr) {
+        number = value.payload().data_int;
+        return true;
+    }
+    return parse_int64(text, size, number) && !(size == 2 && text[0] == '-' && text[1] == '0');
+}
+
+// 至少一边是 packed 数组，逐个元素比较；packed 一边的元素是临时生成的
+template <typename Traits>
+bool basic_json<Traits>::packed_equal(const basic_json &lhs, const basic_json &rhs) {
+    if (lhs.size() != rhs.size())
+        return false;
+    if ((lhs.flags() & rhs.flags() & flag_packed) && (lhs.flags() & flag_packed_double) == (rhs.flags() & flag_packed_double)) {
+        if (lhs.flags() & flag_packed_double)
+            return *lhs.payload().data_doubles == *rhs.payload().data_doubles;
+        return *lhs.payload().data_ints == *rhs.payload().data_ints;
+    }
+    const basic_json &packed = lhs.flags() & flag_packed ? lhs : rhs;
+    const basic_json &other = lhs.flags() & flag_packed ? rhs : lhs;
+    for (std::size_t i = 0; i < packed.packed_size(); i++) {
+        if (other.flags() & flag_packed) {
+            if (packed.packed_element(i) != other.packed_element(i))
+                return false;
+        } else if (packed.packed_element(i) != (*other.payload().data_array)[i])
+            return false;
+    }
+    return true;
+}
+
+// push_back、emplace_back、append 等写入的数组：null 先转换为空数组，packed 数组先转换为普通数组
+template <typename Traits>
+typename basic_json<Traits>::array_type &basic_json<Traits>::append_target(const char *function) {
+    this->invalidate(this->is_array() ? this->size() : 0);
+    if (this->is_null())
+        this->store(json_array, 0, create<array_type>());
+    else if (!this->is_array())
+        MY_JSON_THROW(std::logic_error(std::string("function Json::") + function + ": type error"));
+    (void)function;
+    this->unpack();
+    return *this->payload().data_array;
+}
+
+// 把容器或字符串移动到带有 ContainerHeader 的新内存块中
+template <typename Traits>
+void basic_json<Traits>::attach_header() {
+    if (this->flags() & flag_header)
+        return;
+    if (this->is_array())
+        this->store(json_array, this->flags() | flag_header, relocate(this->payload().data_array));
+    else if (this->is_object())
+        this->store(json_object, this->flags() | flag_header, relocate(this->payload().data_object));
+    else
+        this->store(json_string, this->flags() | flag_header, relocate(this->payload().data_string));
+}
+
+// 即将修改容器：共享时先取得独占的一份，返回此后的 ContainerHeader
+template <typename Traits>
+typename basic_json<Traits>::ContainerHeader *basic_json<Traits>::exclusive_header() {
+    ContainerHeader *block = this->header();
+    if (block != nullptr && block->shares != 0) {
+        this->unshare();
+        block = this->header();
+    }
+    return block;
+}
+
+// 字符串、数组与对象的存储地址，两个节点相同时共享同一份存储
+template <typename Traits>
+const void *basic_json<Traits>::storage_address() const {
+    switch (this->type()) {
+    case json_string:
+        return payload().data_string;
+    case json_array:
+        if (this->flags() & flag_packed_double)
+            return payload().data_doubles;
+        if (this->flags() & flag_packed)
+            return payload().data_ints;
+        return payload().data_array;
+    case json_object:
+        return payload().data_object;
+    default:
+        return nullptr;
+    }
+}
+
+// 开始共享：附加 ContainerHeader 并把引用计数设为 1，返回因此增加的内存
+template <typename Traits>
+std::size_t basic_json<Traits>::share() {
+    std::size_t added = 0;
+    if (!(this->flags() & flag_header)) {
+        this->attach_header();
+        added = this->header_overhead();
+    }
+    this->header()->shares = 1;
+    return added;
+}
+
+// ContainerHeader 与对齐使内存块比容器或字符串本身多出的大小
+template <typename Traits>
+std::size_t basic_json<Traits>::header_overhead() const {
+    if (this->is_array())
+        return block_size<array_type>() * sizeof(ContainerHeader) - sizeof(array_type);
+    if (this->is_object())
+        return block_size<object_type>() * sizeof(ContainerHeader) - sizeof(object_type);
+    return block_size<string_type>() * sizeof(ContainerHeader) - sizeof(string_type);
+}
+
+// 只有自己引用时直接接管，否则复制一份容器，其中的元素与成员仍然共享
+template <typename Traits>
+void basic_json<Traits>::unshare() {
+    ContainerHeader *block = this->header();
+    if (block->shares == 1) {
+        block->shares = 0;
+        return;
+    }
+    basic_json detached;
+    if (this->is_array())
+        detached.store(json_array, 0, create<array_type>(*payload().data_array));
+    else if (this->is_object())
+        detached.store(json_object, 0, create<object_type>(*payload().data_object));
+    else
+        detached.store(json_string, this->flags() & flag_escaped, create<string_type>(*payload().data_string));
+    *this = std::move(detached);
+}
+
+template <typename Traits>
+bool basic_json<Traits>::is_shared() const {
+    ContainerHeader *block = this->header();
+    return block != nullptr && block->shares != 0;
+}
+
+template <typename Traits>
+void basic_json<Traits>::invalidate() {
+    touch();
+    ContainerHeader *block = this->exclusive_header();
+    if (block != nullptr) {
+        block->hash_valid = false;
+        if (block->text)
+            block->text->clear();
+        if (block->index)
+            block->index->stale = true;
+    }
+}
+
+// 只修改第 position 个元素，或在末尾追加元素（position 为原来的大小）时使用：索引只需重新处理该元素
+template <typename Traits>
+void basic_json<Traits>::invalidate(std::size_t position) {
+    touch();
+    ContainerHeader *block = this->exclusive_header();
+    if (block == nullptr)
+        return;
+    block->hash_valid = false;
+    if (block->text)
+        block->text->clear();
+    ArrayIndex *index = block->index.get();
+    if (index == nullptr || index->stale || position >= index->count)
+        return;
+    index->dirty.push_back(position);
+    // 修改的元素较多时整体重建更快
+    if (index->dirty.size() > index->count / 4 + 64) {
+        index->stale = true;
+        index->dirty.clear();
+    }
+}
+
+// 每个 Traits 一个计数器；为 0 时还没有索引依赖它，修改时不必递增
+template <typename Traits>
+std::atomic<std::uint64_t> &basic_json<Traits>::generation() {
+    static std::atomic<std::uint64_t> counter(0);
+    return counter;
+}
+
+// stamp 由 fetch_add 产生，不会等于任何线程在 touch 中记下的值，因此之后的第一次修改一定会再次递增
+template <typename Traits>
+std::uint64_t basic_json<Traits>::stamp() {
+    return generation().fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+// 计数器仍是本线程上次递增的结果时，期间没有新的 stamp，它已经不等于任何有效的 stamp，连续的修改不必再递增
+template <typename Traits>
+void basic_json<Traits>::touch() {
+    static thread_local std::uint64_t last = 0;
+    std::uint64_t value = generation().load(std::memory_order_relaxed);
+    if (value != 0 && value != last)
+        last = generation().fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+// 0 表示缓存不依赖计数器
+template <typename Traits>
+bool basic_json<Traits>::current(std::uint64_t value) {
+    return value == 0 || value == generation().load(std::memory_order_relaxed);
+}
+
+// 在交出子节点的可修改引用或 packed 数组的 span 之前调用；数组的索引之后需要检查全部元素
+template <typename Traits>
+void basic_json<Traits>::lend() {
+    if ((this->is_array() || this->is_object()) && !(this->flags() & flag_lent))
+        this->set_flags(this->flags() | flag_lent);
+    ContainerHeader *block = this->header();
+    if (block != nullptr && block->index) {
+        block->index->watch_all = true;
+        block->index->watched.clear();
+        block->index->watching.clear();
+    }
+}
+
+// 只交出数组第 position 个元素的引用，索引之后只需检查该元素
+template <typename Traits>
+void basic_json<Traits>::lend(std::size_t position) {
+    if (!this->is_array() || position >= payload().data_array->size())
+        return;
+    if (!(this->flags() & flag_lent))
+        this->set_flags(this->flags() | flag_lent);
+    ContainerHeader *block = this->header();
+    if (block != nullptr && block->index)
+        block->index->watch(position);
+}
+
+template <typename Traits>
+template <typename T, typename... Args>
+T *basic_json<Traits>::create(Args &&...args) {
+    typedef typename std::allocator_traits<typename Traits::allocator_type>::template rebind_alloc<T> Alloc;
+    Alloc alloc;
+    T *ptr = std::allocator_traits<Alloc>::allocate(alloc, 1);
+    MY_JSON_TRY {
+        std::allocator_traits<Alloc>::construct(alloc, ptr, std::forward<Args>(args)...);
+    } MY_JSON_CATCH_ALL {
+        std::allocator_traits<Alloc>::deallocate(alloc, ptr, 1);
+        MY_JSON_RETHROW;
+    }
+    return ptr;
+}
+
+// block 不为空时 ptr 位于 relocate 申请的内存块中，与 ContainerHeader 一起释放
+template <typename Traits>
+template <typename T>
+void basic_json<Traits>::destroy(T *ptr, ContainerHeader *block) {
+    typedef typename std::allocator_traits<typename Traits::allocator_type>::template rebind_alloc<T> Alloc;
+    typedef typename std::allocator_traits<typename Traits::allocator_type>::template rebind_alloc<ContainerHeader> BlockAlloc;
+    Alloc alloc;
+    std::allocator_traits<Alloc>::destroy(alloc, ptr);
+    if (block == nullptr) {
+        std::allocator_traits<Alloc>::deallocate(alloc, ptr, 1);
+        return;
+    }
+    BlockAlloc block_alloc;
+    block->~ContainerHeader();
+    std::allocator_traits<BlockAlloc>::deallocate(block_alloc, block, block_size<T>());
+}
+
+// 内存块按 ContainerHeader 的个数申请，容器紧跟在 ContainerHeader 之后
+template <typename Traits>
+template <typename T>
+T *basic_json<Traits>::relocate(T *container) {
+    typedef typename std::allocator_traits<typename Traits::allocator_type>::template rebind_alloc<T> Alloc;
+    typedef typename std::allocator_traits<typename Traits::allocator_type>::template rebind_alloc<ContainerHeader> BlockAlloc;
+    Alloc alloc;
+    BlockAlloc block_alloc;
+    ContainerHeader *block = std::allocator_traits<BlockAlloc>::allocate(block_alloc, block_size<T>());
+    new (block) ContainerHeader();
+    T *moved = reinterpret_cast<T *>(block + 1);
+    MY_JSON_TRY {
+        std::allocator_traits<Alloc>::construct(alloc, moved, std::move(*container));
+    } MY_JSON_CATCH_ALL {
+        block->~ContainerHeader();
+        std::allocator_traits<BlockAlloc>::deallocate(block_alloc, block, block_size<T>());
+        MY_JSON_RETHROW;
+    }
+    destroy(container, nullptr);
+    return moved;
+}
+
+template <typename Traits>
+template <typename T>
+std::size_t basic_json<Traits>::block_size() {
+    return 1 + (sizeof(T) + sizeof(ContainerHeader) - 1) / sizeof(ContainerHeader);
+}
+
+template <typename Traits>
+std::uint64_t basic_json<Traits>::hash_mix(std::uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    value ^= value >> 33;
+    return value;
+}
+
+template <typename Traits>
+std::uint64_t basic_json<Traits>::hash_bytes(const char *data, std::size_t size, std::uint64_t seed) {
+    std::uint64_t hash = seed ^ (size * 0x9e3779b97f4a7c15ULL);
+    std::size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        std::uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        hash = (hash ^ hash_mix(word)) * 0x9e3779b97f4a7c15ULL;
+    }
+    if (i < size) {
+        std::uint64_t word = 0;
+        std::memcpy(&word, data + i, size - i);
+        hash = (hash ^ hash_mix(word)) * 0x9e3779b97f4a7c15ULL;
+    }
+    return hash_mix(hash);
+}
+
+// 对象成员的哈希相加，与顺序无关；-0.0 与 0.0 相等，因此哈希也相同
+// memo 不为空时记录容器的哈希，同一个节点只计算一次
+template <typename Traits>
+std::uint64_t basic_json<Traits>::hash_node(const basic_json &json, std::uint64_t seed, std::unordered_map<const basic_json *, std::uint64_t> *memo) {
+    std::uint64_t type_seed = hash_mix(seed + 0x9e3779b97f4a7c15ULL * (json.type() + 1));
+    switch (json.type()) {
+    case json_bool:
+        return hash_mix(type_seed ^ json.payload().data_bool);
+    case json_int: {
+        // 原文与解码后的值相等时哈希也相同；超出 int64 的整数按 uint64 或原文计算
+        std::size_t size = 0;
+        const char *text = json.raw_text(size);
+        std::int64_t number = json.payload().data_int;
+        std::uint64_t unsigned_number;
+        if (text == nullptr || parse_int64(text, size, number))
+            return hash_mix(type_seed ^ static_cast<std::uint64_t>(number));
+        if (parse_uint64(text, size, unsigned_number))
+            return hash_mix(type_seed ^ unsigned_number);
+        return hash_bytes(text, size, type_seed);
+    }
+    case json_double: {
+        double number = json.get_double();
+        number = number == 0 ? 0 : number;
+        std::uint64_t bits;
+        std::memcpy(&bits, &number, 8);
+        return hash_mix(type_seed ^ bits);
+    }
+    case json_string: {
+        if (!(json.flags() & flag_escaped))
+            return hash_bytes(json.payload().data_string->data(), json.payload().data_string->size(), type_seed);
+        string_type str = json.get_string();
+        return hash_bytes(str.data(), str.size(), type_seed);
+    }
+    case json_array:
+    case json_object:
+        break;
+    default:
+        return type_seed;
+    }
+    const std::uint64_t *cached = json.hash_cache();
+    if (seed == 0 && cached != nullptr)
+        return *cached;
+    if (memo != nullptr) {
+        auto iter = memo->find(&json);
+        if (iter != memo->end())
+            return iter->second;
+    }
+    std::uint64_t hash = type_seed;
+    if (json.flags() & flag_packed) {
+        // 与逐个元素调用 hash_node 的结果相同
+        bool real = (json.flags() & flag_packed_double) != 0;
+        std::uint64_t element_seed = hash_mix(seed + 0x9e3779b97f4a7c15ULL * ((real ? json_double : json_int) + 1));
+        std::size_t count = json.packed_size();
+        for (std::size_t i = 0; i < count; i++) {
+            std::uint64_t bits;
+            if (real) {
+                double number = (*json.payload().data_doubles)[i];
+                number = number == 0 ? 0 : number;
+                std::memcpy(&bits, &number, 8);
+            } else
+                bits = static_cast<std::uint64_t>((*json.payload().data_ints)[i]);
+            hash = (hash ^ hash_mix(element_seed ^ bits)) * 0x9e3779b97f4a7c15ULL;
+        }
+        hash = hash_mix(hash ^ count);
+    } else if (json.is_array()) {
+        for (const auto &i : *json.payload().data_array)
+            hash = (hash ^ hash_node(i, seed, memo)) * 0x9e3779b97f4a7c15ULL;
+        hash = hash_mix(hash ^ json.payload().data_array->size());
+    } else {
+        std::uint64_t sum = 0;
+        for (const auto &i : *json.payload().data_object)
+            sum += hash_mix(hash_bytes(i.first.data(), i.first.size(), type_seed) ^ (hash_node(i.second, seed, memo) * 0x9e3779b97f4a7c15ULL));
+        hash = hash_mix(hash ^ sum ^ json.payload().data_object->size());
+    }
+    if (memo != nullptr)
+        memo->emplace(&json, hash);
+    return hash;
+}
+
+// 直接追加到 str 末尾，避免为每个子节点生成临时字符串
+template <typename Traits>
+void basic_json<Traits>::dump(std::string &str, JsonStats *stats, std::uint64_t depth) const {
+    MY_JSON_STATS(std::size_t capacity = str.capacity();)
+    MY_JSON_STATS(stats->nodes[this->type()]++;)
+    MY_JSON_STATS(if ((this->type() == json_array || this->type() == json_object) && depth + 1 > stats->max_depth) stats->max_depth = depth + 1;)
+    switch (this->type()) {
+    case json_null:
+        str += "null";
+        break;
+    case json_bool:
+        str += payload().data_bool ? "true" : "false";
+        break;
+    case json_int:
+    case json_double: {
+        std::size_t size = 0;
+        const char *text = this->raw_text(size);
+        if (text != nullptr)
+            str.append(text, size);
+        else if (this->type() == json_int)
+            str += std::to_string(payload().data_int);
+        else
+            str += std::to_string(payload().data_double);
+        break;
+    }
+    case json_string:
+        str += '"';
+        if (this->flags() & flag_escaped)
+            str.append(payload().data_string->data(), payload().data_string->size());
+        else
+            append_escaped(str, payload().data_string->data(), payload().data_string->size());
+        str += '"';
+        break;
+    case json_array:
+        if (const std::string *text = this->dump_cache()) {
+            str += *text;
+            break;
+        }
+        if (this->flags() & flag_packed) {
+            str += '[';
+            for (std::size_t i = 0; i < this->packed_size(); i++) {
+                str += this->flags() & flag_packed_double ? std::to_string((*payload().data_doubles)[i]) : std::to_string((*payload().data_ints)[i]);
+                str += ',';
+            }
+            if (this->packed_size() != 0)
+                str.pop_back();
+            str += ']';
+            break;
+        }
+        str += '[';
+        for (const auto &i : *payload().data_array) {
+            i.dump(str, stats, depth + 1);
+            str += ',';
+        }
+        if (!payload().data_array->empty())
+            str.pop_back();
+        str += ']';
+        break;
+    case json_object:
+        if (const std::string *text = this->dump_cache()) {
+            str += *text;
+            break;
+        }
+        str += '{';
+        for (const auto &i : *payload().data_object) {
+            str += '"';
+            append_escaped(str, i.first.data(), i.first.size());
+            str += "\":";
+            i.second.dump(str, stats, depth + 1);
+            str += ',';
+        }
+        if (!payload().data_object->empty())
+            str.pop_back();
+        str += '}';
+        break;
+    default:
+        break;
+    }
+    MY_JSON_STATS(stats->allocations += str.capacity() != capacity;)
+}
+
+// 共享的值只增加引用计数
+template <typename Traits>
+void basic_json<Traits>::copy(const basic_json &other) {
+    Type type = other.type();
+    std::uint8_t flags = other.flags();
+    Value data = other.payload();
+    ContainerHeader *block = other.header();
+    if (block != nullptr && block->shares != 0) {
+        block->shares++;
+        this->store(type, flags & (flag_header | flag_escaped), data);
+        return;
+    }
+    switch (type) {
+    case json_int:
+    case json_double:
+        if (flags & flag_raw_heap)
+            this->store(type, flags & (flag_raw_number | flag_raw_heap), create<string_type>(*data.data_string));
+        else
+            this->store(type, flags & flag_raw_number, data);
+        break;
+    case json_string:
+        this->store(type, flags & flag_escaped, create<string_type>(*data.data_string));
+        break;
+    case json_array:
+        if (flags & flag_packed_double)
+            this->store(type, flags & (flag_packed | flag_packed_double), create<PackedBuffer<double>>(*data.data_doubles));
+        else if (flags & flag_packed)
+            this->store(type, flag_packed, create<PackedBuffer<std::int64_t>>(*data.data_ints));
+        else
+            this->store(type, 0, create<array_type>(*data.data_array));
+        break;
+    case json_object:
+        this->store(type, 0, create<object_type>(*data.data_object));
+        break;
+    default:
+        this->store(type, 0, data);
+        break;
+    }
+}
+
+// 输入提前结束时抛出 runtime_error，其余错误抛出 logic_error，信息中带有出错的字节偏移
+template <typename Traits>
+void basic_json<Traits>::throw_error(const JsonError &error) {
+    std::string message = std::string(error.message()) + " at offset " + std::to_string(error.offset);
+    if (error.code == JsonError::unexpected_end)
+        MY_JSON_THROW(std::runtime_error(message));
+    MY_JSON_THROW(std::logic_error(message));
+}
+
+template <typename Traits>
+const basic_json<Traits> *basic_json<Traits>::find_member(const char *key, std::size_t size) const {
+    if (!this->is_object())
+        return nullptr;
+    auto iter = find_key(*payload().data_object, key, size, 0);
+    return iter == payload().data_object->end() ? nullptr : &iter->second;
+}
+
+template <typename Traits>
+const basic_json<Traits> &basic_json<Traits>::at_member(const char *key, std::size_t size) const {
+    if (!this->is_object())
+        MY_JSON_THROW(std::logic_error("function Json::at: type error"));
+    const basic_json *member = this->find_member(key, size);
+    if (member == nullptr)
+        MY_JSON_THROW(std::out_of_range("function Json::at: key not found " + std::string(key, size)));
+    return *member;
+}
+
+#ifdef MY_JSON_STRING_VIEW
+// 比较器带有 is_transparent 时 object_type::find 接受 std::string_view，不需要构造临时的 key
+template <typename Traits>
+template <typename Object>
+auto basic_json<Traits>::find_key(const Object &object, const char *key, std::size_t size, int) -> decltype(object.find(std::string_view(key, size))) {
+    return object.find(std::string_view(key, size));
+}
+#endif
+
+template <typename Traits>
+template <typename Object>
+typename Object::const_iterator basic_json<Traits>::find_key(const Object &object, const char *key, std::size_t size, long) {
+    return object.find(string_type(key, size));
+}
+
+template <typename Traits>
+basic_json<Traits> basic_json<Traits>::from_raw_number(Type type, const char *text, std::size_t size) {
+    // 紧凑布局没有位置保存内联的原文
+    basic_json number;
+    Value data;
+    if (compact_layout || size > sizeof(data.data_raw)) {
+        number.store(type, flag_raw_number | flag_raw_heap, create<string_type>(text, size));
+    } else {
+        std::memset(data.data_raw, 0, sizeof(data.data_raw));
+        std::memcpy(data.data_raw, text, size);
+        number.store(type, flag_raw_number, data);
+    }
+    return number;
+}
+
+// 能否不保存原文、直接保存在节点中
+template <typename Traits>
+bool basic_json<Traits>::inline_int(std::int64_t number) {
+    return number >= -Storage::int_max - 1 && number <= Storage::int_max;
+}
+
+// 超出内联范围时与解析的结果一样保存原文
+template <typename Traits>
+basic_json<Traits> basic_json<Traits>::from_int64(std::int64_t number) {
+    basic_json json;
+    if (inline_int(number)) {
+        json.store(json_int, 0, Value(number));
+        return json;
+    }
+    std::string text = std::to_string(number);
+    return from_raw_number(json_int, text.data(), text.size());
+}
+
+template <typename Traits>
+basic_json<Traits> basic_json<Traits>::from_uint64(std::uint64_t number) {
+    if (number <= static_cast<std::uint64_t>(INT64_MAX))
+        return from_int64(static_cast<std::int64_t>(number));
+    std::string text = std::to_string(number);
+    return from_raw_number(json_int, text.data(), text.size());
+}
+
+// 没有保存原文时返回 nullptr
+template <typename Traits>
+const char *basic_json<Traits>::raw_text(std::size_t &size) const {
+    if (!(this->flags() & flag_raw_number))
+        return nullptr;
+    if (this->flags() & flag_raw_heap) {
+        size = payload().data_string->size();
+        return payload().data_string->data();
+    }
+    const char *text = storage.inline_text();
+    size = std::find(text, text + sizeof(Value().data_raw), '\0') - text;
+    return text;
+}
+
+// 整数先按 int64 比较，再按 uint64 比较，都超出范围时比较原文
+template <typename Traits>
+bool basic_json<Traits>::number_equal(const basic_json &other) const {
+    if (this->type() == json_double)
+        return this->get_double() == other.get_double();
+    std::size_t size = 0, other_size = 0;
+    const char *text = this->raw_text(size), *other_text = other.raw_text(other_size);
+    std::int64_t number = payload().data_int, other_number = other.payload().data_int;
+    bool exact = text == nullptr || parse_int64(text, size, number);
+    bool other_exact = other_text == nullptr || parse_int64(other_text, other_size, other_number);
+    if (exact || other_exact)
+        return exact && other_exact && number == other_number;
+    std::uint64_t unsigned_number = 0, other_unsigned_number = 0;
+    exact = parse_uint64(text, size, unsigned_number);
+    other_exact = parse_uint64(other_text, other_size, other_unsigned_number);
+    if (exact || other_exact)
+        return exact && other_exact && unsigned_number == other_unsigned_number;
+    return size == other_size && std::memcmp(text, other_text, size) == 0;
+}
+
+// text 为合法的 JSON 数字，超出范围时返回 false
+template <typename Traits>
+bool basic_json<Traits>::parse_int64(const char *text, std::size_t size, std::int64_t &value) {
+    bool negative = size != 0 && text[0] == '-';
+    std::uint64_t number;
+    if (!parse_uint64(text + negative, size - negative, number))
+        return false;
+    if (number > static_cast<std::uint64_t>(INT64_MAX) + negative)
+        return false;
+    value = negative ? static_cast<std::int64_t>(0 - number) : static_cast<std::int64_t>(number);
+    return true;
+}
+
+template <typename Traits>
+bool basic_json<Traits>::parse_uint64(const char *text, std::size_t size, std::uint64_t &value) {
+    if (size == 0 || size > 20)
+        return false;
+    value = 0;
+    for (std::size_t i = 0; i < size; i++) {
+        unsigned digit = text[i] - '0';
+        if (digit > 9 || value > (UINT64_MAX - digit) / 10)
+            return false;
+        value = value * 10 + digit;
+    }
+    return true;
+}
+
+// 结果为无穷大（超出 double 的范围）时返回 false，value 仍为 strtod 的结果
+template <typename Traits>
+bool basic_json<Traits>::parse_double(const char *text, std::size_t size, double &value) {
+    char buffer[64];
+    if (size < sizeof(buffer)) {
+        std::memcpy(buffer, text, size);
+        buffer[size] = '\0';
+        value = std::strtod(buffer, nullptr);
+    } else
+        value = std::strtod(std::string(text, size).c_str(), nullptr);
+    return value != HUGE_VAL && value != -HUGE_VAL;
+}
+
+// 不是十六进制数字时返回 -1
+template <typename Traits>
+int basic_json<Traits>::hex_digit(char ch) {
+    if (ch >= '0' && ch <= '9')
+        return ch - '0';
+    if (ch >= 'a' && ch <= 'f')
+        return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F')
+        return ch - 'A' + 10;
+    return -1;
+}
+
+// text 为已经检查过的转义后的原文，解码结果以 UTF-8 追加到 str
+// \u 转义按 UTF-16 处理，成对的代理项合并为一个字符，孤立的代理项替换为 U+FFFD
+template <typename Traits>
+void basic_json<Traits>::unescape(const char *text, std::size_t size, string_type &str) {
+    const char *end = text + size;
+    str.reserve(str.size() + size);
+    while (text != end) {
+        const char *escape = std::find(text, end, '\\');
+        str.append(text, escape - text);
+        if (escape == end)
+            break;
+        text = escape + 2;
+        switch (escape[1]) {
+        case 'b':
+            str += '\b';
+            break;
+        case 'f':
+            str += '\f';
+            break;
+        case 'n':
+            str += '\n';
+            break;
+        case 'r':
+            str += '\r';
+            break;
+        case 't':
+            str += '\t';
+            break;
+        case 'u': {
+            std::uint32_t code = 0;
+            for (int i = 0; i < 4; i++)
+                code = code << 4 | hex_digit(text[i]);
+            text += 4;
+            if (code >= 0xD800 && code < 0xDC00 && end - text >= 6 && text[0] == '\\' && text[1] == 'u') {
+                std::uint32_t low = 0;
+                for (int i = 2; i < 6; i++)
+                    low = low << 4 | hex_digit(text[i]);
+                if (low >= 0xDC00 && low < 0xE000) {
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    text += 6;
+                }
+            }
+            if (code >= 0xD800 && code < 0xE000)
+                code = 0xFFFD;
+            if (code < 0x80)
+                str += static_cast<char>(code);
+            else if (code < 0x800) {
+                str += static_cast<char>(0xC0 | code >> 6);
+                str += static_cast<char>(0x80 | (code & 0x3F));
+            } else if (code < 0x10000) {
+                str += static_cast<char>(0xE0 | code >> 12);
+                str += static_cast<char>(0x80 | (code >> 6 & 0x3F));
+                str += static_cast<char>(0x80 | (code & 0x3F));
+            } else {
+                str += static_cast<char>(0xF0 | code >> 18);
+                str += static_cast<char>(0x80 | (code >> 12 & 0x3F));
+                str += static_cast<char>(0x80 | (code >> 6 & 0x3F));
+                str += static_cast<char>(0x80 | (code & 0x3F));
+            }
+            break;
+        }
+        default: // '"'、'\\' 与 '/'
+            str += escape[1];
+            break;
+        }
+    }
+}
+
+// 转义 '"'、'\\' 与控制字符，其余字符（包括 UTF-8 的多字节字符）原样输出
+template <typename Traits>
+void basic_json<Traits>::append_escaped(std::string &str, const char *data, std::size_t size) {
+    static const char hex[] = "0123456789abcdef";
+    const char *end = data + size;
+    while (data != end) {
+        const char *next = data;
+        while (next != end && *next != '"' && *next != '\\' && static_cast<unsigned char>(*next) >= 0x20)
+            next++;
+        str.append(data, next - data);
+        if (next == end)
+            break;
+        switch (*next) {
+        case '"':
+            str += "\\\"";
+            break;
+        case '\\':
+            str += "\\\\";
+            break;
+        case '\b':
+            str += "\\b";
+            break;
+        case '\f':
+            str += "\\f";
+            break;
+        case '\n':
+            str += "\\n";
+            break;
+        case '\r':
+            str += "\\r";
+            break;
+        case '\t':
+            str += "\\t";
+            break;
+        default:
+            str += "\\u00";
+            str += hex[*next >> 4];
+            str += hex[*next & 0xF];
+            break;
+        }
+        data = next + 1;
+    }
+}
+
+// p 指向一个非 ASCII 字节，返回从 p 开始的 UTF-8 字符的字节数；编码不合法（包括过长编码、代理项与超出 U+10FFFF）时返回 0
+template <typename Traits>
+std::size_t basic_json<Traits>::utf8_length(const char *p, const char *end) {
+    unsigned char lead = p[0];
+    std::size_t length;
+    if (lead >= 0xC2 && lead <= 0xDF)
+        length = 2;
+    else if (lead >= 0xE0 && lead <= 0xEF)
+        length = 3;
+    else if (lead >= 0xF0 && lead <= 0xF4)
+        length = 4;
+    else
+        return 0;
+    if (static_cast<std::size_t>(end - p) < length)
+        return 0;
+    for (std::size_t i = 1; i < length; i++)
+        if ((static_cast<unsigned char>(p[i]) & 0xC0) != 0x80)
+            return 0;
+    unsigned char next = p[1];
+    if ((lead == 0xE0 && next < 0xA0) || (lead == 0xED && next >= 0xA0) || (lead == 0xF0 && next < 0x90) || (lead == 0xF4 && next >= 0x90))
+        return 0;
+    return length;
+}
+
+// mask 不为 0，返回最低的置位的位置
+template <typename Traits>
+unsigned basic_json<Traits>::lowest_bit(unsigned mask) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctz(mask);
+#elif defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    unsigned index = 0;
+    for (; !(mask & 1); mask >>= 1)
+        index++;
+    return index;
+#endif
+}
+
+// p 指向字符串开头引号之后，返回结尾引号的位置；出错时 code 不为 ok，返回值为出错的位置
+template <typename Traits>
+const char *basic_json<Traits>::find_string_end(const char *p, const char *end, bool &escaped, JsonError::Code &code) {
+    escaped = false;
+    code = JsonError::ok;
+#ifdef MY_JSON_SSE2
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i space = _mm_set1_epi8(' ');
+#endif
+    while (true) {
+#ifdef MY_JSON_SSE2
+        // 按有符号比较时，控制字符与非 ASCII 字节都小于 ' '，去掉最高位为 1 的字节后只剩控制字符
+        while (end - p >= 16) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+            unsigned high = _mm_movemask_epi8(chunk);
+            unsigned stop = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash))) |
+                            (_mm_movemask_epi8(_mm_cmplt_epi8(chunk, space)) & ~high);
+            if ((stop | high) == 0) {
+                p += 16;
+                continue;
+            }
+            // 第一个引号、反斜杠或控制字符之前的非 ASCII 字符在块内逐个校验，其间的 ASCII 字节按掩码跳过，之后从字符的下一个字节继续按 16 字节检查
+            // 续字节不会是引号、反斜杠或控制字符，合法的字符不会越过 stop 的位置
+            unsigned limit = stop != 0 ? lowest_bit(stop) : 16;
+            const char *next = p + limit;
+            while (high != 0 && lowest_bit(high) < limit) {
+                unsigned offset = lowest_bit(high);
+                std::size_t length = utf8_length(p + offset, end);
+                if (length == 0) {
+                    code = JsonError::invalid_utf8;
+                    return p + offset;
+                }
+                high = offset + length >= 16 ? 0 : high & ~((1u << (offset + length)) - 1);
+                if (p + offset + length > next)
+                    next = p + offset + length;
+            }
+            p = next;
+            if (stop != 0)
+                break;
+        }
+#endif
+        if (p == end) {
+            code = JsonError::unexpected_end;
+            return p;
+        }
+        unsigned char ch = *p;
+        if (ch == '"')
+            return p;
+        if (ch == '\\') {
+            escaped = true;
+            if (end - p < 2) {
+                code = JsonError::unexpected_end;
+                return end;
+            }
+            switch (p[1]) {
+            case '"':
+            case '\\':
+            case '/':
+            case 'b':
+            case 'f':
+            case 'n':
+            case 'r':
+            case 't':
+                p += 2;
+                break;
+            case 'u':
+                for (int i = 2; i < 6; i++) {
+                    if (p + i == end) {
+                        code = JsonError::unexpected_end;
+                        return end;
+                    }
+                    if (hex_digit(p[i]) < 0) {
+                        code = JsonError::invalid_escape;
+                        return p;
+                    }
+                }
+                p += 6;
+                break;
+            default:
+                code = JsonError::invalid_escape;
+                return p;
+            }
+        } else if (ch < 0x20) {
+            code = JsonError::unexpected_character;
+            return p;
+        } else if (ch < 0x80)
+            p++;
+        else {
+            std::size_t length = utf8_length(p, end);
+            if (length == 0) {
+                code = JsonError::invalid_utf8;
+                return p;
+            }
+            p += length;
+        }
+    }
+}
+
+template class my_json::basic_json<JsonTraits>;
+
+const char *JsonError::message() const {
+    switch (code) {
+    case ok:
+        return "ok";
+    case unexpected_end:
+        return "Unexpected end of json";
+    case unexpected_character:
+        return "Unexpected character";
+    case invalid_escape:
+        return "Invalid escape";
+    case invalid_utf8:
+        return "Invalid UTF-8";
+    case trailing_characters:
+        return "Unexpected character after json";
+    case depth_exceeded:
+        return "Maximum depth exceeded";
+    case too_many_nodes:
+        return "Too many nodes";
+    case string_too_long:
+        return "String too long";
+    case container_too_large:
+        return "Container too large";
+    case memory_exceeded:
+        return "Memory limit exceeded";
+    default:
+        return "Unknown error";
+    }
+}
+
+JsonProjection::JsonProjection() {
+    this->clear();
+}
+
+JsonProjection::JsonProjection(std::initializer_list<std::string> pointers) {
+    this->clear();
+    for (const auto &i : pointers)
+        this->add(i);
+}
+
+void JsonProjection::add(const std::string &pointer) {
+    std::vector<std::string> path;
+    if (!pointer.empty()) {
+        if (pointer[0] != '/')
+            MY_JSON_THROW(std::logic_error("function JsonProjection::add: invalid json pointer " + pointer));
+        std::string token;
+        for (std::size_t i = 1; i <= pointer.size(); i++) {
+            if (i == pointer.size() || pointer[i] == '/') {
+                path.push_back(std::move(token));
+                token.clear();
+            } else if (pointer[i] == '~') {
+                if (i + 1 < pointer.size() && pointer[i + 1] == '0')
+                    token += '~';
+                else if (i + 1 < pointer.size() && pointer[i + 1] == '1')
+                    token += '/';
+                else
+                    MY_JSON_THROW(std::logic_error("function JsonProjection::add: invalid json pointer " + pointer));
+                i++;
+            } else
+                token += pointer[i];
+        }
+    }
+    this->insert(path);
+    this->expand(0);
+}
+
+void JsonProjection::clear() {
+    nodes.clear();
+    nodes.push_back(Node{std::string(), npos, false, npos, std::vector<std::size_t>()});
+}
+
+std::size_t JsonProjection::member(std::size_t node, const char *key, std::size_t size) const {
+    const Node &parent = nodes[node];
+    for (std::size_t i : parent.children) {
+        const std::string &name = nodes[i].key;
+        if (name.size() == size && std::memcmp(name.data(), key, size) == 0)
+            return i;
+    }
+    return parent.wildcard;
+}
+
+std::size_t JsonProjection::element(std::size_t node, std::size_t index) const {
+    const Node &parent = nodes[node];
+    for (std::size_t i : parent.children) {
+        if (nodes[i].index == index)
+            return i;
+    }
+    return parent.wildcard;
+}
+
+// 找到或创建名为 key 的子节点；complete 的节点不再需要子节点
+std::size_t JsonProjection::child(std::size_t node, const std::string &key) {
+    if (key == "*" && nodes[node].wildcard != npos)
+        return nodes[node].wildcard;
+    for (std::size_t i : nodes[node].children) {
+        if (nodes[i].key == key)
+            return i;
+    }
+    std::size_t index = npos;
+    if (!key.empty() && key.size() < 20 && (key[0] != '0' || key.size() == 1) && key.find_first_not_of("0123456789") == std::string::npos)
+        index = std::stoull(key);
+    std::size_t id = nodes.size();
+    nodes.push_back(Node{key, index, false, npos, std::vector<std::size_t>()});
+    if (key == "*")
+        nodes[node].wildcard = id;
+    else
+        nodes[node].children.push_back(id);
+    return id;
+}
+
+// 按原样插入路径，"*" 作为普通的子节点保存，之后由 expand 合并到同级的其他子节点中
+void JsonProjection::insert(const std::vector<std::string> &path) {
+    std::size_t node = 0;
+    for (const auto &i : path) {
+        if (nodes[node].complete)
+            return;
+        node = this->child(node, i);
+    }
+    nodes[node].complete = true;
+    nodes[node].children.clear();
+    nodes[node].wildcard = npos;
+}
+
+// 把 source 子树中选中的路径并入 target
+void JsonProjection::merge(std::size_t target, std::size_t source) {
+    if (nodes[target].complete)
+        return;
+    if (nodes[source].complete) {
+        nodes[target].complete = true;
+        nodes[target].children.clear();
+        nodes[target].wildcard = npos;
+        return;
+    }
+    // 合并过程中 nodes 可能扩容，不能持有元素的引用
+    std::vector<std::size_t> children = nodes[source].children;
+    if (nodes[source].wildcard != npos)
+        children.push_back(nodes[source].wildcard);
+    for (std::size_t i : children) {
+        std::string key = nodes[i].key;
+        this->merge(this->child(target, key), i);
+    }
+}
+
+// "*" 匹配的路径同样适用于明确写出的同级成员，例如 "/*/a" 与 "/x/b" 同时选中 x 的 a 与 b
+void JsonProjection::expand(std::size_t node) {
+    std::size_t wildcard = nodes[node].wildcard;
+    for (std::size_t i = 0; i < nodes[node].children.size(); i++) {
+        std::size_t child = nodes[node].children[i];
+        if (wildcard != npos)
+            this->merge(child, wildcard);
+        this->expand(child);
+    }
+    if (wildcard != npos)
+        this->expand(wildcard);
+}
+
+const JsonColumn *JsonColumns::find(const std::string &name) const {
+    for (const auto &i : columns) {
+        if (i.name == name)
+            return &i;
+    }
+    return nullptr;
+}
+
+JsonView::JsonView() : base(nullptr), offset(0) {}
+
+JsonView::JsonView(const char *base, std::uint64_t offset) : base(base), offset(offset) {}
+
+Json::Type JsonView::type() const {
+    if (base == nullptr)
+        return Json::json_null;
+    std::uint32_t tag;
+    std::memcpy(&tag, base + offset, 4);
+    return static_cast<Json::Type>(tag);
+}
+
+bool JsonView::is_null() const {
+    return this->type() == Json::json_null;
+}
+
+bool JsonView::is_bool() const {
+    return this->type() == Json::json_bool;
+}
+
+bool JsonView::is_int() const {
+    return this->type() == Json::json_int;
+}
+
+bool JsonView::is_double() const {
+    return this->type() == Json::json_double;
+}
+
+bool JsonView::is_string() const {
+    return this->type() == Json::json_string;
+}
+
+bool JsonView::is_array() const {
+    return this->type() == Json::json_array;
+}
+
+bool JsonView::is_object() const {
+    return this->type() == Json::json_object;
+}
+
+bool JsonView::get_bool() const {
+    if (this->is_bool())
+        return this->aux() != 0;
+    MY_JSON_THROW(std::logic_error("function JsonView::get_bool: type error"));
+}
+
+int JsonView::get_int() const {
+    if (this->is_int()) {
+        if (this->aux() == JsonView::int_signed) {
+            std::int64_t number = this->get_int64();
+            if (number >= INT_MIN && number <= INT_MAX)
+                return static_cast<int>(number);
+        }
+        MY_JSON_THROW(std::out_of_range("function JsonView::get_int: number out of range"));
+    }
+    MY_JSON_THROW(std::logic_error("function JsonView::get_int: type error"));
+}
+
+std::int64_t JsonView::get_int64() const {
+    if (this->is_int()) {
+        if (this->aux() == JsonView::int_signed) {
+            std::int64_t number;
+            std::memcpy(&number, this->payload(), sizeof(number));
+            return number;
+        }
+        MY_JSON_THROW(std::out_of_range("function JsonView::get_int64: number out of range"));
+    }
+    MY_JSON_THROW(std::logic_error("function JsonView::get_int64: type error"));
+}
+
+std::uint64_t JsonView::get_uint64() const {
+    if (this->is_int()) {
+        if (this->aux() == JsonView::int_unsigned) {
+            std::uint64_t number;
+            std::memcpy(&number, this->payload(), sizeof(number));
+            return number;
+        }
+        if (this->aux() == JsonView::int_signed && this->get_int64() >= 0)
+            return static_cast<std::uint64_t>(this->get_int64());
+        MY_JSON_THROW(std::out_of_range("function JsonView::get_uint64: number out of range"));
+    }
+    MY_JSON_THROW(std::logic_error("function JsonView::get_uint64: type error"));
+}
+
+// 与 Json::get_number_text 相同，超出 uint64 范围的整数返回保存的原文
+std::string JsonView::get_number_text() const {
+    switch (this->type()) {
+    case Json::json_int:
+        if (this->aux() == JsonView::int_signed)
+            return std::to_string(this->get_int64());
+        if (this->aux() == JsonView::int_unsigned)
+            return std::to_string(this->get_uint64());
+        return std::string(this->payload());
+    case Json::json_double:
+        return std::to_string(this->get_double());
+    default:
+        break;
+    }
+    MY_JSON_THROW(std::logic_error("function JsonView::get_number_text: type error"));
+}
+
+double JsonView::get_double() const {
+    if (this->is_double()) {
+        double value;
+        std::memcpy(&value, this->payload(), sizeof(double));
+        return value;
+    }
+    MY_JSON_THROW(std::logic_error("function JsonView::get_double: type error"));
+}
+
+std::string JsonView::get_string() const {
+    if (this->is_string())
+        return std::string(this->payload(), this->aux());
+    MY_JSON_THROW(std::logic_error("function JsonView::get_string: type error"));
+}
+
+std::vector<JsonView> JsonView::get_array() const {
+    if (this->is_array()) {
+        std::vector<JsonView> array;
+        int size = this->size();
+        array.reserve(size);
+        for (int i = 0; i < size; i++)
+            array.push_back((*this)[i]);
+        return array;
+    }
+    MY_JSON_THROW(std::logic_error("function JsonView::get_array: type error"));
+}
+
+std::map<std::string, JsonView> JsonView::get_object() const {
+    if (this->is_object()) {
+        std::map<std::string, JsonView> object;
+        const char *members = this->payload();
+        std::uint32_t size = this->aux();
+        for (std::uint32_t i = 0; i < size; i++) {
+            std::uint64_t member[2];
+            std::memcpy(member, members + i * 16, 16);
+            object.emplace_hint(object.end(), JsonView(base, member[0]).get_string(), JsonView(base, member[1]));
+        }
+        return object;
+    }
+    MY_JSON_THROW(std::logic_error("function JsonView::get_object: type error"));
+}
+
+const char *JsonView::c_str() const {
+    if (this->is_string())
+        return this->payload();
+    MY_JSON_THROW(std::logic_error("function JsonView::c_str: type error"));
+}
+
+std::size_t JsonView::length() const {
+    if (this->is_string())
+        return this->aux();
+    MY_JSON_THROW(std::logic_error("function JsonView::length: type error"));
+}
+
+int JsonView::size() const {
+    switch (this->type()) {
+    case Json::json_array:
+    case Json::json_object:
+        return this->aux();
+    default:
+        break;
+    }
+    MY_JSON_THROW(std::logic_error("function JsonView::size: this json object is not array or map,cam't get size"));
+}
+
+bool JsonView::empty() const {
+    switch (this->type()) {
+    case Json::json_null:
+        return true;
+    case Json::json_array:
+    case Json::json_object:
+        return this->aux() == 0;
+    default:
+        break;
+    }
+    MY_JSON_THROW(std::logic_error("function JsonView::empty: type error"));
+}
+
+std::string JsonView::to_string() const {
+    std::string str;
+    switch (this->type()) {
+    case Json::json_null:
+        str = "null";
+        break;
+    case Json::json_bool:
+        str = this->get_bool() ? "true" : "false";
+        break;
+    case Json::json_int:
+        str = this->get_number_text();
+        break;
+    case Json::json_double:
+        str = std::to_string(this->get_double());
+        break;
+    case Json::json_string:
+        str = "\"";
+        Json::append_escaped(str, this->c_str(), this->length());
+        str += "\"";
+        break;
+    case Json::json_array: {
+        str = "[";
+        int size = this->size();
+        for (int i = 0; i < size; i++)
+            str += (*this)[i].to_string() + ",";
+        if (size != 0)
+            str.pop_back();
+        str += "]";
+        break;
+    }
+    case Json::json_object: {
+        str = "{";
+        const char *members = this->payload();
+        std::uint32_t size = this->aux();
+        for (std::uint32_t i = 0; i < size; i++) {
+            std::uint64_t member[2];
+            std::memcpy(member, members + i * 16, 16);
+            str += JsonView(base, member[0]).to_string() + ":" + JsonView(base, member[1]).to_string() + ",";
+        }
+        if (size != 0)
+            str.pop_back();
+        str += "}";
+        break;
+    }
+    default:
+        break;
+    }
+    return str;
+}
+
+Json JsonView::to_json() const {
+    switch (this->type()) {
+    case Json::json_bool:
+        return Json(this->get_bool());
+    case Json::json_int: {
+        if (this->aux() == JsonView::int_signed)
+            return Json(this->get_int64());
+        if (this->aux() == JsonView::int_unsigned)
+            return Json(this->get_uint64());
+        // 超出 uint64 范围时保留原文
+        Json number;
+        number.parse(this->get_number_text());
+        return number;
+    }
+    case Json::json_double:
+        return Json(this->get_double());
+    case Json::json_string:
+        return Json(this->get_string());
+    case Json::json_array: {
+        Json array(Json::json_array);
+        int size = this->size();
+        for (int i = 0; i < size; i++)
+            array.push_back((*this)[i].to_json());
+        return array;
+    }
+    case Json::json_object: {
+        Json object(Json::json_object);
+        const char *members = this->payload();
+        std::uint32_t size = this->aux();
+        for (std::uint32_t i = 0; i < size; i++) {
+            std::uint64_t member[2];
+            std::memcpy(member, members + i * 16, 16);
+            object[JsonView(base, member[0]).get_string()] = JsonView(base, member[1]).to_json();
+        }
+        return object;
+    }
+    default:
+        break;
+    }
+    return Json();
+}
+
+bool JsonView::find(const char *key) const {
+    return this->has_key(key);
+}
+
+bool JsonView::find(const std::string &key) const {
+    return this->has_key(key);
+}
+
+bool JsonView::has_key(const char *key) const {
+    if (this->is_object())
+        return this->lookup(key, std::strlen(key)) != 0;
+    MY_JSON_THROW(std::logic_error("function JsonView::has_key: type error"));
+}
+
+bool JsonView::has_key(const std::string &key) const {
+    if (this->is_object())
+        return this->lookup(key.data(), key.size()) != 0;
+    MY_JSON_THROW(std::logic_error("function JsonView::has_key: type error"));
+}
+
+JsonView JsonView::operator[](int index) const {
+    if (this->is_array()) {
+        if (index >= 0 && static_cast<std::uint32_t>(index) < this->aux()) {
+            std::uint64_t child;
+            std::memcpy(&child, this->payload() + index * 8, 8);
+            return JsonView(base, child);
+        }
+        MY_JSON_THROW(std::out_of_range("function JsonView::operator[]: index out of range"));
+    } else
+        MY_JSON_THROW(std::logic_error("function JsonView::operator[]: type error"));
+}
+
+JsonView JsonView::operator[](const char *key) const {
+    if (this->is_object()) {
+        std::uint64_t child = this->lookup(key, std::strlen(key));
+        if (child != 0)
+            return JsonView(base, child);
+        MY_JSON_THROW(std::out_of_range("function JsonView::operator[]: key not found"));
+    } else
+        MY_JSON_THROW(std::logic_error("function JsonView::operator[]: type error"));
+}
+
+JsonView JsonView::operator[](const std::string &key) const {
+    if (this->is_object()) {
+        std::uint64_t child = this->lookup(key.data(), key.size());
+        if (child != 0)
+            return JsonView(base, child);
+        MY_JSON_THROW(std::out_of_range("function JsonView::operator[]: key not found"));
+    } else
+        MY_JSON_THROW(std::logic_error("function JsonView::operator[]: type error"));
+}
+
+JsonView::operator bool() const {
+    if (this->is_bool())
+        return this->aux() != 0;
+    else
+        MY_JSON_THROW(std::logic_error("function JsonView::operator bool(): type error"));
+}
+
+JsonView::operator int() const {
+    if (this->is_int())
+        return this->get_int();
+    else
+        MY_JSON_THROW(std::logic_error("function JsonView::operator int(): type error"));
+}
+
+JsonView::operator double() const {
+    if (this->is_double())
+        return this->get_double();
+    else
+        MY_JSON_THROW(std::logic_error("function JsonView::operator double(): type error"));
+}
+
+JsonView::operator std::string() const {
+    if (this->is_string())
+        return this->get_string();
+    else
+        MY_JSON_THROW(std::logic_error("function JsonView::operator std::string(): type error"));
+}
+
+std::uint32_t JsonView::aux() const {
+    std::uint32_t aux;
+    std::memcpy(&aux, base + offset + 4, 4);
+    return aux;
+}
+
+const char *JsonView::payload() const {
+    return base + offset + 8;
+}
+
+// 成员按 key 排序保存，二分查找，找不到时返回 0（0 处是文件头，不会是合法节点）
+std::uint64_t JsonView::lookup(const char *key, std::size_t size) const {
+    const char *members = this->payload();
+    std::uint32_t low = 0, high = this->aux();
+    while (low < high) {
+        std::uint32_t mid = low + (high - low) / 2;
+        std::uint64_t member[2];
+        std::memcpy(member, members + mid * 16, 16);
+        JsonView name(base, member[0]);
+        std::size_t length = name.aux();
+        int cmp = std::memcmp(name.payload(), key, length < size ? length : size);
+        if (cmp == 0)
+            cmp = length < size ? -1 : (length > size ? 1 : 0);
+        if (cmp == 0)
+            return member[1];
+        if (cmp < 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return 0;
+}
+
+JsonSnapshot::JsonSnapshot() : data(nullptr), length(0), root_offset(0) {
+#ifdef _WIN32
+    file_handle = nullptr;
+    mapping_handle = nullptr;
+#endif
+}
+
+JsonSnapshot::JsonSnapshot(const char *path) : JsonSnapshot() {
+    this->open(path);
+}
+
+JsonSnapshot::JsonSnapshot(const std::string &path) : JsonSnapshot() {
+    this->open(path);
+}
+
+JsonSnapshot::JsonSnapshot(JsonSnapshot &&other) : JsonSnapshot() {
+    *this = std::move(other);
+}
+
+JsonSnapshot::~JsonSnapshot() {
+    this->close();
+}
+
+JsonSnapshot &JsonSnapshot::operator=(JsonSnapshot &&other) {
+    if (this != &other) {
+        this->close();
+        data = other.data;
+        length = other.length;
+        root_offset = other.root_offset;
+        other.data = nullptr;
+        other.length = 0;
+        other.root_offset = 0;
+#ifdef _WIN32
+        file_handle = other.file_handle;
+        mapping_handle = other.mapping_handle;
+        other.file_handle = nullptr;
+        other.mapping_handle = nullptr;
+#endif
+    }
+    return *this;
+}
+
+void JsonSnapshot::open(const char *path) {
+    std::string str(path);
+    this->open(str);
+}
+
+void JsonSnapshot::open(const std::string &path) {
+    this->close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        MY_JSON_THROW(std::runtime_error("function JsonSnapshot::open: file is not open"));
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart < header_size) {
+        CloseHandle(file);
+        MY_JSON_THROW(std::runtime_error("function JsonSnapshot::open: invalid snapshot"));
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    const void *view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (view == nullptr) {
+        if (mapping)
+            CloseHandle(mapping);
+        CloseHandle(file);
+        MY_JSON_THROW(std::runtime_error("function JsonSnapshot::open: mmap failed"));
+    }
+    file_handle = file;
+    mapping_handle = mapping;
+    data = static_cast<const char *>(view);
+    length = static_cast<std::size_t>(file_size.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        MY_JSON_THROW(std::runtime_error("function JsonSnapshot::open: file is not open"));
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < header_size) {
+        ::close(fd);
+        MY_JSON_THROW(std::runtime_error("function JsonSnapshot::open: invalid snapshot"));
+    }
+    void *view = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (view == MAP_FAILED)
+        MY_JSON_THROW(std::runtime_error("function JsonSnapshot::open: mmap failed"));
+    data = static_cast<const char *>(view);
+    length = st.st_size;
+#endif
+    std::uint32_t file_version, endian;
+    std::uint64_t file_size;
+    std::memcpy(&file_version, data + 8, 4);
+    std::memcpy(&endian, data + 12, 4);
+    std::memcpy(&root_offset, data + 16, 8);
+    std::memcpy(&file_size, data + 24, 8);
+    if (std::memcmp(data, "MYJSNAP", 8) != 0 || file_version != version || endian != 0x01020304 || file_size != length || root_offset < header_size || root_offset + 8 > length) {
+        this->close();
+        MY_JSON_THROW(std::runtime_error("function JsonSnapshot::open: invalid snapshot"));
+    }
+}
+
+void JsonSnapshot::close() {
+    if (data == nullptr)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+    CloseHandle(mapping_handle);
+    CloseHandle(file_handle);
+    file_handle = nullptr;
+    mapping_handle = nullptr;
+#else
+    munmap(const_cast<char *>(data), length);
+#endif
+    data = nullptr;
+    length = 0;
+    root_offset = 0;
+}
+
+bool JsonSnapshot::is_open() const {
+    return data != nullptr;
+}
+
+std::size_t JsonSnapshot::size() const {
+    return length;
+}
+
+JsonView JsonSnapshot::root() const {
+    if (data == nullptr)
+        MY_JSON_THROW(std::logic_error("function JsonSnapshot::root: snapshot is not open"));
+    return JsonView(data, root_offset);
+}
\ No newline at end of file
@@ -1,14 +1,366 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
 #include <map>
+#include <memory>
+#include <stdexcept>
 #include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
+// 定义 MY_JSON_INSTRUMENTATION 后统计 parse 与 to_string 的调用信息，未定义时统计的代码不参与编译
+// 类的布局与宏无关（Parser 总是带有 stats 成员），但 Parser 等定义在头文件中的函数体随宏变化，
+// 因此所有包含本头文件的翻译单元必须与 Json.cpp 使用相同的定义，否则违反 ODR
+#ifdef MY_JSON_INSTRUMENTATION
+#include <chrono>
+#define MY_JSON_STATS(...) __VA_ARGS__
+#else
+#define MY_JSON_STATS(...)
+#endif
+
+// 编译时关闭了异常（-fno-exceptions）时，原本抛出异常的地方改为调用 std::abort()，
+// 此时解析请使用带 JsonError 参数的 parse，查找请使用 get_ptr
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+#define MY_JSON_THROW(...) throw __VA_ARGS__
+#define MY_JSON_TRY try
+#define MY_JSON_CATCH_ALL catch (...)
+#define MY_JSON_RETHROW throw
+#else
+#include <cstdlib>
+#define MY_JSON_THROW(...) std::abort()
+#define MY_JSON_TRY if (true)
+#define MY_JSON_CATCH_ALL else
+#define MY_JSON_RETHROW std::abort()
+#endif
+
+// 有 SSE2 时字符串每次检查 16 个字节，非 ASCII 字符在块内校验 UTF-8 后继续按块检查，只有遇到引号、反斜杠或控制字符时才逐字节处理
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MY_JSON_SSE2
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// C++17 起提供以 std::string_view 为 key 的查找
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#include <string_view>
+#define MY_JSON_STRING_VIEW
+#endif
+
+// C++20 起 JsonSpan 可以转换为 std::span
+#if __cplusplus >= 202002L || (defined(_MSVC_LANG) && _MSVC_LANG >= 202002L)
+#include <span>
+#define MY_JSON_SPAN
+#endif
+
+// C++20 起支持在编译期解析的 JSON 字面量 "..."_json，需要 constexpr 的 std::vector / std::string 与类类型的模板参数
+#if (__cplusplus >= 202002L || (defined(_MSVC_LANG) && _MSVC_LANG >= 202002L)) && defined(__cpp_nontype_template_args) && __cpp_nontype_template_args >= 201911L && defined(__cpp_lib_constexpr_vector) && defined(__cpp_lib_constexpr_string)
+#include <array>
+#include <bit>
+#define MY_JSON_LITERAL
+#endif
+
 namespace my_json {
 
-    class Json {
+    // 单次调用或累计的统计信息，时间单位为纳秒
+    // allocations 为结果中字符串、数组、对象以及它们的缓冲区申请内存的次数
+    struct JsonStats {
+        std::uint64_t parse_calls;
+        std::uint64_t parse_errors; // parse_calls 中失败的次数
+        std::uint64_t serialize_calls;
+        std::uint64_t bytes_in;
+        std::uint64_t bytes_out;
+        std::uint64_t nodes[7]; // 按 Json::Type 分类
+        std::uint64_t max_depth;
+        std::uint64_t allocations;
+        std::uint64_t read_ns;
+        std::uint64_t parse_ns;
+        std::uint64_t serialize_ns;
+    };
+
+    class JsonInstrumentation {
+    public:
+        // input 为解析的原文，序列化时为输出的文本
+        typedef std::function<void(const JsonStats &stats, const std::string &input)> Callback;
+
+        static bool enabled();
+        static JsonStats total();
+        static JsonStats last();
+        static void reset();
+
+        // 单次调用耗时不少于 threshold_ns 时调用 callback，用于采样慢文档；callback 为空时取消
+        static void set_callback(Callback callback, std::uint64_t threshold_ns);
+
+        static void record(const JsonStats &stats, const std::string &input);
+        // 只在调用 callback 时才把 input 复制为 std::string
+        static void record(const JsonStats &stats, const char *input, std::size_t size);
+        static void record_read(std::uint64_t ns);
+    
+    private:
+        struct State;
+
+        static State &state();
+    };
+
+    // basic_json 的默认策略：std::string、std::vector 与 std::map，内存来自全局堆
+    // 自定义策略需要提供同样的成员：
+    //   allocator_type 用于申请字符串、数组、对象本身以及它们的附加信息，使用时默认构造，
+    //     因此按线程或按请求区分的内存池需要由分配器自己找到对应的资源（例如 thread_local）
+    //   string_type 需要提供 std::basic_string<char> 的接口
+    //   array_type 为类似 std::vector 的顺序容器，object_type 为以 string_type 为 key 的 map，有序无序均可，
+    //     比较器支持异构查找（例如 std::less<>）时 get_ptr 与 at 不需要构造临时的 key
+    //   容器内部使用的分配器由容器类型决定，例如 std::pmr::vector
+    // Json.cpp 只实例化了默认的 Json，使用其他策略请包含 Json.hpp
+    struct JsonTraits {
+        typedef std::allocator<char> allocator_type;
+        typedef std::string string_type;
+        template <typename Json>
+        using array_type = std::vector<Json>;
+        template <typename Json>
+        using object_type = std::map<std::string, Json>;
+    };
+
+    // 与 JsonTraits 相同，但节点使用 8 字节的紧凑布局，见 basic_json::CompactStorage；Json.cpp 没有实例化，使用时请包含 Json.hpp
+    // 自定义策略中定义 static const bool compact_layout = true 即可使用紧凑布局，没有该成员时使用默认的 16 字节布局
+    struct JsonCompactTraits : JsonTraits {
+        static const bool compact_layout = true;
+    };
+
+    template <typename Traits, typename = void>
+    struct JsonCompactLayout : std::false_type {};
+
+    template <typename Traits>
+    struct JsonCompactLayout<Traits, typename std::enable_if<Traits::compact_layout>::type> : std::true_type {};
+
+    // 校验失败的原因，offset 为出错处相对于输入起始的字节偏移
+    struct JsonError {
+        enum Code {
+            ok = 0,
+            unexpected_end,
+            unexpected_character,
+            invalid_escape,
+            invalid_utf8,
+            trailing_characters,
+            depth_exceeded,
+            too_many_nodes,
+            string_too_long,
+            container_too_large,
+            memory_exceeded
+        };
+
+        constexpr JsonError() : code(ok), offset(0) {}
+        constexpr JsonError(Code code, std::size_t offset) : code(code), offset(offset) {}
+
+        const char *message() const;
+
+        Code code;
+        std::size_t offset;
+    };
+
+    // 解析时的投影：只构建给定 JSON Pointer 指向的子树及其祖先，其余的值只检查括号与引号是否匹配后跳过，不解码也不分配内存
+    // 路径中的 "*" 匹配对象的任意成员或数组的任意元素；数组中跳过的元素以 null 占位，保持下标不变
+    // 空字符串 "" 选中整个文档；通过 JsonParseOptions::projection 传给 parse，解析期间需要保持有效
+    class JsonProjection {
+    public:
+        static const std::size_t npos = static_cast<std::size_t>(-1);
+
+        JsonProjection();
+        JsonProjection(std::initializer_list<std::string> pointers);
+        ~JsonProjection(){};
+
+        void add(const std::string &pointer);
+        void clear();
+
+        // 以下供解析器使用：节点 0 为根，返回 npos 表示该成员或元素没有被选中
+        std::size_t member(std::size_t node, const char *key, std::size_t size) const;
+        std::size_t element(std::size_t node, std::size_t index) const;
+        // 节点的整个子树都被选中
+        bool complete(std::size_t node) const {
+            return nodes[node].complete;
+        }
+
+    private:
+        // index 为 key 作为数组下标时的值，不是下标时为 npos；wildcard 为 "*" 子节点
+        struct Node {
+            std::string key;
+            std::size_t index;
+            bool complete;
+            std::size_t wildcard;
+            std::vector<std::size_t> children;
+        };
+
+        std::size_t child(std::size_t node, const std::string &key);
+        void insert(const std::vector<std::string> &path);
+        void merge(std::size_t target, std::size_t source);
+        void expand(std::size_t node);
+
+        std::vector<Node> nodes;
+    };
+
+    // lazy_numbers: 数字只保存原文，读取时才解码为 int、int64、uint64 或 double，未修改的数字序列化时原样输出
+    // lazy_strings: 含有转义的字符串值保存转义后的原文，读取时才解码，序列化时原样输出；key 总是立即解码
+    // pack_numbers: 元素全部为整数或全部为浮点数的数组保存为 packed 数组，见 basic_json::pack；与 lazy_numbers 同时使用时只打包能按原样输出的数字
+    // 以下为处理不可信输入时的资源限制，0 表示不限制，超出时解析失败并返回对应的错误码：
+    //   max_depth: 数组与对象的最大嵌套层数，默认为 default_max_depth；解析与释放不使用递归，但 dump、拷贝、operator==、
+    //              enable_hash_cache 与 enable_dump_cache 等按层递归，层数过深时会耗尽调用栈，设为 0 前请确认这些操作的层数有上限
+    //   max_nodes: 节点总数
+    //   max_string_length: 单个字符串或 key 转义前的字节数
+    //   max_container_size: 单个数组的元素个数或对象的成员个数
+    //   max_memory: 文档占用内存的估算值，按每个节点 sizeof(Json) 加上字符串与 key 的长度计算，不含容器自身的开销
+    // projection: 不为 nullptr 时只构建被选中的部分，见 JsonProjection；跳过的值不计入 max_nodes 与 max_memory
+    // dedupe: 解析完成后调用 basic_json::dedupe，相同的字符串与子树共享存储
+    struct JsonParseOptions {
+        static const std::size_t default_max_depth = 1024;
+
+        JsonParseOptions() : lazy_numbers(false), lazy_strings(false), pack_numbers(false), dedupe(false), max_depth(default_max_depth), max_nodes(0), max_string_length(0), max_container_size(0), max_memory(0), projection(nullptr) {}
+
+        bool lazy_numbers;
+        bool lazy_strings;
+        bool pack_numbers;
+        bool dedupe;
+        std::size_t max_depth;
+        std::size_t max_nodes;
+        std::size_t max_string_length;
+        std::size_t max_container_size;
+        std::size_t max_memory;
+        const JsonProjection *projection;
+    };
+
+    // basic_json::dedupe 的结果：替换为共享引用的字符串与容器个数，以及释放与新增的内存（估算值），节省的内存为两者之差
+    struct JsonDedupeStats {
+        JsonDedupeStats() : strings(0), containers(0), bytes_released(0), bytes_added(0) {}
+
+        std::size_t strings;
+        std::size_t containers;
+        std::size_t bytes_released;
+        std::size_t bytes_added;
+    };
+
+    // basic_json::memory_usage 的结果，单位为字节，按 sizeof 与容量估算，不含分配器自身的开销
+    // nodes: 节点（根节点、数组的元素、对象成员的值）与 packed 数组中的数字
+    // strings: 字符串值、key 与保存原文的数字，包括字符串对象本身与已使用的缓冲区
+    // containers: 数组与对象本身、对象成员的树节点开销以及 ContainerHeader
+    // caches: enable_dump_cache 的序列化结果、二级索引以及 const 访问 packed 数组时生成的元素副本
+    // slack: 数组与字符串中已分配但没有使用的容量，可由 shrink_to_fit 或 compact 释放
+    // shared: 以上各项中位于 dedupe 共享的存储中的部分，同一份存储只统计一次
+    struct JsonMemoryUsage {
+        JsonMemoryUsage() : nodes(0), strings(0), containers(0), caches(0), slack(0), shared(0) {}
+
+        std::size_t total() const {
+            return nodes + strings + containers + caches + slack;
+        }
+
+        std::size_t nodes;
+        std::size_t strings;
+        std::size_t containers;
+        std::size_t caches;
+        std::size_t slack;
+        std::size_t shared;
+    };
+
+    // 列式导出中的一列：按类型使用 ints、doubles、bools 或 offsets 与 data 之一，长度均为行数（offsets 为行数加一）
+    // validity 为按位的有效标记，缺失、null 或类型不符的值对应的位为 0，数据为 0 或空字符串
+    struct JsonColumn {
+        enum Type {
+            column_int64,
+            column_double,
+            column_bool,
+            column_string
+        };
+
+        JsonColumn() : type(column_int64) {}
+        JsonColumn(const std::string &name, Type type) : name(name), type(type) {}
+
+        bool valid(std::size_t row) const {
+            return (validity[row / 64] >> (row % 64)) & 1;
+        }
+        std::string get_string(std::size_t row) const {
+            return data.substr(offsets[row], offsets[row + 1] - offsets[row]);
+        }
+
+        std::string name;
+        Type type;
+        std::vector<std::uint64_t> validity;
+        std::vector<std::int64_t> ints;
+        std::vector<double> doubles;
+        std::vector<std::uint8_t> bools;
+        std::vector<std::uint64_t> offsets;
+        std::string data;
+    };
+
+    struct JsonColumns {
+        JsonColumns() : rows(0) {}
+
+        // 没有该列时返回 nullptr
+        const JsonColumn *find(const std::string &name) const;
+
+        std::size_t rows;
+        std::vector<JsonColumn> columns;
+    };
+
+    // 指向连续缓冲区的视图，提供 C++20 std::span 的常用接口，C++20 起可以隐式转换为 std::span
+    template <typename T>
+    class JsonSpan {
     public:
+        JsonSpan() : pointer(nullptr), count(0) {}
+        JsonSpan(T *data, std::size_t size) : pointer(data), count(size) {}
+
+        T *data() const {
+            return pointer;
+        }
+        std::size_t size() const {
+            return count;
+        }
+        bool empty() const {
+            return count == 0;
+        }
+        T &operator[](std::size_t index) const {
+            return pointer[index];
+        }
+        T *begin() const {
+            return pointer;
+        }
+        T *end() const {
+            return pointer + count;
+        }
+#ifdef MY_JSON_SPAN
+        operator std::span<T>() const {
+            return std::span<T>(pointer, count);
+        }
+#endif
+
+    private:
+        T *pointer;
+        std::size_t count;
+    };
+
+    template <typename Traits>
+    class basic_json;
+
+    typedef basic_json<JsonTraits> Json;
+
+    template <typename Traits>
+    class basic_json {
+    public:
+        // 不定义 allocator_type：否则 std::uses_allocator 会认为 basic_json 需要带分配器构造
+        typedef typename Traits::string_type string_type;
+        typedef typename Traits::template array_type<basic_json> array_type;
+        typedef typename Traits::template object_type<basic_json> object_type;
+
         enum Type {
             json_null = 0,
             json_bool,
@@ -19,18 +371,24 @@ namespace my_json {
             json_object
         };
 
-        Json();
-        Json(Type type);
-        Json(bool value);
-        Json(int value);
-        Json(double value);
-        Json(const char *value);
-        Json(std::string value);
-        Json(std::vector<Json> value);
-        Json(std::map<std::string, Json> value);
-        Json(const Json &other);
-        Json(Json &&other);
-        ~Json();
+        basic_json();
+        basic_json(Type type);
+        basic_json(bool value);
+        basic_json(int value);
+        // 超出内联范围（默认布局为 int，紧凑布局为 47 位有符号整数）的整数与解析的结果一样保存原文，不丢失精度
+        basic_json(unsigned value);
+        basic_json(long value);
+        basic_json(unsigned long value);
+        basic_json(long long value);
+        basic_json(unsigned long long value);
+        basic_json(double value);
+        basic_json(const char *value);
+        basic_json(string_type value);
+        basic_json(array_type value);
+        basic_json(object_type value);
+        basic_json(const basic_json &other);
+        basic_json(basic_json &&other) noexcept;
+        ~basic_json();
 
         Type type() const;
 
@@ -45,272 +403,2229 @@ namespace my_json {
         bool get_bool() const;
         int get_int() const;
         double get_double() const;
-        std::string get_string() const;
-        std::vector<Json> get_array() const;
-        std::map<std::string, Json> get_object() const;
+        // 超出 int 范围的整数不会被截断：解析时保留原文，可用 get_int64、get_uint64 或 get_number_text 读取
+        std::int64_t get_int64() const;
+        std::uint64_t get_uint64() const;
+        std::string get_number_text() const;
+        string_type get_string() const;
+        array_type get_array() const;
+        object_type get_object() const;
 
         int size() const;
         bool empty() const;
         void clear();
 
+        // 元素全部为整数或全部为浮点数的数组可以保存为 packed 数组：int64 或 double 的连续缓冲区，每个元素占 8 字节
+        // pack() 返回是否转换成功，整数与浮点数混合、含有超出 int64 的整数或无法按原样输出的数字时保持不变
+        // push_back、push_front 同类型的数字时仍为 packed，其余修改以及 operator[]、非 const 的 at、get_ptr 需要返回可修改的元素，先转换为普通数组
+        // const 的 at 与 get_ptr 需要返回元素的引用：第一次访问某个元素时生成它所在的 64 个元素（每个 sizeof(Json) 字节）并保留，
+        // 数组被修改后丢弃；全部元素都被访问过时额外占用的内存是缓冲区的 2 倍（紧凑布局为 1 倍），可以与其他线程的 const 访问同时进行
+        // 借出过 span 的数组每次访问都要与缓冲区比较，不一致时生成新的块，旧的块在数组被修改前不释放，之前返回的引用仍然有效
+        // 只读取数字时 get_int64s 与 get_doubles 既不分配内存也更快
+        bool pack();
+        void unpack();
+        bool is_packed() const;
+        // 不是对应类型的 packed 数组时抛出 logic_error；非 const 版本可以原地修改，并使缓存失效
+        JsonSpan<const std::int64_t> get_int64s() const;
+        JsonSpan<const double> get_doubles() const;
+        JsonSpan<std::int64_t> get_int64s();
+        JsonSpan<double> get_doubles();
+
+        // 把子树中相等且序列化结果相同的字符串、数组与对象替换为对同一份存储的引用（hash-consing），按结构哈希查找后逐个比较确认
+        // 共享的值在写入时复制：operator[]、非 const 的 at、get_ptr 等先复制出独占的一份，元素与成员仍然共享；复制共享的值只增加引用计数
+        // 对象的 key、数字、packed 数组以及含有二级索引的数组不共享；共享的值不使用 enable_hash_cache 与 enable_dump_cache 的缓存
+        // 引用计数是原子的，不同文档中共享同一个值的节点可以在不同的线程中读取与复制
+        // 与 compact 一样，dedupe 之前取得的子节点的引用、指针、迭代器与 span 全部失效：被替换的值已经释放，通过它们修改可能影响其他共享的位置
+        JsonDedupeStats dedupe();
+        bool is_shared() const;
+
+        // 整棵树占用的内存，按类别统计，见 JsonMemoryUsage
+        JsonMemoryUsage memory_usage() const;
+        // shrink_to_fit 原地释放数组与字符串多余的容量，不改变内容与缓存，但数组中元素的地址会改变
+        // compact 按当前内容重新分配整棵树，同时消除对象中删除成员后留下的碎片；期间新旧两棵树同时存在
+        // compact 之后哈希缓存、序列化缓存与二级索引都不再保留；两者都不修改共享的值
+        void shrink_to_fit();
+        void compact();
+
         std::string to_string() const;
 
         bool find(const char *key) const;
-        bool find(const std::string &key) const;
+        bool find(const string_type &key) const;
         bool has_key(const char *key) const;
-        bool has_key(const std::string &key) const;
+        bool has_key(const string_type &key) const;
+
+        // 不是数组时抛出 logic_error，null 先转换为空数组
+        // push_front 需要移动全部元素，在头部反复插入时请使用 ArrayBuilder
+        void push_back(const basic_json &value);
+        void push_back(basic_json &&value);
+        void push_front(const basic_json &value);
+        void push_front(basic_json &&value);
+        void reserve(std::size_t size);
 
-        void push_back(const Json &value);
-        void push_front(const Json &value);
+        template <typename... Args>
+        basic_json &emplace_back(Args &&...args) {
+            array_type &array = this->append_target("emplace_back");
+            array.emplace_back(std::forward<Args>(args)...);
+            this->lend(array.size() - 1);
+            return array.back();
+        }
+
+        // 元素可以是 basic_json 或能够构造 basic_json 的类型；随机访问迭代器只分配一次内存
+        template <typename Iterator>
+        void append(Iterator first, Iterator last) {
+            array_type &array = this->append_target("append");
+            array.insert(array.end(), first, last);
+        }
+
+        template <typename Range>
+        void append(const Range &range) {
+            this->append(std::begin(range), std::end(range));
+        }
+
+        void append(array_type &&values);
 
         void erase(int index);
         void erase(const char *key);
-        void erase(const std::string &key);
+        void erase(const string_type &key);
+
+        basic_json &operator=(const basic_json &other);
+        basic_json &operator=(basic_json &&other) noexcept;
+        bool operator==(const basic_json &other) const;
+        bool operator!=(const basic_json &other) const;
+
+        basic_json &operator[](int index);
+        basic_json &operator[](const char *key);
+        basic_json &operator[](const string_type &key);
+
+        // 只读查找：key 不存在时不会插入，const 版本可以被多个线程同时调用
+        // object_type 的比较器支持异构查找（例如 std::less<>）时不构造临时的 key，否则只有超过短字符串长度的 key 需要分配内存
+        // get_ptr 在类型不符或不存在时返回 nullptr；at 在类型不符时抛出 logic_error，不存在时抛出 out_of_range
+        const basic_json *get_ptr(int index) const;
+        const basic_json *get_ptr(const char *key) const;
+        const basic_json *get_ptr(const string_type &key) const;
+        basic_json *get_ptr(int index);
+        basic_json *get_ptr(const char *key);
+        basic_json *get_ptr(const string_type &key);
+        const basic_json &at(int index) const;
+        const basic_json &at(const char *key) const;
+        const basic_json &at(const string_type &key) const;
+        basic_json &at(int index);
+        basic_json &at(const char *key);
+        basic_json &at(const string_type &key);
+#ifdef MY_JSON_STRING_VIEW
+        // Json.cpp 可能按 C++11 编译，显式实例化中不包含这些函数，因此定义为成员模板，由调用方实例化
+        template <typename = void>
+        const basic_json *get_ptr(std::string_view key) const {
+            return this->find_member(key.data(), key.size());
+        }
+
+        template <typename = void>
+        basic_json *get_ptr(std::string_view key) {
+            this->invalidate();
+            this->lend();
+            return const_cast<basic_json *>(this->find_member(key.data(), key.size()));
+        }
+
+        template <typename = void>
+        const basic_json &at(std::string_view key) const {
+            return this->at_member(key.data(), key.size());
+        }
 
-        Json &operator=(const Json &other);
-        Json &operator=(Json &&other);
-        bool operator==(const Json &other) const;
-        bool operator!=(const Json &other) const;
+        template <typename = void>
+        basic_json &at(std::string_view key) {
+            this->invalidate();
+            this->lend();
+            return const_cast<basic_json &>(this->at_member(key.data(), key.size()));
+        }
 
-        Json &operator[](int index);
-        Json &operator[](const char *key);
-        Json &operator[](const std::string &key);
+        template <typename = void>
+        bool has_key(std::string_view key) const {
+            if (!this->is_object())
+                MY_JSON_THROW(std::logic_error("function Json::has_key: type error"));
+            return this->find_member(key.data(), key.size()) != nullptr;
+        }
+#endif
 
         operator bool() const;
         operator int() const;
         operator double() const;
-        operator std::string() const;
-        operator std::vector<Json>() const;
-        operator std::map<std::string, Json>() const;
+        operator string_type() const;
+        operator array_type() const;
+        operator object_type() const;
 
         // 请暂时不要使用这个函数，我无法保证它的正确性
         // 如需输出请使用 to_string() 函数
-        // friend std::ostream &operator<<(std::ostream &os, const Json &json);
+        // friend std::ostream &operator<<(std::ostream &os, const basic_json &json);
 
-        void parse(const char *json);
-        void parse(const std::string &json);
-        void parse(std::ifstream &file);
+        void parse(const char *json, const JsonParseOptions &options = JsonParseOptions());
+        void parse(const std::string &json, const JsonParseOptions &options = JsonParseOptions());
+        void parse(std::ifstream &file, const JsonParseOptions &options = JsonParseOptions());
 
-    private:
+        // 不抛出异常的版本：失败时返回 false，error 中为错误原因与字节偏移，当前对象被清空
+        bool parse(const char *json, JsonError &error, const JsonParseOptions &options = JsonParseOptions());
+        bool parse(const char *json, std::size_t size, JsonError &error, const JsonParseOptions &options = JsonParseOptions());
+        bool parse(const std::string &json, JsonError &error, const JsonParseOptions &options = JsonParseOptions());
+
+        // 只检查语法与 UTF-8 编码，不构建节点，返回第一个错误；嵌套深度只受内存限制
+        static JsonError validate(const char *data, std::size_t size);
+        static JsonError validate(const std::string &json);
+
+        // 将解析好的文档保存为二进制快照，之后可用 JsonSnapshot 通过 mmap 直接加载
+        void save_snapshot(const char *path) const;
+        void save_snapshot(const std::string &path) const;
+        void save_snapshot(std::ofstream &file) const;
+
+        // JSON Patch (RFC 6902) 与 JSON Merge Patch (RFC 7396)，直接在当前对象上修改
+        // 传入右值时补丁中的值会被移动而不是拷贝；任一操作失败时撤销已执行的操作后抛出异常
+        // test 按 RFC 6902 4.6 比较，数字按数值相等（1 与 1.0 相等）；test 与 copy 的源路径只读取，不转换 packed 数组
+        void apply_patch(const basic_json &patch);
+        void apply_patch(basic_json &&patch);
+        void apply_merge_patch(const basic_json &patch);
+        void apply_merge_patch(basic_json &&patch);
+
+        // 生成把 source 变为 target 的 JSON Patch，哈希相同的子树直接跳过
+        // 数组默认按最长公共子序列对齐；给出 array_key 时，成员都是对象且都带有该 key 的数组按 key 的值匹配元素
+        static basic_json diff(const basic_json &source, const basic_json &target);
+        static basic_json diff(const basic_json &source, const basic_json &target, const string_type &array_key);
+
+        // 结构哈希：数字按类型区分（1 与 1.0 不同），对象与成员顺序无关
+        // 不同 seed 得到互相独立的哈希，seed 为 0 时会使用 enable_hash_cache() 缓存的结果
+        std::uint64_t hash(std::uint64_t seed = 0) const;
+        std::pair<std::uint64_t, std::uint64_t> hash128(std::uint64_t seed = 0) const;
+
+        // 为子树中的所有数组和对象计算并缓存哈希，operator== 可据此在 O(1) 内判定不相等
+        // 通过 operator[]、push_back、erase 等接口修改时，沿访问路径的缓存会失效，再次调用只重新计算失效的部分
+        // 借出过子节点引用（非 const 的 operator[]、at、get_ptr、find_by、emplace_back 等）的容器及其祖先无法知道引用之后的修改，
+        // 它们以及借出过 span 的 packed 数组的祖先不保存缓存，每次使用时由子节点重新计算，其中没有借出过引用的子树仍使用缓存；
+        // 缓存只随本文档的修改失效，与其他文档互不影响
+        void enable_hash_cache();
+
+        // 为从本节点起前 depth 层（本节点为第 1 层）的数组和对象缓存序列化的结果，to_string() 直接复制没有修改过的子树
+        // 失效的规则与 enable_hash_cache 相同，修改后再次调用只重新生成失效的容器，其余的子树按缓存拼接
+        // 缓存占用的内存约为输出的大小乘以 depth，depth 为 1 时只缓存本节点；只读访问请使用 const 的接口，以免使缓存失效
+        void enable_dump_cache(std::size_t depth = 2);
+
+        // 为对象数组建立二级索引，key 为每个元素中 path（相对于元素的 JSON Pointer，"" 表示元素本身）处的值
+        // index_hashed 的 find_by 为 O(1)；index_sorted 的 find_by 为 O(log n)，并支持 find_range
+        // 缺少 path 或该处为数组、对象的元素不进入索引；每个数组只有一个索引，再次调用时替换原有的索引
+        // 通过 operator[]、at、get_ptr、find_by 取得元素，或用 push_back、append 等在末尾追加后，下次查找只重新处理涉及的元素；
+        // 这些元素的引用之后仍可能被修改，此后每次查找前都会重新检查这些元素的 key
+        // 重建索引时数组已经借出过元素引用（包括建立索引之前借出的），或借出的元素超过 64 个时，无法逐个检查，
+        // 同一 Traits 的任何文档有过修改后，下次查找都会重建整个索引
+        // erase、push_front、patch 等其余修改使下次查找重建整个索引；数组被赋值、清空或复制时不保留索引
+        // 有尚未处理的修改或借出过引用时，查找可能更新索引，此时 const 的查找也不能与其他线程同时进行
+        enum IndexType { index_hashed, index_sorted };
+        void create_index(const string_type &path, IndexType type = index_hashed);
+        void drop_index();
+        bool has_index() const;
+        // 返回 key 相等的元素中下标最小的一个，没有时返回 nullptr；没有索引时抛出 logic_error
+        const basic_json *find_by(const basic_json &key) const;
+        basic_json *find_by(const basic_json &key);
+        // 按下标排序
+        std::vector<const basic_json *> find_all_by(const basic_json &key) const;
+        // 只用于 index_sorted，返回 key 在 [lower, upper] 中的元素，按 key 排序
+        std::vector<const basic_json *> find_range(const basic_json &lower, const basic_json &upper) const;
+
+        // 把对象数组转换为列式存储，每个 key 为一列，不是对象的元素整行无效；不是数组时抛出异常
+        // 不指定 schema 时根据数据推断：列的顺序为 key 第一次出现的顺序，类型为第一个不为 null 的值的类型，
+        // 整数与浮点数混合时为 double，只有 null、数组或对象的 key 不生成列；超出 int64 的整数在 int64 列中无效
+        // threads 为并行的线程数，0 表示使用全部硬件线程；只需要少数字段时可先用 JsonProjection 解析
+        JsonColumns to_columns(unsigned threads = 1) const;
+        JsonColumns to_columns(const std::vector<JsonColumn> &schema, unsigned threads = 1) const;
+
+        // 在两端构建数组，push_back 与 push_front 都是均摊 O(1)；build() 按顺序移动到新的数组中，之后 builder 为空
+        class ArrayBuilder {
+        public:
+            ArrayBuilder() {}
+
+            void reserve(std::size_t size) {
+                back.reserve(size);
+            }
+            void reserve_front(std::size_t size) {
+                front.reserve(size);
+            }
+            std::size_t size() const {
+                return front.size() + back.size();
+            }
+            bool empty() const {
+                return front.empty() && back.empty();
+            }
+
+            void push_back(const basic_json &value) {
+                back.push_back(value);
+            }
+            void push_back(basic_json &&value) {
+                back.push_back(std::move(value));
+            }
+            void push_front(const basic_json &value) {
+                front.push_back(value);
+            }
+            void push_front(basic_json &&value) {
+                front.push_back(std::move(value));
+            }
+
+            template <typename... Args>
+            basic_json &emplace_back(Args &&...args) {
+                back.emplace_back(std::forward<Args>(args)...);
+                return back.back();
+            }
+            template <typename... Args>
+            basic_json &emplace_front(Args &&...args) {
+                front.emplace_back(std::forward<Args>(args)...);
+                return front.back();
+            }
+
+            // 没有在头部插入时直接移交 back 的缓冲区
+            basic_json build() {
+                if (front.empty())
+                    return basic_json(std::move(back));
+                std::reverse(front.begin(), front.end());
+                front.reserve(front.size() + back.size());
+                std::move(back.begin(), back.end(), std::back_inserter(front));
+                back.clear();
+                return basic_json(std::move(front));
+            }
+
+        private:
+            // front 中的元素按插入的逆序保存
+            array_type front;
+            array_type back;
+        };
+
+        // 可重复使用的解析器，直接读取调用者传入的文本，不复制输入；解析结束后不再引用该文本
+        // parse_into 复用目标文档中已有的数组、对象与字符串：数组按下标、对象按 key 对应到原有的节点，
+        // 多出的元素与没有再出现的成员被删除，因此反复解析结构相近的文档时几乎不需要分配内存
+        // 解析失败时抛出异常，或由带 JsonError 参数的版本返回 false，目标文档中保留已经解析的部分
         class Parser {
         public:
-            Parser() : index(0){};
-            Parser(const std::string &json) : json(json), index(0){};
+            Parser() : index(0) {
+                this->set_limits();
+            }
+            Parser(const JsonParseOptions &options) : index(0), options(options) {
+                this->set_limits();
+            }
             ~Parser(){};
 
-            void set_json(const std::string &json) {
-                this->json = json;
+            // 不抛出异常的版本：失败时返回 false，error 中为错误原因与字节偏移
+            bool parse_into(const char *json, std::size_t size, basic_json &target, JsonError &error) {
+                this->json = Input{json, size};
                 index = 0;
+                nodes = 0;
+                memory = 0;
+                this->error = JsonError();
+#ifdef MY_JSON_INSTRUMENTATION
+                stats = JsonStats();
+                auto start = std::chrono::steady_clock::now();
+                bool ok = this->parse_document(target);
+                stats.parse_calls = 1;
+                stats.parse_errors = ok ? 0 : 1;
+                stats.parse_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+                stats.bytes_in = size;
+                JsonInstrumentation::record(stats, json, size);
+#else
+                bool ok = this->parse_document(target);
+#endif
+                error = this->error;
+                return ok;
+            }
+
+            bool parse_into(const std::string &json, basic_json &target, JsonError &error) {
+                return this->parse_into(json.data(), json.size(), target, error);
             }
 
-            Json parse() {
+            void parse_into(const char *json, std::size_t size, basic_json &target) {
+                JsonError error;
+                if (!this->parse_into(json, size, target, error))
+                    throw_error(error);
+            }
+
+            void parse_into(const std::string &json, basic_json &target) {
+                this->parse_into(json.data(), json.size(), target);
+            }
+
+            // 把对象数组的文本直接解析为列，不构建文档，见 to_columns；不在 schema 中的成员与不是对象的元素只检查括号与引号后跳过
+            // 失败时 table 中保留已经解析的行
+            bool parse_columns(const char *json, std::size_t size, const std::vector<JsonColumn> &schema, JsonColumns &table, JsonError &error) {
+                this->json = Input{json, size};
+                index = 0;
+                nodes = 0;
+                memory = 0;
+                this->error = JsonError();
+                frames.clear();
+                std::unordered_map<std::string, std::size_t> names;
+                table = column_table(schema, 0, names);
+                bool ok = this->parse_rows(table, names);
+                error = this->error;
+                return ok;
+            }
+
+            bool parse_columns(const std::string &json, const std::vector<JsonColumn> &schema, JsonColumns &table, JsonError &error) {
+                return this->parse_columns(json.data(), json.size(), schema, table, error);
+            }
+
+            void parse_columns(const char *json, std::size_t size, const std::vector<JsonColumn> &schema, JsonColumns &table) {
+                JsonError error;
+                if (!this->parse_columns(json, size, schema, table, error))
+                    throw_error(error);
+            }
+
+            void parse_columns(const std::string &json, const std::vector<JsonColumn> &schema, JsonColumns &table) {
+                this->parse_columns(json.data(), json.size(), schema, table);
+            }
+
+            // 只在定义了 MY_JSON_INSTRUMENTATION 时写入，未定义时也保留，使类的布局不随宏变化
+            JsonStats stats = JsonStats();
+
+        private:
+            // 栈中的一层：正在解析的数组或对象，count 为已经解析的元素或成员个数，reused 表示对象中有需要清理的旧成员
+            // selection 为该容器在投影中对应的节点，npos 表示构建其中的全部内容
+            struct Frame {
+                basic_json *container;
+                std::size_t count;
+                bool reused;
+                std::size_t selection;
+            };
+
+            static bool heap_allocated(const string_type &str) {
+                const char *data = str.data();
+                const char *self = reinterpret_cast<const char *>(&str);
+                return data < self || data >= self + sizeof(str);
+            }
+
+            // 0 表示不限制，统一换成最大值，检查时只需一次比较
+            void set_limits() {
+                const std::size_t none = static_cast<std::size_t>(-1);
+                limit_depth = options.max_depth != 0 ? options.max_depth : none;
+                limit_nodes = options.max_nodes != 0 ? options.max_nodes : none;
+                limit_string = options.max_string_length != 0 ? options.max_string_length : none;
+                limit_container = options.max_container_size != 0 ? options.max_container_size : none;
+                limit_memory = options.max_memory != 0 ? options.max_memory : none;
+                // 预先分配常见文档所需的栈深度，更深的文档再按需扩容
+                frames.reserve(limit_depth < 16 ? limit_depth : 16);
+            }
+
+            bool allocate(std::size_t size) {
+                memory += size;
+                if (memory > limit_memory)
+                    return this->fail(JsonError::memory_exceeded);
+                return true;
+            }
+
+            // 各个 check 函数出错时记录错误并返回 false，调用方逐层返回，不使用异常
+            bool fail(JsonError::Code code) {
+                if (code == JsonError::unexpected_character && index >= json.size())
+                    code = JsonError::unexpected_end;
+                error = JsonError(code, index);
+                return false;
+            }
+
+            // 迭代地解析：尚未结束的数组与对象保存在 frames 中，嵌套深度不受线程栈大小的限制
+            // target 为接下来要写入的节点，为 nullptr 时表示刚结束了一个值
+            bool parse_document(basic_json &root) {
+                frames.clear();
+                if (options.projection != nullptr && !options.projection->complete(0))
+                    selection = 0;
+                else
+                    selection = JsonProjection::npos;
+                basic_json *target = &root;
+                while (target != nullptr) {
+                    if (!this->parse_value(target) || (target == nullptr && !this->next_value(target)))
+                        return this->unwind();
+                }
+                this->skip_space();
+                if (index != json.size())
+                    return this->fail(JsonError::trailing_characters);
+                if (options.dedupe)
+                    root.dedupe();
+                return true;
+            }
+
+            // 标量写入 target 后把 target 置为 nullptr；数组或对象入栈后 target 指向其第一个元素或成员，为空时直接出栈
+            bool parse_value(basic_json *&target) {
+                if (!compact_layout)
+                    target->set_flags(target->flags() & ~flag_stale);
                 this->skip_space();
-                char ch = this->get_next();
-                switch (ch) {
+                if (++nodes > limit_nodes)
+                    return this->fail(JsonError::too_many_nodes);
+                if (!this->allocate(sizeof(basic_json)))
+                    return false;
+                switch (json[index]) {
                 case 'n':
-                    index--;
-                    return this->check_null();
+                    MY_JSON_STATS(stats.nodes[json_null]++;)
+                    if (!this->check_literal("null"))
+                        return false;
+                    *target = basic_json();
+                    break;
                 case 't':
+                    MY_JSON_STATS(stats.nodes[json_bool]++;)
+                    if (!this->check_literal("true"))
+                        return false;
+                    *target = basic_json(true);
+                    break;
                 case 'f':
-                    index--;
-                    return this->check_bool();
+                    MY_JSON_STATS(stats.nodes[json_bool]++;)
+                    if (!this->check_literal("false"))
+                        return false;
+                    *target = basic_json(false);
+                    break;
                 case '"':
-                    return this->check_string();
+                    MY_JSON_STATS(stats.nodes[json_string]++;)
+                    index++;
+                    if (!this->check_string_value(*target))
+                        return false;
+                    break;
                 case '[':
-                    return this->check_array();
                 case '{':
-                    return this->check_object();
+                    return this->open(target);
                 default:
-                    if (ch >= '0' && ch <= '9' || ch == '-') {
-                        index--;
-                        return this->check_number();
-                    } else
-                        throw std::logic_error("Unexpected character");
+                    if (!this->check_number(*target))
+                        return false;
+                    break;
                 }
+                target = nullptr;
+                return true;
             }
 
-        private:
-            void skip_space() {
-                while (json[index] == ' ' || json[index] == '\t' || json[index] == '\r' || json[index] == '\n')
+            bool open(basic_json *&target) {
+                if (frames.size() == limit_depth)
+                    return this->fail(JsonError::depth_exceeded);
+                bool array = json[index++] == '[';
+                Type type = array ? json_array : json_object;
+                bool reused = false;
+                if (target->type() != type || (target->flags() & flag_packed) || target->is_shared()) {
+                    *target = basic_json(type);
+                    MY_JSON_STATS(stats.allocations++;)
+                } else {
+                    target->invalidate();
+                    // 原有的成员先标记为 flag_stale，解析到同名的 key 时清除，关闭时删除仍带有标记的成员
+                    // 紧凑布局没有 flag_stale，直接清空原有的成员
+                    if (!array && !target->payload().data_object->empty()) {
+                        if (compact_layout)
+                            target->payload().data_object->clear();
+                        else {
+                            reused = true;
+                            for (auto &i : *target->payload().data_object)
+                                i.second.set_flags(i.second.flags() | flag_stale);
+                        }
+                    }
+                }
+                MY_JSON_STATS(stats.nodes[type]++;)
+                frames.push_back(Frame{target, 0, reused, selection});
+                MY_JSON_STATS(if (frames.size() > stats.max_depth) stats.max_depth = frames.size();)
+                this->skip_space();
+                target = nullptr;
+                if (json[index] == (array ? ']' : '}')) {
                     index++;
+                    this->close();
+                    return true;
+                }
+                return array ? this->next_element(target) : this->next_member(target);
             }
 
-            char get_next() {
-                this->skip_space();
-                if (index == json.size())
-                    throw std::runtime_error("Unexpected end of json");
-                return json[index++];
+            // 一个值结束后关闭已经结束的数组与对象，直到遇到 ','，target 指向下一个元素或成员；文档结束时 target 为 nullptr
+            bool next_value(basic_json *&target) {
+                while (!frames.empty()) {
+                    bool array = frames.back().container->type() == json_array;
+                    this->skip_space();
+                    if (json[index] == (array ? ']' : '}')) {
+                        index++;
+                        this->close();
+                        continue;
+                    }
+                    if (json[index] != ',')
+                        return this->fail(JsonError::unexpected_character);
+                    index++;
+                    if (!(array ? this->next_element(target) : this->next_member(target)))
+                        return false;
+                    if (target != nullptr)
+                        return true;
+                }
+                target = nullptr;
+                return true;
             }
 
-            Json check_null() {
-                if (json.substr(index, 4) == "null") {
-                    index += 4;
-                    return Json();
+            // 取得下一个元素或成员的节点，以及它在投影中对应的 selection；没有被投影选中时跳过该值，target 为 nullptr
+            bool next_element(basic_json *&target) {
+                Frame &frame = frames.back();
+                array_type &array = *frame.container->payload().data_array;
+                if (frame.count == limit_container)
+                    return this->fail(JsonError::container_too_large);
+                if (frame.count == array.size()) {
+                    MY_JSON_STATS(std::size_t capacity = array.capacity();)
+                    array.emplace_back();
+                    MY_JSON_STATS(stats.allocations += array.capacity() != capacity;)
+                }
+                basic_json &slot = array[frame.count++];
+                if (frame.selection != JsonProjection::npos) {
+                    std::size_t node = options.projection->element(frame.selection, frame.count - 1);
+                    if (node == JsonProjection::npos) {
+                        slot = basic_json();
+                        return this->skip_value();
+                    }
+                    selection = options.projection->complete(node) ? JsonProjection::npos : node;
                 }
-                throw std::logic_error("Unexpected character");
+                target = &slot;
+                return true;
             }
 
-            Json check_bool() {
-                if (json.substr(index, 4) == "true") {
-                    index += 4;
-                    return Json(true);
+            bool next_member(basic_json *&target) {
+                Frame &frame = frames.back();
+                object_type &object = *frame.container->payload().data_object;
+                this->skip_space();
+                if (frame.count++ == limit_container)
+                    return this->fail(JsonError::container_too_large);
+                if (json[index] != '"')
+                    return this->fail(JsonError::unexpected_character);
+                index++;
+                std::size_t node = JsonProjection::npos;
+                if (frame.selection != JsonProjection::npos) {
+                    // 没有转义的 key 直接与投影比较，只有被选中时才复制
+                    std::size_t start = index;
+                    bool escaped;
+                    if (!this->skip_string(escaped))
+                        return false;
+                    if (!escaped)
+                        node = options.projection->member(frame.selection, json.data() + start, index - 1 - start);
+                    if (escaped || node != JsonProjection::npos) {
+                        index = start;
+                        if (!this->check_string(key))
+                            return false;
+                    }
+                    if (escaped)
+                        node = options.projection->member(frame.selection, key.data(), key.size());
+                } else if (!this->check_string(key))
+                    return false;
+                this->skip_space();
+                if (json[index] != ':')
+                    return this->fail(JsonError::unexpected_character);
+                index++;
+                if (frame.selection != JsonProjection::npos) {
+                    if (node == JsonProjection::npos)
+                        return this->skip_value();
+                    selection = options.projection->complete(node) ? JsonProjection::npos : node;
                 }
-                if (json.substr(index, 5) == "false") {
-                    index += 5;
-                    return Json(false);
+                auto iter = object.find(key);
+                if (iter == object.end()) {
+                    iter = object.emplace(key, basic_json()).first;
+                    MY_JSON_STATS(stats.allocations += heap_allocated(key) ? 2 : 1;)
                 }
-                throw std::logic_error("Unexpected character");
+                target = &iter->second;
+                return true;
             }
 
-            Json check_number() {
-                int start = index;
-                if (json[index] == '-')
-                    index++;
-                if (json[index] == '0')
-                    index++;
-                else if (json[index] >= '1' && json[index] <= '9') {
-                    index++;
-                    while (json[index] >= '0' && json[index] <= '9')
+            // index 指向开头引号之后，跳过字符串并移到结尾引号之后；只检查转义与 UTF-8 编码，不解码
+            bool skip_string(bool &escaped) {
+                JsonError::Code code;
+                const char *begin = json.data();
+                index = find_string_end(begin + index, begin + json.size(), escaped, code) - begin;
+                if (code != JsonError::ok)
+                    return this->fail(code);
+                index++;
+                return true;
+            }
+
+            // 跳过没有被投影选中的值：只检查括号与引号是否匹配，不解码数字与字符串，也不分配内存
+            bool skip_value() {
+                std::size_t start = index;
+                skipped.clear();
+                do {
+                    this->skip_space();
+                    bool escaped;
+                    switch (json[index]) {
+                    case '"':
                         index++;
-                } else
-                    throw std::logic_error("Unexpected character");
-                if (json[index] == '.') {
-                    index++;
-                    if (json[index] >= '0' && json[index] <= '9') {
+                        if (!this->skip_string(escaped))
+                            return false;
+                        break;
+                    case '[':
+                    case '{':
+                        if (frames.size() + skipped.size() == limit_depth)
+                            return this->fail(JsonError::depth_exceeded);
+                        skipped += json[index] == '[' ? ']' : '}';
                         index++;
-                        while (json[index] >= '0' && json[index] <= '9')
-                            index++;
-                    } else
-                        throw std::logic_error("Unexpected character");
-                }
-                if (json[index] == 'e' || json[index] == 'E') {
-                    index++;
-                    if (json[index] == '+' || json[index] == '-')
+                        break;
+                    case ']':
+                    case '}':
+                        if (skipped.empty() || skipped.back() != json[index])
+                            return this->fail(JsonError::unexpected_character);
+                        skipped.pop_back();
                         index++;
-                    if (json[index] >= '0' && json[index] <= '9') {
+                        break;
+                    case ',':
+                    case ':':
+                        if (skipped.empty() || index == start)
+                            return this->fail(JsonError::unexpected_character);
                         index++;
-                        while (json[index] >= '0' && json[index] <= '9')
+                        break;
+                    default:
+                        // 数字与 true、false、null：只跳过可能出现在其中的字符
+                        std::size_t begin = index;
+                        while ((json[index] >= '0' && json[index] <= '9') || (json[index] >= 'a' && json[index] <= 'z') || json[index] == '-' || json[index] == '+' || json[index] == '.' || json[index] == 'E')
                             index++;
-                    } else
-                        throw std::logic_error("Unexpected character");
+                        if (index == begin)
+                            return this->fail(JsonError::unexpected_character);
+                        break;
+                    }
+                } while (!skipped.empty());
+                return true;
+            }
+
+            // 出栈：删除数组中多出的元素与对象中没有再出现的成员
+            void close() {
+                Frame &frame = frames.back();
+                if (frame.container->type() == json_array) {
+                    array_type &array = *frame.container->payload().data_array;
+                    if (frame.count != array.size())
+                        array.erase(array.begin() + frame.count, array.end());
+                    if (options.pack_numbers && frame.count != 0)
+                        frame.container->pack();
+                } else if (frame.reused) {
+                    object_type &object = *frame.container->payload().data_object;
+                    for (auto iter = object.begin(); iter != object.end();) {
+                        if (iter->second.flags() & flag_stale)
+                            iter = object.erase(iter);
+                        else
+                            ++iter;
+                    }
                 }
-                std::string number = json.substr(start, index - start);
-                if (number.find('.') != std::string::npos || number.find('e') != std::string::npos || number.find('E') != std::string::npos)
-                    return Json(std::stod(number));
-                else
-                    return Json(std::stoi(number));
+                frames.pop_back();
             }
 
-            std::string check_string() {
-                std::string str;
-                while (true) {
-                    char ch = this->get_next();
-                    if (ch == '\\') {
-                        ch = this->get_next();
-                        switch (ch) {
-                        case '"':
-                            str += '"';
-                            break;
-                        case '\\':
-                            str += '\\';
-                            break;
-                        case '/':
-                            str += '/';
-                            break;
-                        case 'b':
-                            str += '\b';
-                            break;
-                        case 'f':
-                            str += '\f';
-                            break;
-                        case 'n':
-                            str += '\n';
-                            break;
-                        case 'r':
-                            str += '\r';
-                            break;
-                        case 't':
-                            str += '\t';
-                            break;
-                        case 'u':
-                            index += 4;
+            // 出错时依次关闭尚未结束的数组与对象，使目标文档中只保留已经解析的部分
+            bool unwind() {
+                while (!frames.empty())
+                    this->close();
+                return false;
+            }
+
+            bool parse_rows(JsonColumns &table, const std::unordered_map<std::string, std::size_t> &names) {
+                this->skip_space();
+                if (json[index] != '[')
+                    return this->fail(JsonError::unexpected_character);
+                index++;
+                this->skip_space();
+                if (json[index] == ']')
+                    index++;
+                else {
+                    // cell 在各行之间复用，字符串值不需要每次重新分配
+                    basic_json cell;
+                    std::vector<std::pair<std::string, std::size_t>> shape;
+                    while (true) {
+                        if (table.rows == limit_container)
+                            return this->fail(JsonError::container_too_large);
+                        this->add_row(table);
+                        this->skip_space();
+                        if (json[index] == '{') {
+                            if (!this->parse_row(table, names, shape, cell))
+                                return false;
+                        } else if (!this->skip_value())
+                            return false;
+                        this->skip_space();
+                        if (json[index] == ']') {
+                            index++;
                             break;
-                        default:
-                            throw std::logic_error("Unexpected character");
                         }
-                    } else if (ch == '"')
-                        return str;
-                    else
-                        str += ch;
+                        if (json[index] != ',')
+                            return this->fail(JsonError::unexpected_character);
+                        index++;
+                    }
                 }
+                this->skip_space();
+                if (index != json.size())
+                    return this->fail(JsonError::trailing_characters);
+                return true;
             }
 
-            Json check_array() {
-                Json array = Json(json_array);
-                while (true) {
-                    this->skip_space();
-                    if (json[index] == ']') {
-                        index++;
-                        return array;
-                    }
-                    array.push_back(this->parse());
-                    this->skip_space();
-                    if (json[index] == ']') {
-                        index++;
-                        return array;
-                    }
-                    if (json[index] == ',')
-                        index++;
+            static void add_row(JsonColumns &table) {
+                std::size_t row = table.rows++;
+                for (auto &i : table.columns) {
+                    if (row % 64 == 0)
+                        i.validity.push_back(0);
+                    if (i.type == JsonColumn::column_int64)
+                        i.ints.push_back(0);
+                    else if (i.type == JsonColumn::column_double)
+                        i.doubles.push_back(0);
+                    else if (i.type == JsonColumn::column_bool)
+                        i.bools.push_back(0);
                     else
-                        throw std::logic_error("Unexpected character");
+                        i.offsets.push_back(i.data.size());
                 }
             }
 
-            Json check_object() {
-                Json object = Json(json_object);
-                while (true) {
+            // shape 为上一行各位置上的 key 与对应的列，同构的行只需比较 key 而不用查找
+            bool parse_row(JsonColumns &table, const std::unordered_map<std::string, std::size_t> &names, std::vector<std::pair<std::string, std::size_t>> &shape, basic_json &cell) {
+                const std::size_t none = static_cast<std::size_t>(-1);
+                std::size_t row = table.rows - 1;
+                index++;
+                this->skip_space();
+                if (json[index] == '}') {
+                    index++;
+                    return true;
+                }
+                for (std::size_t position = 0;; position++) {
                     this->skip_space();
-                    if (json[index] == '}') {
-                        index++;
-                        return object;
+                    if (position == limit_container)
+                        return this->fail(JsonError::container_too_large);
+                    if (json[index] != '"')
+                        return this->fail(JsonError::unexpected_character);
+                    std::size_t start = ++index;
+                    bool escaped;
+                    if (!this->skip_string(escaped))
+                        return false;
+                    const char *name = json.data() + start;
+                    std::size_t size = index - 1 - start;
+                    if (escaped) {
+                        index = start;
+                        if (!this->check_string(key))
+                            return false;
+                        name = key.data();
+                        size = key.size();
+                    }
+                    if (position == shape.size())
+                        shape.push_back(std::make_pair(std::string(), none));
+                    std::pair<std::string, std::size_t> &cached = shape[position];
+                    if (cached.first.compare(0, std::string::npos, name, size) != 0) {
+                        cached.first.assign(name, size);
+                        auto iter = names.find(cached.first);
+                        cached.second = iter != names.end() ? iter->second : none;
                     }
-                    this->get_next();
-                    std::string key = this->check_string();
                     this->skip_space();
-                    if (json[index] == ':')
-                        index++;
-                    else
-                        throw std::logic_error("Unexpected character");
-                    object[key] = this->parse();
+                    if (json[index] != ':')
+                        return this->fail(JsonError::unexpected_character);
+                    index++;
+                    this->skip_space();
+                    if (cached.second == none || json[index] == '[' || json[index] == '{') {
+                        if (!this->skip_value())
+                            return false;
+                    } else {
+                        basic_json *target = &cell;
+                        if (!this->parse_value(target))
+                            return false;
+                        JsonColumn &column = table.columns[cached.second];
+                        if (cell.column_value(column, row, column.data))
+                            column.validity[row / 64] |= std::uint64_t(1) << (row % 64);
+                    }
                     this->skip_space();
                     if (json[index] == '}') {
                         index++;
-                        return object;
+                        return true;
                     }
-                    if (json[index] == ',')
+                    if (json[index] != ',')
+                        return this->fail(JsonError::unexpected_character);
+                    index++;
+                }
+            }
+
+            void skip_space() {
+                while (json[index] == ' ' || json[index] == '\t' || json[index] == '\r' || json[index] == '\n')
+                    index++;
+            }
+
+            bool check_literal(const char *literal) {
+                std::size_t size = std::char_traits<char>::length(literal);
+                if (!json.matches(index, literal, size))
+                    return this->fail(JsonError::unexpected_character);
+                index += size;
+                return true;
+            }
+
+            bool check_digits() {
+                if (json[index] < '0' || json[index] > '9')
+                    return false;
+                while (json[index] >= '0' && json[index] <= '9')
+                    index++;
+                return true;
+            }
+
+            bool check_number(basic_json &target) {
+                std::size_t start = index;
+                bool integer = true;
+                if (json[index] == '-')
+                    index++;
+                if (json[index] == '0')
+                    index++;
+                else if (json[index] < '1' || json[index] > '9' || !this->check_digits())
+                    return this->fail(JsonError::unexpected_character);
+                if (json[index] == '.') {
+                    index++;
+                    integer = false;
+                    if (!this->check_digits())
+                        return this->fail(JsonError::unexpected_character);
+                }
+                if (json[index] == 'e' || json[index] == 'E') {
+                    index++;
+                    integer = false;
+                    if (json[index] == '+' || json[index] == '-')
                         index++;
-                    else
-                        throw std::logic_error("Unexpected character");
+                    if (!this->check_digits())
+                        return this->fail(JsonError::unexpected_character);
+                }
+                const char *text = json.data() + start;
+                std::size_t size = index - start;
+                MY_JSON_STATS(stats.nodes[integer ? json_int : json_double]++;)
+                if (!options.lazy_numbers) {
+                    // 超出内联的整数范围或无法用有限的 double 表示时保留原文，避免截断
+                    std::int64_t number;
+                    if (integer && parse_int64(text, size, number) && inline_int(number)) {
+                        target = from_int64(number);
+                        return true;
+                    }
+                    double real;
+                    if (!integer && parse_double(text, size, real)) {
+                        target = basic_json(real);
+                        return true;
+                    }
+                }
+                MY_JSON_STATS(stats.allocations += size > sizeof(Value::data_raw);)
+                target = from_raw_number(integer ? json_int : json_double, text, size);
+                return true;
+            }
+
+            // index 指向开头引号之后，找到结尾的引号并检查转义与 UTF-8 编码，escaped 表示其中是否含有转义
+            bool scan_string(std::size_t &end, bool &escaped) {
+                JsonError::Code code;
+                const char *begin = json.data();
+                const char *quote = find_string_end(begin + index, begin + json.size(), escaped, code);
+                end = quote - begin;
+                if (code != JsonError::ok) {
+                    index = end;
+                    return this->fail(code);
+                }
+                if (end - index > limit_string)
+                    return this->fail(JsonError::string_too_long);
+                return this->allocate(end - index);
+            }
+
+            // 解码后替换 str 原有的内容，保留 str 的容量
+            bool check_string(string_type &str) {
+                bool escaped;
+                std::size_t end;
+                if (!this->scan_string(end, escaped))
+                    return false;
+                str.clear();
+                if (escaped)
+                    unescape(json.data() + index, end - index, str);
+                else
+                    str.append(json.data() + index, end - index);
+                index = end + 1;
+                return true;
+            }
+
+            // 原有的字符串没有共享时复用其缓冲区
+            bool check_string_value(basic_json &target) {
+                if (!target.is_string() || (target.flags() & flag_header)) {
+                    target = basic_json(json_string);
+                    MY_JSON_STATS(stats.allocations++;)
+                }
+                string_type &str = *target.payload().data_string;
+                MY_JSON_STATS(std::size_t capacity = str.capacity();)
+                target.set_flags(0);
+                if (!options.lazy_strings) {
+                    if (!this->check_string(str))
+                        return false;
+                } else {
+                    bool escaped;
+                    std::size_t end;
+                    if (!this->scan_string(end, escaped))
+                        return false;
+                    str.assign(json.data() + index, end - index);
+                    if (escaped)
+                        target.set_flags(flag_escaped);
+                    index = end + 1;
                 }
+                MY_JSON_STATS(stats.allocations += str.capacity() != capacity;)
+                return true;
             }
 
-            std::string json;
-            int index;
+            // 调用者的缓冲区末尾不一定有 '\0'，越过结尾的下标读到 '\0'，逐字符判断的循环不需要单独检查结尾
+            struct Input {
+                const char *begin;
+                std::size_t length;
+
+                char operator[](std::size_t i) const {
+                    return i < length ? begin[i] : '\0';
+                }
+                const char *data() const {
+                    return begin;
+                }
+                std::size_t size() const {
+                    return length;
+                }
+                bool matches(std::size_t i, const char *text, std::size_t count) const {
+                    return i <= length && length - i >= count && std::memcmp(begin + i, text, count) == 0;
+                }
+            };
+
+            Input json = Input{nullptr, 0};
+            std::size_t index;
+            JsonParseOptions options;
+            JsonError error;
+            string_type key;
+            std::vector<Frame> frames;
+            std::size_t selection;
+            std::string skipped;
+            std::size_t nodes;
+            std::size_t memory;
+            std::size_t limit_depth;
+            std::size_t limit_nodes;
+            std::size_t limit_string;
+            std::size_t limit_container;
+            std::size_t limit_memory;
         };
 
-        void copy(const Json &other);
+    private:
+        friend class JsonView;
+
+        void copy(const basic_json &other);
+        static void throw_error(const JsonError &error);
+
+        const basic_json *find_member(const char *key, std::size_t size) const;
+        const basic_json &at_member(const char *key, std::size_t size) const;
+#ifdef MY_JSON_STRING_VIEW
+        template <typename Object>
+        static auto find_key(const Object &object, const char *key, std::size_t size, int) -> decltype(object.find(std::string_view(key, size)));
+#endif
+        template <typename Object>
+        static typename Object::const_iterator find_key(const Object &object, const char *key, std::size_t size, long);
+
+        static basic_json from_raw_number(Type type, const char *text, std::size_t size);
+        static bool inline_int(std::int64_t number);
+        static basic_json from_int64(std::int64_t number);
+        static basic_json from_uint64(std::uint64_t number);
+        const char *raw_text(std::size_t &size) const;
+        bool number_equal(const basic_json &other) const;
+        static bool parse_int64(const char *text, std::size_t size, std::int64_t &value);
+        static bool parse_uint64(const char *text, std::size_t size, std::uint64_t &value);
+        static bool parse_double(const char *text, std::size_t size, double &value);
+        static int hex_digit(char ch);
+        static std::size_t utf8_length(const char *p, const char *end);
+        static unsigned lowest_bit(unsigned mask);
+        static const char *find_string_end(const char *p, const char *end, bool &escaped, JsonError::Code &code);
+        static void unescape(const char *text, std::size_t size, string_type &str);
+        static std::size_t column_chunk(std::size_t rows, unsigned threads);
+        static JsonColumns column_table(const std::vector<JsonColumn> &schema, std::size_t rows, std::unordered_map<std::string, std::size_t> &names);
+        static void run_parallel(std::size_t count, const std::function<void(std::size_t)> &body);
+        bool column_value(JsonColumn &column, std::size_t row, std::string &buffer) const;
+        static void append_escaped(std::string &str, const char *data, std::size_t size);
+        void dump(std::string &str, JsonStats *stats, std::uint64_t depth) const;
+
+        std::uint64_t write_snapshot(std::ofstream &file, std::uint64_t &pos) const;
+        static std::uint64_t write_snapshot_node(std::ofstream &file, std::uint64_t &pos, Type type, std::uint32_t aux, const void *data, std::size_t size);
+
+        struct PatchStep;
+
+        static std::vector<string_type> parse_pointer(const string_type &pointer);
+        static bool parse_index(const string_type &token, std::size_t &index);
+        static void reserve_patch_steps(std::vector<PatchStep> *undo, std::size_t count);
+        basic_json *resolve_pointer(const std::vector<string_type> &path, std::size_t depth);
+        const basic_json *find_pointer(const std::vector<string_type> &path) const;
+        static bool patch_equal(const basic_json &lhs, const basic_json &rhs);
+        static bool patch_number_equal(const basic_json &integer, double real);
+        void patch_operation(basic_json &operation, std::vector<PatchStep> &undo);
+        void patch_add(const std::vector<string_type> &path, basic_json &&value, std::vector<PatchStep> *undo);
+        basic_json patch_remove(const std::vector<string_type> &path, std::vector<PatchStep> *undo);
+        void patch_replace(const std::vector<string_type> &path, basic_json &&value, std::vector<PatchStep> *undo);
+        void patch_rollback(std::vector<PatchStep> &undo);
+        static void merge_patch(basic_json &target, basic_json &&patch, std::vector<string_type> &path, std::vector<PatchStep> *undo);
+
+        template <typename To, typename From>
+        static To string_cast(const From &str);
+        static string_type index_token(std::size_t index);
+
+        struct DiffContext;
+
+        static std::uint64_t diff_hash(const basic_json &json, DiffContext &context);
+        static string_type escape_pointer(const string_type &key);
+        static void diff_emit(DiffContext &context, const char *op, const string_type &path, const basic_json *value);
+        static void diff_node(const basic_json &source, const basic_json &target, const string_type &path, DiffContext &context);
+        static void diff_object(const basic_json &source, const basic_json &target, const string_type &path, DiffContext &context);
+        static void diff_array(const basic_json &source, const basic_json &target, const string_type &path, DiffContext &context);
+        static bool diff_keyed_array(const basic_json &source, const basic_json &target, const string_type &path, DiffContext &context);
+
+        struct ArrayIndex;
+
+        // 容器的附加信息，只在开启哈希缓存等可选功能时分配；被 dedupe 共享的字符串也带有 ContainerHeader
+        // 与容器放在同一块内存中并位于容器之前，因此 value 中的指针仍直接指向容器
+        // text 为 enable_dump_cache 缓存的序列化结果，为空表示已经失效；index 为 create_index 建立的索引
+        // shares 为共享该值的节点个数，0 表示没有共享
+        // 只有 cache_plain 的容器保存 hash 与 text，见 CacheState
+        struct alignas(std::max_align_t) ContainerHeader {
+            std::uint64_t hash;
+            std::unique_ptr<std::string> text;
+            std::unique_ptr<ArrayIndex> index;
+            std::atomic<std::uint32_t> shares;
+            bool hash_valid;
+        };
+
+        // 子树的缓存能否信任：cache_plain 中的节点只能通过沿访问路径使缓存失效的接口修改，缓存一直有效到这些接口使它失效；
+        // cache_guarded 中有借出过子节点引用的容器（flag_lent）或借出过 span 的 packed 数组，之后可能不经过祖先直接修改，
+        // cache_guarded 的容器不保存缓存，每次使用时由子节点重新计算
+        enum CacheState { cache_plain, cache_guarded };
+
+        // 只用于借出的元素未知的二级索引（见 ArrayIndex::watch_all）：同一 Traits 的任何节点被修改时 generation() 递增，
+        // 还没有取过 stamp 时不递增，因此没有这样的索引时修改只读取一次计数器；取得的 stamp 与之后的修改一定不同
+        static std::atomic<std::uint64_t> &generation();
+        static std::uint64_t stamp();
+        static void touch();
+        static bool current(std::uint64_t value);
+        void lend();
+        void lend(std::size_t position);
+        static CacheState cache_hash(basic_json &json);
+        static CacheState cache_dump(basic_json &json, std::size_t depth);
+
+        // flag_raw_number: 数字保存的是原文，不超过 8 个字符时放在 data_raw 中（不足的部分补 '\0'），
+        // 否则同时带有 flag_raw_heap，原文保存在 data_string 中
+        // flag_escaped: data_string 中是字符串转义后的原文（不含引号），由 get_string() 等解码
+        // flag_header: 容器或字符串之前有 ContainerHeader，字符串只在被 dedupe 共享时带有
+        // flag_stale: 只在 Parser::parse_into 解析对象的过程中使用，标记尚未被新文档覆盖的成员
+        // flag_packed: packed 数组，元素保存在 data_ints 中，同时带有 flag_packed_double 时保存在 data_doubles 中；packed 数组没有 ContainerHeader
+        // flag_lent: 数组或对象曾经把子节点的可修改引用交给调用者（packed 数组为 span），随存储移动，复制时不保留
+        enum Flag {
+            flag_header = 1,
+            flag_raw_number = 2,
+            flag_raw_heap = 4,
+            flag_escaped = 8,
+            flag_stale = 16,
+            flag_packed = 32,
+            flag_packed_double = 64,
+            flag_lent = 128
+        };
+
+        union Value;
+
+        array_type &append_target(const char *function);
+
+        // 通过 Storage 读写类型、标志与 Value，布局由 Traits 决定
+        std::uint8_t flags() const;
+        Value payload() const;
+        void store(Type type, std::uint8_t flags, Value value);
+        void set_flags(std::uint8_t flags);
+
+        ContainerHeader *header() const;
+        void release(std::size_t depth);
+        void detach_nested(std::vector<basic_json> &nested);
+        const std::uint64_t *hash_cache() const;
+        const std::string *dump_cache() const;
+        std::size_t packed_size() const;
+        basic_json packed_element(std::size_t index) const;
+        const basic_json &packed_ref(std::size_t index) const;
+        void drop_packed_elements();
+        bool packed_append(const basic_json &value, bool front);
+        static bool packed_int64(const basic_json &value, std::int64_t &number);
+        static bool packed_equal(const basic_json &lhs, const basic_json &rhs);
+        void attach_header();
+        ContainerHeader *exclusive_header();
+        const void *storage_address() const;
+        std::size_t share();
+        std::size_t header_overhead() const;
+        void unshare();
+        void invalidate();
+        void invalidate(std::size_t position);
+        ArrayIndex *array_index(const char *function) const;
+        static const basic_json *index_key(const basic_json &element, const std::vector<string_type> &path, bool &lent);
+        static bool index_less(const basic_json &lhs, const basic_json &rhs);
+
+        struct DedupeContext;
+
+        static bool dedupe_node(basic_json &json, bool inside_shared, DedupeContext &context);
+        static bool dedupe_equal(const basic_json &lhs, const basic_json &rhs);
+        static void measure_tree(const basic_json &json, bool shared, JsonMemoryUsage &usage, std::unordered_set<const void *> &visited);
+        template <typename String>
+        static void measure_string(const String &str, std::size_t &bytes, std::size_t &slack);
+        static void measure(const basic_json &json, JsonMemoryUsage &usage);
+        static std::size_t heap_size(const basic_json &json);
+        static std::size_t owned_size(const basic_json &json);
+
+        template <typename T, typename... Args>
+        static T *create(Args &&...args);
+        template <typename T>
+        static void destroy(T *ptr, ContainerHeader *block);
+        template <typename T>
+        static T *relocate(T *container);
+        template <typename T>
+        static std::size_t block_size();
+
+        static std::uint64_t hash_mix(std::uint64_t value);
+        static std::uint64_t hash_bytes(const char *data, std::size_t size, std::uint64_t seed);
+        static std::uint64_t hash_node(const basic_json &json, std::uint64_t seed, std::unordered_map<const basic_json *, std::uint64_t> *memo);
+
+        // const 的 at 与 get_ptr 访问 packed 数组时生成的元素，每 64 个元素一块，只生成访问到的块，见 packed_ref
+        struct PackedElements;
+
+        // packed 数组的数字缓冲区；elements 见 PackedElements，修改缓冲区的接口会丢弃它；复制时不复制 elements
+        template <typename T>
+        struct PackedBuffer : std::vector<T> {
+            PackedBuffer(std::vector<T> &&values) : std::vector<T>(std::move(values)), elements(nullptr) {}
+            PackedBuffer(const PackedBuffer &other) : std::vector<T>(other), elements(nullptr) {}
+            PackedBuffer &operator=(const PackedBuffer &other) = delete;
+            ~PackedBuffer() {
+                delete elements.load(std::memory_order_relaxed);
+            }
+
+            std::atomic<PackedElements *> elements;
+        };
 
         union Value {
+            Value() : data_double(0) {}
+            Value(bool value) : data_bool(value) {}
+            Value(int value) : data_int(value) {}
+            Value(std::int64_t value) : data_int(value) {}
+            Value(double value) : data_double(value) {}
+            Value(string_type *value) : data_string(value) {}
+            Value(array_type *value) : data_array(value) {}
+            Value(object_type *value) : data_object(value) {}
+            Value(PackedBuffer<std::int64_t> *value) : data_ints(value) {}
+            Value(PackedBuffer<double> *value) : data_doubles(value) {}
+
             bool data_bool;
-            int data_int;
+            std::int64_t data_int;
             double data_double;
-            std::string *data_string;
-            std::vector<Json> *data_array;
-            std::map<std::string, Json> *data_object;
+            char data_raw[8];
+            string_type *data_string;
+            array_type *data_array;
+            object_type *data_object;
+            PackedBuffer<std::int64_t> *data_ints;
+            PackedBuffer<double> *data_doubles;
+        };
+
+        // 默认布局：类型、标志与 Value 分开保存，对齐后共 16 字节；超出 int 的整数保存原文
+        struct WideStorage {
+            static const std::int64_t int_max = INT_MAX;
+
+            Type data_type;
+            std::uint8_t data_flags;
+            Value value;
+
+            Type type() const {
+                return data_type;
+            }
+            std::uint8_t flags() const {
+                return data_flags;
+            }
+            Value load() const {
+                return value;
+            }
+            void store(Type type, std::uint8_t flags, Value value) {
+                data_type = type;
+                data_flags = flags;
+                this->value = value;
+            }
+            void set_flags(std::uint8_t flags) {
+                data_flags = flags;
+            }
+            const char *inline_text() const {
+                return value.data_raw;
+            }
+        };
+
+        // 紧凑布局（NaN-boxing）：高 13 位不全为 1 时整个字是一个 double，NaN 统一保存为 0x7ff8000000000000
+        // 否则 bit 48-50 为类型（json_double 表示保存原文的浮点数），低 48 位为 payload：
+        //   bool 为 0 或 1；int 为 bit 1-47 中的 47 位有符号整数，毫秒时间戳等都可以内联保存；
+        //   指针要求 8 字节对齐且不超过 48 位，低 3 位保存标志：
+        //   整数 bit 0 表示 payload 是原文的指针；字符串 bit 0、1 分别为 flag_escaped、flag_header；
+        //   数组 bit 1 为 flag_packed，普通数组 bit 0、2 分别为 flag_header、flag_lent，packed 数组 bit 0、2 分别为 flag_lent、flag_packed_double；
+        //   对象 bit 0、1 分别为 flag_header、flag_lent
+        // 原文总是保存在堆上（带有 flag_raw_heap），超出 47 位的整数与默认布局一样保存原文，因此 64 位整数不会丢失精度
+        // 没有位置保存 flag_stale，Parser::parse_into 复用对象时先清空原有的成员
+        struct CompactStorage {
+            std::uint64_t word;
+
+            static const std::uint64_t boxed = 0xfff8000000000000ULL;
+            static const std::uint64_t pointer_mask = 0x0000fffffffffff8ULL;
+            static const std::uint64_t int_mask = 0x0000fffffffffffeULL;
+            static const std::int64_t int_max = (1LL << 46) - 1;
+
+            Type type() const {
+                if ((word & boxed) != boxed)
+                    return json_double;
+                return static_cast<Type>((word >> 48) & 7);
+            }
+            std::uint8_t flags() const {
+                if ((word & boxed) != boxed)
+                    return 0;
+                unsigned bits = word & 7;
+                switch ((word >> 48) & 7) {
+                case json_int:
+                    return bits & 1 ? flag_raw_number | flag_raw_heap : 0;
+                case json_double:
+                    return flag_raw_number | flag_raw_heap;
+                case json_string:
+                    return (bits & 1 ? flag_escaped : 0) | (bits & 2 ? flag_header : 0);
+                case json_array:
+                    if (bits & 2)
+                        return flag_packed | (bits & 1 ? flag_lent : 0) | (bits & 4 ? flag_packed_double : 0);
+                    return (bits & 1 ? flag_header : 0) | (bits & 4 ? flag_lent : 0);
+                case json_object:
+                    return (bits & 1 ? flag_header : 0) | (bits & 2 ? flag_lent : 0);
+                default:
+                    return 0;
+                }
+            }
+            Value load() const {
+                Value value;
+                if ((word & boxed) != boxed) {
+                    std::memcpy(&value.data_double, &word, sizeof(double));
+                    return value;
+                }
+                std::uintptr_t pointer = static_cast<std::uintptr_t>(word & pointer_mask);
+                switch ((word >> 48) & 7) {
+                case json_bool:
+                    value.data_bool = (word & 1) != 0;
+                    break;
+                case json_int:
+                    if (word & 1)
+                        value.data_string = reinterpret_cast<string_type *>(pointer);
+                    else
+                        value.data_int = static_cast<std::int64_t>(word << 16) >> 17;
+                    break;
+                case json_double:
+                case json_string:
+                    value.data_string = reinterpret_cast<string_type *>(pointer);
+                    break;
+                case json_array:
+                    if ((word & 6) == 6)
+                        value.data_doubles = reinterpret_cast<PackedBuffer<double> *>(pointer);
+                    else if (word & 2)
+                        value.data_ints = reinterpret_cast<PackedBuffer<std::int64_t> *>(pointer);
+                    else
+                        value.data_array = reinterpret_cast<array_type *>(pointer);
+                    break;
+                case json_object:
+                    value.data_object = reinterpret_cast<object_type *>(pointer);
+                    break;
+                default:
+                    break;
+                }
+                return value;
+            }
+            void store(Type type, std::uint8_t flags, Value value) {
+                std::uint64_t tag = boxed | static_cast<std::uint64_t>(type) << 48;
+                switch (type) {
+                case json_bool:
+                    word = tag | value.data_bool;
+                    break;
+                case json_int:
+                    if (flags & flag_raw_number)
+                        word = tag | box(value.data_string) | 1;
+                    else
+                        word = tag | (static_cast<std::uint64_t>(value.data_int) << 1 & int_mask);
+                    break;
+                case json_double:
+                    if (flags & flag_raw_number)
+                        word = tag | box(value.data_string);
+                    else if (value.data_double != value.data_double)
+                        word = 0x7ff8000000000000ULL;
+                    else
+                        std::memcpy(&word, &value.data_double, sizeof(double));
+                    break;
+                case json_string:
+                    word = tag | box(value.data_string) | (flags & flag_escaped ? 1 : 0) | (flags & flag_header ? 2 : 0);
+                    break;
+                case json_array:
+                    if (flags & flag_packed)
+                        word = tag | box(value.data_array) | 2 | (flags & flag_lent ? 1 : 0) | (flags & flag_packed_double ? 4 : 0);
+                    else
+                        word = tag | box(value.data_array) | (flags & flag_header ? 1 : 0) | (flags & flag_lent ? 4 : 0);
+                    break;
+                case json_object:
+                    word = tag | box(value.data_object) | (flags & flag_header ? 1 : 0) | (flags & flag_lent ? 2 : 0);
+                    break;
+                default:
+                    word = tag;
+                    break;
+                }
+            }
+            void set_flags(std::uint8_t flags) {
+                this->store(this->type(), flags, this->load());
+            }
+            // 原文总是保存在堆上
+            const char *inline_text() const {
+                return nullptr;
+            }
+            template <typename T>
+            static std::uint64_t box(T *pointer) {
+                std::uint64_t bits = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(pointer));
+                if (bits & ~pointer_mask)
+                    MY_JSON_THROW(std::runtime_error("function Json: pointer does not fit the compact layout"));
+                return bits;
+            }
+        };
+
+        static const bool compact_layout = JsonCompactLayout<Traits>::value;
+        typedef typename std::conditional<compact_layout, CompactStorage, WideStorage>::type Storage;
+
+        Storage storage;
+    };
+
+    extern template class basic_json<JsonTraits>;
+
+    // 快照文件格式（版本 2，所有偏移量都相对于文件起始位置，因此与加载地址无关）:
+    //   header: "MYJSNAP\0" | u32 version | u32 0x01020304 | u64 root offset | u64 file size
+    //   node:   u32 type | u32 aux | payload，每个节点按 8 字节对齐
+    //     null / bool: aux 保存值，无 payload
+    //     int:    aux 为 JsonView::int_signed / int_unsigned 时 payload 为 8 字节 int64 / uint64，
+    //             为 int_text 时 payload 为以 '\0' 结尾的数字原文（超出 uint64 范围的整数）
+    //     double: payload 为 8 字节 double
+    //     string: aux 为长度，payload 为字符数据并以 '\0' 结尾
+    //     array:  aux 为元素个数，payload 为 u64 元素偏移量
+    //     object: aux 为成员个数，payload 为按 key 排序的 (u64 key 偏移量, u64 value 偏移量)
+    class JsonView {
+    public:
+        // int 节点的 aux
+        enum {
+            int_signed = 0,
+            int_unsigned = 1,
+            int_text = 2
+        };
+
+        JsonView();
+        JsonView(const char *base, std::uint64_t offset);
+
+        Json::Type type() const;
+
+        bool is_null() const;
+        bool is_bool() const;
+        bool is_int() const;
+        bool is_double() const;
+        bool is_string() const;
+        bool is_array() const;
+        bool is_object() const;
+
+        bool get_bool() const;
+        // 超出 int 范围时 get_int 抛出 out_of_range，可用 get_int64、get_uint64 或 get_number_text 读取
+        int get_int() const;
+        std::int64_t get_int64() const;
+        std::uint64_t get_uint64() const;
+        std::string get_number_text() const;
+        double get_double() const;
+        std::string get_string() const;
+        std::vector<JsonView> get_array() const;
+        std::map<std::string, JsonView> get_object() const;
+
+        // 直接返回快照中的字符串，不做拷贝
+        const char *c_str() const;
+        std::size_t length() const;
+
+        int size() const;
+        bool empty() const;
+
+        std::string to_string() const;
+        Json to_json() const;
+
+        bool find(const char *key) const;
+        bool find(const std::string &key) const;
+        bool has_key(const char *key) const;
+        bool has_key(const std::string &key) const;
+
+        JsonView operator[](int index) const;
+        JsonView operator[](const char *key) const;
+        JsonView operator[](const std::string &key) const;
+
+        operator bool() const;
+        operator int() const;
+        operator double() const;
+        operator std::string() const;
+
+    private:
+        std::uint32_t aux() const;
+        const char *payload() const;
+        std::uint64_t lookup(const char *key, std::size_t size) const;
+
+        const char *base;
+        std::uint64_t offset;
+    };
+
+    // 以只读方式 mmap 快照文件，页面按需加载，同一主机上的多个进程共享物理内存
+    // 由 root() 得到的 JsonView 在 JsonSnapshot 关闭或析构后失效
+    class JsonSnapshot {
+    public:
+        enum {
+            version = 2,
+            header_size = 32
         };
 
-        Type data_type;
-        Value value;
+        JsonSnapshot();
+        JsonSnapshot(const char *path);
+        JsonSnapshot(const std::string &path);
+        JsonSnapshot(JsonSnapshot &&other);
+        JsonSnapshot(const JsonSnapshot &other) = delete;
+        ~JsonSnapshot();
+
+        JsonSnapshot &operator=(JsonSnapshot &&other);
+        JsonSnapshot &operator=(const JsonSnapshot &other) = delete;
+
+        void open(const char *path);
+        void open(const std::string &path);
+        void close();
+
+        bool is_open() const;
+        std::size_t size() const;
+        JsonView root() const;
+
+    private:
+        const char *data;
+        std::size_t length;
+        std::uint64_t root_offset;
+#ifdef _WIN32
+        void *file_handle;
+        void *mapping_handle;
+#endif
     };
 
+#ifdef MY_JSON_LITERAL
+    // 在编译期解析 JSON 文本并生成快照格式的字节序列（格式见 JsonView），是 _json 字面量的实现
+    // 语法、转义与 UTF-8 的检查与运行时的 parse 一致，重复的 key 保留最后一个；double 按 IEEE 754 就近舍入
+    // 编译器逐条解释常量表达式，std::vector::push_back 与 std::string 的追加代价很高，因此结果直接按下标写入预先分配的缓冲区
+    class JsonTapeBuilder {
+    public:
+        struct Result {
+            JsonError error;
+            std::size_t size;
+            std::uint64_t root;
+        };
+
+        constexpr JsonTapeBuilder(const char *text, std::size_t text_size)
+            : text(text), text_size(text_size), index(0), root_offset(0), bytes(nullptr), used(0), values(nullptr), count(0) {}
+        JsonTapeBuilder(const JsonTapeBuilder &other) = delete;
+        JsonTapeBuilder &operator=(const JsonTapeBuilder &other) = delete;
+
+        constexpr ~JsonTapeBuilder() {
+            delete[] bytes;
+            delete[] values;
+        }
+
+        // 只取结果的大小与根节点位置，不保留字节序列
+        static constexpr Result measure(const char *text, std::size_t text_size) {
+            JsonTapeBuilder builder(text, text_size);
+            JsonError error = builder.build();
+            return Result{error, builder.size(), builder.root()};
+        }
+
+        static constexpr JsonError validate(const char *text, std::size_t text_size) {
+            return JsonTapeBuilder(text, text_size).build();
+        }
+
+        // 出错时结果只有全 0 的文件头
+        constexpr JsonError build() {
+            delete[] bytes;
+            delete[] values;
+            // 每个节点、偏移量与成员都能对应到输入中的字节，快照不超过输入的 16 倍加上文件头（"[1,2]" 中每个 int 节点与偏移量占 24 字节）；未结束的容器中的值不超过输入的字节数
+            bytes = new char[JsonSnapshot::header_size + 16 * (text_size + 1)];
+            values = new std::uint64_t[text_size + 1];
+            index = 0;
+            count = 0;
+            used = 0;
+            this->fill(JsonSnapshot::header_size);
+            JsonError error = this->parse();
+            if (error.code != JsonError::ok) {
+                used = 0;
+                this->fill(JsonSnapshot::header_size);
+                root_offset = 0;
+            }
+            return error;
+        }
+
+        constexpr const char *data() const {
+            return bytes;
+        }
+
+        constexpr std::size_t size() const {
+            return used;
+        }
+
+        constexpr std::uint64_t root() const {
+            return root_offset;
+        }
+
+    private:
+        // 尚未结束的容器，它的值是 values[start, count)；object 为交替的 key 偏移量与 value 偏移量
+        struct Frame {
+            bool object;
+            std::size_t start;
+        };
+
+        struct Member {
+            std::uint64_t prefix;
+            std::uint64_t key;
+            std::uint64_t value;
+            std::size_t position;
+        };
+
+        // 小端序的 32 位分段，只用于超出快速路径的 double
+        typedef std::vector<std::uint32_t> BigInt;
+
+        // 用显式的栈代替递归，嵌套深度不受编译器 constexpr 递归深度的限制
+        constexpr JsonError parse() {
+            std::vector<Frame> frames;
+            this->skip_space();
+            while (true) {
+                if (index == text_size)
+                    return JsonError(JsonError::unexpected_end, index);
+                char ch = text[index];
+                std::uint64_t offset = 0;
+                if (ch == '[' || ch == '{') {
+                    index++;
+                    frames.push_back(Frame{ch == '{', count});
+                    this->skip_space();
+                    if (index == text_size || text[index] != (ch == '{' ? '}' : ']')) {
+                        if (ch == '{') {
+                            JsonError error = this->key();
+                            if (error.code != JsonError::ok)
+                                return error;
+                        }
+                        continue;
+                    }
+                    index++;
+                    offset = this->close(frames);
+                } else {
+                    JsonError error = this->scalar(offset);
+                    if (error.code != JsonError::ok)
+                        return error;
+                }
+                // 一个值结束后逐层处理 ',' 与右括号，直到遇到下一个值或整个文档结束
+                while (true) {
+                    if (frames.empty())
+                        return this->finish(offset);
+                    bool object = frames.back().object;
+                    values[count++] = offset;
+                    this->skip_space();
+                    if (index == text_size)
+                        return JsonError(JsonError::unexpected_end, index);
+                    if (text[index] == ',') {
+                        index++;
+                        this->skip_space();
+                        if (object) {
+                            JsonError error = this->key();
+                            if (error.code != JsonError::ok)
+                                return error;
+                        }
+                        break;
+                    }
+                    if (text[index] != (object ? '}' : ']'))
+                        return JsonError(JsonError::unexpected_character, index);
+                    index++;
+                    offset = this->close(frames);
+                }
+            }
+        }
+
+        constexpr JsonError finish(std::uint64_t root) {
+            this->skip_space();
+            if (index != text_size)
+                return JsonError(JsonError::trailing_characters, index);
+            root_offset = root;
+            const char magic[8] = "MYJSNAP";
+            for (int i = 0; i < 8; i++)
+                bytes[i] = magic[i];
+            this->put_at(8, JsonSnapshot::version, 4);
+            this->put_at(12, 0x01020304, 4);
+            this->put_at(16, root, 8);
+            this->put_at(24, used, 8);
+            return JsonError();
+        }
+
+        // 解析 object 成员的 key 与其后的 ':'，key 直接写为字符串节点
+        constexpr JsonError key() {
+            if (index == text_size)
+                return JsonError(JsonError::unexpected_end, index);
+            if (text[index] != '"')
+                return JsonError(JsonError::unexpected_character, index);
+            std::uint64_t offset = 0;
+            JsonError error = this->string(offset);
+            if (error.code != JsonError::ok)
+                return error;
+            this->skip_space();
+            if (index == text_size)
+                return JsonError(JsonError::unexpected_end, index);
+            if (text[index] != ':')
+                return JsonError(JsonError::unexpected_character, index);
+            index++;
+            this->skip_space();
+            values[count++] = offset;
+            return JsonError();
+        }
+
+        // object 的成员按 key 排序后写出，JsonView 据此二分查找
+        constexpr std::uint64_t close(std::vector<Frame> &frames) {
+            Frame frame = frames.back();
+            frames.pop_back();
+            std::uint64_t offset = used;
+            if (!frame.object) {
+                this->put(Json::json_array, 4);
+                this->put(count - frame.start, 4);
+                for (std::size_t i = frame.start; i < count; i++)
+                    this->put(values[i], 8);
+                count = frame.start;
+                return offset;
+            }
+            // 先按 key 的前 8 个字节排序，相同时才逐字节比较；位置作为最后的依据，重复的 key 中最后一个排在最后
+            std::size_t total = (count - frame.start) / 2;
+            Member *members = new Member[total];
+            for (std::size_t i = 0; i < total; i++) {
+                std::uint64_t key = values[frame.start + i * 2];
+                members[i] = Member{this->prefix(key), key, values[frame.start + i * 2 + 1], i};
+            }
+            std::sort(members, members + total, [this](const Member &lhs, const Member &rhs) {
+                if (lhs.prefix != rhs.prefix)
+                    return lhs.prefix < rhs.prefix;
+                int cmp = this->compare(lhs.key, rhs.key);
+                return cmp != 0 ? cmp < 0 : lhs.position < rhs.position;
+            });
+            this->put(Json::json_object, 4);
+            this->put(0, 4);
+            std::uint32_t unique = 0;
+            for (std::size_t i = 0; i < total; i++) {
+                if (i + 1 < total && members[i].prefix == members[i + 1].prefix && this->compare(members[i].key, members[i + 1].key) == 0)
+                    continue;
+                this->put(members[i].key, 8);
+                this->put(members[i].value, 8);
+                unique++;
+            }
+            delete[] members;
+            this->put_at(offset + 4, unique, 4);
+            count = frame.start;
+            return offset;
+        }
+
+        // 字符串节点的前 8 个字节按大端序组成的整数，不足的部分补 0，整数的顺序与字节序列的顺序一致
+        constexpr std::uint64_t prefix(std::uint64_t offset) const {
+            std::uint64_t length = this->get(offset + 4, 4);
+            std::uint64_t value = 0;
+            for (std::uint64_t i = 0; i < 8; i++)
+                value = value << 8 | (i < length ? static_cast<unsigned char>(bytes[offset + 8 + i]) : 0);
+            return value;
+        }
+
+        // 比较两个字符串节点，与 JsonView 查找时的顺序一致
+        constexpr int compare(std::uint64_t lhs, std::uint64_t rhs) const {
+            std::uint64_t left = this->get(lhs + 4, 4), right = this->get(rhs + 4, 4);
+            for (std::uint64_t i = 0; i < left && i < right; i++) {
+                unsigned char a = bytes[lhs + 8 + i], b = bytes[rhs + 8 + i];
+                if (a != b)
+                    return a < b ? -1 : 1;
+            }
+            return left < right ? -1 : (left > right ? 1 : 0);
+        }
+
+        constexpr JsonError scalar(std::uint64_t &offset) {
+            switch (text[index]) {
+            case 'n':
+                offset = this->node(Json::json_null, 0);
+                return this->word("null");
+            case 't':
+                offset = this->node(Json::json_bool, 1);
+                return this->word("true");
+            case 'f':
+                offset = this->node(Json::json_bool, 0);
+                return this->word("false");
+            case '"':
+                return this->string(offset);
+            default:
+                return this->number(offset);
+            }
+        }
+
+        constexpr JsonError word(std::string_view literal) {
+            if (text_size - index < literal.size() || literal != std::string_view(text + index, literal.size()))
+                return JsonError(JsonError::unexpected_character, index);
+            index += literal.size();
+            return JsonError();
+        }
+
+        // index 指向开头的引号，结束时指向结尾引号之后；解码结果以 UTF-8 直接写为字符串节点
+        constexpr JsonError string(std::uint64_t &offset) {
+            offset = this->node(Json::json_string, 0);
+            index++;
+            while (true) {
+                if (index == text_size)
+                    return JsonError(JsonError::unexpected_end, index);
+                unsigned char ch = text[index];
+                if (ch == '"')
+                    break;
+                if (ch == '\\') {
+                    if (text_size - index < 2)
+                        return JsonError(JsonError::unexpected_end, text_size);
+                    switch (text[index + 1]) {
+                    case '"':
+                    case '\\':
+                    case '/':
+                        bytes[used++] = text[index + 1];
+                        break;
+                    case 'b':
+                        bytes[used++] = '\b';
+                        break;
+                    case 'f':
+                        bytes[used++] = '\f';
+                        break;
+                    case 'n':
+                        bytes[used++] = '\n';
+                        break;
+                    case 'r':
+                        bytes[used++] = '\r';
+                        break;
+                    case 't':
+                        bytes[used++] = '\t';
+                        break;
+                    case 'u': {
+                        std::uint32_t code = 0;
+                        JsonError error = this->hex(index + 2, code);
+                        if (error.code != JsonError::ok)
+                            return error;
+                        index += 4;
+                        // 成对的代理项合并为一个字符，孤立的代理项替换为 U+FFFD
+                        std::uint32_t low = 0;
+                        if (code >= 0xD800 && code < 0xDC00 && text_size - index >= 8 && text[index + 2] == '\\' && text[index + 3] == 'u' &&
+                            this->hex(index + 4, low).code == JsonError::ok && low >= 0xDC00 && low < 0xE000) {
+                            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                            index += 6;
+                        }
+                        if (code >= 0xD800 && code < 0xE000)
+                            code = 0xFFFD;
+                        this->put_utf8(code);
+                        break;
+                    }
+                    default:
+                        return JsonError(JsonError::invalid_escape, index);
+                    }
+                    index += 2;
+                } else if (ch < 0x20)
+                    return JsonError(JsonError::unexpected_character, index);
+                else if (ch < 0x80)
+                    bytes[used++] = text[index++];
+                else {
+                    std::size_t length = this->utf8_length();
+                    if (length == 0)
+                        return JsonError(JsonError::invalid_utf8, index);
+                    for (std::size_t i = 0; i < length; i++)
+                        bytes[used++] = text[index++];
+                }
+            }
+            index++;
+            this->put_at(offset + 4, used - offset - 8, 4);
+            this->fill(1);
+            this->align();
+            return JsonError();
+        }
+
+        // begin 指向 \u 之后的 4 个十六进制数字
+        constexpr JsonError hex(std::size_t begin, std::uint32_t &code) const {
+            code = 0;
+            for (std::size_t i = begin; i < begin + 4; i++) {
+                if (i >= text_size)
+                    return JsonError(JsonError::unexpected_end, text_size);
+                char ch = text[i];
+                int digit = ch >= '0' && ch <= '9' ? ch - '0' : (ch >= 'a' && ch <= 'f' ? ch - 'a' + 10 : (ch >= 'A' && ch <= 'F' ? ch - 'A' + 10 : -1));
+                if (digit < 0)
+                    return JsonError(JsonError::invalid_escape, begin - 2);
+                code = code << 4 | digit;
+            }
+            return JsonError();
+        }
+
+        constexpr void put_utf8(std::uint32_t code) {
+            if (code < 0x80)
+                bytes[used++] = static_cast<char>(code);
+            else if (code < 0x800) {
+                bytes[used++] = static_cast<char>(0xC0 | code >> 6);
+                bytes[used++] = static_cast<char>(0x80 | (code & 0x3F));
+            } else if (code < 0x10000) {
+                bytes[used++] = static_cast<char>(0xE0 | code >> 12);
+                bytes[used++] = static_cast<char>(0x80 | (code >> 6 & 0x3F));
+                bytes[used++] = static_cast<char>(0x80 | (code & 0x3F));
+            } else {
+                bytes[used++] = static_cast<char>(0xF0 | code >> 18);
+                bytes[used++] = static_cast<char>(0x80 | (code >> 12 & 0x3F));
+                bytes[used++] = static_cast<char>(0x80 | (code >> 6 & 0x3F));
+                bytes[used++] = static_cast<char>(0x80 | (code & 0x3F));
+            }
+        }
+
+        // 与 Json::utf8_length 相同，编码不合法时返回 0
+        constexpr std::size_t utf8_length() const {
+            unsigned char lead = text[index];
+            std::size_t length = 0;
+            if (lead >= 0xC2 && lead <= 0xDF)
+                length = 2;
+            else if (lead >= 0xE0 && lead <= 0xEF)
+                length = 3;
+            else if (lead >= 0xF0 && lead <= 0xF4)
+                length = 4;
+            else
+                return 0;
+            if (text_size - index < length)
+                return 0;
+            for (std::size_t i = 1; i < length; i++)
+                if ((static_cast<unsigned char>(text[index + i]) & 0xC0) != 0x80)
+                    return 0;
+            unsigned char next = text[index + 1];
+            if ((lead == 0xE0 && next < 0xA0) || (lead == 0xED && next >= 0xA0) || (lead == 0xF0 && next < 0x90) || (lead == 0xF4 && next >= 0x90))
+                return 0;
+            return length;
+        }
+
+        constexpr bool digit_at(std::size_t position) const {
+            return position < text_size && text[position] >= '0' && text[position] <= '9';
+        }
+
+        // 没有小数部分与指数的数字为 int，其余为 double
+        constexpr JsonError number(std::uint64_t &offset) {
+            std::size_t start = index;
+            bool negative = text[index] == '-';
+            if (negative)
+                index++;
+            if (index == text_size)
+                return JsonError(JsonError::unexpected_end, index);
+            // 值为有效数字（不含前导零）乘以 10^exponent，mantissa 只累加前 19 位有效数字
+            std::size_t first = index;
+            std::uint64_t mantissa = 0;
+            long digits = 0;
+            long exponent = 0;
+            if (text[index] == '0')
+                index++;
+            else if (this->digit_at(index)) {
+                for (; this->digit_at(index); index++, digits++)
+                    if (digits < 19)
+                        mantissa = mantissa * 10 + (text[index] - '0');
+            } else
+                return JsonError(JsonError::unexpected_character, index);
+            bool integer = true;
+            if (index < text_size && text[index] == '.') {
+                integer = false;
+                index++;
+                if (index == text_size)
+                    return JsonError(JsonError::unexpected_end, index);
+                if (!this->digit_at(index))
+                    return JsonError(JsonError::unexpected_character, index);
+                for (; this->digit_at(index); index++, exponent--) {
+                    if (digits == 0 && text[index] == '0')
+                        continue;
+                    if (digits < 19)
+                        mantissa = mantissa * 10 + (text[index] - '0');
+                    digits++;
+                }
+            }
+            std::size_t last = index;
+            if (index < text_size && (text[index] == 'e' || text[index] == 'E')) {
+                integer = false;
+                index++;
+                bool negative_exponent = index < text_size && text[index] == '-';
+                if (index < text_size && (text[index] == '-' || text[index] == '+'))
+                    index++;
+                if (index == text_size)
+                    return JsonError(JsonError::unexpected_end, index);
+                if (!this->digit_at(index))
+                    return JsonError(JsonError::unexpected_character, index);
+                long value = 0;
+                for (; this->digit_at(index); index++)
+                    if (value < 100000)
+                        value = value * 10 + (text[index] - '0');
+                exponent += negative_exponent ? -value : value;
+            }
+            if (integer) {
+                // 与 save_snapshot 相同：优先保存为 int64，其次 uint64，都放不下时保存原文
+                const std::uint64_t int64_limit = std::uint64_t(1) << 63;
+                std::uint64_t value = mantissa;
+                bool fits = digits < 19;
+                if (digits == 19 || digits == 20) {
+                    fits = true;
+                    value = 0;
+                    for (std::size_t i = first; i < last && fits; i++) {
+                        std::uint64_t digit = text[i] - '0';
+                        fits = value <= (UINT64_MAX - digit) / 10;
+                        value = value * 10 + digit;
+                    }
+                }
+                if (fits && value < int64_limit + std::uint64_t(negative)) {
+                    offset = this->node(Json::json_int, JsonView::int_signed);
+                    this->put(negative ? ~value + 1 : value, 8);
+                } else if (fits && !negative) {
+                    offset = this->node(Json::json_int, JsonView::int_unsigned);
+                    this->put(value, 8);
+                } else {
+                    offset = this->node(Json::json_int, JsonView::int_text);
+                    for (std::size_t i = start; i < last; i++)
+                        bytes[used++] = text[i];
+                    bytes[used++] = '\0';
+                    this->align();
+                }
+                return JsonError();
+            }
+            std::uint64_t bits = digits == 0 ? 0 : this->double_bits(mantissa, digits, exponent, first, last);
+            if (negative)
+                bits |= std::uint64_t(1) << 63;
+            offset = this->node(Json::json_double, 0);
+            this->put(bits, 8);
+            return JsonError();
+        }
+
+        // 有效数字不超过 19 位且 |exponent| <= 27 时，5^|exponent| 不超过 64 位，用 128 位整数精确计算；否则逐位处理 text[first, last) 中的数字
+        // 超出范围时为无穷大，与运行时 get_double 的结果一致
+        constexpr std::uint64_t double_bits(std::uint64_t mantissa, long digits, long exponent, std::size_t first, std::size_t last) const {
+            const std::uint64_t infinity = std::uint64_t(0x7FF) << 52;
+            if (digits - 1 + exponent > 308)
+                return infinity;
+            if (digits + exponent < -324)
+                return 0;
+            if (digits <= 19 && exponent >= -27 && exponent <= 27) {
+                std::uint64_t power = 1;
+                for (long i = 0; i < (exponent < 0 ? -exponent : exponent); i++)
+                    power *= 5;
+                if (exponent >= 0) {
+                    std::uint64_t high = 0, low = 0;
+                    wide_multiply(mantissa, power, high, low);
+                    return round(high, low, false, exponent);
+                }
+                // 被除数左移到最高位，商至少有 64 位；余数小于 2^63，左移一位不会溢出
+                long shift = 128 - std::bit_width(mantissa);
+                std::uint64_t dividend = mantissa << (shift - 64);
+                std::uint64_t high = 0, low = 0, remainder = 0;
+                for (int i = 127; i >= 0; i--) {
+                    remainder = remainder << 1 | (i >= 64 ? dividend >> (i - 64) & 1 : 0);
+                    high = high << 1 | low >> 63;
+                    low <<= 1;
+                    if (remainder >= power) {
+                        remainder -= power;
+                        low |= 1;
+                    }
+                }
+                return round(high, low, remainder != 0, exponent - shift);
+            }
+            BigInt value;
+            for (std::size_t i = first; i < last; i++)
+                if (text[i] != '.')
+                    multiply(value, 10, text[i] - '0');
+            if (exponent >= 0) {
+                for (long i = 0; i < exponent; i++)
+                    multiply(value, 10, 0);
+                return round(value, false, 0);
+            }
+            // 被除数左移 shift 位使商至少有 55 位
+            BigInt scale(1, 1);
+            for (long i = 0; i < -exponent; i++)
+                multiply(scale, 10, 0);
+            long length = static_cast<long>(bit_length(value));
+            long shift = std::max(0L, static_cast<long>(bit_length(scale)) - length + 55);
+            BigInt quotient, remainder;
+            for (long i = length - 1; i >= -shift; i--) {
+                multiply(remainder, 2, i >= 0 && bit(value, i));
+                bool take = !less(remainder, scale);
+                if (take)
+                    subtract(remainder, scale);
+                multiply(quotient, 2, take);
+            }
+            return round(quotient, bit_length(remainder) != 0, -shift);
+        }
+
+        // 取最高的 128 位，其余的位并入 sticky
+        static constexpr std::uint64_t round(const BigInt &value, bool sticky, long scale) {
+            long length = static_cast<long>(bit_length(value));
+            long drop = std::max(0L, length - 128);
+            std::uint64_t high = 0, low = 0;
+            for (long i = length - 1; i >= drop; i--) {
+                high = high << 1 | low >> 63;
+                low = low << 1 | bit(value, i);
+            }
+            for (long i = 0; i < drop && !sticky; i++)
+                sticky = bit(value, i);
+            return round(high, low, sticky, scale + drop);
+        }
+
+        // 值为 (high * 2^64 + low + 小于 1 的部分) * 2^scale，sticky 表示小于 1 的部分不为 0；舍入到最近的 double，相等时取偶数
+        static constexpr std::uint64_t round(std::uint64_t high, std::uint64_t low, bool sticky, long scale) {
+            const std::uint64_t infinity = std::uint64_t(0x7FF) << 52;
+            const std::uint64_t hidden = std::uint64_t(1) << 52;
+            auto at = [high, low](long index) -> std::uint64_t {
+                return (index >= 64 ? high >> (index - 64) : low >> index) & 1;
+            };
+            long length = high != 0 ? 64 + std::bit_width(high) : std::bit_width(low);
+            long exponent = length - 1 + scale;
+            if (exponent > 1023)
+                return infinity;
+            // 最低有效位的权重，非规格化数为 2^-1074
+            long lsb = std::max(exponent - 52, -1074L);
+            long shift = lsb - scale;
+            std::uint64_t mantissa = 0;
+            for (long i = length - 1; i >= std::max(shift, 0L); i--)
+                mantissa = mantissa << 1 | at(i);
+            if (shift < 0)
+                mantissa <<= -shift;
+            else if (shift > 0 && at(shift - 1)) {
+                bool rest = sticky;
+                for (long i = 0; i < shift - 1 && !rest; i++)
+                    rest = at(i);
+                if (rest || (mantissa & 1))
+                    mantissa++;
+                if (mantissa == hidden << 1) {
+                    mantissa >>= 1;
+                    lsb++;
+                }
+            }
+            if (mantissa < hidden)
+                return mantissa;
+            std::uint64_t biased = lsb + 52 + 1023;
+            return biased >= 0x7FF ? infinity : (biased << 52 | (mantissa & (hidden - 1)));
+        }
+
+        static constexpr void wide_multiply(std::uint64_t lhs, std::uint64_t rhs, std::uint64_t &high, std::uint64_t &low) {
+            std::uint64_t a = lhs >> 32, b = lhs & 0xFFFFFFFF, c = rhs >> 32, d = rhs & 0xFFFFFFFF;
+            std::uint64_t middle = (b * d >> 32) + (a * d & 0xFFFFFFFF) + (b * c & 0xFFFFFFFF);
+            low = middle << 32 | (b * d & 0xFFFFFFFF);
+            high = a * c + (a * d >> 32) + (b * c >> 32) + (middle >> 32);
+        }
+
+        static constexpr void multiply(BigInt &value, std::uint32_t factor, std::uint32_t addend) {
+            std::uint64_t carry = addend;
+            for (auto &i : value) {
+                std::uint64_t product = static_cast<std::uint64_t>(i) * factor + carry;
+                i = static_cast<std::uint32_t>(product);
+                carry = product >> 32;
+            }
+            if (carry != 0)
+                value.push_back(static_cast<std::uint32_t>(carry));
+        }
+
+        static constexpr void subtract(BigInt &lhs, const BigInt &rhs) {
+            std::int64_t borrow = 0;
+            for (std::size_t i = 0; i < lhs.size(); i++) {
+                std::int64_t difference = static_cast<std::int64_t>(lhs[i]) - (i < rhs.size() ? rhs[i] : 0) - borrow;
+                borrow = difference < 0;
+                lhs[i] = static_cast<std::uint32_t>(difference + (borrow << 32));
+            }
+        }
+
+        static constexpr bool less(const BigInt &lhs, const BigInt &rhs) {
+            for (std::size_t i = std::max(lhs.size(), rhs.size()); i > 0; i--) {
+                std::uint32_t left = i <= lhs.size() ? lhs[i - 1] : 0;
+                std::uint32_t right = i <= rhs.size() ? rhs[i - 1] : 0;
+                if (left != right)
+                    return left < right;
+            }
+            return false;
+        }
+
+        static constexpr std::size_t bit_length(const BigInt &value) {
+            for (std::size_t i = value.size(); i > 0; i--)
+                if (value[i - 1] != 0)
+                    return (i - 1) * 32 + std::bit_width(value[i - 1]);
+            return 0;
+        }
+
+        static constexpr bool bit(const BigInt &value, long index) {
+            std::size_t limb = static_cast<std::size_t>(index) / 32;
+            return limb < value.size() && (value[limb] >> (index % 32) & 1);
+        }
+
+        constexpr void skip_space() {
+            while (index < text_size && (text[index] == ' ' || text[index] == '\t' || text[index] == '\n' || text[index] == '\r'))
+                index++;
+        }
+
+        // 按本机字节序读写，与 save_snapshot 一致
+        constexpr void put_at(std::uint64_t offset, std::uint64_t value, int width) {
+            for (int i = 0; i < width; i++) {
+                int shift = std::endian::native == std::endian::little ? i * 8 : (width - 1 - i) * 8;
+                bytes[offset + i] = static_cast<char>(value >> shift & 0xFF);
+            }
+        }
+
+        constexpr std::uint64_t get(std::uint64_t offset, int width) const {
+            std::uint64_t value = 0;
+            for (int i = 0; i < width; i++) {
+                int shift = std::endian::native == std::endian::little ? i * 8 : (width - 1 - i) * 8;
+                value |= static_cast<std::uint64_t>(static_cast<unsigned char>(bytes[offset + i])) << shift;
+            }
+            return value;
+        }
+
+        constexpr void put(std::uint64_t value, int width) {
+            this->put_at(used, value, width);
+            used += width;
+        }
+
+        constexpr void fill(std::size_t size) {
+            for (std::size_t i = 0; i < size; i++)
+                bytes[used++] = '\0';
+        }
+
+        constexpr void align() {
+            this->fill((8 - used % 8) % 8);
+        }
+
+        // 节点头，payload 由调用者紧接着写入
+        constexpr std::uint64_t node(Json::Type type, std::uint32_t aux) {
+            std::uint64_t offset = used;
+            this->put(type, 4);
+            this->put(aux, 4);
+            return offset;
+        }
+
+        const char *text;
+        std::size_t text_size;
+        std::size_t index;
+        std::uint64_t root_offset;
+        char *bytes;
+        std::size_t used;
+        std::uint64_t *values;
+        std::size_t count;
+    };
+
+    // 字符串字面量作为模板参数，N 包括结尾的 '\0'
+    template <std::size_t N>
+    struct JsonLiteralText {
+        constexpr JsonLiteralText(const char (&text)[N]) {
+            std::copy(text, text + N, data);
+        }
+
+        constexpr std::size_t size() const {
+            return N - 1;
+        }
+
+        char data[N];
+    };
+
+    // 每个不同的字面量对应一份静态的只读快照，在编译期生成，程序启动时不需要解析或初始化
+    template <JsonLiteralText Text>
+    struct JsonLiteral {
+        static constexpr JsonTapeBuilder::Result result = JsonTapeBuilder::measure(Text.data, Text.size());
+        static constexpr JsonError error = result.error;
+
+        alignas(8) static constexpr std::array<char, result.size> tape = [] {
+            JsonTapeBuilder builder(Text.data, Text.size());
+            builder.build();
+            std::array<char, result.size> bytes;
+            std::copy(builder.data(), builder.data() + result.size, bytes.begin());
+            return bytes;
+        }();
+
+        static JsonView root() {
+            return JsonView(tape.data(), result.root);
+        }
+    };
+
+    // 只用于在编译错误中显示错误码与偏移量
+    template <JsonError::Code Code, std::size_t Offset>
+    struct JsonLiteralCheck {
+        static constexpr bool value = Code == JsonError::ok;
+    };
+
+    inline namespace literals {
+        // R"({"a": [1, 2.5, "x"]})"_json 在编译期解析并校验，格式错误时编译失败
+        // 返回的 JsonView 指向静态的快照，整个程序运行期间有效；需要修改时用 to_json() 得到 Json
+        template <JsonLiteralText Text>
+        JsonView operator""_json() {
+            static_assert(JsonLiteralCheck<JsonLiteral<Text>::error.code, JsonLiteral<Text>::error.offset>::value, "invalid JSON literal");
+            return JsonLiteral<Text>::root();
+        }
+    } // namespace literals
+#endif
+
 } // namespace my_json
+
+namespace std {
+    template <typename Traits>
+    struct hash<my_json::basic_json<Traits>> {
+        std::size_t operator()(const my_json::basic_json<Traits> &json) const {
+            return static_cast<std::size_t>(json.hash());
+        }
+    };
+} // namespace std
@@ -1,14 +1,616 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
 #include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// 定义 MY_JSON_INSTRUMENTATION 后统计 parse 与 to_string 的调用信息，未定义时统计的代码不参与编译
+// 类的布局与宏无关（Parser 总是带有 stats 成员），但 Parser 等定义在头文件中的函数体随宏变化，
+// 因此所有包含本头文件的翻译单元必须与 Json.cpp 使用相同的定义，否则违反 ODR
+#ifdef MY_JSON_INSTRUMENTATION
+#include <chrono>
+#define MY_JSON_STATS(...) __VA_ARGS__
+#else
+#define MY_JSON_STATS(...)
+#endif
+
+// 编译时关闭了异常（-fno-exceptions）时，原本抛出异常的地方改为调用 std::abort()，
+// 此时解析请使用带 JsonError 参数的 parse，查找请使用 get_ptr
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+#define MY_JSON_THROW(...) throw __VA_ARGS__
+#define MY_JSON_TRY try
+#define MY_JSON_CATCH_ALL catch (...)
+#define MY_JSON_RETHROW throw
+#else
+#include <cstdlib>
+#define MY_JSON_THROW(...) std::abort()
+#define MY_JSON_TRY if (true)
+#define MY_JSON_CATCH_ALL else
+#define MY_JSON_RETHROW std::abort()
+#endif
+
+// 有 SSE2 时字符串每次检查 16 个字节，非 ASCII 字符在块内校验 UTF-8 后继续按块检查，只有遇到引号、反斜杠或控制字符时才逐字节处理
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MY_JSON_SSE2
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// C++17 起提供以 std::string_view 为 key 的查找
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#include <string_view>
+#define MY_JSON_STRING_VIEW
+#endif
+
+// C++20 起 JsonSpan 可以转换为 std::span
+#if __cplusplus >= 202002L || (defined(_MSVC_LANG) && _MSVC_LANG >= 202002L)
+#include <span>
+#define MY_JSON_SPAN
+#endif
+
+// C++20 起支持在编译期解析的 JSON 字面量 "..."_json，需要 constexpr 的 std::vector / std::string 与类类型的模板参数
+#if (__cplusplus >= 202002L || (defined(_MSVC_LANG) && _MSVC_LANG >= 202002L)) && defined(__cpp_nontype_template_args) && __cpp_nontype_template_args >= 201911L && defined(__cpp_lib_constexpr_vector) && defined(__cpp_lib_constexpr_string)
+#include <array>
+#include <bit>
+#define MY_JSON_LITERAL
+#endif
 
 namespace my_json {
 
-    class Json {
+    // 单次调用或累计的统计信息，时间单位为纳秒
+    // allocations 为结果中字符串、数组、对象以及它们的缓冲区申请内存的次数
+    struct JsonStats {
+        std::uint64_t parse_calls;
+        std::uint64_t parse_errors; // parse_calls 中失败的次数
+        std::uint64_t serialize_calls;
+        std::uint64_t bytes_in;
+        std::uint64_t bytes_out;
+        std::uint64_t nodes[7]; // 按 Json::Type 分类
+        std::uint64_t max_depth;
+        std::uint64_t allocations;
+        std::uint64_t read_ns;
+        std::uint64_t parse_ns;
+        std::uint64_t serialize_ns;
+    };
+
+    class JsonInstrumentation {
+    public:
+        // input 为解析的原文，序列化时为输出的文本
+        typedef std::function<void(const JsonStats &stats, const std::string &input)> Callback;
+
+        static bool enabled() {
+            MY_JSON_STATS(return true;)
+            return false;
+        }
+
+        // JsonStats 的所有字段都是 std::uint64_t，累计值按下标逐个保存
+        static JsonStats total() {
+            JsonStats stats = JsonStats();
+#ifdef MY_JSON_INSTRUMENTATION
+            std::uint64_t *fields = reinterpret_cast<std::uint64_t *>(&stats);
+            for (std::size_t i = 0; i < sizeof(JsonStats) / sizeof(std::uint64_t); i++)
+                fields[i] = state().counters[i].load(std::memory_order_relaxed);
+#endif
+            return stats;
+        }
+
+        static JsonStats last() {
+            MY_JSON_STATS(return last_stats();)
+            return JsonStats();
+        }
+
+        static void reset() {
+#ifdef MY_JSON_INSTRUMENTATION
+            for (auto &i : state().counters)
+                i.store(0, std::memory_order_relaxed);
+#endif
+        }
+
+        // 单次调用耗时不少于 threshold_ns 时调用 callback，用于采样慢文档；callback 为空时取消
+        static void set_callback(Callback callback, std::uint64_t threshold_ns) {
+#ifdef MY_JSON_INSTRUMENTATION
+            std::lock_guard<std::mutex> lock(state().mutex);
+            state().threshold.store(callback ? threshold_ns : UINT64_MAX);
+            state().callback = std::move(callback);
+#else
+            (void)callback;
+            (void)threshold_ns;
+#endif
+        }
+
+        static void record(const JsonStats &stats, const std::string &input) {
+#ifdef MY_JSON_INSTRUMENTATION
+            last_stats() = stats;
+            State &state = JsonInstrumentation::state();
+            const std::uint64_t *fields = reinterpret_cast<const std::uint64_t *>(&stats);
+            const std::size_t max_depth = offsetof(JsonStats, max_depth) / sizeof(std::uint64_t);
+            for (std::size_t i = 0; i < sizeof(JsonStats) / sizeof(std::uint64_t); i++) {
+                if (i != max_depth) {
+                    if (fields[i] != 0)
+                        state.counters[i].fetch_add(fields[i], std::memory_order_relaxed);
+                    continue;
+                }
+                std::uint64_t depth = state.counters[i].load(std::memory_order_relaxed);
+                while (depth < fields[i] && !state.counters[i].compare_exchange_weak(depth, fields[i], std::memory_order_relaxed))
+                    ;
+            }
+            if (stats.read_ns + stats.parse_ns + stats.serialize_ns >= state.threshold.load(std::memory_order_relaxed)) {
+                Callback callback;
+                {
+                    std::lock_guard<std::mutex> lock(state.mutex);
+                    callback = state.callback;
+                }
+                if (callback)
+                    callback(stats, input);
+            }
+#else
+            (void)stats;
+            (void)input;
+#endif
+        }
+
+        static void record_read(std::uint64_t ns) {
+#ifdef MY_JSON_INSTRUMENTATION
+            state().counters[offsetof(JsonStats, read_ns) / sizeof(std::uint64_t)].fetch_add(ns, std::memory_order_relaxed);
+#else
+            (void)ns;
+#endif
+        }
+
+    private:
+#ifdef MY_JSON_INSTRUMENTATION
+        struct State {
+            State() : threshold(UINT64_MAX) {
+                for (auto &i : counters)
+                    i.store(0);
+            }
+
+            std::atomic<std::uint64_t> counters[sizeof(JsonStats) / sizeof(std::uint64_t)];
+            std::atomic<std::uint64_t> threshold;
+            std::mutex mutex;
+            Callback callback;
+        };
+
+        static State &state() {
+            static State state;
+            return state;
+        }
+
+        static JsonStats &last_stats() {
+            static thread_local JsonStats stats = JsonStats();
+            return stats;
+        }
+#endif
+    };
+
+    // basic_json 的默认策略：std::string、std::vector 与 std::map，内存来自全局堆
+    // 自定义策略需要提供同样的成员：
+    //   allocator_type 用于申请字符串、数组、对象本身以及它们的附加信息，使用时默认构造，
+    //     因此按线程或按请求区分的内存池需要由分配器自己找到对应的资源（例如 thread_local）
+    //   string_type 需要提供 std::basic_string<char> 的接口
+    //   array_type 为类似 std::vector 的顺序容器，object_type 为以 string_type 为 key 的 map，有序无序均可，
+    //     比较器支持异构查找（例如 std::less<>）时 get_ptr 与 at 不需要构造临时的 key
+    //   容器内部使用的分配器由容器类型决定，例如 std::pmr::vector
+    // Json.cpp 只实例化了默认的 Json，使用其他策略请包含 Json.hpp
+    struct JsonTraits {
+        typedef std::allocator<char> allocator_type;
+        typedef std::string string_type;
+        template <typename Json>
+        using array_type = std::vector<Json>;
+        template <typename Json>
+        using object_type = std::map<std::string, Json>;
+    };
+
+    // 与 JsonTraits 相同，但节点使用 8 字节的紧凑布局，见 basic_json::CompactStorage；Json.cpp 没有实例化，使用时请包含 Json.hpp
+    // 自定义策略中定义 static const bool compact_layout = true 即可使用紧凑布局，没有该成员时使用默认的 16 字节布局
+    struct JsonCompactTraits : JsonTraits {
+        static const bool compact_layout = true;
+    };
+
+    template <typename Traits, typename = void>
+    struct JsonCompactLayout : std::false_type {};
+
+    template <typename Traits>
+    struct JsonCompactLayout<Traits, typename std::enable_if<Traits::compact_layout>::type> : std::true_type {};
+
+    // 校验失败的原因，offset 为出错处相对于输入起始的字节偏移
+    struct JsonError {
+        enum Code {
+            ok = 0,
+            unexpected_end,
+            unexpected_character,
+            invalid_escape,
+            invalid_utf8,
+            trailing_characters,
+            depth_exceeded,
+            too_many_nodes,
+            string_too_long,
+            container_too_large,
+            memory_exceeded
+        };
+
+        constexpr JsonError() : code(ok), offset(0) {}
+        constexpr JsonError(Code code, std::size_t offset) : code(code), offset(offset) {}
+
+        const char *message() const {
+            switch (code) {
+            case ok:
+                return "ok";
+            case unexpected_end:
+                return "Unexpected end of json";
+            case unexpected_character:
+                return "Unexpected character";
+            case invalid_escape:
+                return "Invalid escape";
+            case invalid_utf8:
+                return "Invalid UTF-8";
+            case trailing_characters:
+                return "Unexpected character after json";
+            case depth_exceeded:
+                return "Maximum depth exceeded";
+            case too_many_nodes:
+                return "Too many nodes";
+            case string_too_long:
+                return "String too long";
+            case container_too_large:
+                return "Container too large";
+            case memory_exceeded:
+                return "Memory limit exceeded";
+            default:
+                return "Unknown error";
+            }
+        }
+
+        Code code;
+        std::size_t offset;
+    };
+
+    // 解析时的投影：只构建给定 JSON Pointer 指向的子树及其祖先，其余的值只检查括号与引号是否匹配后跳过，不解码也不分配内存
+    // 路径中的 "*" 匹配对象的任意成员或数组的任意元素；数组中跳过的元素以 null 占位，保持下标不变
+    // 空字符串 "" 选中整个文档；通过 JsonParseOptions::projection 传给 parse，解析期间需要保持有效
+    class JsonProjection {
+    public:
+        static const std::size_t npos = static_cast<std::size_t>(-1);
+
+        JsonProjection() {
+            this->clear();
+        }
+
+        JsonProjection(std::initializer_list<std::string> pointers) {
+            this->clear();
+            for (const auto &i : pointers)
+                this->add(i);
+        }
+
+        ~JsonProjection(){};
+
+        void add(const std::string &pointer) {
+            std::vector<std::string> path;
+            if (!pointer.empty()) {
+                if (pointer[0] != '/')
+                    MY_JSON_THROW(std::logic_error("function JsonProjection::add: invalid json pointer " + pointer));
+                std::string token;
+                for (std::size_t i = 1; i <= pointer.size(); i++) {
+                    if (i == pointer.size() || pointer[i] == '/') {
+                        path.push_back(std::move(token));
+                        token.clear();
+                    } else if (pointer[i] == '~') {
+                        if (i + 1 < pointer.size() && pointer[i + 1] == '0')
+                            token += '~';
+                        else if (i + 1 < pointer.size() && pointer[i + 1] == '1')
+                            token += '/';
+                        else
+                            MY_JSON_THROW(std::logic_error("function JsonProjection::add: invalid json pointer " + pointer));
+                        i++;
+                    } else
+                        token += pointer[i];
+                }
+            }
+            this->insert(path);
+            this->expand(0);
+        }
+
+        void clear() {
+            nodes.clear();
+            nodes.push_back(Node{std::string(), npos, false, npos, std::vector<std::size_t>()});
+        }
+
+        // 以下供解析器使用：节点 0 为根，返回 npos 表示该成员或元素没有被选中
+        std::size_t member(std::size_t node, const char *key, std::size_t size) const {
+            const Node &parent = nodes[node];
+            for (std::size_t i : parent.children) {
+                const std::string &name = nodes[i].key;
+                if (name.size() == size && std::memcmp(name.data(), key, size) == 0)
+                    return i;
+            }
+            return parent.wildcard;
+        }
+
+        std::size_t element(std::size_t node, std::size_t index) const {
+            const Node &parent = nodes[node];
+            for (std::size_t i : parent.children) {
+                if (nodes[i].index == index)
+                    return i;
+            }
+            return parent.wildcard;
+        }
+
+        // 节点的整个子树都被选中
+        bool complete(std::size_t node) const {
+            return nodes[node].complete;
+        }
+
+    private:
+        // index 为 key 作为数组下标时的值，不是下标时为 npos；wildcard 为 "*" 子节点
+        struct Node {
+            std::string key;
+            std::size_t index;
+            bool complete;
+            std::size_t wildcard;
+            std::vector<std::size_t> children;
+        };
+
+        // 找到或创建名为 key 的子节点；complete 的节点不再需要子节点
+        std::size_t child(std::size_t node, const std::string &key) {
+            if (key == "*" && nodes[node].wildcard != npos)
+                return nodes[node].wildcard;
+            for (std::size_t i : nodes[node].children) {
+                if (nodes[i].key == key)
+                    return i;
+            }
+            std::size_t index = npos;
+            if (!key.empty() && key.size() < 20 && (key[0] != '0' || key.size() == 1) && key.find_first_not_of("0123456789") == std::string::npos)
+                index = std::stoull(key);
+            std::size_t id = nodes.size();
+            nodes.push_back(Node{key, index, false, npos, std::vector<std::size_t>()});
+            if (key == "*")
+                nodes[node].wildcard = id;
+            else
+                nodes[node].children.push_back(id);
+            return id;
+        }
+
+        // 按原样插入路径，"*" 作为普通的子节点保存，之后由 expand 合并到同级的其他子节点中
+        void insert(const std::vector<std::string> &path) {
+            std::size_t node = 0;
+            for (const auto &i : path) {
+                if (nodes[node].complete)
+                    return;
+                node = this->child(node, i);
+            }
+            nodes[node].complete = true;
+            nodes[node].children.clear();
+            nodes[node].wildcard = npos;
+        }
+
+        // 把 source 子树中选中的路径并入 target
+        void merge(std::size_t target, std::size_t source) {
+            if (nodes[target].complete)
+                return;
+            if (nodes[source].complete) {
+                nodes[target].complete = true;
+                nodes[target].children.clear();
+                nodes[target].wildcard = npos;
+                return;
+            }
+            // 合并过程中 nodes 可能扩容，不能持有元素的引用
+            std::vector<std::size_t> children = nodes[source].children;
+            if (nodes[source].wildcard != npos)
+                children.push_back(nodes[source].wildcard);
+            for (std::size_t i : children) {
+                std::string key = nodes[i].key;
+                this->merge(this->child(target, key), i);
+            }
+        }
+
+        // "*" 匹配的路径同样适用于明确写出的同级成员，例如 "/*/a" 与 "/x/b" 同时选中 x 的 a 与 b
+        void expand(std::size_t node) {
+            std::size_t wildcard = nodes[node].wildcard;
+            for (std::size_t i = 0; i < nodes[node].children.size(); i++) {
+                std::size_t child = nodes[node].children[i];
+                if (wildcard != npos)
+                    this->merge(child, wildcard);
+                this->expand(child);
+            }
+            if (wildcard != npos)
+                this->expand(wildcard);
+        }
+
+        std::vector<Node> nodes;
+    };
+
+    // lazy_numbers: 数字只保存原文，读取时才解码为 int、int64、uint64 或 double，未修改的数字序列化时原样输出
+    // lazy_strings: 含有转义的字符串值保存转义后的原文，读取时才解码，序列化时原样输出；key 总是立即解码
+    // pack_numbers: 元素全部为整数或全部为浮点数的数组保存为 packed 数组，见 basic_json::pack；与 lazy_numbers 同时使用时只打包能按原样输出的数字
+    // 以下为处理不可信输入时的资源限制，0 表示不限制，超出时解析失败并返回对应的错误码：
+    //   max_depth: 数组与对象的最大嵌套层数，默认为 default_max_depth；解析与释放不使用递归，但 dump、拷贝、operator==、
+    //              enable_hash_cache 与 enable_dump_cache 等按层递归，层数过深时会耗尽调用栈，设为 0 前请确认这些操作的层数有上限
+    //   max_nodes: 节点总数
+    //   max_string_length: 单个字符串或 key 转义前的字节数
+    //   max_container_size: 单个数组的元素个数或对象的成员个数
+    //   max_memory: 文档占用内存的估算值，按每个节点 sizeof(Json) 加上字符串与 key 的长度计算，不含容器自身的开销
+    // projection: 不为 nullptr 时只构建被选中的部分，见 JsonProjection；跳过的值不计入 max_nodes 与 max_memory
+    // dedupe: 解析完成后调用 basic_json::dedupe，相同的字符串与子树共享存储
+    struct JsonParseOptions {
+        static const std::size_t default_max_depth = 1024;
+
+        JsonParseOptions() : lazy_numbers(false), lazy_strings(false), pack_numbers(false), dedupe(false), max_depth(default_max_depth), max_nodes(0), max_string_length(0), max_container_size(0), max_memory(0), projection(nullptr) {}
+
+        bool lazy_numbers;
+        bool lazy_strings;
+        bool pack_numbers;
+        bool dedupe;
+        std::size_t max_depth;
+        std::size_t max_nodes;
+        std::size_t max_string_length;
+        std::size_t max_container_size;
+        std::size_t max_memory;
+        const JsonProjection *projection;
+    };
+
+    // basic_json::dedupe 的结果：替换为共享引用的字符串与容器个数，以及释放与新增的内存（估算值），节省的内存为两者之差
+    struct JsonDedupeStats {
+        JsonDedupeStats() : strings(0), containers(0), bytes_released(0), bytes_added(0) {}
+
+        std::size_t strings;
+        std::size_t containers;
+        std::size_t bytes_released;
+        std::size_t bytes_added;
+    };
+
+    // basic_json::memory_usage 的结果，单位为字节，按 sizeof 与容量估算，不含分配器自身的开销
+    // nodes: 节点（根节点、数组的元素、对象成员的值）与 packed 数组中的数字
+    // strings: 字符串值、key 与保存原文的数字，包括字符串对象本身与已使用的缓冲区
+    // containers: 数组与对象本身、对象成员的树节点开销以及 ContainerHeader
+    // caches: enable_dump_cache 的序列化结果、二级索引以及 const 访问 packed 数组时生成的元素副本
+    // slack: 数组与字符串中已分配但没有使用的容量，可由 shrink_to_fit 或 compact 释放
+    // shared: 以上各项中位于 dedupe 共享的存储中的部分，同一份存储只统计一次
+    struct JsonMemoryUsage {
+        JsonMemoryUsage() : nodes(0), strings(0), containers(0), caches(0), slack(0), shared(0) {}
+
+        std::size_t total() const {
+            return nodes + strings + containers + caches + slack;
+        }
+
+        std::size_t nodes;
+        std::size_t strings;
+        std::size_t containers;
+        std::size_t caches;
+        std::size_t slack;
+        std::size_t shared;
+    };
+
+    // 列式导出中的一列：按类型使用 ints、doubles、bools 或 offsets 与 data 之一，长度均为行数（offsets 为行数加一）
+    // validity 为按位的有效标记，缺失、null 或类型不符的值对应的位为 0，数据为 0 或空字符串
+    struct JsonColumn {
+        enum Type {
+            column_int64,
+            column_double,
+            column_bool,
+            column_string
+        };
+
+        JsonColumn() : type(column_int64) {}
+        JsonColumn(const std::string &name, Type type) : name(name), type(type) {}
+
+        bool valid(std::size_t row) const {
+            return (validity[row / 64] >> (row % 64)) & 1;
+        }
+        std::string get_string(std::size_t row) const {
+            return data.substr(offsets[row], offsets[row + 1] - offsets[row]);
+        }
+
+        std::string name;
+        Type type;
+        std::vector<std::uint64_t> validity;
+        std::vector<std::int64_t> ints;
+        std::vector<double> doubles;
+        std::vector<std::uint8_t> bools;
+        std::vector<std::uint64_t> offsets;
+        std::string data;
+    };
+
+    struct JsonColumns {
+        JsonColumns() : rows(0) {}
+
+        // 没有该列时返回 nullptr
+        const JsonColumn *find(const std::string &name) const {
+            for (const auto &i : columns) {
+                if (i.name == name)
+                    return &i;
+            }
+            return nullptr;
+        }
+
+        std::size_t rows;
+        std::vector<JsonColumn> columns;
+    };
+
+    // 指向连续缓冲区的视图，提供 C++20 std::span 的常用接口，C++20 起可以隐式转换为 std::span
+    template <typename T>
+    class JsonSpan {
+    public:
+        JsonSpan() : pointer(nullptr), count(0) {}
+        JsonSpan(T *data, std::size_t size) : pointer(data), count(size) {}
+
+        T *data() const {
+            return pointer;
+        }
+        std::size_t size() const {
+            return count;
+        }
+        bool empty() const {
+            return count == 0;
+        }
+        T &operator[](std::size_t index) const {
+            return pointer[index];
+        }
+        T *begin() const {
+            return pointer;
+        }
+        T *end() const {
+            return pointer + count;
+        }
+#ifdef MY_JSON_SPAN
+        operator std::span<T>() const {
+            return std::span<T>(pointer, count);
+        }
+#endif
+
+    private:
+        T *pointer;
+        std::size_t count;
+    };
+
+    template <typename Traits>
+    class basic_json;
+
+    typedef basic_json<JsonTraits> Json;
+
+    template <typename Traits>
+    class basic_json {
     public:
+        // 不定义 allocator_type：否则 std::uses_allocator 会认为 basic_json 需要带分配器构造
+        typedef typename Traits::string_type string_type;
+        typedef typename Traits::template array_type<basic_json> array_type;
+        typedef typename Traits::template object_type<basic_json> object_type;
+
         enum Type {
             json_null = 0,
             json_bool,
@@ -19,218 +621,416 @@ namespace my_json {
             json_object
         };
 
-        Json() : data_type(json_null) {}
+        basic_json() {
+            this->store(json_null, 0, Value());
+        }
 
-        Json(Type type) : data_type(type) {
-            switch (data_type) {
+        basic_json(Type type) {
+            switch (type) {
             case json_string:
-                value.data_string = new std::string();
+                this->store(type, 0, create<string_type>());
                 break;
             case json_array:
-                value.data_array = new std::vector<Json>();
+                this->store(type, 0, create<array_type>());
                 break;
             case json_object:
-                value.data_object = new std::map<std::string, Json>();
+                this->store(type, 0, create<object_type>());
                 break;
             default:
+                this->store(type, 0, Value());
                 break;
             }
         }
 
-        Json(bool value) : data_type(json_bool) {
-            this->value.data_bool = value;
+        basic_json(bool value) {
+            this->store(json_bool, 0, value);
         }
 
-        Json(int value) : data_type(json_int) {
-            this->value.data_int = value;
+        basic_json(int value) {
+            this->store(json_int, 0, value);
         }
 
-        Json(double value) : data_type(json_double) {
-            this->value.data_double = value;
+        // 超出内联范围（默认布局为 int，紧凑布局为 47 位有符号整数）的整数与解析的结果一样保存原文，不丢失精度
+        basic_json(unsigned value) : basic_json(from_uint64(value)) {}
+
+        basic_json(long value) : basic_json(from_int64(value)) {}
+
+        basic_json(unsigned long value) : basic_json(from_uint64(value)) {}
+
+        basic_json(long long value) : basic_json(from_int64(value)) {}
+
+        basic_json(unsigned long long value) : basic_json(from_uint64(value)) {}
+
+        basic_json(double value) {
+            this->store(json_double, 0, value);
         }
 
-        Json(const char *value) : data_type(json_string) {
-            this->value.data_string = new std::string(value);
+        basic_json(const char *value) {
+            this->store(json_string, 0, create<string_type>(value));
         }
 
-        Json(std::string value) : data_type(json_string) {
-            this->value.data_string = new std::string(value);
+        basic_json(string_type value) {
+            this->store(json_string, 0, create<string_type>(std::move(value)));
         }
 
-        Json(std::vector<Json> value) : data_type(json_array) {
-            this->value.data_array = new std::vector<Json>(value);
+        // 调用者可能仍持有 value 中元素的引用（移动不改变元素的地址），因此视为已经借出
+        basic_json(array_type value) {
+            this->store(json_array, flag_lent, create<array_type>(std::move(value)));
         }
 
-        Json(std::map<std::string, Json> value) : data_type(json_object) {
-            this->value.data_object = new std::map<std::string, Json>(value);
+        basic_json(object_type value) {
+            this->store(json_object, flag_lent, create<object_type>(std::move(value)));
         }
 
-        Json(const Json &other) {
+        basic_json(const basic_json &other) {
             this->copy(other);
         }
 
-        Json(Json &&other) {
-            this->data_type = other.data_type;
-            this->value = other.value;
-            other.data_type = json_null;
+        basic_json(basic_json &&other) noexcept {
+            this->storage = other.storage;
+            other.store(json_null, 0, Value());
         }
 
-        ~Json() {
+        ~basic_json() {
             this->clear();
         }
 
         Type type() const {
-            return data_type;
+            return storage.type();
         }
 
         bool is_null() const {
-            return data_type == json_null;
+            return this->type() == json_null;
         }
 
         bool is_bool() const {
-            return data_type == json_bool;
+            return this->type() == json_bool;
         }
 
         bool is_int() const {
-            return data_type == json_int;
+            return this->type() == json_int;
         }
 
         bool is_double() const {
-            return data_type == json_double;
+            return this->type() == json_double;
         }
 
         bool is_string() const {
-            return data_type == json_string;
+            return this->type() == json_string;
         }
 
         bool is_array() const {
-            return data_type == json_array;
+            return this->type() == json_array;
         }
 
         bool is_object() const {
-            return data_type == json_object;
+            return this->type() == json_object;
         }
 
         bool get_bool() const {
             if (this->is_bool())
-                return value.data_bool;
-            throw std::logic_error("function Json::get_bool: type error");
+                return payload().data_bool;
+            MY_JSON_THROW(std::logic_error("function Json::get_bool: type error"));
         }
 
         int get_int() const {
-            if (this->is_int())
-                return value.data_int;
-            throw std::logic_error("function Json::get_int: type error");
+            if (this->is_int()) {
+                std::int64_t number = this->get_int64();
+                if (number < INT_MIN || number > INT_MAX)
+                    MY_JSON_THROW(std::out_of_range("function Json::get_int: number out of range"));
+                return static_cast<int>(number);
+            }
+            MY_JSON_THROW(std::logic_error("function Json::get_int: type error"));
         }
 
         double get_double() const {
-            if (this->is_double())
-                return value.data_double;
-            throw std::logic_error("function Json::get_double: type error");
+            if (this->is_double()) {
+                if (!(this->flags() & flag_raw_number))
+                    return payload().data_double;
+                std::size_t size = 0;
+                const char *text = this->raw_text(size);
+                double number;
+                parse_double(text, size, number);
+                return number;
+            }
+            MY_JSON_THROW(std::logic_error("function Json::get_double: type error"));
         }
 
-        std::string get_string() const {
-            if (this->is_string())
-                return *value.data_string;
-            throw std::logic_error("function Json::get_string: type error");
+        // 超出 int 范围的整数不会被截断：解析时保留原文，可用 get_int64、get_uint64 或 get_number_text 读取
+        std::int64_t get_int64() const {
+            if (this->is_int()) {
+                if (!(this->flags() & flag_raw_number))
+                    return payload().data_int;
+                std::size_t size = 0;
+                const char *text = this->raw_text(size);
+                std::int64_t number;
+                if (parse_int64(text, size, number))
+                    return number;
+                MY_JSON_THROW(std::out_of_range("function Json::get_int64: number out of range"));
+            }
+            MY_JSON_THROW(std::logic_error("function Json::get_int64: type error"));
+        }
+
+        std::uint64_t get_uint64() const {
+            if (this->is_int()) {
+                std::size_t size = 0;
+                const char *text = this->raw_text(size);
+                std::uint64_t number;
+                if (text == nullptr) {
+                    if (payload().data_int >= 0)
+                        return static_cast<std::uint64_t>(payload().data_int);
+                } else if (text[0] != '-') {
+                    if (parse_uint64(text, size, number))
+                        return number;
+                } else if (this->get_int64() == 0)
+                    return 0;
+                MY_JSON_THROW(std::out_of_range("function Json::get_uint64: number out of range"));
+            }
+            MY_JSON_THROW(std::logic_error("function Json::get_uint64: type error"));
+        }
+
+        // 未保存原文时与 to_string() 的输出相同
+        std::string get_number_text() const {
+            if (this->is_int() || this->is_double()) {
+                std::size_t size = 0;
+                const char *text = this->raw_text(size);
+                if (text != nullptr)
+                    return std::string(text, size);
+                return this->is_int() ? std::to_string(payload().data_int) : std::to_string(payload().data_double);
+            }
+            MY_JSON_THROW(std::logic_error("function Json::get_number_text: type error"));
+        }
+
+        string_type get_string() const {
+            if (this->is_string()) {
+                if (!(this->flags() & flag_escaped))
+                    return *payload().data_string;
+                string_type str;
+                unescape(payload().data_string->data(), payload().data_string->size(), str);
+                return str;
+            }
+            MY_JSON_THROW(std::logic_error("function Json::get_string: type error"));
         }
 
-        std::vector<Json> get_array() const {
+        array_type get_array() const {
+            if (this->flags() & flag_packed) {
+                basic_json copy(*this);
+                copy.unpack();
+                return std::move(*copy.payload().data_array);
+            }
             if (this->is_array())
-                return *value.data_array;
-            throw std::logic_error("function Json::get_array: type error");
+                return *payload().data_array;
+            MY_JSON_THROW(std::logic_error("function Json::get_array: type error"));
         }
 
-        std::map<std::string, Json> get_object() const {
+        object_type get_object() const {
             if (this->is_object())
-                return *value.data_object;
-            throw std::logic_error("function Json::get_object: type error");
+                return *payload().data_object;
+            MY_JSON_THROW(std::logic_error("function Json::get_object: type error"));
         }
 
         int size() const {
-            switch (data_type) {
+            switch (this->type()) {
             case json_array:
-                return this->value.data_array->size();
+                if (this->flags() & flag_packed)
+                    return this->packed_size();
+                return this->payload().data_array->size();
             case json_object:
-                return this->value.data_object->size();
+                return this->payload().data_object->size();
             default:
                 break;
             }
-            throw std::logic_error("function Json::size: this json object is not array or map,cam't get size");
+            MY_JSON_THROW(std::logic_error("function Json::size: this json object is not array or map,cam't get size"));
         }
 
         bool empty() const {
-            switch (data_type) {
+            switch (this->type()) {
             case json_null:
                 return true;
             case json_array:
-                return value.data_array->empty();
+                if (this->flags() & flag_packed)
+                    return this->packed_size() == 0;
+                return payload().data_array->empty();
             case json_object:
-                return value.data_object->empty();
+                return payload().data_object->empty();
             default:
                 break;
             }
-            throw std::logic_error("function Json::empty: type error");
+            MY_JSON_THROW(std::logic_error("function Json::empty: type error"));
         }
 
         void clear() {
-            switch (data_type) {
-            case json_string:
-                delete value.data_string;
-                break;
-            case json_array:
-                for (auto i : *value.data_array)
-                    i.clear();
-                delete value.data_array;
-                break;
-            case json_object:
-                for (auto i : *value.data_object)
-                    i.second.clear();
-                delete value.data_object;
-                break;
-            default:
-                break;
+            this->release(0);
+        }
+
+        // 元素全部为整数或全部为浮点数的数组可以保存为 packed 数组：int64 或 double 的连续缓冲区，每个元素占 8 字节
+        // pack() 返回是否转换成功，整数与浮点数混合、含有超出 int64 的整数或无法按原样输出的数字时保持不变
+        // push_back、push_front 同类型的数字时仍为 packed，其余修改以及 operator[]、非 const 的 at、get_ptr 需要返回可修改的元素，先转换为普通数组
+        // const 的 at 与 get_ptr 需要返回元素的引用：第一次访问某个元素时生成它所在的 64 个元素（每个 sizeof(Json) 字节）并保留，
+        // 数组被修改后丢弃；全部元素都被访问过时额外占用的内存是缓冲区的 2 倍（紧凑布局为 1 倍），可以与其他线程的 const 访问同时进行
+        // 借出过 span 的数组每次访问都要与缓冲区比较，不一致时生成新的块，旧的块在数组被修改前不释放，之前返回的引用仍然有效
+        // 只读取数字时 get_int64s 与 get_doubles 既不分配内存也更快
+        // 先生成完整的缓冲区再释放原来的数组，中途失败时保持不变；打包不改变序列化结果，因此父节点的缓存仍然有效
+        bool pack() {
+            if (this->flags() & flag_packed)
+                return true;
+            if (!this->is_array() || payload().data_array->empty())
+                return false;
+            const array_type &array = *payload().data_array;
+            if (array.front().is_double()) {
+                std::vector<double> doubles;
+                doubles.reserve(array.size());
+                for (const auto &i : array) {
+                    if (!i.is_double() || (i.flags() & flag_raw_number))
+                        return false;
+                    doubles.push_back(i.payload().data_double);
+                }
+                PackedBuffer<double> *packed = create<PackedBuffer<double>>(std::move(doubles));
+                this->clear();
+                this->store(json_array, flag_packed | flag_packed_double, packed);
+            } else {
+                std::vector<std::int64_t> ints;
+                ints.reserve(array.size());
+                std::int64_t number;
+                for (const auto &i : array) {
+                    if (!packed_int64(i, number))
+                        return false;
+                    ints.push_back(number);
+                }
+                PackedBuffer<std::int64_t> *packed = create<PackedBuffer<std::int64_t>>(std::move(ints));
+                this->clear();
+                this->store(json_array, flag_packed, packed);
             }
-            data_type = json_null;
+            return true;
         }
 
-        std::string to_string() const {
-            std::string str;
-            switch (data_type) {
-            case json_null:
-                str = "null";
-                break;
-            case json_bool:
-                str = value.data_bool ? "true" : "false";
-                break;
+        // 元素按解析时的规则重建：int 范围内的整数直接保存，其余整数保存原文
+        void unpack() {
+            if (!(this->flags() & flag_packed))
+                return;
+            std::size_t count = this->packed_size();
+            array_type array;
+            array.reserve(count);
+            for (std::size_t i = 0; i < count; i++)
+                array.push_back(this->packed_element(i));
+            array_type *unpacked = create<array_type>(std::move(array));
+            this->clear();
+            this->store(json_array, 0, unpacked);
+        }
+
+        bool is_packed() const {
+            return (this->flags() & flag_packed) != 0;
+        }
+
+        // 不是对应类型的 packed 数组时抛出 logic_error；非 const 版本可以原地修改，并使缓存失效
+        JsonSpan<const std::int64_t> get_int64s() const {
+            if ((this->flags() & (flag_packed | flag_packed_double)) != flag_packed)
+                MY_JSON_THROW(std::logic_error("function Json::get_int64s: not a packed int64 array"));
+            return JsonSpan<const std::int64_t>(payload().data_ints->data(), payload().data_ints->size());
+        }
+
+        JsonSpan<const double> get_doubles() const {
+            if (!(this->flags() & flag_packed_double))
+                MY_JSON_THROW(std::logic_error("function Json::get_doubles: not a packed double array"));
+            return JsonSpan<const double>(payload().data_doubles->data(), payload().data_doubles->size());
+        }
+
+        JsonSpan<std::int64_t> get_int64s() {
+            this->invalidate();
+            JsonSpan<const std::int64_t> span = static_cast<const basic_json *>(this)->get_int64s();
+            this->lend();
+            return JsonSpan<std::int64_t>(const_cast<std::int64_t *>(span.data()), span.size());
+        }
+
+        JsonSpan<double> get_doubles() {
+            this->invalidate();
+            JsonSpan<const double> span = static_cast<const basic_json *>(this)->get_doubles();
+            this->lend();
+            return JsonSpan<double>(const_cast<double *>(span.data()), span.size());
+        }
+
+        // 把子树中相等且序列化结果相同的字符串、数组与对象替换为对同一份存储的引用（hash-consing），按结构哈希查找后逐个比较确认
+        // 共享的值在写入时复制：operator[]、非 const 的 at、get_ptr 等先复制出独占的一份，元素与成员仍然共享；复制共享的值只增加引用计数
+        // 对象的 key、数字、packed 数组以及含有二级索引的数组不共享；共享的值不使用 enable_hash_cache 与 enable_dump_cache 的缓存
+        // 引用计数是原子的，不同文档中共享同一个值的节点可以在不同的线程中读取与复制
+        // 与 compact 一样，dedupe 之前取得的子节点的引用、指针、迭代器与 span 全部失效：被替换的值已经释放，通过它们修改可能影响其他共享的位置
+        JsonDedupeStats dedupe() {
+            DedupeContext context;
+            dedupe_node(*this, false, context);
+            return context.stats;
+        }
+
+        bool is_shared() const {
+            ContainerHeader *block = this->header();
+            return block != nullptr && block->shares != 0;
+        }
+
+        // 整棵树占用的内存，按类别统计，见 JsonMemoryUsage
+        JsonMemoryUsage memory_usage() const {
+            JsonMemoryUsage usage;
+            usage.nodes = sizeof(basic_json);
+            std::unordered_set<const void *> visited;
+            measure_tree(*this, false, usage, visited);
+            return usage;
+        }
+
+        // shrink_to_fit 原地释放数组与字符串多余的容量，不改变内容与缓存，但数组中元素的地址会改变
+        // compact 按当前内容重新分配整棵树，同时消除对象中删除成员后留下的碎片；期间新旧两棵树同时存在
+        // compact 之后哈希缓存、序列化缓存与二级索引都不再保留；两者都不修改共享的值
+        void shrink_to_fit() {
+            if (this->is_shared())
+                return;
+            switch (this->type()) {
             case json_int:
-                str = std::to_string(value.data_int);
-                break;
             case json_double:
-                str = std::to_string(value.data_double);
+                if (this->flags() & flag_raw_heap)
+                    payload().data_string->shrink_to_fit();
                 break;
             case json_string:
-                str = "\"" + *value.data_string + "\"";
+                payload().data_string->shrink_to_fit();
                 break;
             case json_array:
-                str = "[";
-                for (auto i : *value.data_array)
-                    str += i.to_string() + ",";
-                if (!value.data_array->empty())
-                    str.pop_back();
-                str += "]";
+                if (this->flags() & flag_packed_double)
+                    payload().data_doubles->shrink_to_fit();
+                else if (this->flags() & flag_packed)
+                    payload().data_ints->shrink_to_fit();
+                else {
+                    payload().data_array->shrink_to_fit();
+                    for (auto &i : *payload().data_array)
+                        i.shrink_to_fit();
+                }
                 break;
             case json_object:
-                str = "{";
-                for (auto i : *value.data_object)
-                    str += "\"" + i.first + "\":" + i.second.to_string() + ",";
-                if (!value.data_object->empty())
-                    str.pop_back();
-                str += "}";
+                for (auto &i : *payload().data_object)
+                    i.second.shrink_to_fit();
                 break;
             default:
                 break;
             }
+            ContainerHeader *block = this->header();
+            if (block != nullptr && block->text)
+                block->text->shrink_to_fit();
+        }
+
+        // 复制时每个容器与字符串都按实际大小重新分配，之后释放原来的树
+        void compact() {
+            basic_json dense(*this);
+            *this = std::move(dense);
+        }
+
+        std::string to_string() const {
+            std::string str;
+#ifdef MY_JSON_INSTRUMENTATION
+            JsonStats stats = JsonStats();
+            auto start = std::chrono::steady_clock::now();
+            this->dump(str, &stats, 0);
+            stats.serialize_calls = 1;
+            stats.serialize_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            stats.bytes_out = str.size();
+            JsonInstrumentation::record(stats, str);
+#else
+            this->dump(str, nullptr, 0);
+#endif
             return str;
         }
 
@@ -238,461 +1038,5714 @@ namespace my_json {
             return this->has_key(key);
         }
 
-        bool find(const std::string &key) const {
+        bool find(const string_type &key) const {
             return this->has_key(key);
         }
 
         bool has_key(const char *key) const {
-            std::string str(key);
             if (this->is_object())
-                return value.data_object->find(str) != value.data_object->end();
-            throw std::logic_error("function Json::has_key: type error");
+                return this->find_member(key, std::strlen(key)) != nullptr;
+            MY_JSON_THROW(std::logic_error("function Json::has_key: type error"));
         }
 
-        bool has_key(const std::string &key) const {
+        bool has_key(const string_type &key) const {
             if (this->is_object())
-                return value.data_object->find(key) != value.data_object->end();
-            throw std::logic_error("function Json::has_key: type error");
+                return payload().data_object->find(key) != payload().data_object->end();
+            MY_JSON_THROW(std::logic_error("function Json::has_key: type error"));
         }
 
-        void push_back(const Json &value) {
-            if (this->is_array())
-                this->value.data_array->push_back(value);
-            else if (this->is_null()) {
-                this->data_type = json_array;
-                this->value.data_array = new std::vector<Json>();
-                this->value.data_array->push_back(value);
+        // 不是数组时抛出 logic_error，null 先转换为空数组
+        // push_front 需要移动全部元素，在头部反复插入时请使用 ArrayBuilder
+        void push_back(const basic_json &value) {
+            this->invalidate(this->is_array() ? this->size() : 0);
+            if (this->is_array()) {
+                if ((this->flags() & flag_packed) && this->packed_append(value, false))
+                    return;
+                this->unpack();
+                this->payload().data_array->push_back(value);
+            } else if (this->is_null()) {
+                this->store(json_array, 0, create<array_type>());
+                this->payload().data_array->push_back(value);
             } else
-                throw std::logic_error("function Json::push_back: This object has been defined as another type, if you want to force changes to the properties of this object, call the clear() function first");
+                MY_JSON_THROW(std::logic_error("function Json::push_back: This object has been defined as another type, if you want to force changes to the properties of this object, call the clear() function first"));
         }
 
-        void push_front(const Json &value) {
-            if (this->is_array())
-                this->value.data_array->insert(this->value.data_array->begin(), value);
-            else if (this->is_null()) {
-                this->data_type = json_array;
-                this->value.data_array = new std::vector<Json>();
-                this->value.data_array->push_back(value);
+        void push_back(basic_json &&value) {
+            if ((this->flags() & flag_packed) && this->packed_append(value, false))
+                return;
+            this->append_target("push_back").push_back(std::move(value));
+        }
+
+        void push_front(const basic_json &value) {
+            this->invalidate();
+            if (this->is_array()) {
+                if ((this->flags() & flag_packed) && this->packed_append(value, true))
+                    return;
+                this->unpack();
+                this->payload().data_array->insert(this->payload().data_array->begin(), value);
+            } else if (this->is_null()) {
+                this->store(json_array, 0, create<array_type>());
+                this->payload().data_array->push_back(value);
             } else
-                throw std::logic_error("function Json::push_front: This object has been defined as another type, if you want to force changes to the properties of this object, call the clear() function first");
+                MY_JSON_THROW(std::logic_error("function Json::push_front: This object has been defined as another type, if you want to force changes to the properties of this object, call the clear() function first"));
         }
 
-        void erase(int index) {
+        void push_front(basic_json &&value) {
+            this->invalidate();
             if (this->is_array()) {
-                int size = this->value.data_array->size();
-                if (index >= 0 || index < size) {
-                    auto iter = this->value.data_array->begin() + index;
+                if ((this->flags() & flag_packed) && this->packed_append(value, true))
+                    return;
+                this->unpack();
+                this->payload().data_array->insert(this->payload().data_array->begin(), std::move(value));
+            } else if (this->is_null()) {
+                this->store(json_array, 0, create<array_type>());
+                this->payload().data_array->push_back(std::move(value));
+            } else
+                MY_JSON_THROW(std::logic_error("function Json::push_front: This object has been defined as another type, if you want to force changes to the properties of this object, call the clear() function first"));
+        }
+
+        // packed 数组保持 packed，预留的是数字缓冲区的容量
+        void reserve(std::size_t size) {
+            if (this->flags() & flag_packed_double)
+                this->payload().data_doubles->reserve(size);
+            else if (this->flags() & flag_packed)
+                this->payload().data_ints->reserve(size);
+            else
+                this->append_target("reserve").reserve(size);
+        }
+
+        template <typename... Args>
+        basic_json &emplace_back(Args &&...args) {
+            array_type &array = this->append_target("emplace_back");
+            array.emplace_back(std::forward<Args>(args)...);
+            this->lend(array.size() - 1);
+            return array.back();
+        }
+
+        // 元素可以是 basic_json 或能够构造 basic_json 的类型；随机访问迭代器只分配一次内存
+        template <typename Iterator>
+        void append(Iterator first, Iterator last) {
+            array_type &array = this->append_target("append");
+            array.insert(array.end(), first, last);
+        }
+
+        template <typename Range>
+        void append(const Range &range) {
+            this->append(std::begin(range), std::end(range));
+        }
+
+        // 数组为空时直接接管 values 的缓冲区（调用者可能仍持有其中元素的引用，视为已经借出），否则逐个移动元素
+        void append(array_type &&values) {
+            array_type &array = this->append_target("append");
+            if (array.empty()) {
+                array = std::move(values);
+                this->lend();
+            } else {
+                array.reserve(array.size() + values.size());
+                std::move(values.begin(), values.end(), std::back_inserter(array));
+            }
+            values.clear();
+        }
+
+        void erase(int index) {
+            this->invalidate();
+            if (this->flags() & flag_packed) {
+                if (index < 0 || index >= this->size())
+                    MY_JSON_THROW(std::out_of_range("function Json::erase: index out of range"));
+                this->drop_packed_elements();
+                if (this->flags() & flag_packed_double)
+                    payload().data_doubles->erase(payload().data_doubles->begin() + index);
+                else
+                    payload().data_ints->erase(payload().data_ints->begin() + index);
+            } else if (this->is_array()) {
+                int size = this->payload().data_array->size();
+                if (index >= 0 && index < size) {
+                    auto iter = this->payload().data_array->begin() + index;
                     iter->clear();
-                    this->value.data_array->erase(iter);
+                    this->payload().data_array->erase(iter);
                 } else
-                    throw std::out_of_range("function Json::erase: index out of range");
+                    MY_JSON_THROW(std::out_of_range("function Json::erase: index out of range"));
             } else
-                throw std::logic_error("function Json::erase: type error");
+                MY_JSON_THROW(std::logic_error("function Json::erase: type error"));
         }
 
         void erase(const char *key) {
-            std::string str(key);
+            string_type str(key);
             erase(str);
         }
 
-        void erase(const std::string &key) {
+        void erase(const string_type &key) {
+            this->invalidate();
             if (this->is_object()) {
-                auto iter = this->value.data_object->find(key);
-                if (iter != this->value.data_object->end()) {
+                auto iter = this->payload().data_object->find(key);
+                if (iter != this->payload().data_object->end()) {
                     iter->second.clear();
-                    this->value.data_object->erase(iter);
+                    this->payload().data_object->erase(iter);
                 }
             } else
-                throw std::logic_error("function Json::erase: type error");
+                MY_JSON_THROW(std::logic_error("function Json::erase: type error"));
         }
 
-        Json &operator=(const Json &other) {
+        basic_json &operator=(const basic_json &other) {
             this->clear();
             this->copy(other);
             return *this;
         }
 
-        Json &operator=(Json &&other) {
+        basic_json &operator=(basic_json &&other) noexcept {
             this->clear();
-            this->data_type = other.data_type;
-            this->value = other.value;
-            other.data_type = json_null;
+            this->storage = other.storage;
+            other.store(json_null, 0, Value());
             return *this;
         }
 
-        bool operator==(const Json &other) const {
-            if (this->data_type != other.data_type)
+        bool operator==(const basic_json &other) const {
+            if (this->type() != other.type())
                 return false;
-            switch (this->data_type) {
+            ContainerHeader *lhs = this->header(), *rhs = other.header();
+            if (lhs != nullptr && rhs != nullptr) {
+                if (lhs == rhs)
+                    return true;
+                const std::uint64_t *lhs_hash = this->hash_cache(), *rhs_hash = other.hash_cache();
+                if (lhs_hash != nullptr && rhs_hash != nullptr && *lhs_hash != *rhs_hash)
+                    return false;
+            }
+            switch (this->type()) {
             case json_null:
                 return true;
             case json_bool:
-                return this->value.data_bool == other.value.data_bool;
+                return this->payload().data_bool == other.payload().data_bool;
             case json_int:
-                return this->value.data_int == other.value.data_int;
             case json_double:
-                return this->value.data_double == other.value.data_double;
+                if ((this->flags() | other.flags()) & flag_raw_number)
+                    return this->number_equal(other);
+                if (this->type() == json_int)
+                    return this->payload().data_int == other.payload().data_int;
+                return this->payload().data_double == other.payload().data_double;
             case json_string:
-                return *this->value.data_string == *other.value.data_string;
+                if ((this->flags() | other.flags()) & flag_escaped)
+                    return this->get_string() == other.get_string();
+                return *this->payload().data_string == *other.payload().data_string;
             case json_array:
-                return *this->value.data_array == *other.value.data_array;
+                if ((this->flags() | other.flags()) & flag_packed)
+                    return packed_equal(*this, other);
+                return *this->payload().data_array == *other.payload().data_array;
             case json_object:
-                return *this->value.data_object == *other.value.data_object;
+                return *this->payload().data_object == *other.payload().data_object;
             default:
                 break;
             }
             return false;
         }
 
-        bool operator!=(const Json &other) const {
+        bool operator!=(const basic_json &other) const {
             return !((*this) == other);
         }
 
-        Json &operator[](int index) {
+        basic_json &operator[](int index) {
+            this->invalidate(index);
+            this->unpack();
             if (this->is_array()) {
-                int size = this->value.data_array->size();
+                int size = this->payload().data_array->size();
                 if (index >= 0 && index < size) {
-                    return this->value.data_array->at(index);
+                    this->lend(static_cast<std::size_t>(index));
+                    return this->payload().data_array->at(index);
                 }
-                throw std::out_of_range("function Json::operator[]: index out of range");
+                MY_JSON_THROW(std::out_of_range("function Json::operator[]: index out of range"));
             } else
-                throw std::logic_error("function Json::operator[]: type error");
+                MY_JSON_THROW(std::logic_error("function Json::operator[]: type error"));
         }
 
-        Json &operator[](const char *key) {
-            std::string str(key);
-            return (*this)[str];
+        basic_json &operator[](const char *key) {
+            basic_json *member = this->get_ptr(key);
+            if (member != nullptr)
+                return *member;
+            return (*this)[string_type(key)];
         }
 
-        Json &operator[](const std::string &key) {
+        basic_json &operator[](const string_type &key) {
+            this->invalidate();
             if (this->is_object()) {
-                auto iter = this->value.data_object->find(key);
-                if (iter != this->value.data_object->end())
+                this->lend();
+                auto iter = this->payload().data_object->find(key);
+                if (iter != this->payload().data_object->end())
                     return iter->second;
-                else {
-                    this->value.data_object->insert(std::make_pair(key, Json()));
-                    return (*this)[key];
-                }
+                else
+                    return this->payload().data_object->emplace(key, basic_json()).first->second;
             } else if (this->is_null()) {
-                this->data_type = json_object;
-                this->value.data_object = new std::map<std::string, Json>();
+                this->store(json_object, 0, create<object_type>());
                 return (*this)[key];
             } else
-                throw std::logic_error("function Json::operator[]: type error");
+                MY_JSON_THROW(std::logic_error("function Json::operator[]: type error"));
         }
 
-        operator bool() const {
+        // 只读查找：key 不存在时不会插入，const 版本可以被多个线程同时调用
+        // object_type 的比较器支持异构查找（例如 std::less<>）时不构造临时的 key，否则只有超过短字符串长度的 key 需要分配内存
+        // get_ptr 在类型不符或不存在时返回 nullptr；at 在类型不符时抛出 logic_error，不存在时抛出 out_of_range
+        const basic_json *get_ptr(int index) const {
+            if (!this->is_array() || index < 0 || index >= this->size())
+                return nullptr;
+            if (this->flags() & flag_packed)
+                return &this->packed_ref(index);
+            return &(*payload().data_array)[index];
+        }
+
+        const basic_json *get_ptr(const char *key) const {
+            return this->find_member(key, std::strlen(key));
+        }
+
+        const basic_json *get_ptr(const string_type &key) const {
+            return this->find_member(key.data(), key.size());
+        }
+
+        // 返回的指针可能被用来修改，因此与 operator[] 一样使哈希缓存失效
+        basic_json *get_ptr(int index) {
+            this->invalidate(index);
+            this->unpack();
+            this->lend(static_cast<std::size_t>(index));
+            return const_cast<basic_json *>(static_cast<const basic_json *>(this)->get_ptr(index));
+        }
+
+        basic_json *get_ptr(const char *key) {
+            this->invalidate();
+            this->lend();
+            return const_cast<basic_json *>(this->find_member(key, std::strlen(key)));
+        }
+
+        basic_json *get_ptr(const string_type &key) {
+            this->invalidate();
+            this->lend();
+            return const_cast<basic_json *>(this->find_member(key.data(), key.size()));
+        }
+
+        const basic_json &at(int index) const {
+            if (!this->is_array())
+                MY_JSON_THROW(std::logic_error("function Json::at: type error"));
+            const basic_json *element = this->get_ptr(index);
+            if (element == nullptr)
+                MY_JSON_THROW(std::out_of_range("function Json::at: index out of range"));
+            return *element;
+        }
+
+        const basic_json &at(const char *key) const {
+            return this->at_member(key, std::strlen(key));
+        }
+
+        const basic_json &at(const string_type &key) const {
+            return this->at_member(key.data(), key.size());
+        }
+
+        basic_json &at(int index) {
+            this->invalidate(index);
+            this->unpack();
+            this->lend(static_cast<std::size_t>(index));
+            return const_cast<basic_json &>(static_cast<const basic_json *>(this)->at(index));
+        }
+
+        basic_json &at(const char *key) {
+            this->invalidate();
+            this->lend();
+            return const_cast<basic_json &>(static_cast<const basic_json *>(this)->at(key));
+        }
+
+        basic_json &at(const string_type &key) {
+            this->invalidate();
+            this->lend();
+            return const_cast<basic_json &>(static_cast<const basic_json *>(this)->at(key));
+        }
+#ifdef MY_JSON_STRING_VIEW
+        // Json.cpp 可能按 C++11 编译，显式实例化中不包含这些函数，因此定义为成员模板，由调用方实例化
+        template <typename = void>
+        const basic_json *get_ptr(std::string_view key) const {
+            return this->find_member(key.data(), key.size());
+        }
+
+        template <typename = void>
+        basic_json *get_ptr(std::string_view key) {
+            this->invalidate();
+            this->lend();
+            return const_cast<basic_json *>(this->find_member(key.data(), key.size()));
+        }
+
+        template <typename = void>
+        const basic_json &at(std::string_view key) const {
+            return this->at_member(key.data(), key.size());
+        }
+
+        template <typename = void>
+        basic_json &at(std::string_view key) {
+            this->invalidate();
+            this->lend();
+            return const_cast<basic_json &>(this->at_member(key.data(), key.size()));
+        }
+
+        template <typename = void>
+        bool has_key(std::string_view key) const {
+            if (!this->is_object())
+                MY_JSON_THROW(std::logic_error("function Json::has_key: type error"));
+            return this->find_member(key.data(), key.size()) != nullptr;
+        }
+#endif
+
+        operator bool() const {
             if (this->is_bool())
-                return this->value.data_bool;
+                return this->payload().data_bool;
             else
-                throw std::logic_error("function Json::operator bool(): type error");
+                MY_JSON_THROW(std::logic_error("function Json::operator bool(): type error"));
         }
 
         operator int() const {
             if (this->is_int())
-                return this->value.data_int;
+                return this->get_int();
             else
-                throw std::logic_error("function Json::operator int(): type error");
+                MY_JSON_THROW(std::logic_error("function Json::operator int(): type error"));
         }
 
         operator double() const {
             if (this->is_double())
-                return this->value.data_double;
+                return this->get_double();
             else
-                throw std::logic_error("function Json::operator double(): type error");
+                MY_JSON_THROW(std::logic_error("function Json::operator double(): type error"));
         }
 
-        operator std::string() const {
+        operator string_type() const {
             if (this->is_string())
-                return *this->value.data_string;
+                return this->get_string();
             else
-                throw std::logic_error("function Json::operator std::string(): type error");
+                MY_JSON_THROW(std::logic_error("function Json::operator std::string(): type error"));
         }
 
-        operator std::vector<Json>() const {
+        operator array_type() const {
+            if (this->flags() & flag_packed)
+                return this->get_array();
             if (this->is_array())
-                return *this->value.data_array;
+                return *this->payload().data_array;
             else
-                throw std::logic_error("function Json::operator std::vector<Json>(): type error");
+                MY_JSON_THROW(std::logic_error("function Json::operator std::vector<Json>(): type error"));
         }
 
-        operator std::map<std::string, Json>() const {
+        operator object_type() const {
             if (this->is_object())
-                return *this->value.data_object;
+                return *this->payload().data_object;
             else
-                throw std::logic_error("function Json::operator std::map<std::string, Json>(): type error");
+                MY_JSON_THROW(std::logic_error("function Json::operator std::map<std::string, Json>(): type error"));
         }
 
         // 请暂时不要使用这个函数，我无法保证它的正确性
         // 如需输出请使用 to_string() 函数
-        // friend std::ostream &operator<<(std::ostream &os, const Json &json);
+        // friend std::ostream &operator<<(std::ostream &os, const basic_json &json);
 
-        void parse(const char *json) {
-            std::string str(json);
-            this->parse(str);
+        void parse(const char *json, const JsonParseOptions &options = JsonParseOptions()) {
+            JsonError error;
+            if (!this->parse(json, std::strlen(json), error, options))
+                throw_error(error);
         }
 
-        void parse(const std::string &json) {
-            this->clear();
-            Parser parser(json);
-            *this = parser.parse();
+        void parse(const std::string &json, const JsonParseOptions &options = JsonParseOptions()) {
+            JsonError error;
+            if (!this->parse(json.data(), json.size(), error, options))
+                throw_error(error);
         }
 
-        void parse(std::ifstream &file) {
+        void parse(std::ifstream &file, const JsonParseOptions &options = JsonParseOptions()) {
             this->clear();
             std::string json;
             std::string line;
             if (!file.is_open())
-                throw std::runtime_error("function Json::parse: file is not open");
+                MY_JSON_THROW(std::runtime_error("function Json::parse: file is not open"));
+            MY_JSON_STATS(auto start = std::chrono::steady_clock::now();)
             while (std::getline(file, line))
                 json += line;
-            this->parse(json);
+            MY_JSON_STATS(JsonInstrumentation::record_read(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());)
+            this->parse(json, options);
         }
 
-    private:
-        class Parser {
-        public:
-            Parser() : index(0){};
-            Parser(const std::string &json) : json(json), index(0){};
-            ~Parser(){};
+        // 不抛出异常的版本：失败时返回 false，error 中为错误原因与字节偏移，当前对象被清空
+        bool parse(const char *json, JsonError &error, const JsonParseOptions &options = JsonParseOptions()) {
+            return this->parse(json, std::strlen(json), error, options);
+        }
 
-            void set_json(const std::string &json) {
-                this->json = json;
-                index = 0;
-            }
+        bool parse(const char *json, std::size_t size, JsonError &error, const JsonParseOptions &options = JsonParseOptions()) {
+            this->clear();
+            Parser parser(options);
+            if (parser.parse_into(json, size, *this, error))
+                return true;
+            this->clear();
+            return false;
+        }
 
-            Json parse() {
-                this->skip_space();
-                char ch = this->get_next();
-                switch (ch) {
+        bool parse(const std::string &json, JsonError &error, const JsonParseOptions &options = JsonParseOptions()) {
+            return this->parse(json.data(), json.size(), error, options);
+        }
+
+        // 只检查语法与 UTF-8 编码，不构建节点，返回第一个错误；嵌套深度只受内存限制
+        // 用显式的栈代替递归，栈中记录每一层是数组 '[' 还是对象 '{'
+        static JsonError validate(const char *data, std::size_t size) {
+            const char *p = data, *end = data + size;
+            std::string stack;
+            auto skip_space = [&]() {
+                while (p != end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+                    p++;
+            };
+            auto digits = [&]() {
+                const char *start = p;
+                while (p != end && *p >= '0' && *p <= '9')
+                    p++;
+                return p != start;
+            };
+            auto error = [&](JsonError::Code code) {
+                return JsonError(p == end && code == JsonError::unexpected_character ? JsonError::unexpected_end : code, p - data);
+            };
+            // 检查从 p 开始的字符串，成功时 p 指向结尾引号之后
+            auto check_string = [&](JsonError::Code &code) {
+                bool escaped;
+                const char *quote = find_string_end(p + 1, end, escaped, code);
+                p = quote;
+                if (code == JsonError::ok)
+                    p++;
+                return code == JsonError::ok;
+            };
+            JsonError::Code code = JsonError::ok;
+            skip_space();
+            while (true) {
+                // 读取一个值
+                if (p == end)
+                    return error(JsonError::unexpected_end);
+                switch (*p) {
+                case '{':
+                case '[':
+                    stack += *p++;
+                    skip_space();
+                    if (p != end && *p == (stack.back() == '[' ? ']' : '}')) {
+                        stack.pop_back();
+                        p++;
+                        break;
+                    }
+                    if (stack.back() == '{') {
+                        if (p == end || *p != '"')
+                            return error(JsonError::unexpected_character);
+                        if (!check_string(code))
+                            return error(code);
+                        skip_space();
+                        if (p == end || *p != ':')
+                            return error(JsonError::unexpected_character);
+                        p++;
+                        skip_space();
+                    }
+                    continue;
+                case '"':
+                    if (!check_string(code))
+                        return error(code);
+                    break;
                 case 'n':
-                    index--;
-                    return this->check_null();
                 case 't':
-                case 'f':
-                    index--;
-                    return this->check_bool();
-                case '"':
-                    return this->check_string();
-                case '[':
-                    return this->check_array();
-                case '{':
-                    return this->check_object();
+                case 'f': {
+                    const char *literal = *p == 'n' ? "null" : *p == 't' ? "true" : "false";
+                    std::size_t length = std::strlen(literal);
+                    if (static_cast<std::size_t>(end - p) < length || std::memcmp(p, literal, length) != 0)
+                        return error(JsonError::unexpected_character);
+                    p += length;
+                    break;
+                }
                 default:
-                    if (ch >= '0' && ch <= '9' || ch == '-') {
-                        index--;
-                        return this->check_number();
-                    } else
-                        throw std::logic_error("Unexpected character");
+                    if (*p == '-')
+                        p++;
+                    if (p != end && *p == '0')
+                        p++;
+                    else if (p == end || *p < '1' || *p > '9' || !digits())
+                        return error(JsonError::unexpected_character);
+                    if (p != end && *p == '.') {
+                        p++;
+                        if (!digits())
+                            return error(JsonError::unexpected_character);
+                    }
+                    if (p != end && (*p == 'e' || *p == 'E')) {
+                        p++;
+                        if (p != end && (*p == '+' || *p == '-'))
+                            p++;
+                        if (!digits())
+                            return error(JsonError::unexpected_character);
+                    }
+                    break;
+                }
+                // 一个值结束后关闭已完成的数组和对象，直到遇到 ',' 需要读取下一个值
+                while (true) {
+                    skip_space();
+                    if (stack.empty())
+                        return p == end ? JsonError() : error(JsonError::trailing_characters);
+                    if (p == end)
+                        return error(JsonError::unexpected_end);
+                    if (*p == (stack.back() == '[' ? ']' : '}')) {
+                        stack.pop_back();
+                        p++;
+                        continue;
+                    }
+                    if (*p != ',')
+                        return error(JsonError::unexpected_character);
+                    p++;
+                    skip_space();
+                    if (stack.back() == '{') {
+                        if (p == end || *p != '"')
+                            return error(JsonError::unexpected_character);
+                        if (!check_string(code))
+                            return error(code);
+                        skip_space();
+                        if (p == end || *p != ':')
+                            return error(JsonError::unexpected_character);
+                        p++;
+                        skip_space();
+                    }
+                    break;
                 }
             }
+        }
 
-        private:
-            void skip_space() {
-                while (json[index] == ' ' || json[index] == '\t' || json[index] == '\r' || json[index] == '\n')
-                    index++;
-            }
+        static JsonError validate(const std::string &json) {
+            return validate(json.data(), json.size());
+        }
 
-            char get_next() {
-                this->skip_space();
-                if (index == json.size())
-                    throw std::runtime_error("Unexpected end of json");
-                return json[index++];
+        // 将解析好的文档保存为二进制快照，之后可用 JsonSnapshot 通过 mmap 直接加载
+        void save_snapshot(const char *path) const {
+            std::string str(path);
+            this->save_snapshot(str);
+        }
+
+        void save_snapshot(const std::string &path) const {
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            this->save_snapshot(file);
+        }
+
+        void save_snapshot(std::ofstream &file) const;
+
+        // JSON Patch (RFC 6902) 与 JSON Merge Patch (RFC 7396)，直接在当前对象上修改
+        // 传入右值时补丁中的值会被移动而不是拷贝；任一操作失败时撤销已执行的操作后抛出异常
+        // test 按 RFC 6902 4.6 比较，数字按数值相等（1 与 1.0 相等）；test 与 copy 的源路径只读取，不转换 packed 数组
+        void apply_patch(const basic_json &patch) {
+            basic_json copy(patch);
+            this->apply_patch(std::move(copy));
+        }
+
+        void apply_patch(basic_json &&patch) {
+            if (!patch.is_array())
+                MY_JSON_THROW(std::logic_error("function Json::apply_patch: patch must be an array"));
+            patch.unpack();
+            std::vector<PatchStep> undo;
+            MY_JSON_TRY {
+                for (auto &operation : *patch.payload().data_array)
+                    this->patch_operation(operation, undo);
+            } MY_JSON_CATCH_ALL {
+                this->patch_rollback(undo);
+                MY_JSON_RETHROW;
             }
+        }
 
-            Json check_null() {
-                if (json.substr(index, 4) == "null") {
-                    index += 4;
-                    return Json();
-                }
-                throw std::logic_error("Unexpected character");
+        void apply_merge_patch(const basic_json &patch) {
+            basic_json copy(patch);
+            this->apply_merge_patch(std::move(copy));
+        }
+
+        void apply_merge_patch(basic_json &&patch) {
+            std::vector<PatchStep> undo;
+            std::vector<string_type> path;
+            MY_JSON_TRY {
+                merge_patch(*this, std::move(patch), path, &undo);
+            } MY_JSON_CATCH_ALL {
+                this->patch_rollback(undo);
+                MY_JSON_RETHROW;
             }
+        }
 
-            Json check_bool() {
-                if (json.substr(index, 4) == "true") {
-                    index += 4;
-                    return Json(true);
-                }
-                if (json.substr(index, 5) == "false") {
-                    index += 5;
-                    return Json(false);
+        // 生成把 source 变为 target 的 JSON Patch，哈希相同的子树直接跳过
+        // 数组默认按最长公共子序列对齐；给出 array_key 时，成员都是对象且都带有该 key 的数组按 key 的值匹配元素
+        static basic_json diff(const basic_json &source, const basic_json &target) {
+            return diff(source, target, string_type());
+        }
+
+        static basic_json diff(const basic_json &source, const basic_json &target, const string_type &array_key) {
+            DiffContext context;
+            context.array_key = array_key;
+            context.patch = basic_json(json_array);
+            diff_node(source, target, string_type(), context);
+            return std::move(context.patch);
+        }
+
+        // 结构哈希：数字按类型区分（1 与 1.0 不同），对象与成员顺序无关
+        // 不同 seed 得到互相独立的哈希，seed 为 0 时会使用 enable_hash_cache() 缓存的结果
+        std::uint64_t hash(std::uint64_t seed = 0) const {
+            return hash_node(*this, seed, nullptr);
+        }
+
+        std::pair<std::uint64_t, std::uint64_t> hash128(std::uint64_t seed = 0) const {
+            return std::make_pair(hash_node(*this, seed, nullptr), hash_node(*this, hash_mix(seed ^ 0x6a09e667f3bcc909ULL) + 1, nullptr));
+        }
+
+        // 为子树中的所有数组和对象计算并缓存哈希，operator== 可据此在 O(1) 内判定不相等
+        // 通过 operator[]、push_back、erase 等接口修改时，沿访问路径的缓存会失效，再次调用只重新计算失效的部分
+        // 借出过子节点引用（非 const 的 operator[]、at、get_ptr、find_by、emplace_back 等）的容器及其祖先无法知道引用之后的修改，
+        // 它们以及借出过 span 的 packed 数组的祖先不保存缓存，每次使用时由子节点重新计算，其中没有借出过引用的子树仍使用缓存；
+        // 缓存只随本文档的修改失效，与其他文档互不影响
+        void enable_hash_cache() {
+            cache_hash(*this);
+        }
+
+        // 为从本节点起前 depth 层（本节点为第 1 层）的数组和对象缓存序列化的结果，to_string() 直接复制没有修改过的子树
+        // 失效的规则与 enable_hash_cache 相同，修改后再次调用只重新生成失效的容器，其余的子树按缓存拼接
+        // 缓存占用的内存约为输出的大小乘以 depth，depth 为 1 时只缓存本节点；只读访问请使用 const 的接口，以免使缓存失效
+        void enable_dump_cache(std::size_t depth = 2) {
+            cache_dump(*this, depth);
+        }
+
+        // 为对象数组建立二级索引，key 为每个元素中 path（相对于元素的 JSON Pointer，"" 表示元素本身）处的值
+        // index_hashed 的 find_by 为 O(1)；index_sorted 的 find_by 为 O(log n)，并支持 find_range
+        // 缺少 path 或该处为数组、对象的元素不进入索引；每个数组只有一个索引，再次调用时替换原有的索引
+        // 通过 operator[]、at、get_ptr、find_by 取得元素，或用 push_back、append 等在末尾追加后，下次查找只重新处理涉及的元素；
+        // 这些元素的引用之后仍可能被修改，此后每次查找前都会重新检查这些元素的 key
+        // 重建索引时数组已经借出过元素引用（包括建立索引之前借出的），或借出的元素超过 64 个时，无法逐个检查，
+        // 同一 Traits 的任何文档有过修改后，下次查找都会重建整个索引
+        // erase、push_front、patch 等其余修改使下次查找重建整个索引；数组被赋值、清空或复制时不保留索引
+        // 有尚未处理的修改或借出过引用时，查找可能更新索引，此时 const 的查找也不能与其他线程同时进行
+        enum IndexType { index_hashed, index_sorted };
+
+        void create_index(const string_type &path, IndexType type = index_hashed) {
+            if (!this->is_array())
+                MY_JSON_THROW(std::logic_error("function Json::create_index: type error"));
+            std::unique_ptr<ArrayIndex> index(new ArrayIndex());
+            index->path = parse_pointer(path);
+            index->type = type;
+            index->stale = false;
+            index->count = 0;
+            index->generation = 0;
+            this->invalidate();
+            this->unpack();
+            if (!(this->flags() & flag_header))
+                this->attach_header();
+            if (type == index_hashed)
+                index->hashed.reserve(payload().data_array->size());
+            index->watch_all = (this->flags() & flag_lent) != 0;
+            index->refresh(*payload().data_array, index->watch_all);
+            this->header()->index = std::move(index);
+        }
+
+        void drop_index() {
+            ContainerHeader *block = this->header();
+            if (block != nullptr)
+                block->index.reset();
+        }
+
+        bool has_index() const {
+            ContainerHeader *block = this->header();
+            return block != nullptr && block->index;
+        }
+
+        // 返回 key 相等的元素中下标最小的一个，没有时返回 nullptr；没有索引时抛出 logic_error
+        const basic_json *find_by(const basic_json &key) const {
+            const ArrayIndex *index = this->array_index("find_by");
+            const array_type &array = *payload().data_array;
+            std::size_t best = array.size();
+            bool lent = false;
+            if (index->type == index_hashed) {
+                auto range = index->hashed.equal_range(hash_node(key, 0, nullptr));
+                for (auto iter = range.first; iter != range.second; ++iter) {
+                    if (iter->second < best && *index_key(array[iter->second], index->path, lent) == key)
+                        best = iter->second;
                 }
-                throw std::logic_error("Unexpected character");
+            } else {
+                auto range = index->sorted.equal_range(key);
+                for (auto iter = range.first; iter != range.second; ++iter)
+                    best = std::min(best, iter->second);
             }
+            return best == array.size() ? nullptr : &array[best];
+        }
 
-            Json check_number() {
-                int start = index;
-                if (json[index] == '-')
-                    index++;
-                if (json[index] == '0')
-                    index++;
-                else if (json[index] >= '1' && json[index] <= '9') {
-                    index++;
-                    while (json[index] >= '0' && json[index] <= '9')
-                        index++;
-                } else
-                    throw std::logic_error("Unexpected character");
-                if (json[index] == '.') {
-                    index++;
-                    if (json[index] >= '0' && json[index] <= '9') {
-                        index++;
-                        while (json[index] >= '0' && json[index] <= '9')
-                            index++;
-                    } else
-                        throw std::logic_error("Unexpected character");
-                }
-                if (json[index] == 'e' || json[index] == 'E') {
-                    index++;
-                    if (json[index] == '+' || json[index] == '-')
-                        index++;
-                    if (json[index] >= '0' && json[index] <= '9') {
-                        index++;
-                        while (json[index] >= '0' && json[index] <= '9')
-                            index++;
-                    } else
-                        throw std::logic_error("Unexpected character");
+        // 返回的元素可能被修改，与 operator[] 一样只使该元素在索引中失效
+        basic_json *find_by(const basic_json &key) {
+            const basic_json *element = static_cast<const basic_json *>(this)->find_by(key);
+            if (element == nullptr)
+                return nullptr;
+            std::size_t position = element - payload().data_array->data();
+            this->invalidate(position);
+            this->lend(position);
+            return &(*payload().data_array)[position];
+        }
+
+        // 按下标排序
+        std::vector<const basic_json *> find_all_by(const basic_json &key) const {
+            const ArrayIndex *index = this->array_index("find_all_by");
+            const array_type &array = *payload().data_array;
+            std::vector<std::size_t> positions;
+            bool lent = false;
+            if (index->type == index_hashed) {
+                auto range = index->hashed.equal_range(hash_node(key, 0, nullptr));
+                for (auto iter = range.first; iter != range.second; ++iter) {
+                    if (*index_key(array[iter->second], index->path, lent) == key)
+                        positions.push_back(iter->second);
                 }
-                std::string number = json.substr(start, index - start);
-                if (number.find('.') != std::string::npos || number.find('e') != std::string::npos || number.find('E') != std::string::npos)
-                    return Json(std::stod(number));
-                else
-                    return Json(std::stoi(number));
+            } else {
+                auto range = index->sorted.equal_range(key);
+                for (auto iter = range.first; iter != range.second; ++iter)
+                    positions.push_back(iter->second);
             }
+            std::sort(positions.begin(), positions.end());
+            std::vector<const basic_json *> result;
+            result.reserve(positions.size());
+            for (std::size_t i : positions)
+                result.push_back(&array[i]);
+            return result;
+        }
 
-            std::string check_string() {
-                std::string str;
-                while (true) {
-                    char ch = this->get_next();
-                    if (ch == '\\') {
-                        ch = this->get_next();
-                        switch (ch) {
-                        case '"':
-                            str += '"';
-                            break;
-                        case '\\':
-                            str += '\\';
-                            break;
-                        case '/':
-                            str += '/';
-                            break;
-                        case 'b':
-                            str += '\b';
-                            break;
-                        case 'f':
-                            str += '\f';
-                            break;
-                        case 'n':
-                            str += '\n';
+        // 只用于 index_sorted，返回 key 在 [lower, upper] 中的元素，按 key 排序
+        std::vector<const basic_json *> find_range(const basic_json &lower, const basic_json &upper) const {
+            const ArrayIndex *index = this->array_index("find_range");
+            if (index->type != index_sorted)
+                MY_JSON_THROW(std::logic_error("function Json::find_range: index is not sorted"));
+            const array_type &array = *payload().data_array;
+            std::vector<const basic_json *> result;
+            for (auto iter = index->sorted.lower_bound(lower); iter != index->sorted.end() && !index_less(upper, iter->first); ++iter)
+                result.push_back(&array[iter->second]);
+            return result;
+        }
+
+        // 把对象数组转换为列式存储，每个 key 为一列，不是对象的元素整行无效；不是数组时抛出异常
+        // 不指定 schema 时根据数据推断：列的顺序为 key 第一次出现的顺序，类型为第一个不为 null 的值的类型，
+        // 整数与浮点数混合时为 double，只有 null、数组或对象的 key 不生成列；超出 int64 的整数在 int64 列中无效
+        // threads 为并行的线程数，0 表示使用全部硬件线程；只需要少数字段时可先用 JsonProjection 解析
+        JsonColumns to_columns(unsigned threads = 1) const {
+            if (!this->is_array())
+                MY_JSON_THROW(std::logic_error("function Json::to_columns: type error"));
+            if (this->flags() & flag_packed)
+                return basic_json(this->get_array()).to_columns(threads);
+            const array_type &rows = *payload().data_array;
+            std::size_t chunk = column_chunk(rows.size(), threads);
+            std::size_t chunks = (rows.size() + chunk - 1) / chunk;
+            // 各段分别推断，之后按段的顺序合并；type 为 -1 表示还没有遇到标量，real 表示出现过浮点数
+            struct Guess {
+                std::string name;
+                int type;
+                bool real;
+            };
+            std::vector<std::vector<Guess>> guesses(chunks);
+            run_parallel(chunks, [&](std::size_t part) {
+                std::unordered_map<std::string, std::size_t> names;
+                // 同构的对象中成员的顺序相同，先与上一行同一位置的 key 比较，不同时才查找
+                std::vector<std::pair<const string_type *, std::size_t>> shape;
+                std::vector<Guess> &columns = guesses[part];
+                std::size_t end = std::min(rows.size(), (part + 1) * chunk);
+                for (std::size_t row = part * chunk; row < end; row++) {
+                    if (!rows[row].is_object())
+                        continue;
+                    std::size_t position = 0;
+                    for (const auto &member : *rows[row].payload().data_object) {
+                        std::size_t index;
+                        if (position < shape.size() && *shape[position].first == member.first)
+                            index = shape[position].second;
+                        else {
+                            auto iter = names.emplace(std::string(member.first.data(), member.first.size()), columns.size()).first;
+                            index = iter->second;
+                            if (index == columns.size())
+                                columns.push_back(Guess{iter->first, -1, false});
+                            if (position < shape.size())
+                                shape[position] = std::make_pair(&member.first, index);
+                            else
+                                shape.push_back(std::make_pair(&member.first, index));
+                        }
+                        position++;
+                        int type = -1;
+                        switch (member.second.type()) {
+                        case json_bool:
+                            type = JsonColumn::column_bool;
                             break;
-                        case 'r':
-                            str += '\r';
+                        case json_int:
+                            type = JsonColumn::column_int64;
                             break;
-                        case 't':
-                            str += '\t';
+                        case json_double:
+                            type = JsonColumn::column_double;
+                            columns[index].real = true;
                             break;
-                        case 'u':
-                            index += 4;
+                        case json_string:
+                            type = JsonColumn::column_string;
                             break;
                         default:
-                            throw std::logic_error("Unexpected character");
+                            break;
                         }
-                    } else if (ch == '"')
-                        return str;
-                    else
-                        str += ch;
-                }
-            }
-
-            Json check_array() {
-                Json array = Json(json_array);
-                while (true) {
-                    this->skip_space();
-                    if (json[index] == ']') {
-                        index++;
-                        return array;
+                        if (columns[index].type == -1)
+                            columns[index].type = type;
                     }
-                    array.push_back(this->parse());
-                    this->skip_space();
-                    if (json[index] == ']') {
-                        index++;
-                        return array;
+                }
+            });
+            std::vector<Guess> merged;
+            std::unordered_map<std::string, std::size_t> names;
+            for (const auto &part : guesses) {
+                for (const auto &i : part) {
+                    auto iter = names.emplace(i.name, merged.size()).first;
+                    if (iter->second == merged.size())
+                        merged.push_back(i);
+                    else {
+                        Guess &guess = merged[iter->second];
+                        if (guess.type == -1)
+                            guess.type = i.type;
+                        guess.real |= i.real;
                     }
-                    if (json[index] == ',')
-                        index++;
-                    else
-                        throw std::logic_error("Unexpected character");
                 }
             }
+            std::vector<JsonColumn> schema;
+            for (const auto &i : merged) {
+                if (i.type == JsonColumn::column_int64 && i.real)
+                    schema.push_back(JsonColumn(i.name, JsonColumn::column_double));
+                else if (i.type != -1)
+                    schema.push_back(JsonColumn(i.name, static_cast<JsonColumn::Type>(i.type)));
+            }
+            return this->to_columns(schema, threads);
+        }
 
-            Json check_object() {
-                Json object = Json(json_object);
-                while (true) {
-                    this->skip_space();
-                    if (json[index] == '}') {
-                        index++;
-                        return object;
+        JsonColumns to_columns(const std::vector<JsonColumn> &schema, unsigned threads = 1) const {
+            if (!this->is_array())
+                MY_JSON_THROW(std::logic_error("function Json::to_columns: type error"));
+            if (this->flags() & flag_packed)
+                return basic_json(this->get_array()).to_columns(schema, threads);
+            const array_type &rows = *payload().data_array;
+            std::unordered_map<std::string, std::size_t> names;
+            JsonColumns table = column_table(schema, rows.size(), names);
+            std::size_t chunk = column_chunk(rows.size(), threads);
+            std::size_t chunks = (rows.size() + chunk - 1) / chunk;
+            // 字符串先写入各段自己的缓冲区，offsets 中暂存段内的结束位置，之后拼接并改为全局的偏移
+            std::vector<std::vector<std::string>> buffers(chunks, std::vector<std::string>(table.columns.size()));
+            const std::size_t none = static_cast<std::size_t>(-1);
+            std::vector<string_type> keys;
+            for (const auto &i : table.columns)
+                keys.push_back(string_type(i.name.data(), i.name.size()));
+            run_parallel(chunks, [&](std::size_t part) {
+                std::vector<std::pair<const string_type *, std::size_t>> shape;
+                std::size_t end = std::min(rows.size(), (part + 1) * chunk);
+                for (std::size_t row = part * chunk; row < end; row++) {
+                    if (!rows[row].is_object())
+                        continue;
+                    const object_type &object = *rows[row].payload().data_object;
+                    // 只取少数的列时逐列查找，避免访问每个成员
+                    if (keys.size() * 2 < object.size()) {
+                        for (std::size_t index = 0; index < keys.size(); index++) {
+                            auto iter = object.find(keys[index]);
+                            if (iter == object.end())
+                                continue;
+                            JsonColumn &column = table.columns[index];
+                            if (iter->second.column_value(column, row, buffers[part][index]))
+                                column.validity[row / 64] |= std::uint64_t(1) << (row % 64);
+                        }
+                        continue;
                     }
-                    this->get_next();
-                    std::string key = this->check_string();
-                    this->skip_space();
-                    if (json[index] == ':')
-                        index++;
-                    else
-                        throw std::logic_error("Unexpected character");
-                    object[key] = this->parse();
-                    this->skip_space();
-                    if (json[index] == '}') {
-                        index++;
-                        return object;
+                    std::size_t position = 0;
+                    for (const auto &member : object) {
+                        std::size_t index;
+                        if (position < shape.size() && *shape[position].first == member.first)
+                            index = shape[position].second;
+                        else {
+                            auto iter = names.find(std::string(member.first.data(), member.first.size()));
+                            index = iter != names.end() ? iter->second : none;
+                            if (position < shape.size())
+                                shape[position] = std::make_pair(&member.first, index);
+                            else
+                                shape.push_back(std::make_pair(&member.first, index));
+                        }
+                        position++;
+                        if (index == none)
+                            continue;
+                        JsonColumn &column = table.columns[index];
+                        if (member.second.column_value(column, row, buffers[part][index]))
+                            column.validity[row / 64] |= std::uint64_t(1) << (row % 64);
                     }
-                    if (json[index] == ',')
-                        index++;
-                    else
-                        throw std::logic_error("Unexpected character");
                 }
+            });
+            for (std::size_t index = 0; index < table.columns.size(); index++) {
+                JsonColumn &column = table.columns[index];
+                if (column.type != JsonColumn::column_string)
+                    continue;
+                std::vector<std::size_t> bases(chunks + 1, 0);
+                for (std::size_t part = 0; part < chunks; part++)
+                    bases[part + 1] = bases[part] + buffers[part][index].size();
+                column.data.resize(bases[chunks]);
+                run_parallel(chunks, [&](std::size_t part) {
+                    std::string &buffer = buffers[part][index];
+                    if (!buffer.empty())
+                        std::memcpy(&column.data[bases[part]], buffer.data(), buffer.size());
+                    std::string().swap(buffer);
+                    // 无效的行没有数据，结束位置与上一行相同
+                    std::uint64_t offset = bases[part];
+                    std::size_t end = std::min(rows.size(), (part + 1) * chunk);
+                    for (std::size_t row = part * chunk; row < end; row++) {
+                        if (column.valid(row))
+                            offset = bases[part] + column.offsets[row + 1];
+                        column.offsets[row + 1] = offset;
+                    }
+                });
             }
+            return table;
+        }
 
-            std::string json;
-            int index;
-        };
+        // 在两端构建数组，push_back 与 push_front 都是均摊 O(1)；build() 按顺序移动到新的数组中，之后 builder 为空
+        class ArrayBuilder {
+        public:
+            ArrayBuilder() {}
 
-        void copy(const Json &other) {
-            data_type = other.data_type;
-            switch (data_type) {
-            case json_bool:
-                value.data_bool = other.value.data_bool;
-                break;
-            case json_int:
-                value.data_int = other.value.data_int;
-                break;
-            case json_double:
-                value.data_double = other.value.data_double;
-                break;
-            case json_string:
-                value.data_string = new std::string(*other.value.data_string);
-                break;
-            case json_array:
-                value.data_array = new std::vector<Json>(*other.value.data_array);
-                break;
-            case json_object:
-                value.data_object = new std::map<std::string, Json>(*other.value.data_object);
-                break;
-            default:
-                break;
+            void reserve(std::size_t size) {
+                back.reserve(size);
+            }
+            void reserve_front(std::size_t size) {
+                front.reserve(size);
+            }
+            std::size_t size() const {
+                return front.size() + back.size();
+            }
+            bool empty() const {
+                return front.empty() && back.empty();
             }
-        }
 
-        union Value {
-            bool data_bool;
-            int data_int;
-            double data_double;
-            std::string *data_string;
-            std::vector<Json> *data_array;
-            std::map<std::string, Json> *data_object;
+            void push_back(const basic_json &value) {
+                back.push_back(value);
+            }
+            void push_back(basic_json &&value) {
+                back.push_back(std::move(value));
+            }
+            void push_front(const basic_json &value) {
+                front.push_back(value);
+            }
+            void push_front(basic_json &&value) {
+                front.push_back(std::move(value));
+            }
+
+            template <typename... Args>
+            basic_json &emplace_back(Args &&...args) {
+                back.emplace_back(std::forward<Args>(args)...);
+                return back.back();
+            }
+            template <typename... Args>
+            basic_json &emplace_front(Args &&...args) {
+                front.emplace_back(std::forward<Args>(args)...);
+                return front.back();
+            }
+
+            // 没有在头部插入时直接移交 back 的缓冲区
+            basic_json build() {
+                if (front.empty())
+                    return basic_json(std::move(back));
+                std::reverse(front.begin(), front.end());
+                front.reserve(front.size() + back.size());
+                std::move(back.begin(), back.end(), std::back_inserter(front));
+                back.clear();
+                return basic_json(std::move(front));
+            }
+
+        private:
+            // front 中的元素按插入的逆序保存
+            array_type front;
+            array_type back;
         };
 
-        Type data_type;
-        Value value;
-    };
+        // 可重复使用的解析器，直接读取调用者传入的文本，不复制输入；解析结束后不再引用该文本
+        // parse_into 复用目标文档中已有的数组、对象与字符串：数组按下标、对象按 key 对应到原有的节点，
+        // 多出的元素与没有再出现的成员被删除，因此反复解析结构相近的文档时几乎不需要分配内存
+        // 解析失败时抛出异常，或由带 JsonError 参数的版本返回 false，目标文档中保留已经解析的部分
+        class Parser {
+        public:
+            Parser() : index(0) {
+                this->set_limits();
+            }
+            Parser(const JsonParseOptions &options) : index(0), options(options) {
+                this->set_limits();
+            }
+            ~Parser(){};
 
-} // namespace my_json
+            // 不抛出异常的版本：失败时返回 false，error 中为错误原因与字节偏移
+            bool parse_into(const char *json, std::size_t size, basic_json &target, JsonError &error) {
+                this->json = Input{json, size};
+                index = 0;
+                nodes = 0;
+                memory = 0;
+                this->error = JsonError();
+#ifdef MY_JSON_INSTRUMENTATION
+                stats = JsonStats();
+                auto start = std::chrono::steady_clock::now();
+                bool ok = this->parse_document(target);
+                stats.parse_calls = 1;
+                stats.parse_errors = ok ? 0 : 1;
+                stats.parse_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+                stats.bytes_in = size;
+                JsonInstrumentation::record(stats, json, size);
+#else
+                bool ok = this->parse_document(target);
+#endif
+                error = this->error;
+                return ok;
+            }
+
+            bool parse_into(const std::string &json, basic_json &target, JsonError &error) {
+                return this->parse_into(json.data(), json.size(), target, error);
+            }
+
+            void parse_into(const char *json, std::size_t size, basic_json &target) {
+                JsonError error;
+                if (!this->parse_into(json, size, target, error))
+                    throw_error(error);
+            }
+
+            void parse_into(const std::string &json, basic_json &target) {
+                this->parse_into(json.data(), json.size(), target);
+            }
+
+            // 把对象数组的文本直接解析为列，不构建文档，见 to_columns；不在 schema 中的成员与不是对象的元素只检查括号与引号后跳过
+            // 失败时 table 中保留已经解析的行
+            bool parse_columns(const char *json, std::size_t size, const std::vector<JsonColumn> &schema, JsonColumns &table, JsonError &error) {
+                this->json = Input{json, size};
+                index = 0;
+                nodes = 0;
+                memory = 0;
+                this->error = JsonError();
+                frames.clear();
+                std::unordered_map<std::string, std::size_t> names;
+                table = column_table(schema, 0, names);
+                bool ok = this->parse_rows(table, names);
+                error = this->error;
+                return ok;
+            }
+
+            bool parse_columns(const std::string &json, const std::vector<JsonColumn> &schema, JsonColumns &table, JsonError &error) {
+                return this->parse_columns(json.data(), json.size(), schema, table, error);
+            }
+
+            void parse_columns(const char *json, std::size_t size, const std::vector<JsonColumn> &schema, JsonColumns &table) {
+                JsonError error;
+                if (!this->parse_columns(json, size, schema, table, error))
+                    throw_error(error);
+            }
+
+            void parse_columns(const std::string &json, const std::vector<JsonColumn> &schema, JsonColumns &table) {
+                this->parse_columns(json.data(), json.size(), schema, table);
+            }
+
+            // 只在定义了 MY_JSON_INSTRUMENTATION 时写入，未定义时也保留，使类的布局不随宏变化
+            JsonStats stats = JsonStats();
+
+        private:
+            // 栈中的一层：正在解析的数组或对象，count 为已经解析的元素或成员个数，reused 表示对象中有需要清理的旧成员
+            // selection 为该容器在投影中对应的节点，npos 表示构建其中的全部内容
+            struct Frame {
+                basic_json *container;
+                std::size_t count;
+                bool reused;
+                std::size_t selection;
+            };
+
+            static bool heap_allocated(const string_type &str) {
+                const char *data = str.data();
+                const char *self = reinterpret_cast<const char *>(&str);
+                return data < self || data >= self + sizeof(str);
+            }
+
+            // 0 表示不限制，统一换成最大值，检查时只需一次比较
+            void set_limits() {
+                const std::size_t none = static_cast<std::size_t>(-1);
+                limit_depth = options.max_depth != 0 ? options.max_depth : none;
+                limit_nodes = options.max_nodes != 0 ? options.max_nodes : none;
+                limit_string = options.max_string_length != 0 ? options.max_string_length : none;
+                limit_container = options.max_container_size != 0 ? options.max_container_size : none;
+                limit_memory = options.max_memory != 0 ? options.max_memory : none;
+                // 预先分配常见文档所需的栈深度，更深的文档再按需扩容
+                frames.reserve(limit_depth < 16 ? limit_depth : 16);
+            }
+
+            bool allocate(std::size_t size) {
+                memory += size;
+                if (memory > limit_memory)
+                    return this->fail(JsonError::memory_exceeded);
+                return true;
+            }
+
+            // 各个 check 函数出错时记录错误并返回 false，调用方逐层返回，不使用异常
+            bool fail(JsonError::Code code) {
+                if (code == JsonError::unexpected_character && index >= json.size())
+                    code = JsonError::unexpected_end;
+                error = JsonError(code, index);
+                return false;
+            }
+
+            // 迭代地解析：尚未结束的数组与对象保存在 frames 中，嵌套深度不受线程栈大小的限制
+            // target 为接下来要写入的节点，为 nullptr 时表示刚结束了一个值
+            bool parse_document(basic_json &root) {
+                frames.clear();
+                if (options.projection != nullptr && !options.projection->complete(0))
+                    selection = 0;
+                else
+                    selection = JsonProjection::npos;
+                basic_json *target = &root;
+                while (target != nullptr) {
+                    if (!this->parse_value(target) || (target == nullptr && !this->next_value(target)))
+                        return this->unwind();
+                }
+                this->skip_space();
+                if (index != json.size())
+                    return this->fail(JsonError::trailing_characters);
+                if (options.dedupe)
+                    root.dedupe();
+                return true;
+            }
+
+            // 标量写入 target 后把 target 置为 nullptr；数组或对象入栈后 target 指向其第一个元素或成员，为空时直接出栈
+            bool parse_value(basic_json *&target) {
+                if (!compact_layout)
+                    target->set_flags(target->flags() & ~flag_stale);
+                this->skip_space();
+                if (++nodes > limit_nodes)
+                    return this->fail(JsonError::too_many_nodes);
+                if (!this->allocate(sizeof(basic_json)))
+                    return false;
+                switch (json[index]) {
+                case 'n':
+                    MY_JSON_STATS(stats.nodes[json_null]++;)
+                    if (!this->check_literal("null"))
+                        return false;
+                    *target = basic_json();
+                    break;
+                case 't':
+                    MY_JSON_STATS(stats.nodes[json_bool]++;)
+                    if (!this->check_literal("true"))
+                        return false;
+                    *target = basic_json(true);
+                    break;
+                case 'f':
+                    MY_JSON_STATS(stats.nodes[json_bool]++;)
+                    if (!this->check_literal("false"))
+                        return false;
+                    *target = basic_json(false);
+                    break;
+                case '"':
+                    MY_JSON_STATS(stats.nodes[json_string]++;)
+                    index++;
+                    if (!this->check_string_value(*target))
+                        return false;
+                    break;
+                case '[':
+                case '{':
+                    return this->open(target);
+                default:
+                    if (!this->check_number(*target))
+                        return false;
+                    break;
+                }
+                target = nullptr;
+                return true;
+            }
+
+            bool open(basic_json *&target) {
+                if (frames.size() == limit_depth)
+                    return this->fail(JsonError::depth_exceeded);
+                bool array = json[index++] == '[';
+                Type type = array ? json_array : json_object;
+                bool reused = false;
+                if (target->type() != type || (target->flags() & flag_packed) || target->is_shared()) {
+                    *target = basic_json(type);
+                    MY_JSON_STATS(stats.allocations++;)
+                } else {
+                    target->invalidate();
+                    // 原有的成员先标记为 flag_stale，解析到同名的 key 时清除，关闭时删除仍带有标记的成员
+                    // 紧凑布局没有 flag_stale，直接清空原有的成员
+                    if (!array && !target->payload().data_object->empty()) {
+                        if (compact_layout)
+                            target->payload().data_object->clear();
+                        else {
+                            reused = true;
+                            for (auto &i : *target->payload().data_object)
+                                i.second.set_flags(i.second.flags() | flag_stale);
+                        }
+                    }
+                }
+                MY_JSON_STATS(stats.nodes[type]++;)
+                frames.push_back(Frame{target, 0, reused, selection});
+                MY_JSON_STATS(if (frames.size() > stats.max_depth) stats.max_depth = frames.size();)
+                this->skip_space();
+                target = nullptr;
+                if (json[index] == (array ? ']' : '}')) {
+                    index++;
+                    this->close();
+                    return true;
+                }
+                return array ? this->next_element(target) : this->next_member(target);
+            }
+
+            // 一个值结束后关闭已经结束的数组与对象，直到遇到 ','，target 指向下一个元素或成员；文档结束时 target 为 nullptr
+            bool next_value(basic_json *&target) {
+                while (!frames.empty()) {
+                    bool array = frames.back().container->type() == json_array;
+                    this->skip_space();
+                    if (json[index] == (array ? ']' : '}')) {
+                        index++;
+                        this->close();
+                        continue;
+                    }
+                    if (json[index] != ',')
+                        return this->fail(JsonError::unexpected_character);
+                    index++;
+                    if (!(array ? this->next_element(target) : this->next_member(target)))
+                        return false;
+                    if (target != nullptr)
+                        return true;
+                }
+                target = nullptr;
+                return true;
+            }
+
+            // 取得下一个元素或成员的节点，以及它在投影中对应的 selection；没有被投影选中时跳过该值，target 为 nullptr
+            bool next_element(basic_json *&target) {
+                Frame &frame = frames.back();
+                array_type &array = *frame.container->payload().data_array;
+                if (frame.count == limit_container)
+                    return this->fail(JsonError::container_too_large);
+                if (frame.count == array.size()) {
+                    MY_JSON_STATS(std::size_t capacity = array.capacity();)
+                    array.emplace_back();
+                    MY_JSON_STATS(stats.allocations += array.capacity() != capacity;)
+                }
+                basic_json &slot = array[frame.count++];
+                if (frame.selection != JsonProjection::npos) {
+                    std::size_t node = options.projection->element(frame.selection, frame.count - 1);
+                    if (node == JsonProjection::npos) {
+                        slot = basic_json();
+                        return this->skip_value();
+                    }
+                    selection = options.projection->complete(node) ? JsonProjection::npos : node;
+                }
+                target = &slot;
+                return true;
+            }
+
+            bool next_member(basic_json *&target) {
+                Frame &frame = frames.back();
+                object_type &object = *frame.container->payload().data_object;
+                this->skip_space();
+                if (frame.count++ == limit_container)
+                    return this->fail(JsonError::container_too_large);
+                if (json[index] != '"')
+                    return this->fail(JsonError::unexpected_character);
+                index++;
+                std::size_t node = JsonProjection::npos;
+                if (frame.selection != JsonProjection::npos) {
+                    // 没有转义的 key 直接与投影比较，只有被选中时才复制
+                    std::size_t start = index;
+                    bool escaped;
+                    if (!this->skip_string(escaped))
+                        return false;
+                    if (!escaped)
+                        node = options.projection->member(frame.selection, json.data() + start, index - 1 - start);
+                    if (escaped || node != JsonProjection::npos) {
+                        index = start;
+                        if (!this->check_string(key))
+                            return false;
+                    }
+                    if (escaped)
+                        node = options.projection->member(frame.selection, key.data(), key.size());
+                } else if (!this->check_string(key))
+                    return false;
+                this->skip_space();
+                if (json[index] != ':')
+                    return this->fail(JsonError::unexpected_character);
+                index++;
+                if (frame.selection != JsonProjection::npos) {
+                    if (node == JsonProjection::npos)
+                        return this->skip_value();
+                    selection = options.projection->complete(node) ? JsonProjection::npos : node;
+                }
+                auto iter = object.find(key);
+                if (iter == object.end()) {
+                    iter = object.emplace(key, basic_json()).first;
+                    MY_JSON_STATS(stats.allocations += heap_allocated(key) ? 2 : 1;)
+                }
+                target = &iter->second;
+                return true;
+            }
+
+            // index 指向开头引号之后，跳过字符串并移到结尾引号之后；只检查转义与 UTF-8 编码，不解码
+            bool skip_string(bool &escaped) {
+                JsonError::Code code;
+                const char *begin = json.data();
+                index = find_string_end(begin + index, begin + json.size(), escaped, code) - begin;
+                if (code != JsonError::ok)
+                    return this->fail(code);
+                index++;
+                return true;
+            }
+
+            // 跳过没有被投影选中的值：只检查括号与引号是否匹配，不解码数字与字符串，也不分配内存
+            bool skip_value() {
+                std::size_t start = index;
+                skipped.clear();
+                do {
+                    this->skip_space();
+                    bool escaped;
+                    switch (json[index]) {
+                    case '"':
+                        index++;
+                        if (!this->skip_string(escaped))
+                            return false;
+                        break;
+                    case '[':
+                    case '{':
+                        if (frames.size() + skipped.size() == limit_depth)
+                            return this->fail(JsonError::depth_exceeded);
+                        skipped += json[index] == '[' ? ']' : '}';
+                        index++;
+                        break;
+                    case ']':
+                    case '}':
+                        if (skipped.empty() || skipped.back() != json[index])
+                            return this->fail(JsonError::unexpected_character);
+                        skipped.pop_back();
+                        index++;
+                        break;
+                    case ',':
+                    case ':':
+                        if (skipped.empty() || index == start)
+                            return this->fail(JsonError::unexpected_character);
+                        index++;
+                        break;
+                    default:
+                        // 数字与 true、false、null：只跳过可能出现在其中的字符
+                        std::size_t begin = index;
+                        while ((json[index] >= '0' && json[index] <= '9') || (json[index] >= 'a' && json[index] <= 'z') || json[index] == '-' || json[index] == '+' || json[index] == '.' || json[index] == 'E')
+                            index++;
+                        if (index == begin)
+                            return this->fail(JsonError::unexpected_character);
+                        break;
+                    }
+                } while (!skipped.empty());
+                return true;
+            }
+
+            // 出栈：删除数组中多出的元素与对象中没有再出现的成员
+            void close() {
+                Frame &frame = frames.back();
+                if (frame.container->type() == json_array) {
+                    array_type &array = *frame.container->payload().data_array;
+                    if (frame.count != array.size())
+                        array.erase(array.begin() + frame.count, array.end());
+                    if (options.pack_numbers && frame.count != 0)
+                        frame.container->pack();
+                } else if (frame.reused) {
+                    object_type &object = *frame.container->payload().data_object;
+                    for (auto iter = object.begin(); iter != object.end();) {
+                        if (iter->second.flags() & flag_stale)
+                            iter = object.erase(iter);
+                        else
+                            ++iter;
+                    }
+                }
+                frames.pop_back();
+            }
+
+            // 出错时依次关闭尚未结束的数组与对象，使目标文档中只保留已经解析的部分
+            bool unwind() {
+                while (!frames.empty())
+                    this->close();
+                return false;
+            }
+
+            bool parse_rows(JsonColumns &table, const std::unordered_map<std::string, std::size_t> &names) {
+                this->skip_space();
+                if (json[index] != '[')
+                    return this->fail(JsonError::unexpected_character);
+                index++;
+                this->skip_space();
+                if (json[index] == ']')
+                    index++;
+                else {
+                    // cell 在各行之间复用，字符串值不需要每次重新分配
+                    basic_json cell;
+                    std::vector<std::pair<std::string, std::size_t>> shape;
+                    while (true) {
+                        if (table.rows == limit_container)
+                            return this->fail(JsonError::container_too_large);
+                        this->add_row(table);
+                        this->skip_space();
+                        if (json[index] == '{') {
+                            if (!this->parse_row(table, names, shape, cell))
+                                return false;
+                        } else if (!this->skip_value())
+                            return false;
+                        this->skip_space();
+                        if (json[index] == ']') {
+                            index++;
+                            break;
+                        }
+                        if (json[index] != ',')
+                            return this->fail(JsonError::unexpected_character);
+                        index++;
+                    }
+                }
+                this->skip_space();
+                if (index != json.size())
+                    return this->fail(JsonError::trailing_characters);
+                return true;
+            }
+
+            static void add_row(JsonColumns &table) {
+                std::size_t row = table.rows++;
+                for (auto &i : table.columns) {
+                    if (row % 64 == 0)
+                        i.validity.push_back(0);
+                    if (i.type == JsonColumn::column_int64)
+                        i.ints.push_back(0);
+                    else if (i.type == JsonColumn::column_double)
+                        i.doubles.push_back(0);
+                    else if (i.type == JsonColumn::column_bool)
+                        i.bools.push_back(0);
+                    else
+                        i.offsets.push_back(i.data.size());
+                }
+            }
+
+            // shape 为上一行各位置上的 key 与对应的列，同构的行只需比较 key 而不用查找
+            bool parse_row(JsonColumns &table, const std::unordered_map<std::string, std::size_t> &names, std::vector<std::pair<std::string, std::size_t>> &shape, basic_json &cell) {
+                const std::size_t none = static_cast<std::size_t>(-1);
+                std::size_t row = table.rows - 1;
+                index++;
+                this->skip_space();
+                if (json[index] == '}') {
+                    index++;
+                    return true;
+                }
+                for (std::size_t position = 0;; position++) {
+                    this->skip_space();
+                    if (position == limit_container)
+                        return this->fail(JsonError::container_too_large);
+                    if (json[index] != '"')
+                        return this->fail(JsonError::unexpected_character);
+                    std::size_t start = ++index;
+                    bool escaped;
+                    if (!this->skip_string(escaped))
+                        return false;
+                    const char *name = json.data() + start;
+                    std::size_t size = index - 1 - start;
+                    if (escaped) {
+                        index = start;
+                        if (!this->check_string(key))
+                            return false;
+                        name = key.data();
+                        size = key.size();
+                    }
+                    if (position == shape.size())
+                        shape.push_back(std::make_pair(std::string(), none));
+                    std::pair<std::string, std::size_t> &cached = shape[position];
+                    if (cached.first.compare(0, std::string::npos, name, size) != 0) {
+                        cached.first.assign(name, size);
+                        auto iter = names.find(cached.first);
+                        cached.second = iter != names.end() ? iter->second : none;
+                    }
+                    this->skip_space();
+                    if (json[index] != ':')
+                        return this->fail(JsonError::unexpected_character);
+                    index++;
+                    this->skip_space();
+                    if (cached.second == none || json[index] == '[' || json[index] == '{') {
+                        if (!this->skip_value())
+                            return false;
+                    } else {
+                        basic_json *target = &cell;
+                        if (!this->parse_value(target))
+                            return false;
+                        JsonColumn &column = table.columns[cached.second];
+                        if (cell.column_value(column, row, column.data))
+                            column.validity[row / 64] |= std::uint64_t(1) << (row % 64);
+                    }
+                    this->skip_space();
+                    if (json[index] == '}') {
+                        index++;
+                        return true;
+                    }
+                    if (json[index] != ',')
+                        return this->fail(JsonError::unexpected_character);
+                    index++;
+                }
+            }
+
+            void skip_space() {
+                while (json[index] == ' ' || json[index] == '\t' || json[index] == '\r' || json[index] == '\n')
+                    index++;
+            }
+
+            bool check_literal(const char *literal) {
+                std::size_t size = std::char_traits<char>::length(literal);
+                if (!json.matches(index, literal, size))
+                    return this->fail(JsonError::unexpected_character);
+                index += size;
+                return true;
+            }
+
+            bool check_digits() {
+                if (json[index] < '0' || json[index] > '9')
+                    return false;
+                while (json[index] >= '0' && json[index] <= '9')
+                    index++;
+                return true;
+            }
+
+            bool check_number(basic_json &target) {
+                std::size_t start = index;
+                bool integer = true;
+                if (json[index] == '-')
+                    index++;
+                if (json[index] == '0')
+                    index++;
+                else if (json[index] < '1' || json[index] > '9' || !this->check_digits())
+                    return this->fail(JsonError::unexpected_character);
+                if (json[index] == '.') {
+                    index++;
+                    integer = false;
+                    if (!this->check_digits())
+                        return this->fail(JsonError::unexpected_character);
+                }
+                if (json[index] == 'e' || json[index] == 'E') {
+                    index++;
+                    integer = false;
+                    if (json[index] == '+' || json[index] == '-')
+                        index++;
+                    if (!this->check_digits())
+                        return this->fail(JsonError::unexpected_character);
+                }
+                const char *text = json.data() + start;
+                std::size_t size = index - start;
+                MY_JSON_STATS(stats.nodes[integer ? json_int : json_double]++;)
+                if (!options.lazy_numbers) {
+                    // 超出内联的整数范围或无法用有限的 double 表示时保留原文，避免截断
+                    std::int64_t number;
+                    if (integer && parse_int64(text, size, number) && inline_int(number)) {
+                        target = from_int64(number);
+                        return true;
+                    }
+                    double real;
+                    if (!integer && parse_double(text, size, real)) {
+                        target = basic_json(real);
+                        return true;
+                    }
+                }
+                MY_JSON_STATS(stats.allocations += size > sizeof(Value::data_raw);)
+                target = from_raw_number(integer ? json_int : json_double, text, size);
+                return true;
+            }
+
+            // index 指向开头引号之后，找到结尾的引号并检查转义与 UTF-8 编码，escaped 表示其中是否含有转义
+            bool scan_string(std::size_t &end, bool &escaped) {
+                JsonError::Code code;
+                const char *begin = json.data();
+                const char *quote = find_string_end(begin + index, begin + json.size(), escaped, code);
+                end = quote - begin;
+                if (code != JsonError::ok) {
+                    index = end;
+                    return this->fail(code);
+                }
+                if (end - index > limit_string)
+                    return this->fail(JsonError::string_too_long);
+                return this->allocate(end - index);
+            }
+
+            // 解码后替换 str 原有的内容，保留 str 的容量
+            bool check_string(string_type &str) {
+                bool escaped;
+                std::size_t end;
+                if (!this->scan_string(end, escaped))
+                    return false;
+                str.clear();
+                if (escaped)
+                    unescape(json.data() + index, end - index, str);
+                else
+                    str.append(json.data() + index, end - index);
+                index = end + 1;
+                return true;
+            }
+
+            // 原有的字符串没有共享时复用其缓冲区
+            bool check_string_value(basic_json &target) {
+                if (!target.is_string() || (target.flags() & flag_header)) {
+                    target = basic_json(json_string);
+                    MY_JSON_STATS(stats.allocations++;)
+                }
+                string_type &str = *target.payload().data_string;
+                MY_JSON_STATS(std::size_t capacity = str.capacity();)
+                target.set_flags(0);
+                if (!options.lazy_strings) {
+                    if (!this->check_string(str))
+                        return false;
+                } else {
+                    bool escaped;
+                    std::size_t end;
+                    if (!this->scan_string(end, escaped))
+                        return false;
+                    str.assign(json.data() + index, end - index);
+                    if (escaped)
+                        target.set_flags(flag_escaped);
+                    index = end + 1;
+                }
+                MY_JSON_STATS(stats.allocations += str.capacity() != capacity;)
+                return true;
+            }
+
+            // 调用者的缓冲区末尾不一定有 '\0'，越过结尾的下标读到 '\0'，逐字符判断的循环不需要单独检查结尾
+            struct Input {
+                const char *begin;
+                std::size_t length;
+
+                char operator[](std::size_t i) const {
+                    return i < length ? begin[i] : '\0';
+                }
+                const char *data() const {
+                    return begin;
+                }
+                std::size_t size() const {
+                    return length;
+                }
+                bool matches(std::size_t i, const char *text, std::size_t count) const {
+                    return i <= length && length - i >= count && std::memcmp(begin + i, text, count) == 0;
+                }
+            };
+
+            Input json = Input{nullptr, 0};
+            std::size_t index;
+            JsonParseOptions options;
+            JsonError error;
+            string_type key;
+            std::vector<Frame> frames;
+            std::size_t selection;
+            std::string skipped;
+            std::size_t nodes;
+            std::size_t memory;
+            std::size_t limit_depth;
+            std::size_t limit_nodes;
+            std::size_t limit_string;
+            std::size_t limit_container;
+            std::size_t limit_memory;
+        };
+
+    private:
+        friend class JsonView;
+
+        // 共享的值只增加引用计数
+        void copy(const basic_json &other) {
+            Type type = other.type();
+            std::uint8_t flags = other.flags();
+            Value data = other.payload();
+            ContainerHeader *block = other.header();
+            if (block != nullptr && block->shares != 0) {
+                block->shares++;
+                this->store(type, flags & (flag_header | flag_escaped), data);
+                return;
+            }
+            switch (type) {
+            case json_int:
+            case json_double:
+                if (flags & flag_raw_heap)
+                    this->store(type, flags & (flag_raw_number | flag_raw_heap), create<string_type>(*data.data_string));
+                else
+                    this->store(type, flags & flag_raw_number, data);
+                break;
+            case json_string:
+                this->store(type, flags & flag_escaped, create<string_type>(*data.data_string));
+                break;
+            case json_array:
+                if (flags & flag_packed_double)
+                    this->store(type, flags & (flag_packed | flag_packed_double), create<PackedBuffer<double>>(*data.data_doubles));
+                else if (flags & flag_packed)
+                    this->store(type, flag_packed, create<PackedBuffer<std::int64_t>>(*data.data_ints));
+                else
+                    this->store(type, 0, create<array_type>(*data.data_array));
+                break;
+            case json_object:
+                this->store(type, 0, create<object_type>(*data.data_object));
+                break;
+            default:
+                this->store(type, 0, data);
+                break;
+            }
+        }
+
+        // 输入提前结束时抛出 runtime_error，其余错误抛出 logic_error，信息中带有出错的字节偏移
+        static void throw_error(const JsonError &error) {
+            std::string message = std::string(error.message()) + " at offset " + std::to_string(error.offset);
+            if (error.code == JsonError::unexpected_end)
+                MY_JSON_THROW(std::runtime_error(message));
+            MY_JSON_THROW(std::logic_error(message));
+        }
+
+        const basic_json *find_member(const char *key, std::size_t size) const {
+            if (!this->is_object())
+                return nullptr;
+            auto iter = find_key(*payload().data_object, key, size, 0);
+            return iter == payload().data_object->end() ? nullptr : &iter->second;
+        }
+
+        const basic_json &at_member(const char *key, std::size_t size) const {
+            if (!this->is_object())
+                MY_JSON_THROW(std::logic_error("function Json::at: type error"));
+            const basic_json *member = this->find_member(key, size);
+            if (member == nullptr)
+                MY_JSON_THROW(std::out_of_range("function Json::at: key not found " + std::string(key, size)));
+            return *member;
+        }
+
+#ifdef MY_JSON_STRING_VIEW
+        // 比较器带有 is_transparent 时 object_type::find 接受 std::string_view，不需要构造临时的 key
+        template <typename Object>
+        static auto find_key(const Object &object, const char *key, std::size_t size, int) -> decltype(object.find(std::string_view(key, size))) {
+            return object.find(std::string_view(key, size));
+        }
+#endif
+
+        template <typename Object>
+        static typename Object::const_iterator find_key(const Object &object, const char *key, std::size_t size, long) {
+            return object.find(string_type(key, size));
+        }
+
+        static basic_json from_raw_number(Type type, const char *text, std::size_t size) {
+            // 紧凑布局没有位置保存内联的原文
+            basic_json number;
+            Value data;
+            if (compact_layout || size > sizeof(data.data_raw)) {
+                number.store(type, flag_raw_number | flag_raw_heap, create<string_type>(text, size));
+            } else {
+                std::memset(data.data_raw, 0, sizeof(data.data_raw));
+                std::memcpy(data.data_raw, text, size);
+                number.store(type, flag_raw_number, data);
+            }
+            return number;
+        }
+
+        // 能否不保存原文、直接保存在节点中
+        static bool inline_int(std::int64_t number) {
+            return number >= -Storage::int_max - 1 && number <= Storage::int_max;
+        }
+
+        // 超出内联范围时与解析的结果一样保存原文
+        static basic_json from_int64(std::int64_t number) {
+            basic_json json;
+            if (inline_int(number)) {
+                json.store(json_int, 0, Value(number));
+                return json;
+            }
+            std::string text = std::to_string(number);
+            return from_raw_number(json_int, text.data(), text.size());
+        }
+
+        static basic_json from_uint64(std::uint64_t number) {
+            if (number <= static_cast<std::uint64_t>(INT64_MAX))
+                return from_int64(static_cast<std::int64_t>(number));
+            std::string text = std::to_string(number);
+            return from_raw_number(json_int, text.data(), text.size());
+        }
+
+        // 没有保存原文时返回 nullptr
+        const char *raw_text(std::size_t &size) const {
+            if (!(this->flags() & flag_raw_number))
+                return nullptr;
+            if (this->flags() & flag_raw_heap) {
+                size = payload().data_string->size();
+                return payload().data_string->data();
+            }
+            const char *text = storage.inline_text();
+            size = std::find(text, text + sizeof(Value().data_raw), '\0') - text;
+            return text;
+        }
+
+        // 整数先按 int64 比较，再按 uint64 比较，都超出范围时比较原文
+        bool number_equal(const basic_json &other) const {
+            if (this->type() == json_double)
+                return this->get_double() == other.get_double();
+            std::size_t size = 0, other_size = 0;
+            const char *text = this->raw_text(size), *other_text = other.raw_text(other_size);
+            std::int64_t number = payload().data_int, other_number = other.payload().data_int;
+            bool exact = text == nullptr || parse_int64(text, size, number);
+            bool other_exact = other_text == nullptr || parse_int64(other_text, other_size, other_number);
+            if (exact || other_exact)
+                return exact && other_exact && number == other_number;
+            std::uint64_t unsigned_number = 0, other_unsigned_number = 0;
+            exact = parse_uint64(text, size, unsigned_number);
+            other_exact = parse_uint64(other_text, other_size, other_unsigned_number);
+            if (exact || other_exact)
+                return exact && other_exact && unsigned_number == other_unsigned_number;
+            return size == other_size && std::memcmp(text, other_text, size) == 0;
+        }
+
+        // text 为合法的 JSON 数字，超出范围时返回 false
+        static bool parse_int64(const char *text, std::size_t size, std::int64_t &value) {
+            bool negative = size != 0 && text[0] == '-';
+            std::uint64_t number;
+            if (!parse_uint64(text + negative, size - negative, number))
+                return false;
+            if (number > static_cast<std::uint64_t>(INT64_MAX) + negative)
+                return false;
+            value = negative ? static_cast<std::int64_t>(0 - number) : static_cast<std::int64_t>(number);
+            return true;
+        }
+
+        static bool parse_uint64(const char *text, std::size_t size, std::uint64_t &value) {
+            if (size == 0 || size > 20)
+                return false;
+            value = 0;
+            for (std::size_t i = 0; i < size; i++) {
+                unsigned digit = text[i] - '0';
+                if (digit > 9 || value > (UINT64_MAX - digit) / 10)
+                    return false;
+                value = value * 10 + digit;
+            }
+            return true;
+        }
+
+        // 结果为无穷大（超出 double 的范围）时返回 false，value 仍为 strtod 的结果
+        static bool parse_double(const char *text, std::size_t size, double &value) {
+            char buffer[64];
+            if (size < sizeof(buffer)) {
+                std::memcpy(buffer, text, size);
+                buffer[size] = '\0';
+                value = std::strtod(buffer, nullptr);
+            } else
+                value = std::strtod(std::string(text, size).c_str(), nullptr);
+            return value != HUGE_VAL && value != -HUGE_VAL;
+        }
+
+        // 不是十六进制数字时返回 -1
+        static int hex_digit(char ch) {
+            if (ch >= '0' && ch <= '9')
+                return ch - '0';
+            if (ch >= 'a' && ch <= 'f')
+                return ch - 'a' + 10;
+            if (ch >= 'A' && ch <= 'F')
+                return ch - 'A' + 10;
+            return -1;
+        }
+
+        // p 指向一个非 ASCII 字节，返回从 p 开始的 UTF-8 字符的字节数；编码不合法（包括过长编码、代理项与超出 U+10FFFF）时返回 0
+        static std::size_t utf8_length(const char *p, const char *end) {
+            unsigned char lead = p[0];
+            std::size_t length;
+            if (lead >= 0xC2 && lead <= 0xDF)
+                length = 2;
+            else if (lead >= 0xE0 && lead <= 0xEF)
+                length = 3;
+            else if (lead >= 0xF0 && lead <= 0xF4)
+                length = 4;
+            else
+                return 0;
+            if (static_cast<std::size_t>(end - p) < length)
+                return 0;
+            for (std::size_t i = 1; i < length; i++)
+                if ((static_cast<unsigned char>(p[i]) & 0xC0) != 0x80)
+                    return 0;
+            unsigned char next = p[1];
+            if ((lead == 0xE0 && next < 0xA0) || (lead == 0xED && next >= 0xA0) || (lead == 0xF0 && next < 0x90) || (lead == 0xF4 && next >= 0x90))
+                return 0;
+            return length;
+        }
+
+        // mask 不为 0，返回最低的置位的位置
+        static unsigned lowest_bit(unsigned mask) {
+#if defined(__GNUC__) || defined(__clang__)
+            return __builtin_ctz(mask);
+#elif defined(_MSC_VER)
+            unsigned long index;
+            _BitScanForward(&index, mask);
+            return index;
+#else
+            unsigned index = 0;
+            for (; !(mask & 1); mask >>= 1)
+                index++;
+            return index;
+#endif
+        }
+
+        // p 指向字符串开头引号之后，返回结尾引号的位置；出错时 code 不为 ok，返回值为出错的位置
+        static const char *find_string_end(const char *p, const char *end, bool &escaped, JsonError::Code &code) {
+            escaped = false;
+            code = JsonError::ok;
+#ifdef MY_JSON_SSE2
+            const __m128i quote = _mm_set1_epi8('"');
+            const __m128i backslash = _mm_set1_epi8('\\');
+            const __m128i space = _mm_set1_epi8(' ');
+#endif
+            while (true) {
+#ifdef MY_JSON_SSE2
+                // 按有符号比较时，控制字符与非 ASCII 字节都小于 ' '，去掉最高位为 1 的字节后只剩控制字符
+                while (end - p >= 16) {
+                    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+                    unsigned high = _mm_movemask_epi8(chunk);
+                    unsigned stop = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash))) |
+                                    (_mm_movemask_epi8(_mm_cmplt_epi8(chunk, space)) & ~high);
+                    if ((stop | high) == 0) {
+                        p += 16;
+                        continue;
+                    }
+                    // 第一个引号、反斜杠或控制字符之前的非 ASCII 字符在块内逐个校验，其间的 ASCII 字节按掩码跳过，之后从字符的下一个字节继续按 16 字节检查
+                    // 续字节不会是引号、反斜杠或控制字符，合法的字符不会越过 stop 的位置
+                    unsigned limit = stop != 0 ? lowest_bit(stop) : 16;
+                    const char *next = p + limit;
+                    while (high != 0 && lowest_bit(high) < limit) {
+                        unsigned offset = lowest_bit(high);
+                        std::size_t length = utf8_length(p + offset, end);
+                        if (length == 0) {
+                            code = JsonError::invalid_utf8;
+                            return p + offset;
+                        }
+                        high = offset + length >= 16 ? 0 : high & ~((1u << (offset + length)) - 1);
+                        if (p + offset + length > next)
+                            next = p + offset + length;
+                    }
+                    p = next;
+                    if (stop != 0)
+                        break;
+                }
+#endif
+                if (p == end) {
+                    code = JsonError::unexpected_end;
+                    return p;
+                }
+                unsigned char ch = *p;
+                if (ch == '"')
+                    return p;
+                if (ch == '\\') {
+                    escaped = true;
+                    if (end - p < 2) {
+                        code = JsonError::unexpected_end;
+                        return end;
+                    }
+                    switch (p[1]) {
+                    case '"':
+                    case '\\':
+                    case '/':
+                    case 'b':
+                    case 'f':
+                    case 'n':
+                    case 'r':
+                    case 't':
+                        p += 2;
+                        break;
+                    case 'u':
+                        for (int i = 2; i < 6; i++) {
+                            if (p + i == end) {
+                                code = JsonError::unexpected_end;
+                                return end;
+                            }
+                            if (hex_digit(p[i]) < 0) {
+                                code = JsonError::invalid_escape;
+                                return p;
+                            }
+                        }
+                        p += 6;
+                        break;
+                    default:
+                        code = JsonError::invalid_escape;
+                        return p;
+                    }
+                } else if (ch < 0x20) {
+                    code = JsonError::unexpected_character;
+                    return p;
+                } else if (ch < 0x80)
+                    p++;
+                else {
+                    std::size_t length = utf8_length(p, end);
+                    if (length == 0) {
+                        code = JsonError::invalid_utf8;
+                        return p;
+                    }
+                    p += length;
+                }
+            }
+        }
+
+        // text 为已经检查过的转义后的原文，解码结果以 UTF-8 追加到 str
+        // \u 转义按 UTF-16 处理，成对的代理项合并为一个字符，孤立的代理项替换为 U+FFFD
+        static void unescape(const char *text, std::size_t size, string_type &str) {
+            const char *end = text + size;
+            str.reserve(str.size() + size);
+            while (text != end) {
+                const char *escape = std::find(text, end, '\\');
+                str.append(text, escape - text);
+                if (escape == end)
+                    break;
+                text = escape + 2;
+                switch (escape[1]) {
+                case 'b':
+                    str += '\b';
+                    break;
+                case 'f':
+                    str += '\f';
+                    break;
+                case 'n':
+                    str += '\n';
+                    break;
+                case 'r':
+                    str += '\r';
+                    break;
+                case 't':
+                    str += '\t';
+                    break;
+                case 'u': {
+                    std::uint32_t code = 0;
+                    for (int i = 0; i < 4; i++)
+                        code = code << 4 | hex_digit(text[i]);
+                    text += 4;
+                    if (code >= 0xD800 && code < 0xDC00 && end - text >= 6 && text[0] == '\\' && text[1] == 'u') {
+                        std::uint32_t low = 0;
+                        for (int i = 2; i < 6; i++)
+                            low = low << 4 | hex_digit(text[i]);
+                        if (low >= 0xDC00 && low < 0xE000) {
+                            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                            text += 6;
+                        }
+                    }
+                    if (code >= 0xD800 && code < 0xE000)
+                        code = 0xFFFD;
+                    if (code < 0x80)
+                        str += static_cast<char>(code);
+                    else if (code < 0x800) {
+                        str += static_cast<char>(0xC0 | code >> 6);
+                        str += static_cast<char>(0x80 | (code & 0x3F));
+                    } else if (code < 0x10000) {
+                        str += static_cast<char>(0xE0 | code >> 12);
+                        str += static_cast<char>(0x80 | (code >> 6 & 0x3F));
+                        str += static_cast<char>(0x80 | (code & 0x3F));
+                    } else {
+                        str += static_cast<char>(0xF0 | code >> 18);
+                        str += static_cast<char>(0x80 | (code >> 12 & 0x3F));
+                        str += static_cast<char>(0x80 | (code >> 6 & 0x3F));
+                        str += static_cast<char>(0x80 | (code & 0x3F));
+                    }
+                    break;
+                }
+                default: // '"'、'\\' 与 '/'
+                    str += escape[1];
+                    break;
+                }
+            }
+        }
+
+        // 每段的行数为 64 的倍数，使各线程写入 validity 中不同的字；数据较少时不拆分
+        static std::size_t column_chunk(std::size_t rows, unsigned threads) {
+            if (threads == 0)
+                threads = std::max(1u, std::thread::hardware_concurrency());
+            std::size_t chunk = (rows + threads - 1) / threads;
+            chunk = std::max<std::size_t>(4096, (chunk + 63) / 64 * 64);
+            return chunk;
+        }
+
+        // 按 schema 创建 rows 行的空列，重复的列名只保留第一个；names 为列名到下标的映射
+        static JsonColumns column_table(const std::vector<JsonColumn> &schema, std::size_t rows, std::unordered_map<std::string, std::size_t> &names) {
+            JsonColumns table;
+            table.rows = rows;
+            for (const auto &i : schema) {
+                if (!names.emplace(i.name, table.columns.size()).second)
+                    continue;
+                JsonColumn column(i.name, i.type);
+                column.validity.assign((rows + 63) / 64, 0);
+                if (i.type == JsonColumn::column_int64)
+                    column.ints.assign(rows, 0);
+                else if (i.type == JsonColumn::column_double)
+                    column.doubles.assign(rows, 0);
+                else if (i.type == JsonColumn::column_bool)
+                    column.bools.assign(rows, 0);
+                else
+                    column.offsets.assign(rows + 1, 0);
+                table.columns.push_back(std::move(column));
+            }
+            return table;
+        }
+
+        // 在当前线程与 count - 1 个新线程上分别执行 body(0) 到 body(count - 1)
+        static void run_parallel(std::size_t count, const std::function<void(std::size_t)> &body) {
+            std::vector<std::thread> workers;
+            for (std::size_t i = 1; i < count; i++)
+                workers.emplace_back(body, i);
+            if (count != 0)
+                body(0);
+            for (auto &i : workers)
+                i.join();
+        }
+
+        // 把标量写入列的第 row 行，类型不符时返回 false
+        bool column_value(JsonColumn &column, std::size_t row, std::string &buffer) const {
+            std::size_t size = 0;
+            const char *text = this->raw_text(size);
+            switch (column.type) {
+            case JsonColumn::column_int64:
+                if (this->type() != json_int)
+                    return false;
+                if (text == nullptr) {
+                    column.ints[row] = payload().data_int;
+                    return true;
+                }
+                if (parse_int64(text, size, column.ints[row]))
+                    return true;
+                column.ints[row] = 0;
+                return false;
+            case JsonColumn::column_double:
+                if (this->type() != json_int && this->type() != json_double)
+                    return false;
+                if (text != nullptr) {
+                    if (parse_double(text, size, column.doubles[row]))
+                        return true;
+                    column.doubles[row] = 0;
+                    return false;
+                }
+                column.doubles[row] = this->type() == json_int ? payload().data_int : payload().data_double;
+                return true;
+            case JsonColumn::column_bool:
+                if (this->type() != json_bool)
+                    return false;
+                column.bools[row] = payload().data_bool;
+                return true;
+            case JsonColumn::column_string:
+                if (this->type() != json_string)
+                    return false;
+                if (this->flags() & flag_escaped) {
+                    string_type str;
+                    unescape(payload().data_string->data(), payload().data_string->size(), str);
+                    buffer.append(str.data(), str.size());
+                } else
+                    buffer.append(payload().data_string->data(), payload().data_string->size());
+                column.offsets[row + 1] = buffer.size();
+                return true;
+            }
+            return false;
+        }
+
+        // 转义 '"'、'\\' 与控制字符，其余字符（包括 UTF-8 的多字节字符）原样输出
+        static void append_escaped(std::string &str, const char *data, std::size_t size) {
+            static const char hex[] = "0123456789abcdef";
+            const char *end = data + size;
+            while (data != end) {
+                const char *next = data;
+                while (next != end && *next != '"' && *next != '\\' && static_cast<unsigned char>(*next) >= 0x20)
+                    next++;
+                str.append(data, next - data);
+                if (next == end)
+                    break;
+                switch (*next) {
+                case '"':
+                    str += "\\\"";
+                    break;
+                case '\\':
+                    str += "\\\\";
+                    break;
+                case '\b':
+                    str += "\\b";
+                    break;
+                case '\f':
+                    str += "\\f";
+                    break;
+                case '\n':
+                    str += "\\n";
+                    break;
+                case '\r':
+                    str += "\\r";
+                    break;
+                case '\t':
+                    str += "\\t";
+                    break;
+                default:
+                    str += "\\u00";
+                    str += hex[*next >> 4];
+                    str += hex[*next & 0xF];
+                    break;
+                }
+                data = next + 1;
+            }
+        }
+
+        // 直接追加到 str 末尾，避免为每个子节点生成临时字符串
+        void dump(std::string &str, JsonStats *stats, std::uint64_t depth) const {
+            MY_JSON_STATS(std::size_t capacity = str.capacity();)
+            MY_JSON_STATS(stats->nodes[this->type()]++;)
+            MY_JSON_STATS(if ((this->type() == json_array || this->type() == json_object) && depth + 1 > stats->max_depth) stats->max_depth = depth + 1;)
+            switch (this->type()) {
+            case json_null:
+                str += "null";
+                break;
+            case json_bool:
+                str += payload().data_bool ? "true" : "false";
+                break;
+            case json_int:
+            case json_double: {
+                std::size_t size = 0;
+                const char *text = this->raw_text(size);
+                if (text != nullptr)
+                    str.append(text, size);
+                else if (this->type() == json_int)
+                    str += std::to_string(payload().data_int);
+                else
+                    str += std::to_string(payload().data_double);
+                break;
+            }
+            case json_string:
+                str += '"';
+                if (this->flags() & flag_escaped)
+                    str.append(payload().data_string->data(), payload().data_string->size());
+                else
+                    append_escaped(str, payload().data_string->data(), payload().data_string->size());
+                str += '"';
+                break;
+            case json_array:
+                if (const std::string *text = this->dump_cache()) {
+                    str += *text;
+                    break;
+                }
+                if (this->flags() & flag_packed) {
+                    str += '[';
+                    for (std::size_t i = 0; i < this->packed_size(); i++) {
+                        str += this->flags() & flag_packed_double ? std::to_string((*payload().data_doubles)[i]) : std::to_string((*payload().data_ints)[i]);
+                        str += ',';
+                    }
+                    if (this->packed_size() != 0)
+                        str.pop_back();
+                    str += ']';
+                    break;
+                }
+                str += '[';
+                for (const auto &i : *payload().data_array) {
+                    i.dump(str, stats, depth + 1);
+                    str += ',';
+                }
+                if (!payload().data_array->empty())
+                    str.pop_back();
+                str += ']';
+                break;
+            case json_object:
+                if (const std::string *text = this->dump_cache()) {
+                    str += *text;
+                    break;
+                }
+                str += '{';
+                for (const auto &i : *payload().data_object) {
+                    str += '"';
+                    append_escaped(str, i.first.data(), i.first.size());
+                    str += "\":";
+                    i.second.dump(str, stats, depth + 1);
+                    str += ',';
+                }
+                if (!payload().data_object->empty())
+                    str.pop_back();
+                str += '}';
+                break;
+            default:
+                break;
+            }
+            MY_JSON_STATS(stats->allocations += str.capacity() != capacity;)
+        }
+
+        std::uint64_t write_snapshot(std::ofstream &file, std::uint64_t &pos) const;
+
+        static std::uint64_t write_snapshot_node(std::ofstream &file, std::uint64_t &pos, Type type, std::uint32_t aux, const void *data, std::size_t size) {
+            static const char padding[8] = {0};
+            std::uint64_t offset = pos;
+            std::uint32_t tag = type;
+            file.write(reinterpret_cast<const char *>(&tag), 4);
+            file.write(reinterpret_cast<const char *>(&aux), 4);
+            if (size != 0)
+                file.write(static_cast<const char *>(data), size);
+            std::size_t pad = (8 - size % 8) % 8;
+            file.write(padding, pad);
+            pos += 8 + size + pad;
+            return offset;
+        }
+
+        // 撤销日志中的一步，回滚时逆序执行
+        // undo_restore 把上一步撤销时移除的值放回 path，用于撤销 move 操作
+        struct PatchStep {
+            enum Action {
+                undo_add,
+                undo_remove,
+                undo_replace,
+                undo_restore
+            };
+
+            Action action;
+            std::vector<string_type> path;
+            basic_json value;
+        };
+
+        static std::vector<string_type> parse_pointer(const string_type &pointer) {
+            std::vector<string_type> path;
+            if (pointer.empty())
+                return path;
+            if (pointer[0] != '/')
+                MY_JSON_THROW(std::logic_error("function Json::apply_patch: invalid json pointer " + string_cast<std::string>(pointer)));
+            string_type token;
+            for (std::size_t i = 1; i <= pointer.size(); i++) {
+                if (i == pointer.size() || pointer[i] == '/') {
+                    path.push_back(std::move(token));
+                    token.clear();
+                } else if (pointer[i] == '~') {
+                    if (i + 1 < pointer.size() && pointer[i + 1] == '0')
+                        token += '~';
+                    else if (i + 1 < pointer.size() && pointer[i + 1] == '1')
+                        token += '/';
+                    else
+                        MY_JSON_THROW(std::logic_error("function Json::apply_patch: invalid json pointer " + string_cast<std::string>(pointer)));
+                    i++;
+                } else
+                    token += pointer[i];
+            }
+            return path;
+        }
+
+        static bool parse_index(const string_type &token, std::size_t &index) {
+            if (token.empty() || (token[0] == '0' && token.size() > 1))
+                return false;
+            index = 0;
+            for (char ch : token) {
+                if (ch < '0' || ch > '9')
+                    return false;
+                index = index * 10 + (ch - '0');
+            }
+            return true;
+        }
+
+        // 修改之前先预留日志空间，保证修改完成后写日志不会再抛出异常
+        static void reserve_patch_steps(std::vector<PatchStep> *undo, std::size_t count) {
+            if (undo != nullptr && undo->capacity() - undo->size() < count)
+                undo->reserve(undo->size() * 2 + count);
+        }
+
+        basic_json *resolve_pointer(const std::vector<string_type> &path, std::size_t depth) {
+            basic_json *node = this;
+            // 经过的 packed 数组转换为普通数组，以便返回元素的指针
+            for (std::size_t i = 0; i < depth; i++) {
+                node->invalidate();
+                node->unpack();
+                if (node->is_object()) {
+                    auto iter = node->payload().data_object->find(path[i]);
+                    if (iter == node->payload().data_object->end())
+                        return nullptr;
+                    node = &iter->second;
+                } else if (node->is_array()) {
+                    std::size_t index;
+                    if (!parse_index(path[i], index) || index >= node->payload().data_array->size())
+                        return nullptr;
+                    node = &(*node->payload().data_array)[index];
+                } else
+                    return nullptr;
+            }
+            node->invalidate();
+            node->unpack();
+            return node;
+        }
+
+        // 只读的 test 与 copy 的源路径使用，不转换 packed 数组，也不使缓存失效
+        const basic_json *find_pointer(const std::vector<string_type> &path) const {
+            const basic_json *node = this;
+            for (const string_type &token : path) {
+                std::size_t index;
+                if (node->is_object())
+                    node = node->find_member(token.data(), token.size());
+                else if (node->is_array() && parse_index(token, index) && index < static_cast<std::size_t>(node->size()))
+                    node = node->get_ptr(static_cast<int>(index));
+                else
+                    return nullptr;
+                if (node == nullptr)
+                    return nullptr;
+            }
+            return node;
+        }
+
+        // RFC 6902 4.6 的相等：数字按数值比较（1 与 1.0 相等），数组与对象逐个元素、成员比较，其余与 operator== 相同
+        static bool patch_equal(const basic_json &lhs, const basic_json &rhs) {
+            if (lhs.is_int() && rhs.is_double())
+                return patch_number_equal(lhs, rhs.get_double());
+            if (lhs.is_double() && rhs.is_int())
+                return patch_number_equal(rhs, lhs.get_double());
+            if (lhs.type() != rhs.type())
+                return false;
+            if (lhs == rhs)
+                return true;
+            if (lhs.is_array()) {
+                int size = lhs.size();
+                if (size != rhs.size())
+                    return false;
+                for (int i = 0; i < size; i++) {
+                    basic_json lhs_element, rhs_element;
+                    const basic_json &left = lhs.flags() & flag_packed ? (lhs_element = lhs.packed_element(i)) : (*lhs.payload().data_array)[i];
+                    const basic_json &right = rhs.flags() & flag_packed ? (rhs_element = rhs.packed_element(i)) : (*rhs.payload().data_array)[i];
+                    if (!patch_equal(left, right))
+                        return false;
+                }
+                return true;
+            }
+            if (lhs.is_object()) {
+                if (lhs.size() != rhs.size())
+                    return false;
+                for (const auto &i : *lhs.payload().data_object) {
+                    const basic_json *other = rhs.find_member(i.first.data(), i.first.size());
+                    if (other == nullptr || !patch_equal(i.second, *other))
+                        return false;
+                }
+                return true;
+            }
+            return false;
+        }
+
+        // 浮点数必须是整数值；int64 与 uint64 范围内精确比较，超出时按 double 比较原文
+        static bool patch_number_equal(const basic_json &integer, double real) {
+            if (std::floor(real) != real)
+                return false;
+            std::size_t size = 0;
+            const char *text = integer.raw_text(size);
+            std::int64_t number = integer.payload().data_int;
+            std::uint64_t unsigned_number;
+            if (text == nullptr || parse_int64(text, size, number))
+                return real >= -9223372036854775808.0 && real < 9223372036854775808.0 && static_cast<std::int64_t>(real) == number;
+            if (parse_uint64(text, size, unsigned_number))
+                return real >= 0 && real < 18446744073709551616.0 && static_cast<std::uint64_t>(real) == unsigned_number;
+            double other;
+            return parse_double(text, size, other) && other == real;
+        }
+
+        void patch_operation(basic_json &operation, std::vector<PatchStep> &undo) {
+            if (!operation.is_object())
+                MY_JSON_THROW(std::logic_error("function Json::apply_patch: operation must be an object"));
+            auto &members = *operation.payload().data_object;
+            auto op = members.find("op");
+            auto path = members.find("path");
+            if (op == members.end() || !op->second.is_string() || path == members.end() || !path->second.is_string())
+                MY_JSON_THROW(std::logic_error("function Json::apply_patch: operation requires \"op\" and \"path\""));
+            string_type name = op->second.get_string();
+            std::vector<string_type> target = parse_pointer(path->second.get_string());
+
+            if (name == "remove") {
+                this->patch_remove(target, &undo);
+                return;
+            }
+            if (name == "move" || name == "copy") {
+                auto from = members.find("from");
+                if (from == members.end() || !from->second.is_string())
+                    MY_JSON_THROW(std::logic_error("function Json::apply_patch: operation requires \"from\""));
+                std::vector<string_type> source = parse_pointer(from->second.get_string());
+                if (name == "copy") {
+                    const basic_json *node = this->find_pointer(source);
+                    if (node == nullptr)
+                        MY_JSON_THROW(std::logic_error("function Json::apply_patch: path not found " + string_cast<std::string>(from->second.get_string())));
+                    this->patch_add(target, basic_json(*node), &undo);
+                    return;
+                }
+                if (source.size() < target.size() && std::equal(source.begin(), source.end(), target.begin()))
+                    MY_JSON_THROW(std::logic_error("function Json::apply_patch: cannot move a value into one of its children"));
+                reserve_patch_steps(&undo, 2);
+                basic_json moved = this->patch_remove(source, nullptr);
+                MY_JSON_TRY {
+                    this->patch_add(target, std::move(moved), &undo);
+                } MY_JSON_CATCH_ALL {
+                    this->patch_add(source, std::move(moved), nullptr);
+                    MY_JSON_RETHROW;
+                }
+                undo.insert(undo.end() - 1, PatchStep{PatchStep::undo_restore, std::move(source), basic_json()});
+                return;
+            }
+
+            if (name != "add" && name != "replace" && name != "test")
+                MY_JSON_THROW(std::logic_error("function Json::apply_patch: unknown operation " + string_cast<std::string>(name)));
+            auto value = members.find("value");
+            if (value == members.end())
+                MY_JSON_THROW(std::logic_error("function Json::apply_patch: operation requires \"value\""));
+            if (name == "add")
+                this->patch_add(target, std::move(value->second), &undo);
+            else if (name == "replace")
+                this->patch_replace(target, std::move(value->second), &undo);
+            else {
+                const basic_json *node = this->find_pointer(target);
+                if (node == nullptr || !patch_equal(*node, value->second))
+                    MY_JSON_THROW(std::logic_error("function Json::apply_patch: test failed " + string_cast<std::string>(path->second.get_string())));
+            }
+        }
+
+        // value 只在成功时才会被移走，失败时调用者仍持有它
+        void patch_add(const std::vector<string_type> &path, basic_json &&value, std::vector<PatchStep> *undo) {
+            if (path.empty()) {
+                this->patch_replace(path, std::move(value), undo);
+                return;
+            }
+            basic_json *parent = this->resolve_pointer(path, path.size() - 1);
+            if (parent != nullptr && parent->is_object()) {
+                auto iter = parent->payload().data_object->find(path.back());
+                if (iter != parent->payload().data_object->end()) {
+                    this->patch_replace(path, std::move(value), undo);
+                    return;
+                }
+                reserve_patch_steps(undo, 1);
+                std::vector<string_type> undo_path;
+                if (undo != nullptr)
+                    undo_path = path;
+                parent->payload().data_object->insert(iter, std::make_pair(path.back(), std::move(value)));
+                if (undo != nullptr)
+                    undo->push_back(PatchStep{PatchStep::undo_remove, std::move(undo_path), basic_json()});
+                return;
+            }
+            if (parent != nullptr && parent->is_array()) {
+                auto &array = *parent->payload().data_array;
+                std::size_t index = array.size();
+                if (path.back() != "-" && (!parse_index(path.back(), index) || index > array.size()))
+                    MY_JSON_THROW(std::out_of_range("function Json::apply_patch: index out of range"));
+                reserve_patch_steps(undo, 1);
+                std::vector<string_type> undo_path;
+                if (undo != nullptr) {
+                    undo_path = path;
+                    undo_path.back() = index_token(index);
+                }
+                array.insert(array.begin() + index, std::move(value));
+                if (undo != nullptr)
+                    undo->push_back(PatchStep{PatchStep::undo_remove, std::move(undo_path), basic_json()});
+                return;
+            }
+            MY_JSON_THROW(std::logic_error("function Json::apply_patch: path not found"));
+        }
+
+        // 记录日志时被移除的值保存在日志中，返回 null
+        basic_json patch_remove(const std::vector<string_type> &path, std::vector<PatchStep> *undo) {
+            basic_json *parent = path.empty() ? nullptr : this->resolve_pointer(path, path.size() - 1);
+            if (parent == nullptr || !(parent->is_object() || parent->is_array()))
+                MY_JSON_THROW(std::logic_error("function Json::apply_patch: path not found"));
+            reserve_patch_steps(undo, 1);
+            std::vector<string_type> undo_path;
+            if (undo != nullptr)
+                undo_path = path;
+            basic_json removed;
+            if (parent->is_object()) {
+                auto iter = parent->payload().data_object->find(path.back());
+                if (iter == parent->payload().data_object->end())
+                    MY_JSON_THROW(std::logic_error("function Json::apply_patch: path not found"));
+                removed = std::move(iter->second);
+                parent->payload().data_object->erase(iter);
+            } else {
+                auto &array = *parent->payload().data_array;
+                std::size_t index;
+                if (!parse_index(path.back(), index) || index >= array.size())
+                    MY_JSON_THROW(std::out_of_range("function Json::apply_patch: index out of range"));
+                removed = std::move(array[index]);
+                array.erase(array.begin() + index);
+            }
+            if (undo != nullptr) {
+                undo->push_back(PatchStep{PatchStep::undo_add, std::move(undo_path), std::move(removed)});
+                return basic_json();
+            }
+            return removed;
+        }
+
+        void patch_replace(const std::vector<string_type> &path, basic_json &&value, std::vector<PatchStep> *undo) {
+            basic_json *node = this->resolve_pointer(path, path.size());
+            if (node == nullptr)
+                MY_JSON_THROW(std::logic_error("function Json::apply_patch: path not found"));
+            reserve_patch_steps(undo, 1);
+            if (undo != nullptr)
+                undo->push_back(PatchStep{PatchStep::undo_replace, path, std::move(*node)});
+            *node = std::move(value);
+        }
+
+        void patch_rollback(std::vector<PatchStep> &undo) {
+            basic_json dropped;
+            while (!undo.empty()) {
+                PatchStep &step = undo.back();
+                switch (step.action) {
+                case PatchStep::undo_add:
+                    this->patch_add(step.path, std::move(step.value), nullptr);
+                    break;
+                case PatchStep::undo_remove:
+                    dropped = this->patch_remove(step.path, nullptr);
+                    break;
+                case PatchStep::undo_replace: {
+                    basic_json *node = this->resolve_pointer(step.path, step.path.size());
+                    dropped = std::move(*node);
+                    *node = std::move(step.value);
+                    break;
+                }
+                case PatchStep::undo_restore:
+                    this->patch_add(step.path, std::move(dropped), nullptr);
+                    break;
+                }
+                undo.pop_back();
+            }
+        }
+
+        // path 为 target 在根对象中的位置，用于记录日志
+        // 新插入的成员整体由一条 undo_remove 撤销，其内部的修改不再记录
+        static void merge_patch(basic_json &target, basic_json &&patch, std::vector<string_type> &path, std::vector<PatchStep> *undo) {
+            target.invalidate();
+            if (!patch.is_object()) {
+                reserve_patch_steps(undo, 1);
+                if (undo != nullptr)
+                    undo->push_back(PatchStep{PatchStep::undo_replace, path, std::move(target)});
+                target = std::move(patch);
+                return;
+            }
+            if (!target.is_object()) {
+                reserve_patch_steps(undo, 1);
+                if (undo != nullptr)
+                    undo->push_back(PatchStep{PatchStep::undo_replace, path, std::move(target)});
+                target = basic_json(json_object);
+            }
+            // 下面会移走 patch 的成员，共享时先复制
+            patch.invalidate();
+            auto &members = *target.payload().data_object;
+            for (auto &i : *patch.payload().data_object) {
+                auto iter = members.find(i.first);
+                path.push_back(i.first);
+                if (i.second.is_null()) {
+                    if (iter != members.end()) {
+                        reserve_patch_steps(undo, 1);
+                        if (undo != nullptr)
+                            undo->push_back(PatchStep{PatchStep::undo_add, path, std::move(iter->second)});
+                        members.erase(iter);
+                    }
+                } else if (iter == members.end()) {
+                    reserve_patch_steps(undo, 1);
+                    std::vector<string_type> undo_path;
+                    if (undo != nullptr)
+                        undo_path = path;
+                    iter = members.insert(iter, std::make_pair(i.first, basic_json()));
+                    if (undo != nullptr)
+                        undo->push_back(PatchStep{PatchStep::undo_remove, std::move(undo_path), basic_json()});
+                    merge_patch(iter->second, std::move(i.second), path, nullptr);
+                } else
+                    merge_patch(iter->second, std::move(i.second), path, undo);
+                path.pop_back();
+            }
+        }
+
+        template <typename To, typename From>
+        static To string_cast(const From &str) {
+            return To(str.data(), str.size());
+        }
+
+        static string_type index_token(std::size_t index) {
+            return string_cast<string_type>(std::to_string(index));
+        }
+
+        // 容器的哈希只计算一次（已缓存的直接使用）；64 位哈希相同时再用 operator== 确认子树相同
+        struct DiffContext {
+            std::unordered_map<const basic_json *, std::uint64_t> hashes;
+            string_type array_key;
+            basic_json patch;
+        };
+
+        static std::uint64_t diff_hash(const basic_json &json, DiffContext &context) {
+            return hash_node(json, 0, &context.hashes);
+        }
+
+        static string_type escape_pointer(const string_type &key) {
+            string_type token;
+            token.reserve(key.size());
+            for (char ch : key) {
+                if (ch == '~')
+                    token += "~0";
+                else if (ch == '/')
+                    token += "~1";
+                else
+                    token += ch;
+            }
+            return token;
+        }
+
+        static void diff_emit(DiffContext &context, const char *op, const string_type &path, const basic_json *value) {
+            basic_json operation(json_object);
+            operation["op"] = op;
+            operation["path"] = path;
+            if (value != nullptr)
+                operation["value"] = *value;
+            context.patch.payload().data_array->push_back(std::move(operation));
+        }
+
+        static void diff_node(const basic_json &source, const basic_json &target, const string_type &path, DiffContext &context) {
+            if (diff_hash(source, context) == diff_hash(target, context) && source == target)
+                return;
+            // packed 数组没有元素节点，整体替换
+            if (source.type() != target.type() || !(source.is_array() || source.is_object()) || ((source.flags() | target.flags()) & flag_packed))
+                diff_emit(context, "replace", path, &target);
+            else if (source.is_object())
+                diff_object(source, target, path, context);
+            else if (context.array_key.empty() || !diff_keyed_array(source, target, path, context))
+                diff_array(source, target, path, context);
+        }
+
+        // object_type 不一定有序，按 key 在另一边查找而不是归并
+        static void diff_object(const basic_json &source, const basic_json &target, const string_type &path, DiffContext &context) {
+            const auto &from = *source.payload().data_object;
+            const auto &to = *target.payload().data_object;
+            for (const auto &i : from) {
+                auto iter = to.find(i.first);
+                if (iter == to.end())
+                    diff_emit(context, "remove", path + "/" + escape_pointer(i.first), nullptr);
+                else
+                    diff_node(i.second, iter->second, path + "/" + escape_pointer(i.first), context);
+            }
+            for (const auto &i : to) {
+                if (from.find(i.first) == from.end())
+                    diff_emit(context, "add", path + "/" + escape_pointer(i.first), &i.second);
+            }
+        }
+
+        // 去掉相同的头尾后对中间部分求 LCS，规模过大时退化为按下标逐个比较
+        // 相邻的删除与插入配对成对元素的递归 diff，而不是整体删除再添加
+        static void diff_array(const basic_json &source, const basic_json &target, const string_type &path, DiffContext &context) {
+            const auto &from = *source.payload().data_array;
+            const auto &to = *target.payload().data_array;
+            std::size_t begin = 0, from_end = from.size(), to_end = to.size();
+            while (begin < from_end && begin < to_end && diff_hash(from[begin], context) == diff_hash(to[begin], context) && from[begin] == to[begin])
+                begin++;
+            while (from_end > begin && to_end > begin && diff_hash(from[from_end - 1], context) == diff_hash(to[to_end - 1], context) && from[from_end - 1] == to[to_end - 1]) {
+                from_end--;
+                to_end--;
+            }
+            std::size_t n = from_end - begin, m = to_end - begin;
+
+            // script: 0 保留，1 删除 from 中的元素，2 插入 to 中的元素
+            std::vector<char> script;
+            if (n != 0 && m != 0 && n * m <= (1u << 22)) {
+                std::vector<std::uint64_t> from_hash(n), to_hash(m);
+                for (std::size_t i = 0; i < n; i++)
+                    from_hash[i] = diff_hash(from[begin + i], context);
+                for (std::size_t j = 0; j < m; j++)
+                    to_hash[j] = diff_hash(to[begin + j], context);
+                std::vector<std::uint32_t> lcs((n + 1) * (m + 1), 0);
+                for (std::size_t i = n; i-- > 0;)
+                    for (std::size_t j = m; j-- > 0;)
+                        lcs[i * (m + 1) + j] = from_hash[i] == to_hash[j] ? lcs[(i + 1) * (m + 1) + j + 1] + 1 : std::max(lcs[(i + 1) * (m + 1) + j], lcs[i * (m + 1) + j + 1]);
+                std::size_t i = 0, j = 0;
+                while (i < n || j < m) {
+                    if (i < n && j < m && from_hash[i] == to_hash[j]) {
+                        script.push_back(0);
+                        i++;
+                        j++;
+                    } else if (j == m || (i < n && lcs[(i + 1) * (m + 1) + j] >= lcs[i * (m + 1) + j + 1])) {
+                        script.push_back(1);
+                        i++;
+                    } else {
+                        script.push_back(2);
+                        j++;
+                    }
+                }
+            } else {
+                script.assign(std::min(n, m), 0);
+                script.insert(script.end(), n > m ? n - m : 0, 1);
+                script.insert(script.end(), m > n ? m - n : 0, 2);
+            }
+
+            std::size_t pos = begin, i = begin, j = begin;
+            for (std::size_t k = 0; k < script.size();) {
+                if (script[k] == 0) {
+                    diff_node(from[i++], to[j++], path + "/" + index_token(pos++), context);
+                    k++;
+                    continue;
+                }
+                std::size_t removed = 0, inserted = 0;
+                for (; k < script.size() && script[k] != 0; k++)
+                    script[k] == 1 ? removed++ : inserted++;
+                for (; removed != 0 && inserted != 0; removed--, inserted--)
+                    diff_node(from[i++], to[j++], path + "/" + index_token(pos++), context);
+                for (; removed != 0; removed--, i++)
+                    diff_emit(context, "remove", path + "/" + index_token(pos), nullptr);
+                for (; inserted != 0; inserted--)
+                    diff_emit(context, "add", path + "/" + index_token(pos++), &to[j++]);
+            }
+        }
+
+        // 元素按 array_key 的值匹配，哈希相同时再用 operator== 确认：先删除没有匹配的元素，
+        // 再保留按 target 顺序递增的最长子序列，其余元素依次移动到 target 中前一个元素之后，最后对匹配的元素递归 diff
+        // 当前位置用树状数组统计，n 个元素为 O(n log n)；有元素不是对象或缺少该 key 时返回 false，由调用者改用 LCS
+        static bool diff_keyed_array(const basic_json &source, const basic_json &target, const string_type &path, DiffContext &context) {
+            const auto &from = *source.payload().data_array;
+            const auto &to = *target.payload().data_array;
+            auto collect = [&context](const array_type &array, std::vector<const basic_json *> &keys) {
+                keys.reserve(array.size());
+                for (const auto &i : array) {
+                    if (!i.is_object())
+                        return false;
+                    auto key = i.payload().data_object->find(context.array_key);
+                    if (key == i.payload().data_object->end())
+                        return false;
+                    keys.push_back(&key->second);
+                }
+                return true;
+            };
+            std::vector<const basic_json *> from_keys, to_keys;
+            if (!collect(from, from_keys) || !collect(to, to_keys))
+                return false;
+
+            // 同一哈希的候选按 source 中的顺序排列，next 之前的都已匹配
+            struct Candidates {
+                std::vector<std::size_t> from;
+                std::size_t next;
+            };
+            const std::size_t none = SIZE_MAX;
+            std::unordered_map<std::uint64_t, Candidates> candidates;
+            for (std::size_t i = 0; i < from.size(); i++)
+                candidates[diff_hash(*from_keys[i], context)].from.push_back(i);
+            std::vector<std::size_t> match(to.size(), none);
+            std::vector<char> used(from.size(), 0);
+            for (std::size_t j = 0; j < to.size(); j++) {
+                auto iter = candidates.find(diff_hash(*to_keys[j], context));
+                if (iter == candidates.end())
+                    continue;
+                Candidates &candidate = iter->second;
+                while (candidate.next < candidate.from.size() && used[candidate.from[candidate.next]])
+                    candidate.next++;
+                for (std::size_t k = candidate.next; k < candidate.from.size(); k++) {
+                    std::size_t i = candidate.from[k];
+                    if (!used[i] && *from_keys[i] == *to_keys[j]) {
+                        match[j] = i;
+                        used[i] = 1;
+                        break;
+                    }
+                }
+            }
+            for (std::size_t i = from.size(); i-- > 0;) {
+                if (!used[i])
+                    diff_emit(context, "remove", path + "/" + index_token(i), nullptr);
+            }
+
+            // 删除后剩下的元素按原来的顺序编号，order[p] 为第 p 个元素在 target 中的位置
+            std::vector<std::size_t> position(from.size(), none), order;
+            for (std::size_t i = 0; i < from.size(); i++) {
+                if (used[i]) {
+                    position[i] = order.size();
+                    order.push_back(0);
+                }
+            }
+            for (std::size_t j = 0; j < to.size(); j++) {
+                if (match[j] != none)
+                    order[position[match[j]]] = j;
+            }
+            std::vector<std::size_t> tails, parent(order.size());
+            std::vector<char> keep(order.size(), 0);
+            for (std::size_t p = 0; p < order.size(); p++) {
+                auto iter = std::lower_bound(tails.begin(), tails.end(), order[p], [&order](std::size_t q, std::size_t value) { return order[q] < value; });
+                parent[p] = iter == tails.begin() ? none : *(iter - 1);
+                if (iter == tails.end())
+                    tails.push_back(p);
+                else
+                    *iter = p;
+            }
+            for (std::size_t p = tails.empty() ? none : tails.back(); p != none; p = parent[p])
+                keep[p] = 1;
+
+            // 槽位：每个剩下的元素一个，其后依次是 target 中紧跟它的移动或插入的元素，开头的一组属于数组的起点
+            // run 为 0 表示起点，p + 1 表示第 p 个元素之后
+            std::vector<std::size_t> run_size(order.size() + 1, 0), run_start(order.size() + 1), slot(order.size());
+            std::size_t run = 0;
+            for (std::size_t j = 0; j < to.size(); j++) {
+                if (match[j] != none && keep[position[match[j]]])
+                    run = position[match[j]] + 1;
+                else
+                    run_size[run]++;
+            }
+            std::size_t slots = run_size[0];
+            run_start[0] = 0;
+            for (std::size_t p = 0; p < order.size(); p++) {
+                slot[p] = slots++;
+                run_start[p + 1] = slots;
+                slots += run_size[p + 1];
+            }
+            std::vector<std::size_t> tree(slots + 1, 0);
+            auto update = [&tree](std::size_t index, int delta) {
+                for (index++; index < tree.size(); index += index & (0 - index))
+                    tree[index] += delta;
+            };
+            auto rank = [&tree](std::size_t index) {
+                std::size_t count = 0;
+                for (; index != 0; index -= index & (0 - index))
+                    count += tree[index];
+                return count;
+            };
+            for (std::size_t p = 0; p < order.size(); p++)
+                update(slot[p], 1);
+
+            std::size_t next = run_start[0];
+            for (std::size_t j = 0; j < to.size(); j++) {
+                if (match[j] != none && keep[position[match[j]]]) {
+                    next = run_start[position[match[j]] + 1];
+                    continue;
+                }
+                std::size_t target_slot = next++;
+                if (match[j] == none) {
+                    diff_emit(context, "add", path + "/" + index_token(rank(target_slot)), &to[j]);
+                    update(target_slot, 1);
+                    continue;
+                }
+                std::size_t p = position[match[j]];
+                std::size_t from_index = rank(slot[p]);
+                update(slot[p], -1);
+                std::size_t to_index = rank(target_slot);
+                update(target_slot, 1);
+                if (from_index != to_index) {
+                    basic_json operation(json_object);
+                    operation["op"] = "move";
+                    operation["from"] = path + "/" + index_token(from_index);
+                    operation["path"] = path + "/" + index_token(to_index);
+                    context.patch.payload().data_array->push_back(std::move(operation));
+                }
+            }
+            for (std::size_t j = 0; j < to.size(); j++) {
+                if (match[j] != none)
+                    diff_node(from[match[j]], to[j], path + "/" + index_token(j), context);
+            }
+            return true;
+        }
+
+        // 数组的二级索引，见 create_index
+        // entries 与数组的前 count 个元素一一对应，记录元素在 hashed 或 sorted 中的位置，之后的元素尚未加入索引
+        // dirty 为修改过、需要重新取 key 的下标；stale 为 true 时下次查找重建整个索引
+        // watched 为之后可能通过引用修改的元素：索引存在期间借出的下标，以及 path 经过的容器带有 flag_lent 的元素，
+        // 每次查找前重新取这些元素的 key 与索引中的比较，不同时重新加入。借出的下标未知（建立索引之前数组已经借出过引用）
+        // 或 watched 过多时 watch_all 为 true，此时只能依赖 generation()：它与上次查找时取得的值不同时重建整个索引
+        struct ArrayIndex {
+            struct Less {
+                bool operator()(const basic_json &lhs, const basic_json &rhs) const {
+                    return index_less(lhs, rhs);
+                }
+            };
+            typedef std::multimap<basic_json, std::size_t, Less> Sorted;
+            struct Entry {
+                bool present;
+                std::uint64_t hash;
+                typename Sorted::iterator position;
+            };
+
+            std::vector<string_type> path;
+            IndexType type;
+            bool stale;
+            bool watch_all;
+            std::size_t count;
+            std::uint64_t generation;
+            std::vector<std::size_t> dirty;
+            std::vector<std::size_t> watched;
+            std::vector<bool> watching;
+            std::vector<Entry> entries;
+            std::unordered_multimap<std::uint64_t, std::size_t> hashed;
+            Sorted sorted;
+
+            // lent 为数组是否借出过元素的引用，重建后无法知道之前借出的是哪些元素
+            void refresh(const array_type &array, bool lent) {
+                if (watch_all && !current(generation))
+                    stale = true;
+                for (std::size_t i : watched)
+                    if (i < count && this->moved(array, i))
+                        dirty.push_back(i);
+                if (stale || array.size() < count) {
+                    hashed.clear();
+                    sorted.clear();
+                    entries.clear();
+                    dirty.clear();
+                    watched.clear();
+                    watching.clear();
+                    count = 0;
+                    stale = false;
+                    watch_all = lent;
+                    if (type == index_hashed)
+                        hashed.reserve(array.size());
+                }
+                // 先移除全部修改过的元素再重新加入，同一个下标可能出现多次
+                for (std::size_t i : dirty)
+                    remove(i);
+                for (std::size_t i : dirty)
+                    if (!entries[i].present)
+                        add(array, i);
+                dirty.clear();
+                entries.resize(array.size());
+                for (; count < array.size(); count++)
+                    add(array, count);
+                // 每次查找都要检查 watched 中的元素，超过 64 个时改为依赖 generation()
+                if (watched.size() > 64) {
+                    watch_all = true;
+                    watched.clear();
+                    watching.clear();
+                }
+                // 之后的修改会使 generation() 变化；只在 watch_all 时取 stamp，其余情况 const 的查找在没有修改时不写入
+                if (watch_all && (generation == 0 || !current(generation)))
+                    generation = stamp();
+            }
+
+            // 元素在 path 处的 key 是否与索引中记录的不同
+            bool moved(const array_type &array, std::size_t position) const {
+                bool lent = false;
+                const basic_json *key = index_key(array[position], path, lent);
+                const Entry &entry = entries[position];
+                if (key == nullptr || !entry.present)
+                    return (key != nullptr) != entry.present;
+                if (type == index_hashed)
+                    return hash_node(*key, 0, nullptr) != entry.hash;
+                return index_less(*key, entry.position->first) || index_less(entry.position->first, *key);
+            }
+
+            void watch(std::size_t position) {
+                if (watch_all)
+                    return;
+                if (watching.size() <= position)
+                    watching.resize(position + 1);
+                if (!watching[position]) {
+                    watching[position] = true;
+                    watched.push_back(position);
+                }
+            }
+
+            void add(const array_type &array, std::size_t position) {
+                bool lent = false;
+                const basic_json *key = index_key(array[position], path, lent);
+                if (lent)
+                    this->watch(position);
+                if (key == nullptr)
+                    return;
+                Entry &entry = entries[position];
+                if (type == index_hashed) {
+                    entry.hash = hash_node(*key, 0, nullptr);
+                    hashed.emplace(entry.hash, position);
+                } else
+                    entry.position = sorted.emplace(*key, position);
+                entry.present = true;
+            }
+
+            // 估算值，不含 sorted 中 key 的字符串
+            std::size_t memory() const {
+                std::size_t size = sizeof(ArrayIndex) + entries.capacity() * sizeof(Entry) + (dirty.capacity() + watched.capacity()) * sizeof(std::size_t) + watching.capacity() / 8;
+                size += hashed.bucket_count() * sizeof(void *) + hashed.size() * (sizeof(typename std::unordered_multimap<std::uint64_t, std::size_t>::value_type) + sizeof(void *));
+                size += sorted.size() * (sizeof(typename Sorted::value_type) + 4 * sizeof(void *));
+                return size;
+            }
+
+            void remove(std::size_t position) {
+                Entry &entry = entries[position];
+                if (!entry.present)
+                    return;
+                if (type == index_hashed) {
+                    auto range = hashed.equal_range(entry.hash);
+                    for (auto iter = range.first; iter != range.second; ++iter) {
+                        if (iter->second == position) {
+                            hashed.erase(iter);
+                            break;
+                        }
+                    }
+                } else
+                    sorted.erase(entry.position);
+                entry.present = false;
+            }
+        };
+
+        // 容器的附加信息，只在开启哈希缓存等可选功能时分配；被 dedupe 共享的字符串也带有 ContainerHeader
+        // 与容器放在同一块内存中并位于容器之前，因此 value 中的指针仍直接指向容器
+        // text 为 enable_dump_cache 缓存的序列化结果，为空表示已经失效；index 为 create_index 建立的索引
+        // shares 为共享该值的节点个数，0 表示没有共享
+        // 只有 cache_plain 的容器保存 hash 与 text，见 CacheState
+        struct alignas(std::max_align_t) ContainerHeader {
+            std::uint64_t hash;
+            std::unique_ptr<std::string> text;
+            std::unique_ptr<ArrayIndex> index;
+            std::atomic<std::uint32_t> shares;
+            bool hash_valid;
+        };
+
+        // 子树的缓存能否信任：cache_plain 中的节点只能通过沿访问路径使缓存失效的接口修改，缓存一直有效到这些接口使它失效；
+        // cache_guarded 中有借出过子节点引用的容器（flag_lent）或借出过 span 的 packed 数组，之后可能不经过祖先直接修改，
+        // cache_guarded 的容器不保存缓存，每次使用时由子节点重新计算
+        enum CacheState { cache_plain, cache_guarded };
+
+        // 只用于借出的元素未知的二级索引（见 ArrayIndex::watch_all）：同一 Traits 的任何节点被修改时 generation() 递增，
+        // 还没有取过 stamp 时不递增，因此没有这样的索引时修改只读取一次计数器；取得的 stamp 与之后的修改一定不同
+        // 每个 Traits 一个计数器；为 0 时还没有索引依赖它，修改时不必递增
+        static std::atomic<std::uint64_t> &generation() {
+            static std::atomic<std::uint64_t> counter(0);
+            return counter;
+        }
+
+        // stamp 由 fetch_add 产生，不会等于任何线程在 touch 中记下的值，因此之后的第一次修改一定会再次递增
+        static std::uint64_t stamp() {
+            return generation().fetch_add(1, std::memory_order_relaxed) + 1;
+        }
+
+        // 计数器仍是本线程上次递增的结果时，期间没有新的 stamp，它已经不等于任何有效的 stamp，连续的修改不必再递增
+        static void touch() {
+            static thread_local std::uint64_t last = 0;
+            std::uint64_t value = generation().load(std::memory_order_relaxed);
+            if (value != 0 && value != last)
+                last = generation().fetch_add(1, std::memory_order_relaxed) + 1;
+        }
+
+        // 0 表示缓存不依赖计数器
+        static bool current(std::uint64_t value) {
+            return value == 0 || value == generation().load(std::memory_order_relaxed);
+        }
+
+        // 在交出子节点的可修改引用或 packed 数组的 span 之前调用；数组的索引之后需要检查全部元素
+        void lend() {
+            if ((this->is_array() || this->is_object()) && !(this->flags() & flag_lent))
+                this->set_flags(this->flags() | flag_lent);
+            ContainerHeader *block = this->header();
+            if (block != nullptr && block->index) {
+                block->index->watch_all = true;
+                block->index->watched.clear();
+                block->index->watching.clear();
+            }
+        }
+
+        // 只交出数组第 position 个元素的引用，索引之后只需检查该元素
+        void lend(std::size_t position) {
+            if (!this->is_array() || position >= payload().data_array->size())
+                return;
+            if (!(this->flags() & flag_lent))
+                this->set_flags(this->flags() | flag_lent);
+            ContainerHeader *block = this->header();
+            if (block != nullptr && block->index)
+                block->index->watch(position);
+        }
+
+        // 先处理子节点，再由它们的状态决定本节点：只有 cache_plain 的容器保存哈希，cache_plain 的缓存只在失效时重新计算
+        // cache_guarded 的容器之后的 hash() 都要经过它们重新计算，其中 cache_plain 的子树直接使用缓存
+        static CacheState cache_hash(basic_json &json) {
+            if (json.flags() & flag_packed)
+                return json.flags() & flag_lent ? cache_guarded : cache_plain;
+            if (!(json.is_array() || json.is_object()) || json.is_shared())
+                return cache_plain;
+            if (json.hash_cache() != nullptr)
+                return cache_plain;
+            CacheState state = json.flags() & flag_lent ? cache_guarded : cache_plain;
+            if (json.is_array()) {
+                for (auto &i : *json.payload().data_array)
+                    state = std::max(state, cache_hash(i));
+            } else {
+                for (auto &i : *json.payload().data_object)
+                    state = std::max(state, cache_hash(i.second));
+            }
+            if (state == cache_guarded)
+                return state;
+            if (!(json.flags() & flag_header))
+                json.attach_header();
+            ContainerHeader *block = json.header();
+            block->hash = hash_node(json, 0, nullptr);
+            block->hash_valid = true;
+            return state;
+        }
+
+        // 与 cache_hash 相同，先由子树的状态决定能否缓存；只有前 depth 层的容器保存结果，更深的容器只遍历以确定状态
+        // 更深处已有的有效缓存（之前以更大的 depth 调用时生成）仍会使用，其状态不需要重新遍历
+        static CacheState cache_dump(basic_json &json, std::size_t depth) {
+            if (json.flags() & flag_packed)
+                return json.flags() & flag_lent ? cache_guarded : cache_plain;
+            if (!(json.is_array() || json.is_object()) || json.is_shared())
+                return cache_plain;
+            ContainerHeader *block = json.header();
+            if (json.dump_cache() != nullptr)
+                return cache_plain;
+            CacheState state = json.flags() & flag_lent ? cache_guarded : cache_plain;
+            std::size_t next = depth == 0 ? 0 : depth - 1;
+            if (json.is_array()) {
+                for (auto &i : *json.payload().data_array)
+                    state = std::max(state, cache_dump(i, next));
+            } else {
+                for (auto &i : *json.payload().data_object)
+                    state = std::max(state, cache_dump(i.second, next));
+            }
+            // 失效的缓存：不再缓存的容器释放内存，其余的清空后复用容量
+            if (block != nullptr && block->text) {
+                if (depth == 0 || state == cache_guarded)
+                    block->text.reset();
+                else
+                    block->text->clear();
+            }
+            if (depth == 0 || state == cache_guarded)
+                return state;
+            if (!(json.flags() & flag_header))
+                json.attach_header();
+            block = json.header();
+            if (!block->text)
+                block->text.reset(new std::string());
+            // 子节点的缓存都已有效，dump 只需拼接；缓存为空时 dump 不会读取它，因此可以直接写入并复用原有的容量
+            json.dump(*block->text, nullptr, 0);
+            return state;
+        }
+
+        // flag_raw_number: 数字保存的是原文，不超过 8 个字符时放在 data_raw 中（不足的部分补 '\0'），
+        // 否则同时带有 flag_raw_heap，原文保存在 data_string 中
+        // flag_escaped: data_string 中是字符串转义后的原文（不含引号），由 get_string() 等解码
+        // flag_header: 容器或字符串之前有 ContainerHeader，字符串只在被 dedupe 共享时带有
+        // flag_stale: 只在 Parser::parse_into 解析对象的过程中使用，标记尚未被新文档覆盖的成员
+        // flag_packed: packed 数组，元素保存在 data_ints 中，同时带有 flag_packed_double 时保存在 data_doubles 中；packed 数组没有 ContainerHeader
+        // flag_lent: 数组或对象曾经把子节点的可修改引用交给调用者（packed 数组为 span），随存储移动，复制时不保留
+        enum Flag {
+            flag_header = 1,
+            flag_raw_number = 2,
+            flag_raw_heap = 4,
+            flag_escaped = 8,
+            flag_stale = 16,
+            flag_packed = 32,
+            flag_packed_double = 64,
+            flag_lent = 128
+        };
+
+        union Value;
+
+        // push_back、emplace_back、append 等写入的数组：null 先转换为空数组，packed 数组先转换为普通数组
+        array_type &append_target(const char *function) {
+            this->invalidate(this->is_array() ? this->size() : 0);
+            if (this->is_null())
+                this->store(json_array, 0, create<array_type>());
+            else if (!this->is_array())
+                MY_JSON_THROW(std::logic_error(std::string("function Json::") + function + ": type error"));
+            (void)function;
+            this->unpack();
+            return *this->payload().data_array;
+        }
+
+        // 通过 Storage 读写类型、标志与 Value，布局由 Traits 决定
+        std::uint8_t flags() const {
+            return storage.flags();
+        }
+
+        Value payload() const {
+            return storage.load();
+        }
+
+        void store(Type type, std::uint8_t flags, Value value) {
+            storage.store(type, flags, value);
+        }
+
+        void set_flags(std::uint8_t flags) {
+            storage.set_flags(flags);
+        }
+
+        ContainerHeader *header() const {
+            if (!(this->flags() & flag_header))
+                return nullptr;
+            const char *data = static_cast<const char *>(this->storage_address());
+            return reinterpret_cast<ContainerHeader *>(const_cast<char *>(data) - sizeof(ContainerHeader));
+        }
+
+        // 共享的值只减少引用计数，最后一个引用释放存储
+        // 递归超过 64 层后，把剩余的嵌套容器移到显式的栈中逐个释放，释放任意深度的文档都不会耗尽调用栈
+        void release(std::size_t depth) {
+            touch();
+            ContainerHeader *block = this->header();
+            if (block != nullptr && block->shares != 0 && block->shares.fetch_sub(1) != 1) {
+                this->store(json_null, 0, Value());
+                return;
+            }
+            if (depth >= 64) {
+                std::vector<basic_json> nested;
+                this->detach_nested(nested);
+                while (!nested.empty()) {
+                    basic_json node(std::move(nested.back()));
+                    nested.pop_back();
+                    node.detach_nested(nested);
+                }
+            }
+            switch (this->type()) {
+            case json_int:
+            case json_double:
+                if (this->flags() & flag_raw_heap)
+                    destroy(payload().data_string, nullptr);
+                break;
+            case json_string:
+                destroy(payload().data_string, block);
+                break;
+            case json_array:
+                if (this->flags() & flag_packed_double)
+                    destroy(payload().data_doubles, nullptr);
+                else if (this->flags() & flag_packed)
+                    destroy(payload().data_ints, nullptr);
+                else {
+                    for (auto &i : *payload().data_array)
+                        i.release(depth + 1);
+                    destroy(payload().data_array, block);
+                }
+                break;
+            case json_object:
+                for (auto &i : *payload().data_object)
+                    i.second.release(depth + 1);
+                destroy(payload().data_object, block);
+                break;
+            default:
+                break;
+            }
+            this->store(json_null, 0, Value());
+        }
+
+        // 把非空的子容器移入 nested，留下的子节点释放时不再递归；其他引用仍在使用的共享容器保持不变
+        void detach_nested(std::vector<basic_json> &nested) {
+            ContainerHeader *block = this->header();
+            if (block != nullptr && block->shares > 1)
+                return;
+            auto detach = [&nested](basic_json &child) {
+                if ((child.is_array() && !(child.flags() & flag_packed) && !child.payload().data_array->empty()) ||
+                    (child.is_object() && !child.payload().data_object->empty()))
+                    nested.push_back(std::move(child));
+            };
+            if (this->is_array() && !(this->flags() & flag_packed)) {
+                for (auto &i : *payload().data_array)
+                    detach(i);
+            } else if (this->is_object()) {
+                for (auto &i : *payload().data_object)
+                    detach(i.second);
+            }
+        }
+
+        // enable_hash_cache 缓存的哈希，没有缓存或已经失效时返回 nullptr；借出过引用的容器不使用缓存
+        const std::uint64_t *hash_cache() const {
+            const ContainerHeader *block = this->header();
+            if (block == nullptr || !block->hash_valid || (this->flags() & flag_lent))
+                return nullptr;
+            return &block->hash;
+        }
+
+        // enable_dump_cache 缓存的序列化结果，没有缓存或已经失效时返回 nullptr
+        const std::string *dump_cache() const {
+            const ContainerHeader *block = this->header();
+            if (block == nullptr || !block->text || block->text->empty() || (this->flags() & flag_lent))
+                return nullptr;
+            return block->text.get();
+        }
+
+        std::size_t packed_size() const {
+            return this->flags() & flag_packed_double ? payload().data_doubles->size() : payload().data_ints->size();
+        }
+
+        basic_json packed_element(std::size_t index) const {
+            if (this->flags() & flag_packed_double)
+                return basic_json((*payload().data_doubles)[index]);
+            return from_int64((*payload().data_ints)[index]);
+        }
+
+        // 第一次访问时生成块表，访问到的块再各自生成，都用 compare_exchange 发布，同时访问的线程中只有一个的结果被保留
+        // 借出过 span 的数组可能已被原地修改，块中的该元素与缓冲区不一致时生成新的块替换，已经发布的块不再修改
+        const basic_json &packed_ref(std::size_t index) const {
+            bool real = (this->flags() & flag_packed_double) != 0;
+            std::atomic<PackedElements *> &slot = real ? payload().data_doubles->elements : payload().data_ints->elements;
+            PackedElements *elements = slot.load(std::memory_order_acquire);
+            if (elements == nullptr) {
+                std::unique_ptr<PackedElements> built(new PackedElements(this->packed_size()));
+                if (slot.compare_exchange_strong(elements, built.get(), std::memory_order_acq_rel))
+                    elements = built.release();
+            }
+            typedef typename PackedElements::Block Block;
+            std::size_t offset = index % PackedElements::block_size, first = index - offset;
+            std::atomic<Block *> &block_slot = elements->blocks[index / PackedElements::block_size];
+            Block *block = block_slot.load(std::memory_order_acquire);
+            if (block != nullptr && (this->flags() & flag_lent)) {
+                const basic_json &element = block->values[offset];
+                double real_number = real ? element.payload().data_double : 0;
+                std::int64_t number;
+                bool same = real ? std::memcmp(&real_number, &(*payload().data_doubles)[index], sizeof(double)) == 0
+                                 : packed_int64(element, number) && number == (*payload().data_ints)[index];
+                if (!same)
+                    block = nullptr;
+            }
+            if (block == nullptr) {
+                std::unique_ptr<Block> built(new Block());
+                std::size_t last = std::min(first + PackedElements::block_size, this->packed_size());
+                for (std::size_t i = first; i < last; i++)
+                    built->values[i - first] = this->packed_element(i);
+                Block *old = block_slot.load(std::memory_order_acquire);
+                if (block_slot.compare_exchange_strong(old, built.get(), std::memory_order_acq_rel)) {
+                    if (old != nullptr)
+                        elements->retire(old);
+                    block = built.release();
+                } else
+                    block = old;
+            }
+            return block->values[offset];
+        }
+
+        void drop_packed_elements() {
+            std::atomic<PackedElements *> &slot = this->flags() & flag_packed_double ? payload().data_doubles->elements : payload().data_ints->elements;
+            delete slot.exchange(nullptr, std::memory_order_acq_rel);
+        }
+
+        // 类型与缓冲区一致时直接写入并返回 true，否则返回 false，由调用者转换为普通数组
+        bool packed_append(const basic_json &value, bool front) {
+            if (this->flags() & flag_packed_double) {
+                if (!value.is_double() || (value.flags() & flag_raw_number))
+                    return false;
+                this->drop_packed_elements();
+                auto &doubles = *this->payload().data_doubles;
+                doubles.insert(front ? doubles.begin() : doubles.end(), value.payload().data_double);
+                return true;
+            }
+            std::int64_t number;
+            if (!packed_int64(value, number))
+                return false;
+            this->drop_packed_elements();
+            auto &ints = *this->payload().data_ints;
+            ints.insert(front ? ints.begin() : ints.end(), number);
+            return true;
+        }
+
+        // 保存原文的整数只有在 int64 范围内且原文与 std::to_string 的输出相同时才能打包，"-0" 除外的 JSON 整数都满足后者
+        static bool packed_int64(const basic_json &value, std::int64_t &number) {
+            if (!value.is_int())
+                return false;
+            std::size_t size = 0;
+            const char *text = value.raw_text(size);
+            if (text == nullptr) {
+                number = value.payload().data_int;
+                return true;
+            }
+            return parse_int64(text, size, number) && !(size == 2 && text[0] == '-' && text[1] == '0');
+        }
+
+        // 至少一边是 packed 数组，逐个元素比较；packed 一边的元素是临时生成的
+        static bool packed_equal(const basic_json &lhs, const basic_json &rhs) {
+            if (lhs.size() != rhs.size())
+                return false;
+            if ((lhs.flags() & rhs.flags() & flag_packed) && (lhs.flags() & flag_packed_double) == (rhs.flags() & flag_packed_double)) {
+                if (lhs.flags() & flag_packed_double)
+                    return *lhs.payload().data_doubles == *rhs.payload().data_doubles;
+                return *lhs.payload().data_ints == *rhs.payload().data_ints;
+            }
+            const basic_json &packed = lhs.flags() & flag_packed ? lhs : rhs;
+            const basic_json &other = lhs.flags() & flag_packed ? rhs : lhs;
+            for (std::size_t i = 0; i < packed.packed_size(); i++) {
+                if (other.flags() & flag_packed) {
+                    if (packed.packed_element(i) != other.packed_element(i))
+                        return false;
+                } else if (packed.packed_element(i) != (*other.payload().data_array)[i])
+                    return false;
+            }
+            return true;
+        }
+
+        // 把容器或字符串移动到带有 ContainerHeader 的新内存块中
+        void attach_header() {
+            if (this->flags() & flag_header)
+                return;
+            if (this->is_array())
+                this->store(json_array, this->flags() | flag_header, relocate(this->payload().data_array));
+            else if (this->is_object())
+                this->store(json_object, this->flags() | flag_header, relocate(this->payload().data_object));
+            else
+                this->store(json_string, this->flags() | flag_header, relocate(this->payload().data_string));
+        }
+
+        // 即将修改容器：共享时先取得独占的一份，返回此后的 ContainerHeader
+        ContainerHeader *exclusive_header() {
+            ContainerHeader *block = this->header();
+            if (block != nullptr && block->shares != 0) {
+                this->unshare();
+                block = this->header();
+            }
+            return block;
+        }
+
+        // 字符串、数组与对象的存储地址，两个节点相同时共享同一份存储
+        const void *storage_address() const {
+            switch (this->type()) {
+            case json_string:
+                return payload().data_string;
+            case json_array:
+                if (this->flags() & flag_packed_double)
+                    return payload().data_doubles;
+                if (this->flags() & flag_packed)
+                    return payload().data_ints;
+                return payload().data_array;
+            case json_object:
+                return payload().data_object;
+            default:
+                return nullptr;
+            }
+        }
+
+        // 开始共享：附加 ContainerHeader 并把引用计数设为 1，返回因此增加的内存
+        std::size_t share() {
+            std::size_t added = 0;
+            if (!(this->flags() & flag_header)) {
+                this->attach_header();
+                added = this->header_overhead();
+            }
+            this->header()->shares = 1;
+            return added;
+        }
+
+        // ContainerHeader 与对齐使内存块比容器或字符串本身多出的大小
+        std::size_t header_overhead() const {
+            if (this->is_array())
+                return block_size<array_type>() * sizeof(ContainerHeader) - sizeof(array_type);
+            if (this->is_object())
+                return block_size<object_type>() * sizeof(ContainerHeader) - sizeof(object_type);
+            return block_size<string_type>() * sizeof(ContainerHeader) - sizeof(string_type);
+        }
+
+        // 只有自己引用时直接接管，否则复制一份容器，其中的元素与成员仍然共享
+        void unshare() {
+            ContainerHeader *block = this->header();
+            if (block->shares == 1) {
+                block->shares = 0;
+                return;
+            }
+            basic_json detached;
+            if (this->is_array())
+                detached.store(json_array, 0, create<array_type>(*payload().data_array));
+            else if (this->is_object())
+                detached.store(json_object, 0, create<object_type>(*payload().data_object));
+            else
+                detached.store(json_string, this->flags() & flag_escaped, create<string_type>(*payload().data_string));
+            *this = std::move(detached);
+        }
+
+        void invalidate() {
+            touch();
+            ContainerHeader *block = this->exclusive_header();
+            if (block != nullptr) {
+                block->hash_valid = false;
+                if (block->text)
+                    block->text->clear();
+                if (block->index)
+                    block->index->stale = true;
+            }
+        }
+
+        // 只修改第 position 个元素，或在末尾追加元素（position 为原来的大小）时使用：索引只需重新处理该元素
+        void invalidate(std::size_t position) {
+            touch();
+            ContainerHeader *block = this->exclusive_header();
+            if (block == nullptr)
+                return;
+            block->hash_valid = false;
+            if (block->text)
+                block->text->clear();
+            ArrayIndex *index = block->index.get();
+            if (index == nullptr || index->stale || position >= index->count)
+                return;
+            index->dirty.push_back(position);
+            // 修改的元素较多时整体重建更快
+            if (index->dirty.size() > index->count / 4 + 64) {
+                index->stale = true;
+                index->dirty.clear();
+            }
+        }
+
+        // 查找前把尚未处理的修改反映到索引中
+        ArrayIndex *array_index(const char *function) const {
+            ContainerHeader *block = this->header();
+            if (block == nullptr || !block->index)
+                MY_JSON_THROW(std::logic_error(std::string("function Json::") + function + ": array has no index"));
+            (void)function;
+            block->index->refresh(*payload().data_array, (this->flags() & flag_lent) != 0);
+            return block->index.get();
+        }
+
+        // 返回元素中 path 处的标量，不存在或为数组、对象时返回 nullptr；经过的容器借出过引用时 lent 为 true
+        static const basic_json *index_key(const basic_json &element, const std::vector<string_type> &path, bool &lent) {
+            const basic_json *node = &element;
+            for (const string_type &token : path) {
+                std::size_t index;
+                lent = lent || (node->flags() & flag_lent);
+                if (node->is_object())
+                    node = node->find_member(token.data(), token.size());
+                else if (node->is_array() && parse_index(token, index) && index < static_cast<std::size_t>(node->size()))
+                    node = node->get_ptr(static_cast<int>(index));
+                else
+                    return nullptr;
+                if (node == nullptr)
+                    return nullptr;
+            }
+            if (node->is_array() || node->is_object())
+                return nullptr;
+            return node;
+        }
+
+        // 有序索引的比较：先按类型，再按值；超出 int64 的整数排在其余整数之后，按原文比较
+        static bool index_less(const basic_json &lhs, const basic_json &rhs) {
+            if (lhs.type() != rhs.type())
+                return lhs.type() < rhs.type();
+            switch (lhs.type()) {
+            case json_bool:
+                return lhs.payload().data_bool < rhs.payload().data_bool;
+            case json_int: {
+                if (!((lhs.flags() | rhs.flags()) & flag_raw_number))
+                    return lhs.payload().data_int < rhs.payload().data_int;
+                std::size_t size = 0, other_size = 0;
+                const char *text = lhs.raw_text(size), *other_text = rhs.raw_text(other_size);
+                std::int64_t number = lhs.payload().data_int, other_number = rhs.payload().data_int;
+                bool exact = text == nullptr || parse_int64(text, size, number);
+                bool other_exact = other_text == nullptr || parse_int64(other_text, other_size, other_number);
+                if (exact || other_exact)
+                    return exact && other_exact ? number < other_number : exact;
+                return string_type(text, size) < string_type(other_text, other_size);
+            }
+            case json_double:
+                return lhs.get_double() < rhs.get_double();
+            case json_string:
+                if ((lhs.flags() | rhs.flags()) & flag_escaped)
+                    return lhs.get_string() < rhs.get_string();
+                return *lhs.payload().data_string < *rhs.payload().data_string;
+            default:
+                return false;
+            }
+        }
+
+        // dedupe 的状态：entries 按结构哈希保存每个值第一次出现的节点，出现重复之前只记录节点的地址，
+        // 第一次重复时把该节点转换为共享的值（位于共享的存储中时改为复制一份），之后的重复都引用 value
+        // visited 记录已经遍历过的共享存储及其中是否含有不能共享的值，同一份存储只遍历一次
+        struct DedupeContext {
+            struct Entry {
+                basic_json *node;
+                bool inside_shared;
+                basic_json value;
+            };
+
+            std::unordered_multimap<std::uint64_t, Entry> entries;
+            std::unordered_map<const basic_json *, std::uint64_t> memo;
+            std::unordered_map<const void *, bool> visited;
+            JsonDedupeStats stats;
+        };
+
+        // 后序遍历：子节点先替换为共享的引用，父节点比较时子节点只需比较地址
+        // 返回子树中是否全部可以共享；含有 packed 数组或二级索引的子树不参与比较，以保证 entries 中记录的节点不会随被替换的子树释放
+        // inside_shared 表示节点位于共享的存储中，只登记而不修改
+        static bool dedupe_node(basic_json &json, bool inside_shared, DedupeContext &context) {
+            Type type = json.type();
+            if (type != json_string && type != json_array && type != json_object)
+                return true;
+            if (json.flags() & flag_packed)
+                return false;
+            ContainerHeader *block = json.header();
+            bool shared = block != nullptr && block->shares != 0;
+            bool complete = block == nullptr || !block->index;
+            if (type != json_string) {
+                auto visited = context.visited.end();
+                if (shared) {
+                    visited = context.visited.find(json.storage_address());
+                    if (visited != context.visited.end())
+                        complete = visited->second;
+                }
+                if (!shared || visited == context.visited.end()) {
+                    if (type == json_array) {
+                        for (auto &i : *json.payload().data_array)
+                            complete = dedupe_node(i, inside_shared || shared, context) && complete;
+                    } else {
+                        for (auto &i : *json.payload().data_object)
+                            complete = dedupe_node(i.second, inside_shared || shared, context) && complete;
+                    }
+                    if (shared)
+                        context.visited.emplace(json.storage_address(), complete);
+                }
+            }
+            if (!complete)
+                return false;
+            std::uint64_t hash = hash_node(json, 0, &context.memo);
+            auto range = context.entries.equal_range(hash);
+            for (auto iter = range.first; iter != range.second; ++iter) {
+                typename DedupeContext::Entry &entry = iter->second;
+                const basic_json &value = entry.node != nullptr ? *entry.node : entry.value;
+                if (!dedupe_equal(value, json))
+                    continue;
+                if (inside_shared || value.storage_address() == json.storage_address())
+                    return true;
+                if (entry.node != nullptr) {
+                    if (entry.inside_shared) {
+                        entry.value = *entry.node;
+                        context.stats.bytes_added += owned_size(entry.value) + entry.value.share();
+                    } else {
+                        context.stats.bytes_added += entry.node->share();
+                        entry.value = *entry.node;
+                    }
+                    entry.node = nullptr;
+                }
+                context.stats.bytes_released += owned_size(json);
+                if (type == json_string)
+                    context.stats.strings++;
+                else
+                    context.stats.containers++;
+                json = entry.value;
+                return true;
+            }
+            typename DedupeContext::Entry entry;
+            if (shared) {
+                entry.node = nullptr;
+                entry.value = json;
+            } else
+                entry.node = &json;
+            entry.inside_shared = inside_shared;
+            context.entries.emplace(hash, std::move(entry));
+            return true;
+        }
+
+        // 比 operator== 更严格：还要求序列化的结果相同，原文保存的数字与字符串按原文比较，-0.0 与 0.0 不相等
+        static bool dedupe_equal(const basic_json &lhs, const basic_json &rhs) {
+            if (lhs.type() != rhs.type())
+                return false;
+            std::uint8_t mask = flag_raw_number | flag_escaped | flag_packed | flag_packed_double;
+            if ((lhs.flags() & mask) != (rhs.flags() & mask))
+                return false;
+            if (lhs.storage_address() != nullptr && lhs.storage_address() == rhs.storage_address())
+                return true;
+            switch (lhs.type()) {
+            case json_int:
+            case json_double: {
+                if (lhs.flags() & flag_raw_number) {
+                    std::size_t size = 0, other_size = 0;
+                    const char *text = lhs.raw_text(size), *other_text = rhs.raw_text(other_size);
+                    return size == other_size && std::memcmp(text, other_text, size) == 0;
+                }
+                if (lhs.is_int())
+                    return lhs.payload().data_int == rhs.payload().data_int;
+                double left = lhs.payload().data_double, right = rhs.payload().data_double;
+                return std::memcmp(&left, &right, sizeof(double)) == 0;
+            }
+            case json_string:
+                return *lhs.payload().data_string == *rhs.payload().data_string;
+            case json_array: {
+                if (lhs.flags() & flag_packed)
+                    return lhs == rhs;
+                const array_type &left = *lhs.payload().data_array, &right = *rhs.payload().data_array;
+                if (left.size() != right.size())
+                    return false;
+                for (std::size_t i = 0; i < left.size(); i++) {
+                    if (!dedupe_equal(left[i], right[i]))
+                        return false;
+                }
+                return true;
+            }
+            case json_object: {
+                const object_type &left = *lhs.payload().data_object, &right = *rhs.payload().data_object;
+                if (left.size() != right.size())
+                    return false;
+                for (auto i = left.begin(), j = right.begin(); i != left.end(); ++i, ++j) {
+                    if (i->first != j->first || !dedupe_equal(i->second, j->second))
+                        return false;
+                }
+                return true;
+            }
+            default:
+                return lhs == rhs;
+            }
+        }
+
+        // 共享的存储只统计一次，同时计入 shared
+        static void measure_tree(const basic_json &json, bool shared, JsonMemoryUsage &usage, std::unordered_set<const void *> &visited) {
+            if (json.is_shared()) {
+                if (!visited.insert(json.storage_address()).second)
+                    return;
+                shared = true;
+            }
+            std::size_t total = usage.total();
+            measure(json, usage);
+            if (shared)
+                usage.shared += usage.total() - total;
+            if (json.is_array() && !(json.flags() & flag_packed)) {
+                for (const auto &i : *json.payload().data_array)
+                    measure_tree(i, shared, usage, visited);
+            } else if (json.is_object()) {
+                for (const auto &i : *json.payload().data_object)
+                    measure_tree(i.second, shared, usage, visited);
+            }
+        }
+
+        // 字符串对象计入 strings；数据不在对象内部时（没有使用短字符串优化）再计入缓冲区，多余的容量计入 slack
+        template <typename String>
+        static void measure_string(const String &str, std::size_t &bytes, std::size_t &slack) {
+            const char *data = reinterpret_cast<const char *>(str.data());
+            const char *self = reinterpret_cast<const char *>(&str);
+            bytes += sizeof(str);
+            if (data < self || data >= self + sizeof(str)) {
+                bytes += (str.size() + 1) * sizeof(typename String::value_type);
+                slack += (str.capacity() - str.size()) * sizeof(typename String::value_type);
+            }
+        }
+
+        // 节点自身的存储，不含子节点的存储；数组中的元素与对象的成员本身计入 nodes，对象的成员按红黑树的节点（3 个指针与颜色）估算开销
+        static void measure(const basic_json &json, JsonMemoryUsage &usage) {
+            switch (json.type()) {
+            case json_int:
+            case json_double:
+                if (json.flags() & flag_raw_heap)
+                    measure_string(*json.payload().data_string, usage.strings, usage.slack);
+                break;
+            case json_string:
+                measure_string(*json.payload().data_string, usage.strings, usage.slack);
+                break;
+            case json_array:
+                if (json.flags() & flag_packed_double) {
+                    const PackedBuffer<double> &numbers = *json.payload().data_doubles;
+                    usage.containers += sizeof(numbers);
+                    usage.nodes += numbers.size() * sizeof(double);
+                    usage.slack += (numbers.capacity() - numbers.size()) * sizeof(double);
+                    if (const PackedElements *elements = numbers.elements.load(std::memory_order_acquire))
+                        usage.caches += elements->memory();
+                } else if (json.flags() & flag_packed) {
+                    const PackedBuffer<std::int64_t> &numbers = *json.payload().data_ints;
+                    usage.containers += sizeof(numbers);
+                    usage.nodes += numbers.size() * sizeof(std::int64_t);
+                    usage.slack += (numbers.capacity() - numbers.size()) * sizeof(std::int64_t);
+                    if (const PackedElements *elements = numbers.elements.load(std::memory_order_acquire))
+                        usage.caches += elements->memory();
+                } else {
+                    const array_type &array = *json.payload().data_array;
+                    usage.containers += sizeof(array);
+                    usage.nodes += array.size() * sizeof(basic_json);
+                    usage.slack += (array.capacity() - array.size()) * sizeof(basic_json);
+                }
+                break;
+            case json_object:
+                usage.containers += sizeof(object_type);
+                for (const auto &i : *json.payload().data_object) {
+                    usage.nodes += sizeof(basic_json);
+                    usage.containers += sizeof(i) - sizeof(i.first) - sizeof(basic_json) + 4 * sizeof(void *);
+                    measure_string(i.first, usage.strings, usage.slack);
+                }
+                break;
+            default:
+                break;
+            }
+            ContainerHeader *block = json.header();
+            if (block != nullptr) {
+                usage.containers += json.header_overhead();
+                if (block->text)
+                    measure_string(*block->text, usage.caches, usage.caches);
+                if (block->index)
+                    usage.caches += block->index->memory();
+            }
+        }
+
+        static std::size_t heap_size(const basic_json &json) {
+            JsonMemoryUsage usage;
+            measure(json, usage);
+            return usage.total();
+        }
+
+        // 释放节点时实际归还的内存：仍被其他节点引用的共享值不计入
+        static std::size_t owned_size(const basic_json &json) {
+            ContainerHeader *block = json.header();
+            if (block != nullptr && block->shares > 1)
+                return 0;
+            std::size_t size = heap_size(json);
+            if (json.is_array() && !(json.flags() & flag_packed)) {
+                for (const auto &i : *json.payload().data_array)
+                    size += owned_size(i);
+            } else if (json.is_object()) {
+                for (const auto &i : *json.payload().data_object)
+                    size += owned_size(i.second);
+            }
+            return size;
+        }
+
+        template <typename T, typename... Args>
+        static T *create(Args &&...args) {
+            typedef typename std::allocator_traits<typename Traits::allocator_type>::template rebind_alloc<T> Alloc;
+            Alloc alloc;
+            T *ptr = std::allocator_traits<Alloc>::allocate(alloc, 1);
+            MY_JSON_TRY {
+                std::allocator_traits<Alloc>::construct(alloc, ptr, std::forward<Args>(args)...);
+            } MY_JSON_CATCH_ALL {
+                std::allocator_traits<Alloc>::deallocate(alloc, ptr, 1);
+                MY_JSON_RETHROW;
+            }
+            return ptr;
+        }
+
+        // block 不为空时 ptr 位于 relocate 申请的内存块中，与 ContainerHeader 一起释放
+        template <typename T>
+        static void destroy(T *ptr, ContainerHeader *block) {
+            typedef typename std::allocator_traits<typename Traits::allocator_type>::template rebind_alloc<T> Alloc;
+            typedef typename std::allocator_traits<typename Traits::allocator_type>::template rebind_alloc<ContainerHeader> BlockAlloc;
+            Alloc alloc;
+            std::allocator_traits<Alloc>::destroy(alloc, ptr);
+            if (block == nullptr) {
+                std::allocator_traits<Alloc>::deallocate(alloc, ptr, 1);
+                return;
+            }
+            BlockAlloc block_alloc;
+            block->~ContainerHeader();
+            std::allocator_traits<BlockAlloc>::deallocate(block_alloc, block, block_size<T>());
+        }
+
+        // 内存块按 ContainerHeader 的个数申请，容器紧跟在 ContainerHeader 之后
+        template <typename T>
+        static T *relocate(T *container) {
+            typedef typename std::allocator_traits<typename Traits::allocator_type>::template rebind_alloc<T> Alloc;
+            typedef typename std::allocator_traits<typename Traits::allocator_type>::template rebind_alloc<ContainerHeader> BlockAlloc;
+            Alloc alloc;
+            BlockAlloc block_alloc;
+            ContainerHeader *block = std::allocator_traits<BlockAlloc>::allocate(block_alloc, block_size<T>());
+            new (block) ContainerHeader();
+            T *moved = reinterpret_cast<T *>(block + 1);
+            MY_JSON_TRY {
+                std::allocator_traits<Alloc>::construct(alloc, moved, std::move(*container));
+            } MY_JSON_CATCH_ALL {
+                block->~ContainerHeader();
+                std::allocator_traits<BlockAlloc>::deallocate(block_alloc, block, block_size<T>());
+                MY_JSON_RETHROW;
+            }
+            destroy(container, nullptr);
+            return moved;
+        }
+
+        template <typename T>
+        static std::size_t block_size() {
+            return 1 + (sizeof(T) + sizeof(ContainerHeader) - 1) / sizeof(ContainerHeader);
+        }
+
+        static std::uint64_t hash_mix(std::uint64_t value) {
+            value ^= value >> 33;
+            value *= 0xff51afd7ed558ccdULL;
+            value ^= value >> 33;
+            value *= 0xc4ceb9fe1a85ec53ULL;
+            value ^= value >> 33;
+            return value;
+        }
+
+        static std::uint64_t hash_bytes(const char *data, std::size_t size, std::uint64_t seed) {
+            std::uint64_t hash = seed ^ (size * 0x9e3779b97f4a7c15ULL);
+            std::size_t i = 0;
+            for (; i + 8 <= size; i += 8) {
+                std::uint64_t word;
+                std::memcpy(&word, data + i, 8);
+                hash = (hash ^ hash_mix(word)) * 0x9e3779b97f4a7c15ULL;
+            }
+            if (i < size) {
+                std::uint64_t word = 0;
+                std::memcpy(&word, data + i, size - i);
+                hash = (hash ^ hash_mix(word)) * 0x9e3779b97f4a7c15ULL;
+            }
+            return hash_mix(hash);
+        }
+
+        // 对象成员的哈希相加，与顺序无关；-0.0 与 0.0 相等，因此哈希也相同
+        // memo 不为空时记录容器的哈希，同一个节点只计算一次
+        static std::uint64_t hash_node(const basic_json &json, std::uint64_t seed, std::unordered_map<const basic_json *, std::uint64_t> *memo) {
+            std::uint64_t type_seed = hash_mix(seed + 0x9e3779b97f4a7c15ULL * (json.type() + 1));
+            switch (json.type()) {
+            case json_bool:
+                return hash_mix(type_seed ^ json.payload().data_bool);
+            case json_int: {
+                // 原文与解码后的值相等时哈希也相同；超出 int64 的整数按 uint64 或原文计算
+                std::size_t size = 0;
+                const char *text = json.raw_text(size);
+                std::int64_t number = json.payload().data_int;
+                std::uint64_t unsigned_number;
+                if (text == nullptr || parse_int64(text, size, number))
+                    return hash_mix(type_seed ^ static_cast<std::uint64_t>(number));
+                if (parse_uint64(text, size, unsigned_number))
+                    return hash_mix(type_seed ^ unsigned_number);
+                return hash_bytes(text, size, type_seed);
+            }
+            case json_double: {
+                double number = json.get_double();
+                number = number == 0 ? 0 : number;
+                std::uint64_t bits;
+                std::memcpy(&bits, &number, 8);
+                return hash_mix(type_seed ^ bits);
+            }
+            case json_string: {
+                if (!(json.flags() & flag_escaped))
+                    return hash_bytes(json.payload().data_string->data(), json.payload().data_string->size(), type_seed);
+                string_type str = json.get_string();
+                return hash_bytes(str.data(), str.size(), type_seed);
+            }
+            case json_array:
+            case json_object:
+                break;
+            default:
+                return type_seed;
+            }
+            const std::uint64_t *cached = json.hash_cache();
+            if (seed == 0 && cached != nullptr)
+                return *cached;
+            if (memo != nullptr) {
+                auto iter = memo->find(&json);
+                if (iter != memo->end())
+                    return iter->second;
+            }
+            std::uint64_t hash = type_seed;
+            if (json.flags() & flag_packed) {
+                // 与逐个元素调用 hash_node 的结果相同
+                bool real = (json.flags() & flag_packed_double) != 0;
+                std::uint64_t element_seed = hash_mix(seed + 0x9e3779b97f4a7c15ULL * ((real ? json_double : json_int) + 1));
+                std::size_t count = json.packed_size();
+                for (std::size_t i = 0; i < count; i++) {
+                    std::uint64_t bits;
+                    if (real) {
+                        double number = (*json.payload().data_doubles)[i];
+                        number = number == 0 ? 0 : number;
+                        std::memcpy(&bits, &number, 8);
+                    } else
+                        bits = static_cast<std::uint64_t>((*json.payload().data_ints)[i]);
+                    hash = (hash ^ hash_mix(element_seed ^ bits)) * 0x9e3779b97f4a7c15ULL;
+                }
+                hash = hash_mix(hash ^ count);
+            } else if (json.is_array()) {
+                for (const auto &i : *json.payload().data_array)
+                    hash = (hash ^ hash_node(i, seed, memo)) * 0x9e3779b97f4a7c15ULL;
+                hash = hash_mix(hash ^ json.payload().data_array->size());
+            } else {
+                std::uint64_t sum = 0;
+                for (const auto &i : *json.payload().data_object)
+                    sum += hash_mix(hash_bytes(i.first.data(), i.first.size(), type_seed) ^ (hash_node(i.second, seed, memo) * 0x9e3779b97f4a7c15ULL));
+                hash = hash_mix(hash ^ sum ^ json.payload().data_object->size());
+            }
+            if (memo != nullptr)
+                memo->emplace(&json, hash);
+            return hash;
+        }
+
+        // const 的 at 与 get_ptr 访问 packed 数组时生成的元素，每 64 个元素一块，只生成访问到的块，见 packed_ref
+        // blocks 的长度在生成时按缓冲区的大小确定，缓冲区的大小改变之前总是先丢弃 elements
+        // 被替换的块移到 retired，之前返回的引用仍然指向它们，与 elements 一起释放
+        struct PackedElements {
+            static const std::size_t block_size = 64;
+
+            struct Block {
+                basic_json values[block_size];
+                Block *next;
+            };
+
+            explicit PackedElements(std::size_t size) : count((size + block_size - 1) / block_size), blocks(new std::atomic<Block *>[count]), retired(nullptr) {
+                for (std::size_t i = 0; i < count; i++)
+                    blocks[i].store(nullptr, std::memory_order_relaxed);
+            }
+            PackedElements(const PackedElements &other) = delete;
+            PackedElements &operator=(const PackedElements &other) = delete;
+            ~PackedElements() {
+                for (std::size_t i = 0; i < count; i++)
+                    delete blocks[i].load(std::memory_order_relaxed);
+                Block *block = retired.load(std::memory_order_relaxed);
+                while (block != nullptr) {
+                    Block *next = block->next;
+                    delete block;
+                    block = next;
+                }
+            }
+
+            void retire(Block *block) {
+                block->next = retired.load(std::memory_order_relaxed);
+                while (!retired.compare_exchange_weak(block->next, block, std::memory_order_release, std::memory_order_relaxed))
+                    ;
+            }
+
+            std::size_t memory() const {
+                std::size_t size = sizeof(PackedElements) + count * sizeof(std::atomic<Block *>);
+                for (std::size_t i = 0; i < count; i++)
+                    size += blocks[i].load(std::memory_order_acquire) != nullptr ? sizeof(Block) : 0;
+                for (const Block *block = retired.load(std::memory_order_acquire); block != nullptr; block = block->next)
+                    size += sizeof(Block);
+                return size;
+            }
+
+            std::size_t count;
+            std::unique_ptr<std::atomic<Block *>[]> blocks;
+            std::atomic<Block *> retired;
+        };
+
+        // packed 数组的数字缓冲区；elements 见 PackedElements，修改缓冲区的接口会丢弃它；复制时不复制 elements
+        template <typename T>
+        struct PackedBuffer : std::vector<T> {
+            PackedBuffer(std::vector<T> &&values) : std::vector<T>(std::move(values)), elements(nullptr) {}
+            PackedBuffer(const PackedBuffer &other) : std::vector<T>(other), elements(nullptr) {}
+            PackedBuffer &operator=(const PackedBuffer &other) = delete;
+            ~PackedBuffer() {
+                delete elements.load(std::memory_order_relaxed);
+            }
+
+            std::atomic<PackedElements *> elements;
+        };
+
+        union Value {
+            Value() : data_double(0) {}
+            Value(bool value) : data_bool(value) {}
+            Value(int value) : data_int(value) {}
+            Value(std::int64_t value) : data_int(value) {}
+            Value(double value) : data_double(value) {}
+            Value(string_type *value) : data_string(value) {}
+            Value(array_type *value) : data_array(value) {}
+            Value(object_type *value) : data_object(value) {}
+            Value(PackedBuffer<std::int64_t> *value) : data_ints(value) {}
+            Value(PackedBuffer<double> *value) : data_doubles(value) {}
+
+            bool data_bool;
+            std::int64_t data_int;
+            double data_double;
+            char data_raw[8];
+            string_type *data_string;
+            array_type *data_array;
+            object_type *data_object;
+            PackedBuffer<std::int64_t> *data_ints;
+            PackedBuffer<double> *data_doubles;
+        };
+
+        // 默认布局：类型、标志与 Value 分开保存，对齐后共 16 字节；超出 int 的整数保存原文
+        struct WideStorage {
+            static const std::int64_t int_max = INT_MAX;
+
+            Type data_type;
+            std::uint8_t data_flags;
+            Value value;
+
+            Type type() const {
+                return data_type;
+            }
+            std::uint8_t flags() const {
+                return data_flags;
+            }
+            Value load() const {
+                return value;
+            }
+            void store(Type type, std::uint8_t flags, Value value) {
+                data_type = type;
+                data_flags = flags;
+                this->value = value;
+            }
+            void set_flags(std::uint8_t flags) {
+                data_flags = flags;
+            }
+            const char *inline_text() const {
+                return value.data_raw;
+            }
+        };
+
+        // 紧凑布局（NaN-boxing）：高 13 位不全为 1 时整个字是一个 double，NaN 统一保存为 0x7ff8000000000000
+        // 否则 bit 48-50 为类型（json_double 表示保存原文的浮点数），低 48 位为 payload：
+        //   bool 为 0 或 1；int 为 bit 1-47 中的 47 位有符号整数，毫秒时间戳等都可以内联保存；
+        //   指针要求 8 字节对齐且不超过 48 位，低 3 位保存标志：
+        //   整数 bit 0 表示 payload 是原文的指针；字符串 bit 0、1 分别为 flag_escaped、flag_header；
+        //   数组 bit 1 为 flag_packed，普通数组 bit 0、2 分别为 flag_header、flag_lent，packed 数组 bit 0、2 分别为 flag_lent、flag_packed_double；
+        //   对象 bit 0、1 分别为 flag_header、flag_lent
+        // 原文总是保存在堆上（带有 flag_raw_heap），超出 47 位的整数与默认布局一样保存原文，因此 64 位整数不会丢失精度
+        // 没有位置保存 flag_stale，Parser::parse_into 复用对象时先清空原有的成员
+        struct CompactStorage {
+            std::uint64_t word;
+
+            static const std::uint64_t boxed = 0xfff8000000000000ULL;
+            static const std::uint64_t pointer_mask = 0x0000fffffffffff8ULL;
+            static const std::uint64_t int_mask = 0x0000fffffffffffeULL;
+            static const std::int64_t int_max = (1LL << 46) - 1;
+
+            Type type() const {
+                if ((word & boxed) != boxed)
+                    return json_double;
+                return static_cast<Type>((word >> 48) & 7);
+            }
+            std::uint8_t flags() const {
+                if ((word & boxed) != boxed)
+                    return 0;
+                unsigned bits = word & 7;
+                switch ((word >> 48) & 7) {
+                case json_int:
+                    return bits & 1 ? flag_raw_number | flag_raw_heap : 0;
+                case json_double:
+                    return flag_raw_number | flag_raw_heap;
+                case json_string:
+                    return (bits & 1 ? flag_escaped : 0) | (bits & 2 ? flag_header : 0);
+                case json_array:
+                    if (bits & 2)
+                        return flag_packed | (bits & 1 ? flag_lent : 0) | (bits & 4 ? flag_packed_double : 0);
+                    return (bits & 1 ? flag_header : 0) | (bits & 4 ? flag_lent : 0);
+                case json_object:
+                    return (bits & 1 ? flag_header : 0) | (bits & 2 ? flag_lent : 0);
+                default:
+                    return 0;
+                }
+            }
+            Value load() const {
+                Value value;
+                if ((word & boxed) != boxed) {
+                    std::memcpy(&value.data_double, &word, sizeof(double));
+                    return value;
+                }
+                std::uintptr_t pointer = static_cast<std::uintptr_t>(word & pointer_mask);
+                switch ((word >> 48) & 7) {
+                case json_bool:
+                    value.data_bool = (word & 1) != 0;
+                    break;
+                case json_int:
+                    if (word & 1)
+                        value.data_string = reinterpret_cast<string_type *>(pointer);
+                    else
+                        value.data_int = static_cast<std::int64_t>(word << 16) >> 17;
+                    break;
+                case json_double:
+                case json_string:
+                    value.data_string = reinterpret_cast<string_type *>(pointer);
+                    break;
+                case json_array:
+                    if ((word & 6) == 6)
+                        value.data_doubles = reinterpret_cast<PackedBuffer<double> *>(pointer);
+                    else if (word & 2)
+                        value.data_ints = reinterpret_cast<PackedBuffer<std::int64_t> *>(pointer);
+                    else
+                        value.data_array = reinterpret_cast<array_type *>(pointer);
+                    break;
+                case json_object:
+                    value.data_object = reinterpret_cast<object_type *>(pointer);
+                    break;
+                default:
+                    break;
+                }
+                return value;
+            }
+            void store(Type type, std::uint8_t flags, Value value) {
+                std::uint64_t tag = boxed | static_cast<std::uint64_t>(type) << 48;
+                switch (type) {
+                case json_bool:
+                    word = tag | value.data_bool;
+                    break;
+                case json_int:
+                    if (flags & flag_raw_number)
+                        word = tag | box(value.data_string) | 1;
+                    else
+                        word = tag | (static_cast<std::uint64_t>(value.data_int) << 1 & int_mask);
+                    break;
+                case json_double:
+                    if (flags & flag_raw_number)
+                        word = tag | box(value.data_string);
+                    else if (value.data_double != value.data_double)
+                        word = 0x7ff8000000000000ULL;
+                    else
+                        std::memcpy(&word, &value.data_double, sizeof(double));
+                    break;
+                case json_string:
+                    word = tag | box(value.data_string) | (flags & flag_escaped ? 1 : 0) | (flags & flag_header ? 2 : 0);
+                    break;
+                case json_array:
+                    if (flags & flag_packed)
+                        word = tag | box(value.data_array) | 2 | (flags & flag_lent ? 1 : 0) | (flags & flag_packed_double ? 4 : 0);
+                    else
+                        word = tag | box(value.data_array) | (flags & flag_header ? 1 : 0) | (flags & flag_lent ? 4 : 0);
+                    break;
+                case json_object:
+                    word = tag | box(value.data_object) | (flags & flag_header ? 1 : 0) | (flags & flag_lent ? 2 : 0);
+                    break;
+                default:
+                    word = tag;
+                    break;
+                }
+            }
+            void set_flags(std::uint8_t flags) {
+                this->store(this->type(), flags, this->load());
+            }
+            // 原文总是保存在堆上
+            const char *inline_text() const {
+                return nullptr;
+            }
+            template <typename T>
+            static std::uint64_t box(T *pointer) {
+                std::uint64_t bits = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(pointer));
+                if (bits & ~pointer_mask)
+                    MY_JSON_THROW(std::runtime_error("function Json: pointer does not fit the compact layout"));
+                return bits;
+            }
+        };
+
+        static const bool compact_layout = JsonCompactLayout<Traits>::value;
+        typedef typename std::conditional<compact_layout, CompactStorage, WideStorage>::type Storage;
+
+        Storage storage;
+    };
+
+    // 快照文件格式（版本 2，所有偏移量都相对于文件起始位置，因此与加载地址无关）:
+    //   header: "MYJSNAP\0" | u32 version | u32 0x01020304 | u64 root offset | u64 file size
+    //   node:   u32 type | u32 aux | payload，每个节点按 8 字节对齐
+    //     null / bool: aux 保存值，无 payload
+    //     int:    aux 为 JsonView::int_signed / int_unsigned 时 payload 为 8 字节 int64 / uint64，
+    //             为 int_text 时 payload 为以 '\0' 结尾的数字原文（超出 uint64 范围的整数）
+    //     double: payload 为 8 字节 double
+    //     string: aux 为长度，payload 为字符数据并以 '\0' 结尾
+    //     array:  aux 为元素个数，payload 为 u64 元素偏移量
+    //     object: aux 为成员个数，payload 为按 key 排序的 (u64 key 偏移量, u64 value 偏移量)
+    class JsonView {
+    public:
+        // int 节点的 aux
+        enum {
+            int_signed = 0,
+            int_unsigned = 1,
+            int_text = 2
+        };
+
+        JsonView() : base(nullptr), offset(0) {}
+
+        JsonView(const char *base, std::uint64_t offset) : base(base), offset(offset) {}
+
+        Json::Type type() const {
+            if (base == nullptr)
+                return Json::json_null;
+            std::uint32_t tag;
+            std::memcpy(&tag, base + offset, 4);
+            return static_cast<Json::Type>(tag);
+        }
+
+        bool is_null() const {
+            return this->type() == Json::json_null;
+        }
+
+        bool is_bool() const {
+            return this->type() == Json::json_bool;
+        }
+
+        bool is_int() const {
+            return this->type() == Json::json_int;
+        }
+
+        bool is_double() const {
+            return this->type() == Json::json_double;
+        }
+
+        bool is_string() const {
+            return this->type() == Json::json_string;
+        }
+
+        bool is_array() const {
+            return this->type() == Json::json_array;
+        }
+
+        bool is_object() const {
+            return this->type() == Json::json_object;
+        }
+
+        bool get_bool() const {
+            if (this->is_bool())
+                return this->aux() != 0;
+            MY_JSON_THROW(std::logic_error("function JsonView::get_bool: type error"));
+        }
+
+        // 超出 int 范围时 get_int 抛出 out_of_range，可用 get_int64、get_uint64 或 get_number_text 读取
+        int get_int() const {
+            if (this->is_int()) {
+                if (this->aux() == JsonView::int_signed) {
+                    std::int64_t number = this->get_int64();
+                    if (number >= INT_MIN && number <= INT_MAX)
+                        return static_cast<int>(number);
+                }
+                MY_JSON_THROW(std::out_of_range("function JsonView::get_int: number out of range"));
+            }
+            MY_JSON_THROW(std::logic_error("function JsonView::get_int: type error"));
+        }
+
+        std::int64_t get_int64() const {
+            if (this->is_int()) {
+                if (this->aux() == JsonView::int_signed) {
+                    std::int64_t number;
+                    std::memcpy(&number, this->payload(), sizeof(number));
+                    return number;
+                }
+                MY_JSON_THROW(std::out_of_range("function JsonView::get_int64: number out of range"));
+            }
+            MY_JSON_THROW(std::logic_error("function JsonView::get_int64: type error"));
+        }
+
+        std::uint64_t get_uint64() const {
+            if (this->is_int()) {
+                if (this->aux() == JsonView::int_unsigned) {
+                    std::uint64_t number;
+                    std::memcpy(&number, this->payload(), sizeof(number));
+                    return number;
+                }
+                if (this->aux() == JsonView::int_signed && this->get_int64() >= 0)
+                    return static_cast<std::uint64_t>(this->get_int64());
+                MY_JSON_THROW(std::out_of_range("function JsonView::get_uint64: number out of range"));
+            }
+            MY_JSON_THROW(std::logic_error("function JsonView::get_uint64: type error"));
+        }
+
+        // 与 Json::get_number_text 相同，超出 uint64 范围的整数返回保存的原文
+        std::string get_number_text() const {
+            switch (this->type()) {
+            case Json::json_int:
+                if (this->aux() == JsonView::int_signed)
+                    return std::to_string(this->get_int64());
+                if (this->aux() == JsonView::int_unsigned)
+                    return std::to_string(this->get_uint64());
+                return std::string(this->payload());
+            case Json::json_double:
+                return std::to_string(this->get_double());
+            default:
+                break;
+            }
+            MY_JSON_THROW(std::logic_error("function JsonView::get_number_text: type error"));
+        }
+
+        double get_double() const {
+            if (this->is_double()) {
+                double value;
+                std::memcpy(&value, this->payload(), sizeof(double));
+                return value;
+            }
+            MY_JSON_THROW(std::logic_error("function JsonView::get_double: type error"));
+        }
+
+        std::string get_string() const {
+            if (this->is_string())
+                return std::string(this->payload(), this->aux());
+            MY_JSON_THROW(std::logic_error("function JsonView::get_string: type error"));
+        }
+
+        std::vector<JsonView> get_array() const {
+            if (this->is_array()) {
+                std::vector<JsonView> array;
+                int size = this->size();
+                array.reserve(size);
+                for (int i = 0; i < size; i++)
+                    array.push_back((*this)[i]);
+                return array;
+            }
+            MY_JSON_THROW(std::logic_error("function JsonView::get_array: type error"));
+        }
+
+        std::map<std::string, JsonView> get_object() const {
+            if (this->is_object()) {
+                std::map<std::string, JsonView> object;
+                const char *members = this->payload();
+                std::uint32_t size = this->aux();
+                for (std::uint32_t i = 0; i < size; i++) {
+                    std::uint64_t member[2];
+                    std::memcpy(member, members + i * 16, 16);
+                    object.emplace_hint(object.end(), JsonView(base, member[0]).get_string(), JsonView(base, member[1]));
+                }
+                return object;
+            }
+            MY_JSON_THROW(std::logic_error("function JsonView::get_object: type error"));
+        }
+
+        // 直接返回快照中的字符串，不做拷贝
+        const char *c_str() const {
+            if (this->is_string())
+                return this->payload();
+            MY_JSON_THROW(std::logic_error("function JsonView::c_str: type error"));
+        }
+
+        std::size_t length() const {
+            if (this->is_string())
+                return this->aux();
+            MY_JSON_THROW(std::logic_error("function JsonView::length: type error"));
+        }
+
+        int size() const {
+            switch (this->type()) {
+            case Json::json_array:
+            case Json::json_object:
+                return this->aux();
+            default:
+                break;
+            }
+            MY_JSON_THROW(std::logic_error("function JsonView::size: this json object is not array or map,cam't get size"));
+        }
+
+        bool empty() const {
+            switch (this->type()) {
+            case Json::json_null:
+                return true;
+            case Json::json_array:
+            case Json::json_object:
+                return this->aux() == 0;
+            default:
+                break;
+            }
+            MY_JSON_THROW(std::logic_error("function JsonView::empty: type error"));
+        }
+
+        std::string to_string() const {
+            std::string str;
+            switch (this->type()) {
+            case Json::json_null:
+                str = "null";
+                break;
+            case Json::json_bool:
+                str = this->get_bool() ? "true" : "false";
+                break;
+            case Json::json_int:
+                str = this->get_number_text();
+                break;
+            case Json::json_double:
+                str = std::to_string(this->get_double());
+                break;
+            case Json::json_string:
+                str = "\"";
+                Json::append_escaped(str, this->c_str(), this->length());
+                str += "\"";
+                break;
+            case Json::json_array: {
+                str = "[";
+                int size = this->size();
+                for (int i = 0; i < size; i++)
+                    str += (*this)[i].to_string() + ",";
+                if (size != 0)
+                    str.pop_back();
+                str += "]";
+                break;
+            }
+            case Json::json_object: {
+                str = "{";
+                const char *members = this->payload();
+                std::uint32_t size = this->aux();
+                for (std::uint32_t i = 0; i < size; i++) {
+                    std::uint64_t member[2];
+                    std::memcpy(member, members + i * 16, 16);
+                    str += JsonView(base, member[0]).to_string() + ":" + JsonView(base, member[1]).to_string() + ",";
+                }
+                if (size != 0)
+                    str.pop_back();
+                str += "}";
+                break;
+            }
+            default:
+                break;
+            }
+            return str;
+        }
+
+        Json to_json() const {
+            switch (this->type()) {
+            case Json::json_bool:
+                return Json(this->get_bool());
+            case Json::json_int: {
+                if (this->aux() == JsonView::int_signed)
+                    return Json(this->get_int64());
+                if (this->aux() == JsonView::int_unsigned)
+                    return Json(this->get_uint64());
+                // 超出 uint64 范围时保留原文
+                Json number;
+                number.parse(this->get_number_text());
+                return number;
+            }
+            case Json::json_double:
+                return Json(this->get_double());
+            case Json::json_string:
+                return Json(this->get_string());
+            case Json::json_array: {
+                Json array(Json::json_array);
+                int size = this->size();
+                for (int i = 0; i < size; i++)
+                    array.push_back((*this)[i].to_json());
+                return array;
+            }
+            case Json::json_object: {
+                Json object(Json::json_object);
+                const char *members = this->payload();
+                std::uint32_t size = this->aux();
+                for (std::uint32_t i = 0; i < size; i++) {
+                    std::uint64_t member[2];
+                    std::memcpy(member, members + i * 16, 16);
+                    object[JsonView(base, member[0]).get_string()] = JsonView(base, member[1]).to_json();
+                }
+                return object;
+            }
+            default:
+                break;
+            }
+            return Json();
+        }
+
+        bool find(const char *key) const {
+            return this->has_key(key);
+        }
+
+        bool find(const std::string &key) const {
+            return this->has_key(key);
+        }
+
+        bool has_key(const char *key) const {
+            if (this->is_object())
+                return this->lookup(key, std::strlen(key)) != 0;
+            MY_JSON_THROW(std::logic_error("function JsonView::has_key: type error"));
+        }
+
+        bool has_key(const std::string &key) const {
+            if (this->is_object())
+                return this->lookup(key.data(), key.size()) != 0;
+            MY_JSON_THROW(std::logic_error("function JsonView::has_key: type error"));
+        }
+
+        JsonView operator[](int index) const {
+            if (this->is_array()) {
+                if (index >= 0 && static_cast<std::uint32_t>(index) < this->aux()) {
+                    std::uint64_t child;
+                    std::memcpy(&child, this->payload() + index * 8, 8);
+                    return JsonView(base, child);
+                }
+                MY_JSON_THROW(std::out_of_range("function JsonView::operator[]: index out of range"));
+            } else
+                MY_JSON_THROW(std::logic_error("function JsonView::operator[]: type error"));
+        }
+
+        JsonView operator[](const char *key) const {
+            if (this->is_object()) {
+                std::uint64_t child = this->lookup(key, std::strlen(key));
+                if (child != 0)
+                    return JsonView(base, child);
+                MY_JSON_THROW(std::out_of_range("function JsonView::operator[]: key not found"));
+            } else
+                MY_JSON_THROW(std::logic_error("function JsonView::operator[]: type error"));
+        }
+
+        JsonView operator[](const std::string &key) const {
+            if (this->is_object()) {
+                std::uint64_t child = this->lookup(key.data(), key.size());
+                if (child != 0)
+                    return JsonView(base, child);
+                MY_JSON_THROW(std::out_of_range("function JsonView::operator[]: key not found"));
+            } else
+                MY_JSON_THROW(std::logic_error("function JsonView::operator[]: type error"));
+        }
+
+        operator bool() const {
+            if (this->is_bool())
+                return this->aux() != 0;
+            else
+                MY_JSON_THROW(std::logic_error("function JsonView::operator bool(): type error"));
+        }
+
+        operator int() const {
+            if (this->is_int())
+                return this->get_int();
+            else
+                MY_JSON_THROW(std::logic_error("function JsonView::operator int(): type error"));
+        }
+
+        operator double() const {
+            if (this->is_double())
+                return this->get_double();
+            else
+                MY_JSON_THROW(std::logic_error("function JsonView::operator double(): type error"));
+        }
+
+        operator std::string() const {
+            if (this->is_string())
+                return this->get_string();
+            else
+                MY_JSON_THROW(std::logic_error("function JsonView::operator std::string(): type error"));
+        }
+
+    private:
+        std::uint32_t aux() const {
+            std::uint32_t aux;
+            std::memcpy(&aux, base + offset + 4, 4);
+            return aux;
+        }
+
+        const char *payload() const {
+            return base + offset + 8;
+        }
+
+        // 成员按 key 排序保存，二分查找，找不到时返回 0（0 处是文件头，不会是合法节点）
+        std::uint64_t lookup(const char *key, std::size_t size) const {
+            const char *members = this->payload();
+            std::uint32_t low = 0, high = this->aux();
+            while (low < high) {
+                std::uint32_t mid = low + (high - low) / 2;
+                std::uint64_t member[2];
+                std::memcpy(member, members + mid * 16, 16);
+                JsonView name(base, member[0]);
+                std::size_t length = name.aux();
+                int cmp = std::memcmp(name.payload(), key, length < size ? length : size);
+                if (cmp == 0)
+                    cmp = length < size ? -1 : (length > size ? 1 : 0);
+                if (cmp == 0)
+                    return member[1];
+                if (cmp < 0)
+                    low = mid + 1;
+                else
+                    high = mid;
+            }
+            return 0;
+        }
+
+        const char *base;
+        std::uint64_t offset;
+    };
+
+    // 以只读方式 mmap 快照文件，页面按需加载，同一主机上的多个进程共享物理内存
+    // 由 root() 得到的 JsonView 在 JsonSnapshot 关闭或析构后失效
+    class JsonSnapshot {
+    public:
+        enum {
+            version = 2,
+            header_size = 32
+        };
+
+        JsonSnapshot() : data(nullptr), length(0), root_offset(0) {
+#ifdef _WIN32
+            file_handle = nullptr;
+            mapping_handle = nullptr;
+#endif
+        }
+
+        JsonSnapshot(const char *path) : JsonSnapshot() {
+            this->open(path);
+        }
+
+        JsonSnapshot(const std::string &path) : JsonSnapshot() {
+            this->open(path);
+        }
+
+        JsonSnapshot(JsonSnapshot &&other) : JsonSnapshot() {
+            *this = std::move(other);
+        }
+
+        JsonSnapshot(const JsonSnapshot &other) = delete;
+
+        ~JsonSnapshot() {
+            this->close();
+        }
+
+        JsonSnapshot &operator=(JsonSnapshot &&other) {
+            if (this != &other) {
+                this->close();
+                data = other.data;
+                length = other.length;
+                root_offset = other.root_offset;
+                other.data = nullptr;
+                other.length = 0;
+                other.root_offset = 0;
+#ifdef _WIN32
+                file_handle = other.file_handle;
+                mapping_handle = other.mapping_handle;
+                other.file_handle = nullptr;
+                other.mapping_handle = nullptr;
+#endif
+            }
+            return *this;
+        }
+
+        JsonSnapshot &operator=(const JsonSnapshot &other) = delete;
+
+        void open(const char *path) {
+            std::string str(path);
+            this->open(str);
+        }
+
+        void open(const std::string &path) {
+            this->close();
+#ifdef _WIN32
+            HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE)
+                MY_JSON_THROW(std::runtime_error("function JsonSnapshot::open: file is not open"));
+            LARGE_INTEGER file_size;
+            if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart < header_size) {
+                CloseHandle(file);
+                MY_JSON_THROW(std::runtime_error("function JsonSnapshot::open: invalid snapshot"));
+            }
+            HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            const void *view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+            if (view == nullptr) {
+                if (mapping)
+                    CloseHandle(mapping);
+                CloseHandle(file);
+                MY_JSON_THROW(std::runtime_error("function JsonSnapshot::open: mmap failed"));
+            }
+            file_handle = file;
+            mapping_handle = mapping;
+            data = static_cast<const char *>(view);
+            length = static_cast<std::size_t>(file_size.QuadPart);
+#else
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                MY_JSON_THROW(std::runtime_error("function JsonSnapshot::open: file is not open"));
+            struct stat st;
+            if (fstat(fd, &st) != 0 || st.st_size < header_size) {
+                ::close(fd);
+                MY_JSON_THROW(std::runtime_error("function JsonSnapshot::open: invalid snapshot"));
+            }
+            void *view = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (view == MAP_FAILED)
+                MY_JSON_THROW(std::runtime_error("function JsonSnapshot::open: mmap failed"));
+            data = static_cast<const char *>(view);
+            length = st.st_size;
+#endif
+            std::uint32_t file_version, endian;
+            std::uint64_t file_size;
+            std::memcpy(&file_version, data + 8, 4);
+            std::memcpy(&endian, data + 12, 4);
+            std::memcpy(&root_offset, data + 16, 8);
+            std::memcpy(&file_size, data + 24, 8);
+            if (std::memcmp(data, "MYJSNAP", 8) != 0 || file_version != version || endian != 0x01020304 || file_size != length || root_offset < header_size || root_offset + 8 > length) {
+                this->close();
+                MY_JSON_THROW(std::runtime_error("function JsonSnapshot::open: invalid snapshot"));
+            }
+        }
+
+        void close() {
+            if (data == nullptr)
+                return;
+#ifdef _WIN32
+            UnmapViewOfFile(data);
+            CloseHandle(mapping_handle);
+            CloseHandle(file_handle);
+            file_handle = nullptr;
+            mapping_handle = nullptr;
+#else
+            munmap(const_cast<char *>(data), length);
+#endif
+            data = nullptr;
+            length = 0;
+            root_offset = 0;
+        }
+
+        bool is_open() const {
+            return data != nullptr;
+        }
+
+        std::size_t size() const {
+            return length;
+        }
+
+        JsonView root() const {
+            if (data == nullptr)
+                MY_JSON_THROW(std::logic_error("function JsonSnapshot::root: snapshot is not open"));
+            return JsonView(data, root_offset);
+        }
+
+    private:
+        const char *data;
+        std::size_t length;
+        std::uint64_t root_offset;
+#ifdef _WIN32
+        void *file_handle;
+        void *mapping_handle;
+#endif
+    };
+
+#ifdef MY_JSON_LITERAL
+    // 在编译期解析 JSON 文本并生成快照格式的字节序列（格式见 JsonView），是 _json 字面量的实现
+    // 语法、转义与 UTF-8 的检查与运行时的 parse 一致，重复的 key 保留最后一个；double 按 IEEE 754 就近舍入
+    // 编译器逐条解释常量表达式，std::vector::push_back 与 std::string 的追加代价很高，因此结果直接按下标写入预先分配的缓冲区
+    class JsonTapeBuilder {
+    public:
+        struct Result {
+            JsonError error;
+            std::size_t size;
+            std::uint64_t root;
+        };
+
+        constexpr JsonTapeBuilder(const char *text, std::size_t text_size)
+            : text(text), text_size(text_size), index(0), root_offset(0), bytes(nullptr), used(0), values(nullptr), count(0) {}
+        JsonTapeBuilder(const JsonTapeBuilder &other) = delete;
+        JsonTapeBuilder &operator=(const JsonTapeBuilder &other) = delete;
+
+        constexpr ~JsonTapeBuilder() {
+            delete[] bytes;
+            delete[] values;
+        }
+
+        // 只取结果的大小与根节点位置，不保留字节序列
+        static constexpr Result measure(const char *text, std::size_t text_size) {
+            JsonTapeBuilder builder(text, text_size);
+            JsonError error = builder.build();
+            return Result{error, builder.size(), builder.root()};
+        }
+
+        static constexpr JsonError validate(const char *text, std::size_t text_size) {
+            return JsonTapeBuilder(text, text_size).build();
+        }
+
+        // 出错时结果只有全 0 的文件头
+        constexpr JsonError build() {
+            delete[] bytes;
+            delete[] values;
+            // 每个节点、偏移量与成员都能对应到输入中的字节，快照不超过输入的 16 倍加上文件头（"[1,2]" 中每个 int 节点与偏移量占 24 字节）；未结束的容器中的值不超过输入的字节数
+            bytes = new char[JsonSnapshot::header_size + 16 * (text_size + 1)];
+            values = new std::uint64_t[text_size + 1];
+            index = 0;
+            count = 0;
+            used = 0;
+            this->fill(JsonSnapshot::header_size);
+            JsonError error = this->parse();
+            if (error.code != JsonError::ok) {
+                used = 0;
+                this->fill(JsonSnapshot::header_size);
+                root_offset = 0;
+            }
+            return error;
+        }
+
+        constexpr const char *data() const {
+            return bytes;
+        }
+
+        constexpr std::size_t size() const {
+            return used;
+        }
+
+        constexpr std::uint64_t root() const {
+            return root_offset;
+        }
+
+    private:
+        // 尚未结束的容器，它的值是 values[start, count)；object 为交替的 key 偏移量与 value 偏移量
+        struct Frame {
+            bool object;
+            std::size_t start;
+        };
+
+        struct Member {
+            std::uint64_t prefix;
+            std::uint64_t key;
+            std::uint64_t value;
+            std::size_t position;
+        };
+
+        // 小端序的 32 位分段，只用于超出快速路径的 double
+        typedef std::vector<std::uint32_t> BigInt;
+
+        // 用显式的栈代替递归，嵌套深度不受编译器 constexpr 递归深度的限制
+        constexpr JsonError parse() {
+            std::vector<Frame> frames;
+            this->skip_space();
+            while (true) {
+                if (index == text_size)
+                    return JsonError(JsonError::unexpected_end, index);
+                char ch = text[index];
+                std::uint64_t offset = 0;
+                if (ch == '[' || ch == '{') {
+                    index++;
+                    frames.push_back(Frame{ch == '{', count});
+                    this->skip_space();
+                    if (index == text_size || text[index] != (ch == '{' ? '}' : ']')) {
+                        if (ch == '{') {
+                            JsonError error = this->key();
+                            if (error.code != JsonError::ok)
+                                return error;
+                        }
+                        continue;
+                    }
+                    index++;
+                    offset = this->close(frames);
+                } else {
+                    JsonError error = this->scalar(offset);
+                    if (error.code != JsonError::ok)
+                        return error;
+                }
+                // 一个值结束后逐层处理 ',' 与右括号，直到遇到下一个值或整个文档结束
+                while (true) {
+                    if (frames.empty())
+                        return this->finish(offset);
+                    bool object = frames.back().object;
+                    values[count++] = offset;
+                    this->skip_space();
+                    if (index == text_size)
+                        return JsonError(JsonError::unexpected_end, index);
+                    if (text[index] == ',') {
+                        index++;
+                        this->skip_space();
+                        if (object) {
+                            JsonError error = this->key();
+                            if (error.code != JsonError::ok)
+                                return error;
+                        }
+                        break;
+                    }
+                    if (text[index] != (object ? '}' : ']'))
+                        return JsonError(JsonError::unexpected_character, index);
+                    index++;
+                    offset = this->close(frames);
+                }
+            }
+        }
+
+        constexpr JsonError finish(std::uint64_t root) {
+            this->skip_space();
+            if (index != text_size)
+                return JsonError(JsonError::trailing_characters, index);
+            root_offset = root;
+            const char magic[8] = "MYJSNAP";
+            for (int i = 0; i < 8; i++)
+                bytes[i] = magic[i];
+            this->put_at(8, JsonSnapshot::version, 4);
+            this->put_at(12, 0x01020304, 4);
+            this->put_at(16, root, 8);
+            this->put_at(24, used, 8);
+            return JsonError();
+        }
+
+        // 解析 object 成员的 key 与其后的 ':'，key 直接写为字符串节点
+        constexpr JsonError key() {
+            if (index == text_size)
+                return JsonError(JsonError::unexpected_end, index);
+            if (text[index] != '"')
+                return JsonError(JsonError::unexpected_character, index);
+            std::uint64_t offset = 0;
+            JsonError error = this->string(offset);
+            if (error.code != JsonError::ok)
+                return error;
+            this->skip_space();
+            if (index == text_size)
+                return JsonError(JsonError::unexpected_end, index);
+            if (text[index] != ':')
+                return JsonError(JsonError::unexpected_character, index);
+            index++;
+            this->skip_space();
+            values[count++] = offset;
+            return JsonError();
+        }
+
+        // object 的成员按 key 排序后写出，JsonView 据此二分查找
+        constexpr std::uint64_t close(std::vector<Frame> &frames) {
+            Frame frame = frames.back();
+            frames.pop_back();
+            std::uint64_t offset = used;
+            if (!frame.object) {
+                this->put(Json::json_array, 4);
+                this->put(count - frame.start, 4);
+                for (std::size_t i = frame.start; i < count; i++)
+                    this->put(values[i], 8);
+                count = frame.start;
+                return offset;
+            }
+            // 先按 key 的前 8 个字节排序，相同时才逐字节比较；位置作为最后的依据，重复的 key 中最后一个排在最后
+            std::size_t total = (count - frame.start) / 2;
+            Member *members = new Member[total];
+            for (std::size_t i = 0; i < total; i++) {
+                std::uint64_t key = values[frame.start + i * 2];
+                members[i] = Member{this->prefix(key), key, values[frame.start + i * 2 + 1], i};
+            }
+            std::sort(members, members + total, [this](const Member &lhs, const Member &rhs) {
+                if (lhs.prefix != rhs.prefix)
+                    return lhs.prefix < rhs.prefix;
+                int cmp = this->compare(lhs.key, rhs.key);
+                return cmp != 0 ? cmp < 0 : lhs.position < rhs.position;
+            });
+            this->put(Json::json_object, 4);
+            this->put(0, 4);
+            std::uint32_t unique = 0;
+            for (std::size_t i = 0; i < total; i++) {
+                if (i + 1 < total && members[i].prefix == members[i + 1].prefix && this->compare(members[i].key, members[i + 1].key) == 0)
+                    continue;
+                this->put(members[i].key, 8);
+                this->put(members[i].value, 8);
+                unique++;
+            }
+            delete[] members;
+            this->put_at(offset + 4, unique, 4);
+            count = frame.start;
+            return offset;
+        }
+
+        // 字符串节点的前 8 个字节按大端序组成的整数，不足的部分补 0，整数的顺序与字节序列的顺序一致
+        constexpr std::uint64_t prefix(std::uint64_t offset) const {
+            std::uint64_t length = this->get(offset + 4, 4);
+            std::uint64_t value = 0;
+            for (std::uint64_t i = 0; i < 8; i++)
+                value = value << 8 | (i < length ? static_cast<unsigned char>(bytes[offset + 8 + i]) : 0);
+            return value;
+        }
+
+        // 比较两个字符串节点，与 JsonView 查找时的顺序一致
+        constexpr int compare(std::uint64_t lhs, std::uint64_t rhs) const {
+            std::uint64_t left = this->get(lhs + 4, 4), right = this->get(rhs + 4, 4);
+            for (std::uint64_t i = 0; i < left && i < right; i++) {
+                unsigned char a = bytes[lhs + 8 + i], b = bytes[rhs + 8 + i];
+                if (a != b)
+                    return a < b ? -1 : 1;
+            }
+            return left < right ? -1 : (left > right ? 1 : 0);
+        }
+
+        constexpr JsonError scalar(std::uint64_t &offset) {
+            switch (text[index]) {
+            case 'n':
+                offset = this->node(Json::json_null, 0);
+                return this->word("null");
+            case 't':
+                offset = this->node(Json::json_bool, 1);
+                return this->word("true");
+            case 'f':
+                offset = this->node(Json::json_bool, 0);
+                return this->word("false");
+            case '"':
+                return this->string(offset);
+            default:
+                return this->number(offset);
+            }
+        }
+
+        constexpr JsonError word(std::string_view literal) {
+            if (text_size - index < literal.size() || literal != std::string_view(text + index, literal.size()))
+                return JsonError(JsonError::unexpected_character, index);
+            index += literal.size();
+            return JsonError();
+        }
+
+        // index 指向开头的引号，结束时指向结尾引号之后；解码结果以 UTF-8 直接写为字符串节点
+        constexpr JsonError string(std::uint64_t &offset) {
+            offset = this->node(Json::json_string, 0);
+            index++;
+            while (true) {
+                if (index == text_size)
+                    return JsonError(JsonError::unexpected_end, index);
+                unsigned char ch = text[index];
+                if (ch == '"')
+                    break;
+                if (ch == '\\') {
+                    if (text_size - index < 2)
+                        return JsonError(JsonError::unexpected_end, text_size);
+                    switch (text[index + 1]) {
+                    case '"':
+                    case '\\':
+                    case '/':
+                        bytes[used++] = text[index + 1];
+                        break;
+                    case 'b':
+                        bytes[used++] = '\b';
+                        break;
+                    case 'f':
+                        bytes[used++] = '\f';
+                        break;
+                    case 'n':
+                        bytes[used++] = '\n';
+                        break;
+                    case 'r':
+                        bytes[used++] = '\r';
+                        break;
+                    case 't':
+                        bytes[used++] = '\t';
+                        break;
+                    case 'u': {
+                        std::uint32_t code = 0;
+                        JsonError error = this->hex(index + 2, code);
+                        if (error.code != JsonError::ok)
+                            return error;
+                        index += 4;
+                        // 成对的代理项合并为一个字符，孤立的代理项替换为 U+FFFD
+                        std::uint32_t low = 0;
+                        if (code >= 0xD800 && code < 0xDC00 && text_size - index >= 8 && text[index + 2] == '\\' && text[index + 3] == 'u' &&
+                            this->hex(index + 4, low).code == JsonError::ok && low >= 0xDC00 && low < 0xE000) {
+                            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                            index += 6;
+                        }
+                        if (code >= 0xD800 && code < 0xE000)
+                            code = 0xFFFD;
+                        this->put_utf8(code);
+                        break;
+                    }
+                    default:
+                        return JsonError(JsonError::invalid_escape, index);
+                    }
+                    index += 2;
+                } else if (ch < 0x20)
+                    return JsonError(JsonError::unexpected_character, index);
+                else if (ch < 0x80)
+                    bytes[used++] = text[index++];
+                else {
+                    std::size_t length = this->utf8_length();
+                    if (length == 0)
+                        return JsonError(JsonError::invalid_utf8, index);
+                    for (std::size_t i = 0; i < length; i++)
+                        bytes[used++] = text[index++];
+                }
+            }
+            index++;
+            this->put_at(offset + 4, used - offset - 8, 4);
+            this->fill(1);
+            this->align();
+            return JsonError();
+        }
+
+        // begin 指向 \u 之后的 4 个十六进制数字
+        constexpr JsonError hex(std::size_t begin, std::uint32_t &code) const {
+            code = 0;
+            for (std::size_t i = begin; i < begin + 4; i++) {
+                if (i >= text_size)
+                    return JsonError(JsonError::unexpected_end, text_size);
+                char ch = text[i];
+                int digit = ch >= '0' && ch <= '9' ? ch - '0' : (ch >= 'a' && ch <= 'f' ? ch - 'a' + 10 : (ch >= 'A' && ch <= 'F' ? ch - 'A' + 10 : -1));
+                if (digit < 0)
+                    return JsonError(JsonError::invalid_escape, begin - 2);
+                code = code << 4 | digit;
+            }
+            return JsonError();
+        }
+
+        constexpr void put_utf8(std::uint32_t code) {
+            if (code < 0x80)
+                bytes[used++] = static_cast<char>(code);
+            else if (code < 0x800) {
+                bytes[used++] = static_cast<char>(0xC0 | code >> 6);
+                bytes[used++] = static_cast<char>(0x80 | (code & 0x3F));
+            } else if (code < 0x10000) {
+                bytes[used++] = static_cast<char>(0xE0 | code >> 12);
+                bytes[used++] = static_cast<char>(0x80 | (code >> 6 & 0x3F));
+                bytes[used++] = static_cast<char>(0x80 | (code & 0x3F));
+            } else {
+                bytes[used++] = static_cast<char>(0xF0 | code >> 18);
+                bytes[used++] = static_cast<char>(0x80 | (code >> 12 & 0x3F));
+                bytes[used++] = static_cast<char>(0x80 | (code >> 6 & 0x3F));
+                bytes[used++] = static_cast<char>(0x80 | (code & 0x3F));
+            }
+        }
+
+        // 与 Json::utf8_length 相同，编码不合法时返回 0
+        constexpr std::size_t utf8_length() const {
+            unsigned char lead = text[index];
+            std::size_t length = 0;
+            if (lead >= 0xC2 && lead <= 0xDF)
+                length = 2;
+            else if (lead >= 0xE0 && lead <= 0xEF)
+                length = 3;
+            else if (lead >= 0xF0 && lead <= 0xF4)
+                length = 4;
+            else
+                return 0;
+            if (text_size - index < length)
+                return 0;
+            for (std::size_t i = 1; i < length; i++)
+                if ((static_cast<unsigned char>(text[index + i]) & 0xC0) != 0x80)
+                    return 0;
+            unsigned char next = text[index + 1];
+            if ((lead == 0xE0 && next < 0xA0) || (lead == 0xED && next >= 0xA0) || (lead == 0xF0 && next < 0x90) || (lead == 0xF4 && next >= 0x90))
+                return 0;
+            return length;
+        }
+
+        constexpr bool digit_at(std::size_t position) const {
+            return position < text_size && text[position] >= '0' && text[position] <= '9';
+        }
+
+        // 没有小数部分与指数的数字为 int，其余为 double
+        constexpr JsonError number(std::uint64_t &offset) {
+            std::size_t start = index;
+            bool negative = text[index] == '-';
+            if (negative)
+                index++;
+            if (index == text_size)
+                return JsonError(JsonError::unexpected_end, index);
+            // 值为有效数字（不含前导零）乘以 10^exponent，mantissa 只累加前 19 位有效数字
+            std::size_t first = index;
+            std::uint64_t mantissa = 0;
+            long digits = 0;
+            long exponent = 0;
+            if (text[index] == '0')
+                index++;
+            else if (this->digit_at(index)) {
+                for (; this->digit_at(index); index++, digits++)
+                    if (digits < 19)
+                        mantissa = mantissa * 10 + (text[index] - '0');
+            } else
+                return JsonError(JsonError::unexpected_character, index);
+            bool integer = true;
+            if (index < text_size && text[index] == '.') {
+                integer = false;
+                index++;
+                if (index == text_size)
+                    return JsonError(JsonError::unexpected_end, index);
+                if (!this->digit_at(index))
+                    return JsonError(JsonError::unexpected_character, index);
+                for (; this->digit_at(index); index++, exponent--) {
+                    if (digits == 0 && text[index] == '0')
+                        continue;
+                    if (digits < 19)
+                        mantissa = mantissa * 10 + (text[index] - '0');
+                    digits++;
+                }
+            }
+            std::size_t last = index;
+            if (index < text_size && (text[index] == 'e' || text[index] == 'E')) {
+                integer = false;
+                index++;
+                bool negative_exponent = index < text_size && text[index] == '-';
+                if (index < text_size && (text[index] == '-' || text[index] == '+'))
+                    index++;
+                if (index == text_size)
+                    return JsonError(JsonError::unexpected_end, index);
+                if (!this->digit_at(index))
+                    return JsonError(JsonError::unexpected_character, index);
+                long value = 0;
+                for (; this->digit_at(index); index++)
+                    if (value < 100000)
+                        value = value * 10 + (text[index] - '0');
+                exponent += negative_exponent ? -value : value;
+            }
+            if (integer) {
+                // 与 save_snapshot 相同：优先保存为 int64，其次 uint64，都放不下时保存原文
+                const std::uint64_t int64_limit = std::uint64_t(1) << 63;
+                std::uint64_t value = mantissa;
+                bool fits = digits < 19;
+                if (digits == 19 || digits == 20) {
+                    fits = true;
+                    value = 0;
+                    for (std::size_t i = first; i < last && fits; i++) {
+                        std::uint64_t digit = text[i] - '0';
+                        fits = value <= (UINT64_MAX - digit) / 10;
+                        value = value * 10 + digit;
+                    }
+                }
+                if (fits && value < int64_limit + std::uint64_t(negative)) {
+                    offset = this->node(Json::json_int, JsonView::int_signed);
+                    this->put(negative ? ~value + 1 : value, 8);
+                } else if (fits && !negative) {
+                    offset = this->node(Json::json_int, JsonView::int_unsigned);
+                    this->put(value, 8);
+                } else {
+                    offset = this->node(Json::json_int, JsonView::int_text);
+                    for (std::size_t i = start; i < last; i++)
+                        bytes[used++] = text[i];
+                    bytes[used++] = '\0';
+                    this->align();
+                }
+                return JsonError();
+            }
+            std::uint64_t bits = digits == 0 ? 0 : this->double_bits(mantissa, digits, exponent, first, last);
+            if (negative)
+                bits |= std::uint64_t(1) << 63;
+            offset = this->node(Json::json_double, 0);
+            this->put(bits, 8);
+            return JsonError();
+        }
+
+        // 有效数字不超过 19 位且 |exponent| <= 27 时，5^|exponent| 不超过 64 位，用 128 位整数精确计算；否则逐位处理 text[first, last) 中的数字
+        // 超出范围时为无穷大，与运行时 get_double 的结果一致
+        constexpr std::uint64_t double_bits(std::uint64_t mantissa, long digits, long exponent, std::size_t first, std::size_t last) const {
+            const std::uint64_t infinity = std::uint64_t(0x7FF) << 52;
+            if (digits - 1 + exponent > 308)
+                return infinity;
+            if (digits + exponent < -324)
+                return 0;
+            if (digits <= 19 && exponent >= -27 && exponent <= 27) {
+                std::uint64_t power = 1;
+                for (long i = 0; i < (exponent < 0 ? -exponent : exponent); i++)
+                    power *= 5;
+                if (exponent >= 0) {
+                    std::uint64_t high = 0, low = 0;
+                    wide_multiply(mantissa, power, high, low);
+                    return round(high, low, false, exponent);
+                }
+                // 被除数左移到最高位，商至少有 64 位；余数小于 2^63，左移一位不会溢出
+                long shift = 128 - std::bit_width(mantissa);
+                std::uint64_t dividend = mantissa << (shift - 64);
+                std::uint64_t high = 0, low = 0, remainder = 0;
+                for (int i = 127; i >= 0; i--) {
+                    remainder = remainder << 1 | (i >= 64 ? dividend >> (i - 64) & 1 : 0);
+                    high = high << 1 | low >> 63;
+                    low <<= 1;
+                    if (remainder >= power) {
+                        remainder -= power;
+                        low |= 1;
+                    }
+                }
+                return round(high, low, remainder != 0, exponent - shift);
+            }
+            BigInt value;
+            for (std::size_t i = first; i < last; i++)
+                if (text[i] != '.')
+                    multiply(value, 10, text[i] - '0');
+            if (exponent >= 0) {
+                for (long i = 0; i < exponent; i++)
+                    multiply(value, 10, 0);
+                return round(value, false, 0);
+            }
+            // 被除数左移 shift 位使商至少有 55 位
+            BigInt scale(1, 1);
+            for (long i = 0; i < -exponent; i++)
+                multiply(scale, 10, 0);
+            long length = static_cast<long>(bit_length(value));
+            long shift = std::max(0L, static_cast<long>(bit_length(scale)) - length + 55);
+            BigInt quotient, remainder;
+            for (long i = length - 1; i >= -shift; i--) {
+                multiply(remainder, 2, i >= 0 && bit(value, i));
+                bool take = !less(remainder, scale);
+                if (take)
+                    subtract(remainder, scale);
+                multiply(quotient, 2, take);
+            }
+            return round(quotient, bit_length(remainder) != 0, -shift);
+        }
+
+        // 取最高的 128 位，其余的位并入 sticky
+        static constexpr std::uint64_t round(const BigInt &value, bool sticky, long scale) {
+            long length = static_cast<long>(bit_length(value));
+            long drop = std::max(0L, length - 128);
+            std::uint64_t high = 0, low = 0;
+            for (long i = length - 1; i >= drop; i--) {
+                high = high << 1 | low >> 63;
+                low = low << 1 | bit(value, i);
+            }
+            for (long i = 0; i < drop && !sticky; i++)
+                sticky = bit(value, i);
+            return round(high, low, sticky, scale + drop);
+        }
+
+        // 值为 (high * 2^64 + low + 小于 1 的部分) * 2^scale，sticky 表示小于 1 的部分不为 0；舍入到最近的 double，相等时取偶数
+        static constexpr std::uint64_t round(std::uint64_t high, std::uint64_t low, bool sticky, long scale) {
+            const std::uint64_t infinity = std::uint64_t(0x7FF) << 52;
+            const std::uint64_t hidden = std::uint64_t(1) << 52;
+            auto at = [high, low](long index) -> std::uint64_t {
+                return (index >= 64 ? high >> (index - 64) : low >> index) & 1;
+            };
+            long length = high != 0 ? 64 + std::bit_width(high) : std::bit_width(low);
+            long exponent = length - 1 + scale;
+            if (exponent > 1023)
+                return infinity;
+            // 最低有效位的权重，非规格化数为 2^-1074
+            long lsb = std::max(exponent - 52, -1074L);
+            long shift = lsb - scale;
+            std::uint64_t mantissa = 0;
+            for (long i = length - 1; i >= std::max(shift, 0L); i--)
+                mantissa = mantissa << 1 | at(i);
+            if (shift < 0)
+                mantissa <<= -shift;
+            else if (shift > 0 && at(shift - 1)) {
+                bool rest = sticky;
+                for (long i = 0; i < shift - 1 && !rest; i++)
+                    rest = at(i);
+                if (rest || (mantissa & 1))
+                    mantissa++;
+                if (mantissa == hidden << 1) {
+                    mantissa >>= 1;
+                    lsb++;
+                }
+            }
+            if (mantissa < hidden)
+                return mantissa;
+            std::uint64_t biased = lsb + 52 + 1023;
+            return biased >= 0x7FF ? infinity : (biased << 52 | (mantissa & (hidden - 1)));
+        }
+
+        static constexpr void wide_multiply(std::uint64_t lhs, std::uint64_t rhs, std::uint64_t &high, std::uint64_t &low) {
+            std::uint64_t a = lhs >> 32, b = lhs & 0xFFFFFFFF, c = rhs >> 32, d = rhs & 0xFFFFFFFF;
+            std::uint64_t middle = (b * d >> 32) + (a * d & 0xFFFFFFFF) + (b * c & 0xFFFFFFFF);
+            low = middle << 32 | (b * d & 0xFFFFFFFF);
+            high = a * c + (a * d >> 32) + (b * c >> 32) + (middle >> 32);
+        }
+
+        static constexpr void multiply(BigInt &value, std::uint32_t factor, std::uint32_t addend) {
+            std::uint64_t carry = addend;
+            for (auto &i : value) {
+                std::uint64_t product = static_cast<std::uint64_t>(i) * factor + carry;
+                i = static_cast<std::uint32_t>(product);
+                carry = product >> 32;
+            }
+            if (carry != 0)
+                value.push_back(static_cast<std::uint32_t>(carry));
+        }
+
+        static constexpr void subtract(BigInt &lhs, const BigInt &rhs) {
+            std::int64_t borrow = 0;
+            for (std::size_t i = 0; i < lhs.size(); i++) {
+                std::int64_t difference = static_cast<std::int64_t>(lhs[i]) - (i < rhs.size() ? rhs[i] : 0) - borrow;
+                borrow = difference < 0;
+                lhs[i] = static_cast<std::uint32_t>(difference + (borrow << 32));
+            }
+        }
+
+        static constexpr bool less(const BigInt &lhs, const BigInt &rhs) {
+            for (std::size_t i = std::max(lhs.size(), rhs.size()); i > 0; i--) {
+                std::uint32_t left = i <= lhs.size() ? lhs[i - 1] : 0;
+                std::uint32_t right = i <= rhs.size() ? rhs[i - 1] : 0;
+                if (left != right)
+                    return left < right;
+            }
+            return false;
+        }
+
+        static constexpr std::size_t bit_length(const BigInt &value) {
+            for (std::size_t i = value.size(); i > 0; i--)
+                if (value[i - 1] != 0)
+                    return (i - 1) * 32 + std::bit_width(value[i - 1]);
+            return 0;
+        }
+
+        static constexpr bool bit(const BigInt &value, long index) {
+            std::size_t limb = static_cast<std::size_t>(index) / 32;
+            return limb < value.size() && (value[limb] >> (index % 32) & 1);
+        }
+
+        constexpr void skip_space() {
+            while (index < text_size && (text[index] == ' ' || text[index] == '\t' || text[index] == '\n' || text[index] == '\r'))
+                index++;
+        }
+
+        // 按本机字节序读写，与 save_snapshot 一致
+        constexpr void put_at(std::uint64_t offset, std::uint64_t value, int width) {
+            for (int i = 0; i < width; i++) {
+                int shift = std::endian::native == std::endian::little ? i * 8 : (width - 1 - i) * 8;
+                bytes[offset + i] = static_cast<char>(value >> shift & 0xFF);
+            }
+        }
+
+        constexpr std::uint64_t get(std::uint64_t offset, int width) const {
+            std::uint64_t value = 0;
+            for (int i = 0; i < width; i++) {
+                int shift = std::endian::native == std::endian::little ? i * 8 : (width - 1 - i) * 8;
+                value |= static_cast<std::uint64_t>(static_cast<unsigned char>(bytes[offset + i])) << shift;
+            }
+            return value;
+        }
+
+        constexpr void put(std::uint64_t value, int width) {
+            this->put_at(used, value, width);
+            used += width;
+        }
+
+        constexpr void fill(std::size_t size) {
+            for (std::size_t i = 0; i < size; i++)
+                bytes[used++] = '\0';
+        }
+
+        constexpr void align() {
+            this->fill((8 - used % 8) % 8);
+        }
+
+        // 节点头，payload 由调用者紧接着写入
+        constexpr std::uint64_t node(Json::Type type, std::uint32_t aux) {
+            std::uint64_t offset = used;
+            this->put(type, 4);
+            this->put(aux, 4);
+            return offset;
+        }
+
+        const char *text;
+        std::size_t text_size;
+        std::size_t index;
+        std::uint64_t root_offset;
+        char *bytes;
+        std::size_t used;
+        std::uint64_t *values;
+        std::size_t count;
+    };
+
+    // 字符串字面量作为模板参数，N 包括结尾的 '\0'
+    template <std::size_t N>
+    struct JsonLiteralText {
+        constexpr JsonLiteralText(const char (&text)[N]) {
+            std::copy(text, text + N, data);
+        }
+
+        constexpr std::size_t size() const {
+            return N - 1;
+        }
+
+        char data[N];
+    };
+
+    // 每个不同的字面量对应一份静态的只读快照，在编译期生成，程序启动时不需要解析或初始化
+    template <JsonLiteralText Text>
+    struct JsonLiteral {
+        static constexpr JsonTapeBuilder::Result result = JsonTapeBuilder::measure(Text.data, Text.size());
+        static constexpr JsonError error = result.error;
+
+        alignas(8) static constexpr std::array<char, result.size> tape = [] {
+            JsonTapeBuilder builder(Text.data, Text.size());
+            builder.build();
+            std::array<char, result.size> bytes;
+            std::copy(builder.data(), builder.data() + result.size, bytes.begin());
+            return bytes;
+        }();
+
+        static JsonView root() {
+            return JsonView(tape.data(), result.root);
+        }
+    };
+
+    // 只用于在编译错误中显示错误码与偏移量
+    template <JsonError::Code Code, std::size_t Offset>
+    struct JsonLiteralCheck {
+        static constexpr bool value = Code == JsonError::ok;
+    };
+
+    inline namespace literals {
+        // R"({"a": [1, 2.5, "x"]})"_json 在编译期解析并校验，格式错误时编译失败
+        // 返回的 JsonView 指向静态的快照，整个程序运行期间有效；需要修改时用 to_json() 得到 Json
+        template <JsonLiteralText Text>
+        JsonView operator""_json() {
+            static_assert(JsonLiteralCheck<JsonLiteral<Text>::error.code, JsonLiteral<Text>::error.offset>::value, "invalid JSON literal");
+            return JsonLiteral<Text>::root();
+        }
+    } // namespace literals
+#endif
+
+    template <typename Traits>
+    inline void basic_json<Traits>::save_snapshot(std::ofstream &file) const {
+        if (!file.is_open())
+            MY_JSON_THROW(std::runtime_error("function Json::save_snapshot: file is not open"));
+        char header[JsonSnapshot::header_size] = {0};
+        file.write(header, sizeof(header));
+        std::uint64_t pos = sizeof(header);
+        std::uint64_t root = this->write_snapshot(file, pos);
+
+        std::uint32_t version = JsonSnapshot::version;
+        std::uint32_t endian = 0x01020304;
+        std::memcpy(header, "MYJSNAP", 8);
+        std::memcpy(header + 8, &version, 4);
+        std::memcpy(header + 12, &endian, 4);
+        std::memcpy(header + 16, &root, 8);
+        std::memcpy(header + 24, &pos, 8);
+        file.seekp(0);
+        file.write(header, sizeof(header));
+        file.flush();
+        if (!file)
+            MY_JSON_THROW(std::runtime_error("function Json::save_snapshot: write error"));
+    }
+
+    template <typename Traits>
+    inline std::uint64_t basic_json<Traits>::write_snapshot(std::ofstream &file, std::uint64_t &pos) const {
+        switch (this->type()) {
+        case json_bool:
+            return write_snapshot_node(file, pos, this->type(), payload().data_bool, nullptr, 0);
+        case json_int: {
+            // 能放进 int64 或 uint64 的整数按 8 字节保存，更大的整数保存原文
+            std::size_t size = 0;
+            const char *text = this->raw_text(size);
+            std::int64_t number = 0;
+            std::uint64_t unsigned_number = 0;
+            if (text == nullptr) {
+                number = payload().data_int;
+                return write_snapshot_node(file, pos, this->type(), JsonView::int_signed, &number, sizeof(number));
+            }
+            if (parse_int64(text, size, number))
+                return write_snapshot_node(file, pos, this->type(), JsonView::int_signed, &number, sizeof(number));
+            if (parse_uint64(text, size, unsigned_number))
+                return write_snapshot_node(file, pos, this->type(), JsonView::int_unsigned, &unsigned_number, sizeof(unsigned_number));
+            std::string str(text, size);
+            return write_snapshot_node(file, pos, this->type(), JsonView::int_text, str.c_str(), str.size() + 1);
+        }
+        case json_double: {
+            double number = this->get_double();
+            return write_snapshot_node(file, pos, this->type(), 0, &number, sizeof(double));
+        }
+        case json_string: {
+            string_type str = this->get_string();
+            if (str.size() > UINT32_MAX)
+                MY_JSON_THROW(std::length_error("function Json::save_snapshot: string too long"));
+            return write_snapshot_node(file, pos, this->type(), str.size(), str.c_str(), str.size() + 1);
+        }
+        case json_array: {
+            std::size_t count = this->flags() & flag_packed ? this->packed_size() : payload().data_array->size();
+            if (count > UINT32_MAX)
+                MY_JSON_THROW(std::length_error("function Json::save_snapshot: array too large"));
+            std::vector<std::uint64_t> children;
+            children.reserve(count);
+            if (this->flags() & flag_packed) {
+                for (std::size_t i = 0; i < this->packed_size(); i++)
+                    children.push_back(this->packed_element(i).write_snapshot(file, pos));
+            } else {
+                for (const auto &i : *payload().data_array)
+                    children.push_back(i.write_snapshot(file, pos));
+            }
+            return write_snapshot_node(file, pos, this->type(), children.size(), children.data(), children.size() * sizeof(std::uint64_t));
+        }
+        case json_object: {
+            // JsonView 按 key 二分查找，object_type 无序时先排序
+            typedef const typename object_type::value_type *Member;
+            if (payload().data_object->size() > UINT32_MAX)
+                MY_JSON_THROW(std::length_error("function Json::save_snapshot: object too large"));
+            std::vector<Member> sorted;
+            sorted.reserve(payload().data_object->size());
+            for (const auto &i : *payload().data_object)
+                sorted.push_back(&i);
+            auto less = [](Member lhs, Member rhs) { return lhs->first < rhs->first; };
+            if (!std::is_sorted(sorted.begin(), sorted.end(), less))
+                std::sort(sorted.begin(), sorted.end(), less);
+            std::vector<std::uint64_t> members;
+            members.reserve(sorted.size() * 2);
+            for (Member i : sorted) {
+                if (i->first.size() > UINT32_MAX)
+                    MY_JSON_THROW(std::length_error("function Json::save_snapshot: key too long"));
+                members.push_back(write_snapshot_node(file, pos, json_string, i->first.size(), i->first.c_str(), i->first.size() + 1));
+                members.push_back(i->second.write_snapshot(file, pos));
+            }
+            return write_snapshot_node(file, pos, this->type(), members.size() / 2, members.data(), members.size() * sizeof(std::uint64_t));
+        }
+        default:
+            break;
+        }
+        return write_snapshot_node(file, pos, json_null, 0, nullptr, 0);
+    }
+
+} // namespace my_json
+
+namespace std {
+    template <typename Traits>
+    struct hash<my_json::basic_json<Traits>> {
+        std::size_t operator()(const my_json::basic_json<Traits> &json) const {
+            return static_cast<std::size_t>(json.hash());
+        }
+    };
+} // namespace std
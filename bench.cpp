@@ -0,0 +1,950 @@
+#include "Json.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <new>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// 性能测试：在确定性生成的语料上测量 parse / serialize / lookup / copy / destroy
+// 用法: bench [--json] [--filter name] [--scale n] [--min-time seconds] [--dump dir]
+//   --json      以 JSON 输出结果，便于在版本之间对比
+//   --filter    只运行名称中包含该字符串的语料或操作，例如 twitter、parse
+//   --scale     语料规模倍数，默认为 1
+//   --min-time  每项测试的最短运行时间，默认 0.5 秒
+//   --dump      把生成的语料写入目录后退出
+
+using Json = my_json::Json;
+
+namespace {
+
+    std::atomic<std::uint64_t> allocation_count(0);
+    std::atomic<std::uint64_t> allocation_bytes(0);
+
+} // namespace
+
+// 所有的 operator new / delete 都经过 allocate 与 release，数组、nothrow、sized 与对齐的版本也都替换，分配与释放的方式总是匹配
+// 不内联 release，否则 GCC 在调用处看到 free 释放 operator new 的结果会报告 -Wmismatched-new-delete
+namespace {
+
+#if defined(__GNUC__)
+    __attribute__((noinline))
+#elif defined(_MSC_VER)
+    __declspec(noinline)
+#endif
+    void release(void *ptr) noexcept {
+        std::free(ptr);
+    }
+
+    void *allocate(std::size_t size) noexcept {
+        allocation_count.fetch_add(1, std::memory_order_relaxed);
+        allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+        return std::malloc(size == 0 ? 1 : size);
+    }
+
+#ifdef __cpp_aligned_new
+    // Windows 上对齐的内存必须用 _aligned_free 释放，其他平台与普通分配一样用 free
+#if defined(__GNUC__)
+    __attribute__((noinline))
+#elif defined(_MSC_VER)
+    __declspec(noinline)
+#endif
+    void release_aligned(void *ptr) noexcept {
+#ifdef _WIN32
+        _aligned_free(ptr);
+#else
+        std::free(ptr);
+#endif
+    }
+
+    void *allocate_aligned(std::size_t size, std::align_val_t align) noexcept {
+        allocation_count.fetch_add(1, std::memory_order_relaxed);
+        allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+        std::size_t alignment = static_cast<std::size_t>(align);
+#ifdef _WIN32
+        return _aligned_malloc(size == 0 ? 1 : size, alignment);
+#else
+        void *ptr = nullptr;
+        if (posix_memalign(&ptr, alignment < sizeof(void *) ? sizeof(void *) : alignment, size == 0 ? 1 : size) != 0)
+            return nullptr;
+        return ptr;
+#endif
+    }
+#endif
+
+} // namespace
+
+void *operator new(std::size_t size) {
+    void *ptr = allocate(size);
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void *operator new[](std::size_t size) {
+    void *ptr = allocate(size);
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+    return allocate(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+    return allocate(size);
+}
+
+void operator delete(void *ptr) noexcept {
+    release(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+    release(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept {
+    release(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept {
+    release(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept {
+    release(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept {
+    release(ptr);
+}
+
+#ifdef __cpp_aligned_new
+void *operator new(std::size_t size, std::align_val_t align) {
+    void *ptr = allocate_aligned(size, align);
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void *operator new[](std::size_t size, std::align_val_t align) {
+    void *ptr = allocate_aligned(size, align);
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void *operator new(std::size_t size, std::align_val_t align, const std::nothrow_t &) noexcept {
+    return allocate_aligned(size, align);
+}
+
+void *operator new[](std::size_t size, std::align_val_t align, const std::nothrow_t &) noexcept {
+    return allocate_aligned(size, align);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept {
+    release_aligned(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t) noexcept {
+    release_aligned(ptr);
+}
+
+void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept {
+    release_aligned(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t, std::align_val_t) noexcept {
+    release_aligned(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t, const std::nothrow_t &) noexcept {
+    release_aligned(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t, const std::nothrow_t &) noexcept {
+    release_aligned(ptr);
+}
+#endif
+
+namespace {
+
+    // splitmix64，保证不同平台、不同标准库生成的语料完全相同
+    class Random {
+    public:
+        explicit Random(std::uint64_t seed) : state(seed) {}
+
+        std::uint64_t next() {
+            std::uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            return z ^ (z >> 31);
+        }
+
+        int range(int low, int high) {
+            return low + static_cast<int>(this->next() % static_cast<std::uint64_t>(high - low + 1));
+        }
+
+        double real(double low, double high) {
+            return low + (high - low) * ((this->next() >> 11) * (1.0 / 9007199254740992.0));
+        }
+
+        bool chance(int percent) {
+            return this->range(1, 100) <= percent;
+        }
+
+    private:
+        std::uint64_t state;
+    };
+
+    // 一段路径，用于 lookup 测试；key 为空时表示数组下标
+    struct PathToken {
+        std::string key;
+        int index;
+    };
+
+    // 直接输出 JSON 文本，同时统计节点数并每隔一定数量的值记录一条路径
+    class CorpusWriter {
+    public:
+        CorpusWriter(std::uint64_t seed, int sample_every) : random(seed), nodes(0), sample_every(sample_every) {}
+
+        void begin_object() {
+            this->before_value();
+            text += '{';
+            levels.push_back(Level{true, false});
+        }
+
+        void end_object() {
+            levels.pop_back();
+            text += '}';
+            this->after_container();
+        }
+
+        void begin_array() {
+            this->before_value();
+            text += '[';
+            levels.push_back(Level{true, true});
+            path.push_back(PathToken{std::string(), -1});
+        }
+
+        void end_array() {
+            levels.pop_back();
+            path.pop_back();
+            text += ']';
+            this->after_container();
+        }
+
+        void key(const std::string &name) {
+            if (!levels.back().first)
+                text += ',';
+            levels.back().first = false;
+            this->write_string(name);
+            text += ':';
+            pending_key = name;
+        }
+
+        void value_null() {
+            this->before_value();
+            text += "null";
+            this->after_scalar();
+        }
+
+        void value_bool(bool value) {
+            this->before_value();
+            text += value ? "true" : "false";
+            this->after_scalar();
+        }
+
+        void value_int(int value) {
+            this->before_value();
+            text += std::to_string(value);
+            this->after_scalar();
+        }
+
+        void value_double(double value, int digits) {
+            char buffer[64];
+            std::snprintf(buffer, sizeof(buffer), "%.*f", digits, value);
+            this->before_value();
+            text += buffer;
+            this->after_scalar();
+        }
+
+        void value_string(const std::string &value) {
+            this->before_value();
+            this->write_string(value);
+            this->after_scalar();
+        }
+
+        std::string word(int min_length, int max_length) {
+            static const char letters[] = "abcdefghijklmnopqrstuvwxyz";
+            std::string str(random.range(min_length, max_length), 'a');
+            for (auto &ch : str)
+                ch = letters[random.range(0, 25)];
+            return str;
+        }
+
+        std::string sentence(int words) {
+            std::string str;
+            for (int i = 0; i < words; i++) {
+                if (i != 0)
+                    str += random.chance(8) ? "\n" : " ";
+                if (random.chance(3))
+                    str += "\"" + this->word(2, 8) + "\"";
+                else
+                    str += this->word(1, 10);
+            }
+            return str;
+        }
+
+        Random random;
+        std::string text;
+        std::size_t nodes;
+        std::vector<std::vector<PathToken>> samples;
+
+    private:
+        struct Level {
+            bool first;
+            bool array;
+        };
+
+        void before_value() {
+            nodes++;
+            if (levels.empty())
+                return;
+            Level &level = levels.back();
+            if (level.array) {
+                if (!level.first)
+                    text += ',';
+                level.first = false;
+                path.back().index++;
+            } else
+                path.push_back(PathToken{pending_key, 0});
+        }
+
+        void after_scalar() {
+            if (sample_every != 0 && nodes % sample_every == 0)
+                samples.push_back(path);
+            if (!levels.empty() && !levels.back().array)
+                path.pop_back();
+        }
+
+        void after_container() {
+            if (!levels.empty() && !levels.back().array)
+                path.pop_back();
+        }
+
+        void write_string(const std::string &value) {
+            text += '"';
+            for (char ch : value) {
+                switch (ch) {
+                case '"':
+                    text += "\\\"";
+                    break;
+                case '\\':
+                    text += "\\\\";
+                    break;
+                case '\n':
+                    text += "\\n";
+                    break;
+                case '\t':
+                    text += "\\t";
+                    break;
+                default:
+                    text += ch;
+                }
+            }
+            text += '"';
+        }
+
+        std::vector<Level> levels;
+        std::vector<PathToken> path;
+        std::string pending_key;
+        int sample_every;
+    };
+
+    struct Corpus {
+        std::string name;
+        std::vector<std::string> documents;
+        std::size_t bytes;
+        std::size_t nodes;
+        std::vector<std::vector<PathToken>> paths;
+    };
+
+    Corpus finish(const std::string &name, CorpusWriter &writer) {
+        Corpus corpus;
+        corpus.name = name;
+        corpus.documents.push_back(std::move(writer.text));
+        corpus.bytes = corpus.documents.back().size();
+        corpus.nodes = writer.nodes;
+        corpus.paths = std::move(writer.samples);
+        return corpus;
+    }
+
+    // 类似 twitter.json：大量中等大小的对象，字符串为主，带有嵌套的 user 与 entities
+    Corpus make_twitter(int scale) {
+        CorpusWriter w(1, 7);
+        w.begin_object();
+        w.key("statuses");
+        w.begin_array();
+        for (int i = 0; i < 600 * scale; i++) {
+            w.begin_object();
+            w.key("created_at");
+            w.value_string("Mon Sep 24 03:35:21 +0000 2012");
+            w.key("id");
+            w.value_int(w.random.range(100000000, 2000000000));
+            w.key("id_str");
+            w.value_string(std::to_string(w.random.range(100000000, 2000000000)));
+            w.key("text");
+            w.value_string(w.sentence(w.random.range(5, 25)));
+            w.key("source");
+            w.value_string("<a href=\"http://twitter.com/download/iphone\" rel=\"nofollow\">Twitter for iPhone</a>");
+            w.key("truncated");
+            w.value_bool(false);
+            w.key("in_reply_to_status_id");
+            w.value_null();
+            w.key("user");
+            w.begin_object();
+            w.key("id");
+            w.value_int(w.random.range(1000, 2000000000));
+            w.key("name");
+            w.value_string(w.word(3, 12) + " " + w.word(3, 12));
+            w.key("screen_name");
+            w.value_string(w.word(4, 15));
+            w.key("location");
+            w.value_string(w.random.chance(50) ? w.word(4, 10) : "");
+            w.key("description");
+            w.value_string(w.sentence(w.random.range(0, 20)));
+            w.key("url");
+            w.random.chance(30) ? w.value_string("http://" + w.word(4, 10) + ".com") : w.value_null();
+            w.key("protected");
+            w.value_bool(false);
+            w.key("followers_count");
+            w.value_int(w.random.range(0, 100000));
+            w.key("friends_count");
+            w.value_int(w.random.range(0, 5000));
+            w.key("verified");
+            w.value_bool(w.random.chance(5));
+            w.key("profile_image_url");
+            w.value_string("http://a0.twimg.com/profile_images/" + std::to_string(w.random.range(1000000, 9999999)) + "/" + w.word(5, 12) + "_normal.jpeg");
+            w.key("lang");
+            w.value_string("ja");
+            w.end_object();
+            w.key("geo");
+            w.value_null();
+            w.key("entities");
+            w.begin_object();
+            w.key("hashtags");
+            w.begin_array();
+            for (int j = w.random.range(0, 3); j > 0; j--) {
+                w.begin_object();
+                w.key("text");
+                w.value_string(w.word(3, 12));
+                w.key("indices");
+                w.begin_array();
+                int start = w.random.range(0, 100);
+                w.value_int(start);
+                w.value_int(start + w.random.range(3, 12));
+                w.end_array();
+                w.end_object();
+            }
+            w.end_array();
+            w.key("urls");
+            w.begin_array();
+            w.end_array();
+            w.key("user_mentions");
+            w.begin_array();
+            for (int j = w.random.range(0, 2); j > 0; j--) {
+                w.begin_object();
+                w.key("screen_name");
+                w.value_string(w.word(4, 15));
+                w.key("id");
+                w.value_int(w.random.range(1000, 2000000000));
+                w.end_object();
+            }
+            w.end_array();
+            w.end_object();
+            w.key("retweet_count");
+            w.value_int(w.random.range(0, 1000));
+            w.key("favorited");
+            w.value_bool(false);
+            w.key("lang");
+            w.value_string("ja");
+            w.end_object();
+        }
+        w.end_array();
+        w.key("search_metadata");
+        w.begin_object();
+        w.key("completed_in");
+        w.value_double(0.087, 3);
+        w.key("count");
+        w.value_int(600 * scale);
+        w.key("query");
+        w.value_string("%E4%B8%80");
+        w.end_object();
+        w.end_object();
+        return finish("twitter", w);
+    }
+
+    // 类似 canada.json：GeoJSON 多边形，几乎全部是高精度浮点数组成的二元数组
+    Corpus make_canada(int scale) {
+        CorpusWriter w(2, 101);
+        w.begin_object();
+        w.key("type");
+        w.value_string("FeatureCollection");
+        w.key("features");
+        w.begin_array();
+        w.begin_object();
+        w.key("type");
+        w.value_string("Feature");
+        w.key("properties");
+        w.begin_object();
+        w.key("name");
+        w.value_string("Canada");
+        w.end_object();
+        w.key("geometry");
+        w.begin_object();
+        w.key("type");
+        w.value_string("Polygon");
+        w.key("coordinates");
+        w.begin_array();
+        for (int i = 0; i < 480 * scale; i++) {
+            w.begin_array();
+            double x = w.random.real(-141.0, -52.0), y = w.random.real(41.0, 83.0);
+            for (int j = w.random.range(20, 200); j > 0; j--) {
+                w.begin_array();
+                x += w.random.real(-0.01, 0.01);
+                y += w.random.real(-0.01, 0.01);
+                w.value_double(x, 15);
+                w.value_double(y, 15);
+                w.end_array();
+            }
+            w.end_array();
+        }
+        w.end_array();
+        w.end_object();
+        w.end_object();
+        w.end_array();
+        w.end_object();
+        return finish("canada", w);
+    }
+
+    // 深层嵌套：多条交替嵌套数组与对象的长链
+    Corpus make_deep(int scale) {
+        CorpusWriter w(3, 13);
+        w.begin_array();
+        for (int i = 0; i < 20 * scale; i++) {
+            int depth = w.random.range(200, 500);
+            for (int j = 0; j < depth; j++) {
+                if (j % 2 == 0) {
+                    w.begin_object();
+                    w.key(w.word(1, 4));
+                } else
+                    w.begin_array();
+            }
+            w.value_int(depth);
+            for (int j = depth; j-- > 0;)
+                j % 2 == 0 ? w.end_object() : w.end_array();
+        }
+        w.end_array();
+        return finish("deep", w);
+    }
+
+    // 长字符串：每个 16KB 到 64KB，夹杂需要转义的字符
+    Corpus make_long_strings(int scale) {
+        CorpusWriter w(4, 3);
+        w.begin_array();
+        for (int i = 0; i < 48 * scale; i++) {
+            std::string str;
+            std::size_t length = w.random.range(16 * 1024, 64 * 1024);
+            while (str.size() < length) {
+                str += w.word(1, 12);
+                str += w.random.chance(2) ? (w.random.chance(50) ? "\\" : "\t") : " ";
+            }
+            w.value_string(str);
+        }
+        w.end_array();
+        return finish("long_strings", w);
+    }
+
+    // NDJSON：每行一个较小的日志记录，逐行解析
+    Corpus make_ndjson(int scale) {
+        Corpus corpus;
+        corpus.name = "ndjson";
+        corpus.bytes = 0;
+        corpus.nodes = 0;
+        CorpusWriter w(5, 5);
+        static const char *levels[] = {"debug", "info", "warn", "error"};
+        for (int i = 0; i < 10000 * scale; i++) {
+            w.text.clear();
+            w.samples.clear();
+            std::size_t nodes = w.nodes;
+            w.begin_object();
+            w.key("ts");
+            w.value_int(1500000000 + i);
+            w.key("level");
+            w.value_string(levels[w.random.range(0, 3)]);
+            w.key("service");
+            w.value_string(w.word(4, 10));
+            w.key("latency_ms");
+            w.value_double(w.random.real(0.1, 500.0), 3);
+            w.key("ok");
+            w.value_bool(w.random.chance(95));
+            w.key("msg");
+            w.value_string(w.sentence(w.random.range(3, 12)));
+            w.key("tags");
+            w.begin_array();
+            for (int j = w.random.range(0, 4); j > 0; j--)
+                w.value_string(w.word(3, 8));
+            w.end_array();
+            w.end_object();
+            corpus.nodes += w.nodes - nodes;
+            corpus.bytes += w.text.size() + 1;
+            corpus.documents.push_back(w.text);
+            if (!w.samples.empty())
+                corpus.paths.push_back(w.samples.front());
+            else
+                corpus.paths.push_back(std::vector<PathToken>());
+        }
+        return corpus;
+    }
+
+    struct Options {
+        bool json;
+        std::string filter;
+        int scale;
+        double min_time;
+        std::string dump;
+    };
+
+    struct Result {
+        std::string corpus;
+        std::string op;
+        std::size_t iterations;
+        double ns_per_iteration;
+        double mb_per_s;
+        double ns_per_node;
+        double allocations_per_document;
+        double allocated_bytes_per_document;
+    };
+
+    // 进程级的峰值 RSS 只增不减，无法归属到单个操作，只在整次运行结束后报告一次
+    long peak_rss_kb() {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+            return static_cast<long>(counters.PeakWorkingSetSize / 1024);
+        return 0;
+#else
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+        return usage.ru_maxrss / 1024;
+#else
+        return usage.ru_maxrss;
+#endif
+#endif
+    }
+
+    // 先计时的一次同时统计内存分配；之后重复运行直到超过 min_time，取中位数
+    // body 只计时其中需要测量的部分，返回该部分耗时（纳秒）
+    Result measure(const Options &options, const Corpus &corpus, const std::string &op, double units, const std::function<double()> &body) {
+        std::vector<double> times;
+        std::uint64_t count = allocation_count.load(), bytes = allocation_bytes.load();
+        times.push_back(body());
+        count = allocation_count.load() - count;
+        bytes = allocation_bytes.load() - bytes;
+        double total = times.back();
+        while (times.size() < 5 || total < options.min_time * 1e9) {
+            times.push_back(body());
+            total += times.back();
+        }
+        std::sort(times.begin(), times.end());
+        double median = times[times.size() / 2];
+
+        Result result;
+        result.corpus = corpus.name;
+        result.op = op;
+        result.iterations = times.size();
+        result.ns_per_iteration = median;
+        result.mb_per_s = op == "lookup" ? 0 : corpus.bytes / (median / 1e9) / (1024.0 * 1024.0);
+        result.ns_per_node = median / units;
+        result.allocations_per_document = static_cast<double>(count) / corpus.documents.size();
+        result.allocated_bytes_per_document = static_cast<double>(bytes) / corpus.documents.size();
+        return result;
+    }
+
+    double elapsed(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    Json &resolve(Json &json, const std::vector<PathToken> &path) {
+        Json *node = &json;
+        for (const auto &token : path)
+            node = token.key.empty() && token.index >= 0 ? &(*node)[token.index] : &(*node)[token.key];
+        return *node;
+    }
+
+    // 把 lookup 的路径转换为 JSON Pointer，用于 parse_project 的投影
+    std::string pointer(const std::vector<PathToken> &path) {
+        std::string str;
+        for (const auto &token : path) {
+            str += '/';
+            if (token.key.empty() && token.index >= 0) {
+                str += std::to_string(token.index);
+                continue;
+            }
+            for (char ch : token.key) {
+                if (ch == '~')
+                    str += "~0";
+                else if (ch == '/')
+                    str += "~1";
+                else
+                    str += ch;
+            }
+        }
+        return str;
+    }
+
+    bool selected(const Options &options, const std::string &corpus, const std::string &op) {
+        return options.filter.empty() || corpus.find(options.filter) != std::string::npos || op.find(options.filter) != std::string::npos;
+    }
+
+    void run(const Options &options, const Corpus &corpus, std::vector<Result> &results) {
+        static const char *ops[] = {"parse", "parse_lazy", "parse_packed", "parse_reuse", "parse_project", "validate", "serialize", "serialize_cached", "lookup", "copy", "destroy"};
+        if (std::none_of(std::begin(ops), std::end(ops), [&](const char *op) { return selected(options, corpus.name, op); }))
+            return;
+        std::vector<Json> parsed(corpus.documents.size());
+        for (std::size_t i = 0; i < corpus.documents.size(); i++)
+            parsed[i].parse(corpus.documents[i]);
+        double nodes = static_cast<double>(corpus.nodes);
+
+        if (selected(options, corpus.name, "parse")) {
+            results.push_back(measure(options, corpus, "parse", nodes, [&]() {
+                std::vector<Json> documents(corpus.documents.size());
+                auto start = std::chrono::steady_clock::now();
+                for (std::size_t i = 0; i < corpus.documents.size(); i++)
+                    documents[i].parse(corpus.documents[i]);
+                return elapsed(start);
+            }));
+        }
+        if (selected(options, corpus.name, "parse_lazy")) {
+            my_json::JsonParseOptions lazy;
+            lazy.lazy_numbers = true;
+            lazy.lazy_strings = true;
+            results.push_back(measure(options, corpus, "parse_lazy", nodes, [&]() {
+                std::vector<Json> documents(corpus.documents.size());
+                auto start = std::chrono::steady_clock::now();
+                for (std::size_t i = 0; i < corpus.documents.size(); i++)
+                    documents[i].parse(corpus.documents[i], lazy);
+                return elapsed(start);
+            }));
+        }
+        if (selected(options, corpus.name, "parse_packed")) {
+            my_json::JsonParseOptions packed;
+            packed.pack_numbers = true;
+            results.push_back(measure(options, corpus, "parse_packed", nodes, [&]() {
+                std::vector<Json> documents(corpus.documents.size());
+                auto start = std::chrono::steady_clock::now();
+                for (std::size_t i = 0; i < corpus.documents.size(); i++)
+                    documents[i].parse(corpus.documents[i], packed);
+                return elapsed(start);
+            }));
+        }
+        if (selected(options, corpus.name, "parse_reuse")) {
+            // 同一个 Parser 依次解析到同一个文档中，先解析一遍预热，之后统计的是稳定状态下的内存分配
+            Json::Parser parser;
+            Json document;
+            for (const auto &i : corpus.documents)
+                parser.parse_into(i, document);
+            results.push_back(measure(options, corpus, "parse_reuse", nodes, [&]() {
+                auto start = std::chrono::steady_clock::now();
+                for (const auto &i : corpus.documents)
+                    parser.parse_into(i, document);
+                return elapsed(start);
+            }));
+        }
+        if (selected(options, corpus.name, "parse_project")) {
+            // 只构建 lookup 所用的前 10 条路径，其余的值被跳过
+            my_json::JsonProjection projection;
+            for (std::size_t i = 0; i < corpus.paths.size() && i < 10; i++)
+                projection.add(pointer(corpus.paths[i]));
+            my_json::JsonParseOptions project;
+            project.projection = &projection;
+            results.push_back(measure(options, corpus, "parse_project", nodes, [&]() {
+                std::vector<Json> documents(corpus.documents.size());
+                auto start = std::chrono::steady_clock::now();
+                for (std::size_t i = 0; i < corpus.documents.size(); i++)
+                    documents[i].parse(corpus.documents[i], project);
+                return elapsed(start);
+            }));
+        }
+        if (selected(options, corpus.name, "validate")) {
+            results.push_back(measure(options, corpus, "validate", nodes, [&]() {
+                std::size_t errors = 0;
+                auto start = std::chrono::steady_clock::now();
+                for (const auto &i : corpus.documents)
+                    errors += Json::validate(i).code != my_json::JsonError::ok;
+                double time = elapsed(start);
+                if (errors != 0)
+                    std::abort();
+                return time;
+            }));
+        }
+        if (selected(options, corpus.name, "serialize")) {
+            results.push_back(measure(options, corpus, "serialize", nodes, [&]() {
+                std::size_t size = 0;
+                auto start = std::chrono::steady_clock::now();
+                for (const auto &i : parsed)
+                    size += i.to_string().size();
+                double time = elapsed(start);
+                if (size == 0)
+                    std::abort();
+                return time;
+            }));
+        }
+        if (selected(options, corpus.name, "serialize_cached")) {
+            // 缓存所有层，每次输出前修改 lookup 路径上的一个值，修改路径上的容器以及之前经 operator[] 借出过引用的容器需要重新生成
+            std::vector<Json> cached(parsed);
+            for (auto &i : cached)
+                i.enable_dump_cache(SIZE_MAX);
+            std::size_t next = 0;
+            results.push_back(measure(options, corpus, "serialize_cached", nodes, [&]() {
+                std::size_t size = 0;
+                auto start = std::chrono::steady_clock::now();
+                for (std::size_t i = 0; i < cached.size(); i++) {
+                    if (!corpus.paths.empty()) {
+                        const std::vector<PathToken> &path = corpus.paths[cached.size() == 1 ? next++ % corpus.paths.size() : i];
+                        if (!path.empty())
+                            resolve(cached[i], path) = 1;
+                    }
+                    cached[i].enable_dump_cache(SIZE_MAX);
+                    size += cached[i].to_string().size();
+                }
+                double time = elapsed(start);
+                if (size == 0)
+                    std::abort();
+                return time;
+            }));
+        }
+        if (selected(options, corpus.name, "lookup") && !corpus.paths.empty()) {
+            std::size_t lookups = 0;
+            for (const auto &i : corpus.paths)
+                lookups += i.size();
+            std::size_t documents = corpus.documents.size();
+            results.push_back(measure(options, corpus, "lookup", static_cast<double>(lookups == 0 ? 1 : lookups), [&]() {
+                std::size_t found = 0;
+                auto start = std::chrono::steady_clock::now();
+                for (std::size_t i = 0; i < corpus.paths.size(); i++)
+                    found += resolve(parsed[documents == 1 ? 0 : i], corpus.paths[i]).is_null() ? 0 : 1;
+                double time = elapsed(start);
+                if (found > corpus.paths.size())
+                    std::abort();
+                return time;
+            }));
+        }
+        if (selected(options, corpus.name, "copy")) {
+            results.push_back(measure(options, corpus, "copy", nodes, [&]() {
+                auto start = std::chrono::steady_clock::now();
+                std::vector<Json> copies(parsed);
+                return elapsed(start);
+            }));
+        }
+        if (selected(options, corpus.name, "destroy")) {
+            results.push_back(measure(options, corpus, "destroy", nodes, [&]() {
+                std::vector<Json> *copies = new std::vector<Json>(parsed);
+                auto start = std::chrono::steady_clock::now();
+                delete copies;
+                return elapsed(start);
+            }));
+        }
+    }
+
+    void print_text(const std::vector<Result> &results, long peak_rss) {
+        std::printf("%-13s %-16s %7s %14s %10s %10s %12s %14s\n", "corpus", "op", "iters", "ns/iter", "MB/s", "ns/node", "allocs/doc", "alloc B/doc");
+        for (const auto &i : results)
+            std::printf("%-13s %-16s %7zu %14.0f %10.1f %10.2f %12.1f %14.0f\n", i.corpus.c_str(), i.op.c_str(), i.iterations, i.ns_per_iteration, i.mb_per_s, i.ns_per_node, i.allocations_per_document, i.allocated_bytes_per_document);
+        std::printf("peak RSS of the whole run: %ld KB\n", peak_rss);
+    }
+
+    void print_json(const std::vector<Result> &results, const std::vector<Corpus> &corpora, long peak_rss) {
+        std::printf("{\"corpora\":[");
+        for (std::size_t i = 0; i < corpora.size(); i++)
+            std::printf("%s{\"name\":\"%s\",\"bytes\":%zu,\"documents\":%zu,\"nodes\":%zu}", i ? "," : "", corpora[i].name.c_str(), corpora[i].bytes, corpora[i].documents.size(), corpora[i].nodes);
+        std::printf("],\"results\":[");
+        for (std::size_t i = 0; i < results.size(); i++) {
+            const Result &r = results[i];
+            std::printf("%s{\"corpus\":\"%s\",\"op\":\"%s\",\"iterations\":%zu,\"ns_per_iteration\":%.0f,\"mb_per_s\":%.3f,\"ns_per_node\":%.3f,"
+                        "\"allocations_per_document\":%.3f,\"allocated_bytes_per_document\":%.1f}",
+                        i ? "," : "", r.corpus.c_str(), r.op.c_str(), r.iterations, r.ns_per_iteration, r.mb_per_s, r.ns_per_node,
+                        r.allocations_per_document, r.allocated_bytes_per_document);
+        }
+        std::printf("],\"peak_rss_kb\":%ld}\n", peak_rss);
+    }
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Options options{false, std::string(), 1, 0.5, std::string()};
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--json")
+            options.json = true;
+        else if (arg == "--filter" && i + 1 < argc)
+            options.filter = argv[++i];
+        else if (arg == "--scale" && i + 1 < argc)
+            options.scale = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--min-time" && i + 1 < argc)
+            options.min_time = std::atof(argv[++i]);
+        else if (arg == "--dump" && i + 1 < argc)
+            options.dump = argv[++i];
+        else {
+            std::cerr << "usage: " << argv[0] << " [--json] [--filter name] [--scale n] [--min-time seconds] [--dump dir]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<Corpus> corpora;
+    corpora.push_back(make_twitter(options.scale));
+    corpora.push_back(make_canada(options.scale));
+    corpora.push_back(make_deep(options.scale));
+    corpora.push_back(make_long_strings(options.scale));
+    corpora.push_back(make_ndjson(options.scale));
+
+    if (!options.dump.empty()) {
+        for (const auto &corpus : corpora) {
+            std::string path = options.dump + "/" + corpus.name + (corpus.documents.size() == 1 ? ".json" : ".ndjson");
+            std::ofstream file(path, std::ios::binary);
+            for (const auto &document : corpus.documents)
+                file << document << (corpus.documents.size() == 1 ? "" : "\n");
+            if (!file) {
+                std::cerr << "failed to write " << path << std::endl;
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    std::vector<Result> results;
+    for (const auto &corpus : corpora)
+        run(options, corpus, results);
+    if (options.json)
+        print_json(results, corpora, peak_rss_kb());
+    else
+        print_text(results, peak_rss_kb());
+    return 0;
+}